@@ -33,6 +33,7 @@ static qboolean	playing = false;
 static qboolean	wasPlaying = false;
 static qboolean	enabled = false;
 static qboolean playLooping = false;
+static qboolean streaming = false;	// the track is a wav going through the sound mixer instead of MCI
 
 static byte remap[100];
 
@@ -158,6 +159,18 @@ qboolean CDAudio_TryPlay (char *track, qboolean looping)
 }
 
 
+static qboolean CDAudio_TryStream (int track)
+{
+	if (track < 1) return false;
+
+	// this goes through the filesystem so the track can also come from a pak
+	if (!S_StartMusic (va ("music/track%02i.wav", track))) return false;
+
+	streaming = true;
+	return true;
+}
+
+
 void CDAudio_Play2 (int track, qboolean looping)
 {
 	// if the same track is requested, and if it's currently playing, just continue it
@@ -166,20 +179,26 @@ void CDAudio_Play2 (int track, qboolean looping)
 	// stop whatever is currently playing
 	CDAudio_Stop ();
 
-	// if any of these are NULL we didn't get any tracks
-	if (!cd_basedir[0]) return;
-	if (!cd_ext[0]) return;
-	if (!maxTrack) return;
+	// a wav track is streamed by the sound code and takes precedence over anything MCI would play
+	if (track > 0 && track < 100 && CDAudio_TryStream (remap[track]))
+		track = remap[track];
+	else
+	{
+		// if any of these are NULL we didn't get any tracks
+		if (!cd_basedir[0]) return;
+		if (!cd_ext[0]) return;
+		if (!maxTrack) return;
 
-	// get the track from the remap
-	track = remap[track];
+		// get the track from the remap
+		track = remap[track];
 
-	// if it's out of range don't even try (some maps send track 0 which we interpret as an explicit request for no music) (it was already stopped above so it doesn't need to be again)
-	if (track < 1 || track > maxTrack) return;
+		// if it's out of range don't even try (some maps send track 0 which we interpret as an explicit request for no music) (it was already stopped above so it doesn't need to be again)
+		if (track < 1 || track > maxTrack) return;
 
-	// try it
-	if (!CDAudio_TryPlay (va ("%s/music/track%02i.%s", cd_basedir, track, cd_ext), looping))
-		return;
+		// try it
+		if (!CDAudio_TryPlay (va ("%s/music/track%02i.%s", cd_basedir, track, cd_ext), looping))
+			return;
+	}
 
 	// we got something so store them out
 	playLooping = looping;
@@ -198,6 +217,16 @@ void CDAudio_Play (int track, qboolean looping)
 
 void CDAudio_Stop (void)
 {
+	// a paused stream still has its file open so this doesn't wait for playing
+	if (streaming)
+	{
+		S_StopMusic ();
+		streaming = false;
+		wasPlaying = false;
+		playing = false;
+		return;
+	}
+
 	if (!enabled) return;
 	if (!playing) return;
 
@@ -215,7 +244,9 @@ void CDAudio_Pause (void)
 	if (!enabled) return;
 	if (!playing) return;
 
-	mciSendString ("pause "Q_MCI_DEVICE, NULL, 0, 0);
+	if (streaming)
+		S_PauseMusic (true);
+	else mciSendString ("pause "Q_MCI_DEVICE, NULL, 0, 0);
 
 	wasPlaying = playing;
 	playing = false;
@@ -227,7 +258,9 @@ void CDAudio_Resume (void)
 	if (!enabled) return;
 	if (!wasPlaying) return;
 
-	mciSendString ("resume "Q_MCI_DEVICE, NULL, 0, 0);
+	if (streaming)
+		S_PauseMusic (false);
+	else mciSendString ("resume "Q_MCI_DEVICE, NULL, 0, 0);
 
 	playing = true;
 }
@@ -327,7 +360,7 @@ static void CD_f (void)
 		Com_Printf ("%u tracks\n", maxTrack);
 
 		if (playing)
-			Com_Printf ("Currently %s track %u\n", playLooping ? "looping" : "playing", playTrack);
+			Com_Printf ("Currently %s track %u%s\n", playLooping ? "looping" : "playing", playTrack, streaming ? " (streamed)" : "");
 		else if (wasPlaying)
 			Com_Printf ("Paused %s track %u\n", playLooping ? "looping" : "playing", playTrack);
 
@@ -336,6 +369,22 @@ static void CD_f (void)
 }
 
 
+static void CDAudio_TrackFinished (void)
+{
+	CDAudio_Stop (); // must be done here because of setting playing = false below
+	playing = false; // do this so that the playTrack == track test won't trigger, because we're restarting the same track
+
+	if (playLooping)
+	{
+		// if the track has played the given number of times,
+		// go to the ambient track
+		if (++loopcounter >= cd_loopcount->value)
+			CDAudio_Play2 (cd_looptrack->value, true);
+		else CDAudio_Play2 (playTrack, true);
+	}
+}
+
+
 LONG CDAudio_MessageHandler (HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
 	if (lParam != wDeviceID)
@@ -345,19 +394,7 @@ LONG CDAudio_MessageHandler (HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 	{
 	case MCI_NOTIFY_SUCCESSFUL:
 		if (playing)
-		{
-			CDAudio_Stop (); // must be done here because of setting playing = false below
-			playing = false; // do this so that the playTrack == track test won't trigger, because we're restarting the same track
-
-			if (playLooping)
-			{
-				// if the track has played the given number of times,
-				// go to the ambient track
-				if (++loopcounter >= cd_loopcount->value)
-					CDAudio_Play2 (cd_looptrack->value, true);
-				else CDAudio_Play2 (playTrack, true);
-			}
-		}
+			CDAudio_TrackFinished ();
 
 		break;
 
@@ -385,8 +422,17 @@ LONG CDAudio_MessageHandler (HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 
 void CDAudio_Update (void)
 {
-	if (playing)
-		CDAudio_SetVolume (false);
+	if (!playing)
+		return;
+
+	// a stream that has read its last chunk stands in for MCI_NOTIFY_SUCCESSFUL; the tail of
+	// it is still queued so whatever starts next follows on without a gap
+	if (streaming)
+	{
+		if (!S_MusicPlaying ())
+			CDAudio_TrackFinished ();
+	}
+	else CDAudio_SetVolume (false);
 }
 
 
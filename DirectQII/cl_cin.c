@@ -19,11 +19,33 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 #include "client.h"
 
+// bits resolved by one lookup in the order 1 huffman tables; the rest of a longer code is walked in the tree
+#define HUFF_TABLEBITS	10
+#define HUFF_TABLESIZE	(1 << HUFF_TABLEBITS)
+
+// decoded frames in flight, counting the one on screen and the pending one
+#define CIN_FRAMES		8
+
+// largest compressed frame
+#define CIN_MAXFRAME	0x20000
+
 typedef struct cblock_s {
 	byte	*data;
 	int		count;
 } cblock_t;
 
+typedef enum {CIN_FRAME, CIN_END, CIN_BADFRAME} cinstatus_t;
+
+// one frame of the decode-ahead ring; the buffers are allocated once when the cinematic starts
+typedef struct cinframe_s {
+	cinstatus_t	status;
+	byte	*pic;
+	byte	palette[768];
+	byte	*samples;
+	int		numsamples;
+	int		overread;	// bytes the decompressor read past the frame; reported by the main thread
+} cinframe_t;
+
 typedef struct cinematics_s {
 	int		s_rate;
 	int		s_width;
@@ -31,12 +53,29 @@ typedef struct cinematics_s {
 
 	int		width;
 	int		height;
-	byte	*pic;
-	byte	*pic_pending;
+	byte	*pic;		// the pcx, or the pic of the current frame
+
+	// decode-ahead; the thread fills frames[head % CIN_FRAMES] whenever head - tail < CIN_FRAMES
+	FILE	*file;
+	void	*thread;
+	void	*ready;		// raised by the thread after each frame
+	void	*space;		// raised by the main thread after it releases one
+	volatile int		head;	// frames decoded
+	volatile int		tail;	// oldest frame the main thread still holds
+	volatile qboolean	shutdown;
+	cinframe_t	frames[CIN_FRAMES];
+	cinframe_t	*current;
+	cinframe_t	*pending;
+
+	// only touched by the thread once it's running
+	byte	*compressed;
+	byte	palette[768];
+	int		decodeframe;
 
 	// order 1 huffman stuff
 	int		*hnodes1;	// [256][256][2];
 	int		numhnodes1[256];
+	int		*htable1;	// [256][HUFF_TABLESIZE]; code length << 16 | symbol, or length 0 and the node reached
 
 	int		h_used[512];
 	int		h_count[512];
@@ -79,7 +118,7 @@ void SCR_LoadPCX (char *filename)
 	if (load_pic && load_pal && cin.width > 0 && cin.height > 0)
 	{
 		// copy over to zone
-		cin.pic = (byte *) Zone_Alloc (cin.width * cin.height);
+		cin.pic = (byte *) Zone_AllocCategory (cin.width * cin.height, MEM_CINEMATIC);
 		memcpy (cin.pic, load_pic, cin.width * cin.height);
 		memcpy (cl.cinematicpalette, load_pal, sizeof (cl.cinematicpalette));
 	}
@@ -97,6 +136,9 @@ void SCR_LoadPCX (char *filename)
 
 //=============================================================
 
+static void Huff1TableFree (void);
+static void SCR_StopDecoder (void);
+
 /*
 ==================
 SCR_StopCinematic
@@ -106,29 +148,21 @@ void SCR_StopCinematic (void)
 {
 	cl.cinematictime = 0;	// done
 
-	if (cin.pic)
-	{
+	// a cinematic's pic belongs to one of its frames
+	if (cin.compressed)
+		SCR_StopDecoder ();
+	else if (cin.pic)
 		Zone_Free (cin.pic);
-		cin.pic = NULL;
-	}
 
-	if (cin.pic_pending)
-	{
-		Zone_Free (cin.pic_pending);
-		cin.pic_pending = NULL;
-	}
+	cin.pic = NULL;
 
-	if (cl.cinematic_file)
+	if (cin.file)
 	{
-		fclose (cl.cinematic_file);
-		cl.cinematic_file = NULL;
+		fclose (cin.file);
+		cin.file = NULL;
 	}
 
-	if (cin.hnodes1)
-	{
-		Zone_Free (cin.hnodes1);
-		cin.hnodes1 = NULL;
-	}
+	Huff1TableFree ();
 }
 
 
@@ -183,6 +217,43 @@ int	SmallestNode1 (int numhnodes)
 }
 
 
+/*
+==================
+Huff1BuildLookup
+
+Walks HUFF_TABLEBITS worth of every bit pattern down one context's tree, the same way
+Huff1DecompressTree would
+==================
+*/
+static void Huff1BuildLookup (int prev)
+{
+	int		i, bits, len;
+	int		nodenum;
+	int		*hnodes = cin.hnodes1 - 256 * 2 + (prev << 9);
+	int		*lookup = cin.htable1 + (prev << HUFF_TABLEBITS);
+
+	for (i = 0; i < HUFF_TABLESIZE; i++)
+	{
+		nodenum = cin.numhnodes1[prev];
+
+		// a context with fewer than two symbols has a leaf for a root; the tree decoder still takes a
+		// bit for it and lands in a node slot that's never written, so it comes out as symbol 0
+		if (nodenum < 256)
+		{
+			lookup[i] = (1 << 16) | 0;
+			continue;
+		}
+
+		for (len = 0, bits = i; nodenum >= 256 && len < HUFF_TABLEBITS; len++, bits >>= 1)
+			nodenum = hnodes[nodenum * 2 + (bits & 1)];
+
+		if (nodenum < 256)
+			lookup[i] = (len << 16) | nodenum;
+		else lookup[i] = nodenum;
+	}
+}
+
+
 /*
 ==================
 Huff1TableInit
@@ -190,7 +261,7 @@ Huff1TableInit
 Reads the 64k counts table and initializes the node trees
 ==================
 */
-void Huff1TableInit (void)
+void Huff1TableInit (FILE *f)
 {
 	int		prev;
 	int		j;
@@ -198,7 +269,7 @@ void Huff1TableInit (void)
 	byte	counts[256];
 	int		numhnodes;
 
-	cin.hnodes1 = Zone_Alloc (256 * 256 * 2 * 4);
+	cin.hnodes1 = Zone_AllocCategory (256 * 256 * 2 * 4, MEM_CINEMATIC);
 	memset (cin.hnodes1, 0, 256 * 256 * 2 * 4);
 
 	for (prev = 0; prev < 256; prev++)
@@ -207,7 +278,7 @@ void Huff1TableInit (void)
 		memset (cin.h_used, 0, sizeof (cin.h_used));
 
 		// read a row of counts
-		FS_Read (counts, sizeof (counts), cl.cinematic_file);
+		FS_Read (counts, sizeof (counts), f);
 
 		for (j = 0; j < 256; j++)
 			cin.h_count[j] = counts[j];
@@ -237,23 +308,49 @@ void Huff1TableInit (void)
 
 		cin.numhnodes1[prev] = numhnodes - 1;
 	}
+
+	// the lookup tables need every tree finished
+	cin.htable1 = Zone_AllocCategory (256 * HUFF_TABLESIZE * sizeof (int), MEM_CINEMATIC);
+
+	for (prev = 0; prev < 256; prev++)
+		Huff1BuildLookup (prev);
+}
+
+
+static void Huff1TableFree (void)
+{
+	if (cin.hnodes1)
+	{
+		Zone_Free (cin.hnodes1);
+		cin.hnodes1 = NULL;
+	}
+
+	if (cin.htable1)
+	{
+		Zone_Free (cin.htable1);
+		cin.htable1 = NULL;
+	}
 }
 
 
 /*
 ==================
-Huff1Decompress
+Huff1DecompressTree
+
+The original decoder, a bit at a time down the tree; cinbench checks Huff1Decompress against it
 ==================
 */
-cblock_t Huff1Decompress (cblock_t in)
+static int Huff1DecompressTree (cblock_t in, byte *out, int outsize, int *overread)
 {
-	cblock_t	out;
+	byte		*out_p = out;
 	int			i;
 
 	// get decompressed count
 	int count = in.data[0] + (in.data[1] << 8) + (in.data[2] << 16) + (in.data[3] << 24);
 	byte *input = in.data + 4;
-	byte *out_p = out.data = Zone_Alloc (count);
+
+	if (count > outsize || count < 0)
+		count = outsize;
 
 	// read bits
 	int *hnodesbase = cin.hnodes1 - 256 * 2;	// nodes 0-255 aren't stored
@@ -284,74 +381,311 @@ cblock_t Huff1Decompress (cblock_t in)
 	}
 
 	if (input - in.data != in.count && input - in.data != in.count + 1)
-		Com_DPrintf ("Decompression overread by %i", (input - in.data) - in.count);
+		*overread = (input - in.data) - in.count;
+	else *overread = 0;
+
+	return out_p - out;
+}
+
+
+/*
+==================
+Huff1Decompress
+
+One table lookup per pixel for any code up to HUFF_TABLEBITS long.  The counts are bytes, so
+no code can be longer than 22 bits and a 25 bit buffer always holds the whole of one.
+Returns the number of pixels written, which is never more than outsize.  This runs on the
+decode thread, so an overread is handed back rather than printed
+==================
+*/
+int Huff1Decompress (cblock_t in, byte *out, int outsize, int *overread)
+{
+	byte		*out_p = out;
+	int			entry;
+	int			len;
+	int			nodenum;
+	int			prev = 0;
+	unsigned	bits = 0;
+	int			numbits = 0;
+
+	// get decompressed count
+	int count = in.data[0] + (in.data[1] << 8) + (in.data[2] << 16) + (in.data[3] << 24);
+	byte *input = in.data + 4;
+	byte *end = in.data + in.count;
+
+	int *hnodesbase = cin.hnodes1 - 256 * 2;	// nodes 0-255 aren't stored
+
+	if (count > outsize || count < 0)
+		count = outsize;
+
+	while (count--)
+	{
+		// past the end of the frame reads as zeros rather than whatever follows it
+		while (numbits <= 24)
+		{
+			if (input < end)
+				bits |= (unsigned) *input << numbits;
+
+			input++;
+			numbits += 8;
+		}
+
+		entry = cin.htable1[(prev << HUFF_TABLEBITS) | (bits & (HUFF_TABLESIZE - 1))];
+
+		if ((len = entry >> 16) != 0)
+		{
+			bits >>= len;
+			numbits -= len;
+			prev = entry & 0xffff;
+		}
+		else
+		{
+			// finish a long code in the tree
+			int *hnodes = hnodesbase + (prev << 9);
+
+			bits >>= HUFF_TABLEBITS;
+			numbits -= HUFF_TABLEBITS;
+
+			for (nodenum = entry; nodenum >= 256; bits >>= 1, numbits--)
+				nodenum = hnodes[nodenum * 2 + (bits & 1)];
+
+			prev = nodenum;
+		}
+
+		*out_p++ = prev;
+	}
 
-	out.count = out_p - out.data;
+	// whole bytes still in the buffer were never used
+	input -= numbits >> 3;
 
-	return out;
+	if (input - in.data != in.count && input - in.data != in.count + 1)
+		*overread = (input - in.data) - in.count;
+	else *overread = 0;
+
+	return out_p - out;
 }
 
 
+/*
+=================================================================
+
+DECODE-AHEAD
+
+The thread owns cin.file once it starts and reads, decodes and slices the sound for
+each frame into the next free slot of the ring.  The main thread only takes finished
+frames off the other end, so a slow read or decode no longer holds up presentation
+
+=================================================================
+*/
+
 /*
 ==================
-SCR_ReadNextFrame
+SCR_DecodeFrame
+
+Runs on the decode thread, so it can't Com_Error; a bad frame is handed back for the
+main thread to deal with
 ==================
 */
-byte *SCR_ReadNextFrame (void)
+static cinstatus_t SCR_DecodeFrame (cinframe_t *frame)
 {
-	int		r;
-	int		command;
-	byte	samples[22050 / 14 * 4];
-	byte	compressed[0x20000];
-	int		size;
-	byte	*pic;
-	cblock_t	in, huf1;
-	int		start, end, count;
+	int			r;
+	int			command;
+	int			size;
+	int			start, end;
+	cblock_t	in;
 
 	// read the next frame
-	if ((r = fread (&command, 4, 1, cl.cinematic_file)) == 0)		// we'll give it one more chance
-		r = fread (&command, 4, 1, cl.cinematic_file);
+	if ((r = fread (&command, 4, 1, cin.file)) == 0)		// we'll give it one more chance
+		r = fread (&command, 4, 1, cin.file);
 
 	if (r != 1)
-		return NULL;
+		return CIN_END;
 
 	if ((command = LittleLong (command)) == 2)
-		return NULL;	// last frame marker
+		return CIN_END;	// last frame marker
 
 	if (command == 1)
 	{
 		// read palette
-		FS_Read (cl.cinematicpalette, sizeof (cl.cinematicpalette), cl.cinematic_file);
+		if (fread (cin.palette, sizeof (cin.palette), 1, cin.file) != 1)
+			return CIN_END;
 	}
 
+	memcpy (frame->palette, cin.palette, sizeof (frame->palette));
+
 	// decompress the next frame
-	FS_Read (&size, 4, cl.cinematic_file);
+	if (fread (&size, 4, 1, cin.file) != 1)
+		return CIN_END;
+
 	size = LittleLong (size);
 
-	if (size > sizeof (compressed) || size < 1)
-		Com_Error (ERR_DROP, "Bad compressed frame size");
+	if (size > CIN_MAXFRAME || size < 1)
+		return CIN_BADFRAME;
 
-	FS_Read (compressed, size, cl.cinematic_file);
+	if (fread (cin.compressed, size, 1, cin.file) != 1)
+		return CIN_END;
 
 	// read sound
-	start = cl.cinematicframe * cin.s_rate / 14;
-	end = (cl.cinematicframe + 1) * cin.s_rate / 14;
-	count = end - start;
+	start = cin.decodeframe * cin.s_rate / 14;
+	end = (cin.decodeframe + 1) * cin.s_rate / 14;
+	frame->numsamples = end - start;
 
-	FS_Read (samples, count * cin.s_width * cin.s_channels, cl.cinematic_file);
+	if (frame->numsamples && fread (frame->samples, frame->numsamples * cin.s_width * cin.s_channels, 1, cin.file) != 1)
+		return CIN_END;
 
-	S_RawSamples (count, cin.s_rate, cin.s_width, cin.s_channels, samples);
-
-	in.data = compressed;
+	in.data = cin.compressed;
 	in.count = size;
 
-	huf1 = Huff1Decompress (in);
+	Huff1Decompress (in, frame->pic, cin.width * cin.height, &frame->overread);
+
+	cin.decodeframe++;
+
+	return CIN_FRAME;
+}
+
+
+/*
+==================
+SCR_DecoderThread
+==================
+*/
+static unsigned SCR_DecoderThread (void *param)
+{
+	cinframe_t	*frame;
+
+	while (!cin.shutdown)
+	{
+		// wait for the main thread to give a frame back
+		if (cin.head - cin.tail >= CIN_FRAMES)
+		{
+			Sys_WaitSignal (cin.space, -1);
+			continue;
+		}
+
+		frame = &cin.frames[cin.head % CIN_FRAMES];
+		frame->status = SCR_DecodeFrame (frame);
+
+		// the pic, palette and samples must be in place before the main thread can see the frame
+		Sys_WriteBarrier ();
+		cin.head++;
+		Sys_RaiseSignal (cin.ready);
+
+		// the end or a bad frame is the last thing the thread hands over
+		if (frame->status != CIN_FRAME)
+			break;
+	}
+
+	return 0;
+}
+
+
+/*
+==================
+SCR_StartDecoder
+
+Everything the thread will write into is allocated here, once for the whole cinematic
+==================
+*/
+static void SCR_StartDecoder (void)
+{
+	int		i;
+	int		samplesize = ((cin.s_rate + 13) / 14 + 1) * cin.s_width * cin.s_channels;
+
+	for (i = 0; i < CIN_FRAMES; i++)
+	{
+		cin.frames[i].pic = Zone_AllocCategory (cin.width * cin.height, MEM_CINEMATIC);
+		cin.frames[i].samples = Zone_AllocCategory (samplesize, MEM_CINEMATIC);
+	}
+
+	cin.compressed = Zone_AllocCategory (CIN_MAXFRAME, MEM_CINEMATIC);
+	memcpy (cin.palette, cl.cinematicpalette, sizeof (cin.palette));
+	cin.decodeframe = 0;
+
+	cin.current = cin.pending = NULL;
+	cin.head = cin.tail = 0;
+	cin.shutdown = false;
+
+	cin.ready = Sys_CreateSignal ();
+	cin.space = Sys_CreateSignal ();
+	cin.thread = Sys_CreateThread (SCR_DecoderThread, NULL);
+}
+
+
+static void SCR_StopDecoder (void)
+{
+	int		i;
+
+	if (cin.thread)
+	{
+		cin.shutdown = true;
+		Sys_RaiseSignal (cin.space);
+		Sys_WaitThread (cin.thread);
+	}
+
+	Sys_DestroySignal (cin.ready);
+	Sys_DestroySignal (cin.space);
+
+	for (i = 0; i < CIN_FRAMES; i++)
+	{
+		Zone_Free (cin.frames[i].pic);
+		Zone_Free (cin.frames[i].samples);
+	}
+
+	Zone_Free (cin.compressed);
 
-	pic = huf1.data;
+	memset (cin.frames, 0, sizeof (cin.frames));
+	cin.compressed = NULL;
+	cin.current = cin.pending = NULL;
+	cin.thread = cin.ready = cin.space = NULL;
+}
 
-	cl.cinematicframe++;
 
-	return pic;
+/*
+==================
+SCR_TakeFrame
+
+The next frame off the ring; its sound goes out now, a frame ahead of its picture as
+it always has.  Only waits if the thread has fallen behind
+==================
+*/
+static cinframe_t *SCR_TakeFrame (void)
+{
+	cinframe_t	*frame;
+
+	// without a thread the frame is decoded here, as they all used to be
+	if (!cin.thread && cin.head <= cl.cinematicframe)
+	{
+		frame = &cin.frames[cin.head % CIN_FRAMES];
+		frame->status = SCR_DecodeFrame (frame);
+		cin.head++;
+	}
+
+	while (cin.head <= cl.cinematicframe)
+		Sys_WaitSignal (cin.ready, -1);
+
+	frame = &cin.frames[cl.cinematicframe % CIN_FRAMES];
+
+	if (frame->status == CIN_FRAME)
+	{
+		S_RawSamples (frame->numsamples, cin.s_rate, cin.s_width, cin.s_channels, frame->samples);
+		cl.cinematicframe++;
+	}
+
+	return frame;
+}
+
+
+/*
+==================
+SCR_ReleaseFrame
+
+Hands the oldest held frame back to the thread
+==================
+*/
+static void SCR_ReleaseFrame (void)
+{
+	cin.tail++;
+	Sys_RaiseSignal (cin.space);
 }
 
 
@@ -364,6 +698,7 @@ SCR_RunCinematic
 void SCR_RunCinematic (void)
 {
 	int		frame;
+	cinframe_t	*next;
 
 	if (cl.cinematictime <= 0)
 	{
@@ -393,14 +728,18 @@ void SCR_RunCinematic (void)
 		cl.cinematictime = cls.realtime - cl.cinematicframe * 1000 / 14;
 	}
 
-	if (cin.pic)
-		Zone_Free (cin.pic);
+	next = SCR_TakeFrame ();
 
-	cin.pic = cin.pic_pending;
-	cin.pic_pending = NULL;
-	cin.pic_pending = SCR_ReadNextFrame ();
+	if (next->status == CIN_BADFRAME)
+	{
+		SCR_StopCinematic ();
+		Com_Error (ERR_DROP, "Bad compressed frame size");
+	}
+
+	if (next->status == CIN_FRAME && next->overread)
+		Com_DPrintf ("Decompression overread by %i\n", next->overread);
 
-	if (!cin.pic_pending)
+	if (next->status == CIN_END)
 	{
 		SCR_StopCinematic ();
 		SCR_FinishCinematic ();
@@ -409,6 +748,18 @@ void SCR_RunCinematic (void)
 		cl.cinematictime = 0;
 		return;
 	}
+
+	// the first frame stays up until the second is due rather than blanking for a frame
+	if (cin.pending)
+	{
+		SCR_ReleaseFrame ();
+		cin.current = cin.pending;
+	}
+
+	cin.pending = next;
+
+	cin.pic = cin.current->pic;
+	memcpy (cl.cinematicpalette, cin.current->palette, sizeof (cl.cinematicpalette));
 }
 
 /*
@@ -465,10 +816,14 @@ void SCR_PlayCinematic (char *arg)
 		return;
 	}
 
+	// a cinematic that's still playing (skipped with nextserver, or "map x.cin" typed over it)
+	// must have its decoder joined and its file and tables released before they're reused
+	SCR_StopCinematic ();
+
 	Com_sprintf (name, sizeof (name), "video/%s", arg);
-	FS_FOpenFile (name, &cl.cinematic_file);
+	FS_FOpenFile (name, &cin.file);
 
-	if (!cl.cinematic_file)
+	if (!cin.file)
 	{
 		//		Com_Error (ERR_DROP, "Cinematic %s not found.\n", name);
 		SCR_FinishCinematic ();
@@ -480,23 +835,226 @@ void SCR_PlayCinematic (char *arg)
 
 	cls.state = ca_active;
 
-	FS_Read (&width, 4, cl.cinematic_file);
-	FS_Read (&height, 4, cl.cinematic_file);
+	FS_Read (&width, 4, cin.file);
+	FS_Read (&height, 4, cin.file);
 	cin.width = LittleLong (width);
 	cin.height = LittleLong (height);
 
-	FS_Read (&cin.s_rate, 4, cl.cinematic_file);
+	FS_Read (&cin.s_rate, 4, cin.file);
 	cin.s_rate = LittleLong (cin.s_rate);
-	FS_Read (&cin.s_width, 4, cl.cinematic_file);
+	FS_Read (&cin.s_width, 4, cin.file);
 	cin.s_width = LittleLong (cin.s_width);
-	FS_Read (&cin.s_channels, 4, cl.cinematic_file);
+	FS_Read (&cin.s_channels, 4, cin.file);
 	cin.s_channels = LittleLong (cin.s_channels);
 
-	Huff1TableInit ();
+	Huff1TableInit (cin.file);
 
 	cl.cinematicframe = 0;
-	cin.pic = SCR_ReadNextFrame ();
+	SCR_StartDecoder ();
+
+	cin.current = SCR_TakeFrame ();
+
+	if (cin.current->status == CIN_BADFRAME)
+	{
+		SCR_StopCinematic ();
+		Com_Error (ERR_DROP, "Bad compressed frame size");
+	}
+
+	if (cin.current->status == CIN_FRAME && cin.current->overread)
+		Com_DPrintf ("Decompression overread by %i\n", cin.current->overread);
+
+	if (cin.current->status != CIN_FRAME)
+	{
+		SCR_StopCinematic ();
+		SCR_FinishCinematic ();
+		return;
+	}
+
+	cin.pic = cin.current->pic;
+	memcpy (cl.cinematicpalette, cin.current->palette, sizeof (cl.cinematicpalette));
 	cl.cinematictime = Sys_Milliseconds ();
 }
 
 
+
+
+/*
+=================================================================
+
+CINEMATIC BENCHMARK
+
+=================================================================
+*/
+
+// the cinematics that ship with the game
+static char *cin_stock[] = {"idlog", "ntro", "eou1_", "eou2_", "eou3_", "eou4_", "eou5_", "eou6_", "eou7_", "eou8_", "end", NULL};
+
+typedef struct cinbench_s {
+	int		files;
+	int		frames;
+	int		mismatches;
+	double	pixels;
+	double	treetime;
+	double	tabletime;
+	double	inittime;
+} cinbench_t;
+
+
+/*
+==================
+SCR_BenchCinematic
+
+Decodes every frame of one cinematic with both decoders, timing each and comparing the results
+==================
+*/
+static void SCR_BenchCinematic (char *name, byte *compressed, cinbench_t *bench)
+{
+	FILE		*f;
+	int			header[5];
+	int			command, size, frame;
+	int			rate, samplesize, start, end;
+	int			pixels, treecount, tablecount;
+	int			treeoverread, tableoverread;
+	double		starttime;
+	byte		*tree, *table;
+	cblock_t	in;
+
+	if (FS_FOpenFile (name, &f) == -1 || !f)
+		return;
+
+	// width, height, sound rate, sound width, sound channels
+	FS_Read (header, sizeof (header), f);
+	pixels = LittleLong (header[0]) * LittleLong (header[1]);
+	rate = LittleLong (header[2]);
+	samplesize = LittleLong (header[3]) * LittleLong (header[4]);
+
+	if (pixels <= 0)
+	{
+		Com_Printf ("%s: bad size\n", name);
+		fclose (f);
+		return;
+	}
+
+	tree = Zone_AllocCategory (pixels, MEM_CINEMATIC);
+	table = Zone_AllocCategory (pixels, MEM_CINEMATIC);
+
+	starttime = Sys_FloatTime ();
+	Huff1TableInit (f);
+	bench->inittime += Sys_FloatTime () - starttime;
+
+	for (frame = 0;; frame++)
+	{
+		if (fread (&command, 4, 1, f) != 1)
+			break;
+
+		if ((command = LittleLong (command)) == 2)
+			break;	// last frame marker
+
+		if (command == 1)
+			fseek (f, sizeof (cl.cinematicpalette), SEEK_CUR);
+
+		if (fread (&size, 4, 1, f) != 1)
+			break;
+
+		if ((size = LittleLong (size)) > CIN_MAXFRAME || size < 1)
+		{
+			Com_Printf ("%s: bad compressed frame size\n", name);
+			break;
+		}
+
+		if (fread (compressed, size, 1, f) != 1)
+			break;
+
+		// skip the sound for this frame
+		start = frame * rate / 14;
+		end = (frame + 1) * rate / 14;
+		fseek (f, (end - start) * samplesize, SEEK_CUR);
+
+		in.data = compressed;
+		in.count = size;
+
+		starttime = Sys_FloatTime ();
+		treecount = Huff1DecompressTree (in, tree, pixels, &treeoverread);
+		bench->treetime += Sys_FloatTime () - starttime;
+
+		starttime = Sys_FloatTime ();
+		tablecount = Huff1Decompress (in, table, pixels, &tableoverread);
+		bench->tabletime += Sys_FloatTime () - starttime;
+
+		if (treecount != tablecount || memcmp (tree, table, tablecount))
+			bench->mismatches++;
+
+		if (treeoverread)
+			Com_DPrintf ("%s: tree decompression overread by %i\n", name, treeoverread);
+
+		if (tableoverread)
+			Com_DPrintf ("%s: decompression overread by %i\n", name, tableoverread);
+
+		bench->pixels += tablecount;
+		bench->frames++;
+	}
+
+	Zone_Free (tree);
+	Zone_Free (table);
+	fclose (f);
+	Huff1TableFree ();
+
+	bench->files++;
+}
+
+
+/*
+==================
+SCR_CinBench_f
+
+cinbench [cinematic ...]; with no arguments it runs over the stock cinematics
+==================
+*/
+void SCR_CinBench_f (void)
+{
+	int			i;
+	char		name[MAX_OSPATH];
+	byte		*compressed;
+	cinbench_t	bench;
+
+	if (cl.cinematictime > 0)
+	{
+		Com_Printf ("can't run cinbench while a cinematic is playing\n");
+		return;
+	}
+
+	memset (&bench, 0, sizeof (bench));
+	compressed = Zone_AllocCategory (CIN_MAXFRAME, MEM_CINEMATIC);
+
+	if (Cmd_Argc () > 1)
+	{
+		for (i = 1; i < Cmd_Argc (); i++)
+		{
+			Com_sprintf (name, sizeof (name), "video/%s", Cmd_Argv (i));
+			COM_DefaultExtension (name, ".cin");
+			SCR_BenchCinematic (name, compressed, &bench);
+		}
+	}
+	else
+	{
+		for (i = 0; cin_stock[i]; i++)
+			SCR_BenchCinematic (va ("video/%s.cin", cin_stock[i]), compressed, &bench);
+	}
+
+	Zone_Free (compressed);
+
+	if (!bench.frames)
+	{
+		Com_Printf ("no cinematics found\n");
+		return;
+	}
+
+	Com_Printf ("%i cinematics, %i frames, %.1f megapixels\n", bench.files, bench.frames, bench.pixels / (1024 * 1024));
+	Com_Printf ("table setup: %.3f ms per cinematic\n", bench.inittime * 1000.0 / bench.files);
+	Com_Printf ("tree decode:  %.3f ms per frame, %.1f megapixels/sec\n", bench.treetime * 1000.0 / bench.frames, bench.pixels / (1024 * 1024) / bench.treetime);
+	Com_Printf ("table decode: %.3f ms per frame, %.1f megapixels/sec\n", bench.tabletime * 1000.0 / bench.frames, bench.pixels / (1024 * 1024) / bench.tabletime);
+
+	if (bench.mismatches)
+		Com_Printf ("%i frames differ\n", bench.mismatches);
+	else Com_Printf ("all frames match\n");
+}
@@ -194,6 +194,9 @@ void CL_Record_f (void)
 		Com_Printf ("ERROR: couldn't open.\n");
 		return;
 	}
+
+	// so that it can be played back without a rescan
+	FS_IndexNewFile (va ("demos/%s.dm2", Cmd_Argv (1)));
 	cls.demorecording = true;
 
 	// don't start saving messages until a non-delta compressed message is received
@@ -1081,6 +1084,51 @@ byte *precache_model; // used for skin checking in alias models
 
 static const char *env_suf[6] = {"rt", "bk", "lf", "ft", "up", "dn"};
 
+
+/*
+=================
+CL_PrefetchPrecache
+
+passes everything we're about to load to the filesystem so it can be read in pack order
+=================
+*/
+static void CL_PrefetchPrecache (void)
+{
+	// from qcommon/cmodel.c
+	extern int			numtexinfo;
+	extern mapsurface_t	map_surfaces[];
+
+	char	**names = Zone_Alloc ((MAX_MODELS + MAX_SOUNDS + MAX_IMAGES + numtexinfo) * sizeof (char *));
+	int		i, numnames = 0;
+
+	for (i = 1; i < MAX_MODELS && cl.configstrings[CS_MODELS + i][0]; i++)
+	{
+		if (cl.configstrings[CS_MODELS + i][0] != '*' && cl.configstrings[CS_MODELS + i][0] != '#')
+			names[numnames++] = CopyString (cl.configstrings[CS_MODELS + i]);
+	}
+
+	for (i = 1; i < MAX_SOUNDS && cl.configstrings[CS_SOUNDS + i][0]; i++)
+	{
+		// sexed sounds depend on the player model
+		if (cl.configstrings[CS_SOUNDS + i][0] != '*')
+			names[numnames++] = CopyString (va ("sound/%s", cl.configstrings[CS_SOUNDS + i]));
+	}
+
+	for (i = 1; i < MAX_IMAGES && cl.configstrings[CS_IMAGES + i][0]; i++)
+		names[numnames++] = CopyString (va ("pics/%s.pcx", cl.configstrings[CS_IMAGES + i]));
+
+	for (i = 0; i < numtexinfo; i++)
+		names[numnames++] = CopyString (va ("textures/%s.wal", map_surfaces[i].rname));
+
+	FS_PrefetchFiles (names, numnames);
+
+	for (i = 0; i < numnames; i++)
+		Zone_Free (names[i]);
+
+	Zone_Free (names);
+}
+
+
 void CL_RequestNextDownload (void)
 {
 	unsigned	map_checksum;		// for detecting cheater maps
@@ -1127,7 +1175,7 @@ void CL_RequestNextDownload (void)
 				// checking for skins in the model
 				if (!precache_model)
 				{
-
+					// kept across frames while skins download, so not a read-only pointer into a pack
 					FS_LoadFile (cl.configstrings[precache_check], (void **) &precache_model);
 					if (!precache_model)
 					{
@@ -1368,6 +1416,7 @@ void CL_RequestNextDownload (void)
 	}
 
 	//ZOID
+	CL_PrefetchPrecache ();
 	CL_RegisterSounds ();
 	CL_PrepRefresh ();
 
@@ -1385,6 +1434,16 @@ before allowing the client into the server
 */
 void CL_Precache_f (void)
 {
+	char	mapname[MAX_QPATH];
+
+	// start recording before anything is prefetched or loaded; this does nothing if the local server
+	// has already started recording this map
+	if (cl.configstrings[CS_MODELS + 1][0])
+	{
+		COM_FileBase (cl.configstrings[CS_MODELS + 1], mapname);
+		FS_BeginLoadRecording (mapname);
+	}
+
 	//Yet another hack to let old demos work
 	//the old precache sequence
 	if (Cmd_Argc () < 2)
@@ -1518,6 +1577,7 @@ void CL_InitLocal (void)
 	Cmd_AddCommand ("setenv", CL_Setenv_f);
 	Cmd_AddCommand ("precache", CL_Precache_f);
 	Cmd_AddCommand ("download", CL_Download_f);
+	Cmd_AddCommand ("predbench", CL_PredBench_f);
 
 	// forward to server commands
 	// the only thing this does is allow command completion
@@ -1574,6 +1634,9 @@ void CL_WriteConfiguration (void)
 	fclose (f);
 
 	Cvar_WriteVariables (path);
+
+	// a first write, so that exec can find it without an fs_rescan
+	FS_IndexNewFile ("directq.cfg");
 }
 
 
@@ -270,6 +270,7 @@ void CL_ParseDownload (void)
 
 		if (r)
 			Com_Printf ("failed to rename.\n");
+		else FS_IndexNewFile (cls.downloadname);
 
 		cls.download = NULL;
 		cls.downloadpercent = 0;
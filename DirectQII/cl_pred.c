@@ -196,11 +196,19 @@ int		CL_PMpointcontents (vec3_t point)
 }
 
 
+// pmoves run by CL_PredictMovement, for predbench
+static int		cl_predictedmoves;
+
 /*
 =================
 CL_PredictMovement
 
 Sets cl.predicted_origin and cl.predicted_angles
+
+The state after every command is kept, so as long as the server frame, the last
+acknowledged command and the air acceleration haven't changed only the commands sent
+since the last call need to be run.  Anything else starts again from the acknowledged
+command, as every call used to
 =================
 */
 void CL_PredictMovement (void)
@@ -248,29 +256,53 @@ void CL_PredictMovement (void)
 
 	pm_airaccelerate = atof (cl.configstrings[CS_AIRACCEL]);
 
-	pm.s = cl.frame.playerstate.pmove;
+	// a new frame from the server moves the base and the world the commands collide with
+	if (!cl.predict_valid || cl.predict_ack != ack || cl.predict_serverframe != cl.frame.serverframe ||
+		cl.predict_airaccel != pm_airaccelerate || memcmp (&cl.predict_base, &cl.frame.playerstate.pmove, sizeof (pmove_state_t)))
+	{
+		cl.predict_valid = true;
+		cl.predict_ack = ack;
+		cl.predict_serverframe = cl.frame.serverframe;
+		cl.predict_airaccel = pm_airaccelerate;
+		cl.predict_base = cl.frame.playerstate.pmove;
+		cl.predict_sequence = ack + 1;
+	}
 
-	//	SCR_DebugGraph (current - ack - 1, 0);
+	// carry on from the last command that was run
+	if (cl.predict_sequence > ack + 1)
+	{
+		frame = (cl.predict_sequence - 1) & (CMD_BACKUP - 1);
+		pm.s = cl.predicted_states[frame];
+		VectorCopy (cl.predicted_viewangles[frame], pm.viewangles);
+	}
+	else pm.s = cl.frame.playerstate.pmove;
 
-	frame = 0;
+	//	SCR_DebugGraph (current - ack - 1, 0);
 
 	// run frames
-	while (++ack < current)
+	for (ack = cl.predict_sequence; ack < current; ack++)
 	{
 		frame = ack & (CMD_BACKUP - 1);
 		cmd = &cl.cmds[frame];
 
 		pm.cmd = *cmd;
 		Pmove (&pm);
+		cl_predictedmoves++;
 
 		// save for debug checking
 		cl.predicted_origins[frame][0] = pm.s.origin[0];
 		cl.predicted_origins[frame][1] = pm.s.origin[1];
 		cl.predicted_origins[frame][2] = pm.s.origin[2];
+
+		// and to start from next time
+		cl.predicted_states[frame] = pm.s;
+		VectorCopy (pm.viewangles, cl.predicted_viewangles[frame]);
 	}
 
+	cl.predict_sequence = current;
+
 	// ???smooth out stair step-ups???
-	oldframe = (ack - 2) & (CMD_BACKUP - 1);
+	oldframe = (current - 2) & (CMD_BACKUP - 1);
 	oldz = cl.predicted_origins[oldframe][2];
 	step = pm.s.origin[2] - oldz;
 
@@ -287,3 +319,168 @@ void CL_PredictMovement (void)
 
 	VectorCopy (pm.viewangles, cl.predicted_angles);
 }
+
+
+/*
+=================
+CL_PredBenchCmd
+
+The script predbench runs: forward while turning, with a strafe and a jump now and then
+=================
+*/
+static void CL_PredBenchCmd (usercmd_t *cmd, int frame, int msec)
+{
+	int		t = frame * msec;
+
+	memset (cmd, 0, sizeof (*cmd));
+
+	cmd->msec = msec;
+	cmd->angles[1] = ANGLE2SHORT (t * 0.09f);	// yaw; a full turn every 4 seconds
+	cmd->forwardmove = 400;
+
+	if ((t / 1000) & 1)
+		cmd->sidemove = ((t / 250) & 1) ? 200 : -200;
+
+	if (t % 1500 < 100)
+		cmd->upmove = 200;
+}
+
+
+/*
+=================
+CL_PredBench_f
+
+predbench [seconds] [fps] [ping]
+
+Plays a scripted run of commands through CL_PredictMovement at the given frame rate, with
+server frames arriving every 100 ms acknowledging whatever was sent ping ms earlier.  Each
+frame is predicted once from scratch, as every frame used to be, and once incrementally, and
+the results are compared.  Needs a map to be running for the collision
+=================
+*/
+void CL_PredBench_f (void)
+{
+	int			seconds = (Cmd_Argc () > 1) ? atoi (Cmd_Argv (1)) : 10;
+	int			fps = (Cmd_Argc () > 2) ? atoi (Cmd_Argv (2)) : 250;
+	int			ping = (Cmd_Argc () > 3) ? atoi (Cmd_Argv (3)) : 200;
+	int			numframes, msec, f, pass, ackframe, unacked;
+	int			firstseq, oldincoming, oldoutgoing;
+	int			differ = 0;
+	int			moves[2];
+	double		starttime, times[2];
+	pmove_t		pm;
+	pmove_state_t	*server;
+	vec3_t		*results[2];
+	client_state_t	*saved;
+
+	if (cls.state != ca_active || cl_paused->value || !cl_predict->value || (cl.frame.playerstate.pmove.pm_flags & PMF_NO_PREDICTION))
+	{
+		Com_Printf ("predbench needs an unpaused map with prediction on\n");
+		return;
+	}
+
+	if (seconds < 1) seconds = 1;
+	if (fps < 10) fps = 10;
+	if (fps > 1000) fps = 1000;
+	if (ping < 0) ping = 0;
+
+	msec = 1000 / fps;
+	numframes = seconds * fps;
+
+	// so much ping that the commands would run out makes for a pointless benchmark
+	if ((ping + 100) / msec >= CMD_BACKUP - 1)
+	{
+		Com_Printf ("%i ms of ping at %i fps is more than %i commands\n", ping, fps, CMD_BACKUP);
+		return;
+	}
+
+	// everything here runs on a copy of the real state which is put back afterwards
+	saved = Zone_Alloc (sizeof (client_state_t));
+	memcpy (saved, &cl, sizeof (client_state_t));
+	oldincoming = cls.netchan.incoming_acknowledged;
+	oldoutgoing = cls.netchan.outgoing_sequence;
+
+	server = Zone_Alloc (numframes * sizeof (pmove_state_t));
+	results[0] = Zone_Alloc (numframes * 2 * sizeof (vec3_t));
+	results[1] = Zone_Alloc (numframes * 2 * sizeof (vec3_t));
+
+	firstseq = cls.netchan.outgoing_sequence;
+
+	// what the server will say the player did after each command
+	memset (&pm, 0, sizeof (pm));
+	pm.trace = CL_PMTrace;
+	pm.pointcontents = CL_PMpointcontents;
+	pm_airaccelerate = atof (cl.configstrings[CS_AIRACCEL]);
+	pm.s = cl.frame.playerstate.pmove;
+
+	for (f = 0; f < numframes; f++)
+	{
+		CL_PredBenchCmd (&pm.cmd, f, msec);
+		Pmove (&pm);
+		server[f] = pm.s;
+	}
+
+	for (pass = 0; pass < 2; pass++)
+	{
+		memcpy (&cl, saved, sizeof (client_state_t));
+		cl.predict_valid = false;
+		cls.netchan.outgoing_sequence = firstseq;
+		cls.netchan.incoming_acknowledged = firstseq - 1;
+
+		moves[pass] = cl_predictedmoves;
+		times[pass] = 0;
+		unacked = 0;
+
+		for (f = 0; f < numframes; f++)
+		{
+			// a server frame acknowledging the last command sent ping ms ago
+			if (!(f * msec % 100) && f * msec >= ping)
+			{
+				ackframe = (f * msec - ping) / msec;
+				cl.frame.serverframe++;
+				cl.frame.playerstate.pmove = server[ackframe];
+				cls.netchan.incoming_acknowledged = firstseq + ackframe;
+			}
+
+			CL_PredBenchCmd (&cl.cmds[cls.netchan.outgoing_sequence & (CMD_BACKUP - 1)], f, msec);
+			cls.netchan.outgoing_sequence++;
+			unacked += cls.netchan.outgoing_sequence - cls.netchan.incoming_acknowledged - 1;
+
+			// the first pass throws the cache away every frame
+			if (!pass)
+				cl.predict_valid = false;
+
+			starttime = Sys_FloatTime ();
+			CL_PredictMovement ();
+			times[pass] += Sys_FloatTime () - starttime;
+
+			VectorCopy (cl.predicted_origin, results[pass][f * 2]);
+			VectorCopy (cl.predicted_angles, results[pass][f * 2 + 1]);
+		}
+
+		moves[pass] = cl_predictedmoves - moves[pass];
+	}
+
+	for (f = 0; f < numframes; f++)
+	{
+		if (!VectorCompare (results[0][f * 2], results[1][f * 2]) || !VectorCompare (results[0][f * 2 + 1], results[1][f * 2 + 1]))
+			differ++;
+	}
+
+	memcpy (&cl, saved, sizeof (client_state_t));
+	cls.netchan.incoming_acknowledged = oldincoming;
+	cls.netchan.outgoing_sequence = oldoutgoing;
+
+	Zone_Free (saved);
+	Zone_Free (server);
+	Zone_Free (results[0]);
+	Zone_Free (results[1]);
+
+	Com_Printf ("%i frames at %i fps with %i ms ping, %i commands unacknowledged on average\n", numframes, fps, ping, unacked / numframes);
+	Com_Printf ("from scratch: %.4f ms per frame, %i pmoves\n", times[0] * 1000.0 / numframes, moves[0]);
+	Com_Printf ("incremental:  %.4f ms per frame, %i pmoves\n", times[1] * 1000.0 / numframes, moves[1]);
+
+	if (differ)
+		Com_Printf ("%i frames differ\n", differ);
+	else Com_Printf ("all frames match\n");
+}
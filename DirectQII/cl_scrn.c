@@ -409,6 +409,7 @@ void SCR_Screenshot_f (void)
 			if ((f = fopen (checkname, "rb")) == NULL)
 			{
 				// create the scheenshot
+				FS_CreatePath (checkname);
 				SCR_PerformScreenshot (checkname, SCR_DEFAULT);
 				return;
 			}
@@ -423,6 +424,7 @@ void SCR_Screenshot_f (void)
 	{
 		// using the first param as a custom shot name
 		char *checkname = va ("%s/"SHOTDIR"/%s.tga", FS_Gamedir (), Cmd_Argv (1));
+		FS_CreatePath (checkname);
 		SCR_PerformScreenshot (checkname, SCR_NO_2D_UI);
 	}
 }
@@ -456,6 +458,7 @@ void SCR_Init (void)
 	Cmd_AddCommand ("sizedown", SCR_SizeDown_f);
 	Cmd_AddCommand ("sky", SCR_Sky_f);
 	Cmd_AddCommand ("screenshot", SCR_Screenshot_f);
+	Cmd_AddCommand ("cinbench", SCR_CinBench_f);
 
 	scr_initialized = true;
 }
@@ -631,6 +634,9 @@ void SCR_EndLoadingPlaque (void)
 {
 	cls.disable_screen = 0;
 	Con_ClearNotify ();
+
+	// the map load is complete
+	FS_EndLoadRecording ();
 }
 
 
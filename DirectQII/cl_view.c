@@ -307,6 +307,8 @@ void CL_PrepRefresh (void)
 	strcpy (mapname, cl.configstrings[CS_MODELS + 1] + 5);	// skip "maps/"
 	mapname[strlen (mapname) - 4] = 0;		// cut off ".bsp"
 
+	Hunk_BeginLoad (mapname);
+
 	// register models, pics, and skins
 	Com_Printf ("Map: %s\r", mapname);
 	SCR_UpdateScreen (SCR_NO_VSYNC);
@@ -78,7 +78,7 @@ typedef struct clientinfo_s {
 extern char cl_weaponmodels[MAX_CLIENTWEAPONMODELS][MAX_QPATH];
 extern int num_cl_weaponmodels;
 
-#define	CMD_BACKUP		64	// allow a lot of command backups for very fast systems
+#define	CMD_BACKUP		128	// allow a lot of command backups for very fast systems; 250 fps at 200 ms ping is 75
 
 // the client_state_t structure is wiped completely at every
 // server map change
@@ -99,6 +99,17 @@ typedef struct client_state_s {
 	int			cmd_time[CMD_BACKUP];	// time sent, for calculating pings
 	short		predicted_origins[CMD_BACKUP][3];	// for debug comparing against server
 
+	// the state after each predicted command; only commands from predict_sequence on are run
+	// again until the base they were run from changes
+	pmove_state_t	predicted_states[CMD_BACKUP];
+	vec3_t		predicted_viewangles[CMD_BACKUP];
+	qboolean	predict_valid;
+	int			predict_sequence;
+	int			predict_ack;
+	int			predict_serverframe;
+	float		predict_airaccel;
+	pmove_state_t	predict_base;
+
 	float		predicted_step;				// for stair up smoothing
 	unsigned	predicted_step_time;
 
@@ -135,7 +146,6 @@ typedef struct client_state_s {
 
 	// non-gameserver infornamtion
 	// FIXME: move this cinematic stuff into the cin_t structure
-	FILE		*cinematic_file;
 	int			cinematictime;		// cls.realtime for first cinematic frame
 	int			cinematicframe;
 	char		cinematicpalette[768];
@@ -563,6 +573,7 @@ void CL_DrawInventory (void);
 // cl_pred.c
 //
 void CL_PredictMovement (void);
+void CL_PredBench_f (void);
 
 #if id386
 void x86_TimerStart (void);
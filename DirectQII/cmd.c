@@ -27,12 +27,24 @@ void Cmd_ForwardToServer (void);
 
 typedef struct cmdalias_s {
 	struct cmdalias_s	*next;
+	struct cmdalias_s	*hashnext;
 	char	name[MAX_ALIAS_NAME];
 	char	*value;
 } cmdalias_t;
 
 cmdalias_t	*cmd_alias;
 
+/*
+commands and aliases are each kept in a list (for cmdlist, alias and completion) and in a hash
+table keyed on the lowercased name, so that Cmd_ExecuteString can find them with one probe each
+instead of walking every registered name for every line of every config.  New entries go on
+the front of both the list and their chain, so when two names differ only by case the one that
+matches first is the same one that used to.
+*/
+#define	CMD_HASH_SIZE	512
+
+static cmdalias_t	*cmd_aliashash[CMD_HASH_SIZE];
+
 qboolean	cmd_wait;
 
 #define	ALIAS_LOOP_COUNT	16
@@ -41,6 +53,50 @@ int		alias_count;		// for detecting runaway loops
 
 //=============================================================================
 
+/*
+============
+Cmd_HashName
+============
+*/
+static unsigned Cmd_HashName (char *name)
+{
+	unsigned hash = 2166136261u;
+
+	while (*name)
+	{
+		int c = *name++;
+
+		if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+
+		hash ^= (byte) c;
+		hash *= 16777619u;
+	}
+
+	return hash & (CMD_HASH_SIZE - 1);
+}
+
+
+/*
+============
+Cmd_FindAlias
+
+exact is used when defining an alias, otherwise the match is case-insensitive like execution always was
+============
+*/
+static cmdalias_t *Cmd_FindAlias (char *name, qboolean exact)
+{
+	cmdalias_t	*a;
+
+	for (a = cmd_aliashash[Cmd_HashName (name)]; a; a = a->hashnext)
+	{
+		if (exact ? !strcmp (name, a->name) : !Q_strcasecmp (name, a->name))
+			return a;
+	}
+
+	return NULL;
+}
+
+
 /*
 ============
 Cmd_Wait_f
@@ -64,10 +120,22 @@ COMMAND BUFFER
 =============================================================================
 */
 
-sizebuf_t	cmd_text;
-byte		cmd_text_buf[8192];
+/*
+the command buffer is a queue of text between cbuf_start and cbuf_end.  executing a line just
+moves cbuf_start past it, and inserted text goes in the space that has already been executed
+whenever it fits, so a large exec is consumed in linear time instead of shuffling the whole
+remaining buffer down after every line.  the buffer starts at the size it has always been and
+grows when a config won't fit, up to a cap.
+*/
+#define	CBUF_INITIAL_SIZE	8192
+#define	CBUF_MAX_SIZE		0x400000
+
+static char	*cbuf_data;
+static int	cbuf_size;
+static int	cbuf_start;
+static int	cbuf_end;
 
-byte		defer_text_buf[8192];
+static char	*defer_text;
 
 /*
 ============
@@ -76,65 +144,120 @@ Cbuf_Init
 */
 void Cbuf_Init (void)
 {
-	SZ_Init (&cmd_text, cmd_text_buf, sizeof (cmd_text_buf));
+	cbuf_data = Zone_Alloc (CBUF_INITIAL_SIZE);
+	cbuf_size = CBUF_INITIAL_SIZE;
+	cbuf_start = cbuf_end = 0;
 }
 
+
 /*
 ============
-Cbuf_AddText
+Cbuf_Reserve
 
-Adds command text at the end of the buffer
+Makes sure that len more bytes can be held, growing the buffer if needed; the queued text is
+moved to offset so that the caller can use the space in front of it
 ============
 */
-void Cbuf_AddText (char *text)
+static qboolean Cbuf_Reserve (int len, int offset)
 {
-	int		l;
+	int		queued = cbuf_end - cbuf_start;
 
-	l = strlen (text);
+	if (queued + len >= CBUF_MAX_SIZE)
+		return false;
 
-	if (cmd_text.cursize + l >= cmd_text.maxsize)
+	if (queued + len >= cbuf_size)
 	{
-		Com_Printf ("Cbuf_AddText: overflow\n");
-		return;
+		int		newsize = cbuf_size;
+		char	*newdata;
+
+		while (queued + len >= newsize)
+			newsize <<= 1;
+
+		newdata = Zone_Alloc (newsize);
+		memcpy (newdata + offset, cbuf_data + cbuf_start, queued);
+		Zone_Free (cbuf_data);
+
+		cbuf_data = newdata;
+		cbuf_size = newsize;
 	}
-	SZ_Write (&cmd_text, text, strlen (text));
+	else if (cbuf_start != offset)
+		memmove (cbuf_data + offset, cbuf_data + cbuf_start, queued);
+
+	cbuf_start = offset;
+	cbuf_end = offset + queued;
+
+	return true;
 }
 
 
 /*
 ============
-Cbuf_InsertText
-
-Adds command text immediately after the current command
-Adds a \n to the text
-FIXME: actually change the command buffer to do less copying
+Cbuf_Append
 ============
 */
-void Cbuf_InsertText (char *text)
+static void Cbuf_Append (char *text, int len)
 {
-	char	*temp;
-	int		templen;
-
-	// copy off any commands still remaining in the exec buffer
-	templen = cmd_text.cursize;
-	if (templen)
+	// compact only when the text won't fit behind what's queued
+	if (cbuf_end + len >= cbuf_size)
 	{
-		temp = Zone_Alloc (templen);
-		memcpy (temp, cmd_text.data, templen);
-		SZ_Clear (&cmd_text);
+		if (!Cbuf_Reserve (len, 0))
+		{
+			Com_Printf ("Cbuf_AddText: overflow\n");
+			return;
+		}
 	}
-	else
-		temp = NULL;	// shut up compiler
 
-	// add the entire text of the file
-	Cbuf_AddText (text);
+	memcpy (cbuf_data + cbuf_end, text, len);
+	cbuf_end += len;
+}
 
-	// add the copied off data
-	if (templen)
+
+/*
+============
+Cbuf_Insert
+============
+*/
+static void Cbuf_Insert (char *text, int len)
+{
+	// move the queued text up only when the executed space in front of it is too small
+	if (len > cbuf_start)
 	{
-		SZ_Write (&cmd_text, temp, templen);
-		Zone_Free (temp);
+		if (!Cbuf_Reserve (len, len))
+		{
+			Com_Printf ("Cbuf_AddText: overflow\n");
+			return;
+		}
 	}
+
+	cbuf_start -= len;
+	memcpy (cbuf_data + cbuf_start, text, len);
+}
+
+
+/*
+============
+Cbuf_AddText
+
+Adds command text at the end of the buffer
+============
+*/
+void Cbuf_AddText (char *text)
+{
+	Cbuf_Append (text, strlen (text));
+}
+
+
+/*
+============
+Cbuf_InsertText
+
+Adds command text immediately after the current command
+Adds a \n to the text
+============
+*/
+void Cbuf_InsertText (char *text)
+{
+	Cbuf_Insert (text, strlen (text));
 }
 
 
@@ -145,9 +268,16 @@ Cbuf_CopyToDefer
 */
 void Cbuf_CopyToDefer (void)
 {
-	memcpy (defer_text_buf, cmd_text_buf, cmd_text.cursize);
-	defer_text_buf[cmd_text.cursize] = 0;
-	cmd_text.cursize = 0;
+	int		len = cbuf_end - cbuf_start;
+
+	if (defer_text)
+		Zone_Free (defer_text);
+
+	defer_text = Zone_Alloc (len + 1);
+	memcpy (defer_text, cbuf_data + cbuf_start, len);
+	defer_text[len] = 0;
+
+	cbuf_start = cbuf_end = 0;
 }
 
 /*
@@ -157,8 +287,12 @@ Cbuf_InsertFromDefer
 */
 void Cbuf_InsertFromDefer (void)
 {
-	Cbuf_InsertText (defer_text_buf);
-	defer_text_buf[0] = 0;
+	if (defer_text)
+	{
+		Cbuf_InsertText (defer_text);
+		Zone_Free (defer_text);
+		defer_text = NULL;
+	}
 }
 
 
@@ -192,20 +326,21 @@ Cbuf_Execute
 */
 void Cbuf_Execute (void)
 {
-	int		i;
+	int		i, len;
 	char	*text;
 	char	line[1024];
 	int		quotes;
 
 	alias_count = 0;		// don't allow infinite alias loops
 
-	while (cmd_text.cursize)
+	while (cbuf_start < cbuf_end)
 	{
 		// find a \n or ; line break
-		text = (char *) cmd_text.data;
+		text = cbuf_data + cbuf_start;
+		len = cbuf_end - cbuf_start;
 
 		quotes = 0;
-		for (i = 0; i < cmd_text.cursize; i++)
+		for (i = 0; i < len; i++)
 		{
 			if (text[i] == '"')
 				quotes++;
@@ -215,23 +350,25 @@ void Cbuf_Execute (void)
 				break;
 		}
 
-
-		memcpy (line, text, i);
-		line[i] = 0;
-
-		// delete the text from the command buffer and move remaining commands down
-		// this is necessary because commands (exec, alias) can insert data at the
-		// beginning of the text buffer
-
-		if (i == cmd_text.cursize)
-			cmd_text.cursize = 0;
+		if (i < sizeof (line))
+		{
+			memcpy (line, text, i);
+			line[i] = 0;
+		}
 		else
 		{
-			i++;
-			cmd_text.cursize -= i;
-			memmove (text, text + i, cmd_text.cursize);
+			// this used to overrun line
+			Com_Printf ("Line exceeded %i chars, discarded.\n", (int) sizeof (line));
+			line[0] = 0;
 		}
 
+		// consume the line before executing it because commands (exec, alias) can insert
+		// text at the front of the queue
+		if (i == len)
+			cbuf_start = cbuf_end = 0;
+		else if ((cbuf_start += i + 1) == cbuf_end)
+			cbuf_start = cbuf_end = 0;
+
 		// execute the command line
 		Cmd_ExecuteString (line);
 
@@ -369,8 +506,7 @@ Cmd_Exec_f
 */
 void Cmd_Exec_f (void)
 {
-	char	*f, *f2;
-	int		len;
+	char	*f;
 
 	if (Cmd_Argc () != 2)
 	{
@@ -378,7 +514,8 @@ void Cmd_Exec_f (void)
 		return;
 	}
 
-	len = FS_LoadFile (Cmd_Argv (1), (void **) &f);
+	// read-only loads aren't 0 terminated, so a text file gets a copy
+	FS_LoadFile (Cmd_Argv (1), (void **) &f);
 	if (!f)
 	{
 		Com_Printf ("couldn't exec %s\n", Cmd_Argv (1));
@@ -386,14 +523,9 @@ void Cmd_Exec_f (void)
 	}
 	Com_Printf ("execing %s\n", Cmd_Argv (1));
 
-	// the file doesn't have a trailing 0, so we need to copy it off
-	f2 = Zone_Alloc (len + 1);
-	memcpy (f2, f, len);
-	f2[len] = 0;
-
-	Cbuf_InsertText (f2);
+	// as a terminated string, so a file with an embedded 0 ends there like it always has
+	Cbuf_InsertText (f);
 
-	Zone_Free (f2);
 	FS_FreeFile (f);
 }
 
@@ -444,20 +576,18 @@ void Cmd_Alias_f (void)
 	}
 
 	// if the alias already exists, reuse it
-	for (a = cmd_alias; a; a = a->next)
+	if ((a = Cmd_FindAlias (s, true)) != NULL)
+		Zone_Free (a->value);
+	else
 	{
-		if (!strcmp (s, a->name))
-		{
-			Zone_Free (a->value);
-			break;
-		}
-	}
+		unsigned hash = Cmd_HashName (s);
 
-	if (!a)
-	{
 		a = Zone_Alloc (sizeof (cmdalias_t));
 		a->next = cmd_alias;
 		cmd_alias = a;
+
+		a->hashnext = cmd_aliashash[hash];
+		cmd_aliashash[hash] = a;
 	}
 	strcpy (a->name, s);
 
@@ -485,6 +615,7 @@ COMMAND EXECUTION
 
 typedef struct cmd_function_s {
 	struct cmd_function_s	*next;
+	struct cmd_function_s	*hashnext;
 	char					*name;
 	xcommand_t				function;
 } cmd_function_t;
@@ -495,7 +626,32 @@ static	char		*cmd_argv[MAX_STRING_TOKENS];
 static	char		*cmd_null_string = "";
 static	char		cmd_args[MAX_STRING_CHARS];
 
+// argv strings are packed in here rather than allocated, and live until the next tokenize
+static	char		cmd_tokens[MAX_STRING_CHARS + MAX_STRING_TOKENS];
+
 static	cmd_function_t	*cmd_functions;		// possible commands to execute
+static	cmd_function_t	*cmd_functionhash[CMD_HASH_SIZE];
+
+
+/*
+============
+Cmd_FindCommand
+
+exact is used for registration, otherwise the match is case-insensitive like execution always was
+============
+*/
+static cmd_function_t *Cmd_FindCommand (char *name, qboolean exact)
+{
+	cmd_function_t	*cmd;
+
+	for (cmd = cmd_functionhash[Cmd_HashName (name)]; cmd; cmd = cmd->hashnext)
+	{
+		if (exact ? !strcmp (name, cmd->name) : !Q_strcasecmp (name, cmd->name))
+			return cmd;
+	}
+
+	return NULL;
+}
 
 /*
 ============
@@ -617,13 +773,10 @@ $Cvars will be expanded unless they are in a quoted token
 */
 void Cmd_TokenizeString (char *text, qboolean macroExpand)
 {
-	int		i;
 	char	*com_token;
+	int		tokenlen = 0;
 
 	// clear the args from the last string
-	for (i = 0; i < cmd_argc; i++)
-		Zone_Free (cmd_argv[i]);
-
 	cmd_argc = 0;
 	cmd_args[0] = 0;
 
@@ -656,7 +809,8 @@ void Cmd_TokenizeString (char *text, qboolean macroExpand)
 		{
 			int		l;
 
-			strcpy (cmd_args, text);
+			strncpy (cmd_args, text, sizeof (cmd_args) - 1);
+			cmd_args[sizeof (cmd_args) - 1] = 0;
 
 			// strip off any trailing whitespace
 			l = strlen (cmd_args) - 1;
@@ -673,8 +827,14 @@ void Cmd_TokenizeString (char *text, qboolean macroExpand)
 
 		if (cmd_argc < MAX_STRING_TOKENS)
 		{
-			cmd_argv[cmd_argc] = Zone_Alloc (strlen (com_token) + 1);
-			strcpy (cmd_argv[cmd_argc], com_token);
+			int len = strlen (com_token) + 1;
+
+			// unexpanded text from the network isn't bounded by MAX_STRING_CHARS, so drop what won't fit
+			if (tokenlen + len > sizeof (cmd_tokens))
+				return;
+
+			cmd_argv[cmd_argc] = memcpy (cmd_tokens + tokenlen, com_token, len);
+			tokenlen += len;
 			cmd_argc++;
 		}
 	}
@@ -690,6 +850,7 @@ Cmd_AddCommand
 void Cmd_AddCommand (char *cmd_name, xcommand_t function)
 {
 	cmd_function_t	*cmd;
+	unsigned		hash;
 
 	// fail if the command is a variable name
 	if (Cvar_VariableString (cmd_name)[0])
@@ -699,13 +860,10 @@ void Cmd_AddCommand (char *cmd_name, xcommand_t function)
 	}
 
 	// fail if the command already exists
-	for (cmd = cmd_functions; cmd; cmd = cmd->next)
+	if (Cmd_FindCommand (cmd_name, true))
 	{
-		if (!strcmp (cmd_name, cmd->name))
-		{
-			Com_Printf ("Cmd_AddCommand: %s already defined\n", cmd_name);
-			return;
-		}
+		Com_Printf ("Cmd_AddCommand: %s already defined\n", cmd_name);
+		return;
 	}
 
 	cmd = Zone_Alloc (sizeof (cmd_function_t));
@@ -713,6 +871,10 @@ void Cmd_AddCommand (char *cmd_name, xcommand_t function)
 	cmd->function = function;
 	cmd->next = cmd_functions;
 	cmd_functions = cmd;
+
+	hash = Cmd_HashName (cmd_name);
+	cmd->hashnext = cmd_functionhash[hash];
+	cmd_functionhash[hash] = cmd;
 }
 
 /*
@@ -738,6 +900,13 @@ void Cmd_RemoveCommand (char *cmd_name)
 
 		if (!strcmp (cmd_name, cmd->name))
 		{
+			cmd_function_t **hashback = &cmd_functionhash[Cmd_HashName (cmd_name)];
+
+			// unlink from the hash chain too
+			while (*hashback != cmd)
+				hashback = &(*hashback)->hashnext;
+
+			*hashback = cmd->hashnext;
 			*back = cmd->next;
 			Zone_Free (cmd);
 			return;
@@ -754,15 +923,7 @@ Cmd_Exists
 */
 qboolean	Cmd_Exists (char *cmd_name)
 {
-	cmd_function_t	*cmd;
-
-	for (cmd = cmd_functions; cmd; cmd = cmd->next)
-	{
-		if (!strcmp (cmd_name, cmd->name))
-			return true;
-	}
-
-	return false;
+	return Cmd_FindCommand (cmd_name, true) ? true : false;
 }
 
 
@@ -784,12 +945,10 @@ char *Cmd_CompleteCommand (char *partial)
 		return NULL;
 
 	// check for exact match
-	for (cmd = cmd_functions; cmd; cmd = cmd->next)
-		if (!strcmp (partial, cmd->name))
-			return cmd->name;
-	for (a = cmd_alias; a; a = a->next)
-		if (!strcmp (partial, a->name))
-			return a->name;
+	if ((cmd = Cmd_FindCommand (partial, true)) != NULL)
+		return cmd->name;
+	if ((a = Cmd_FindAlias (partial, true)) != NULL)
+		return a->name;
 
 	// check for partial match
 	for (cmd = cmd_functions; cmd; cmd = cmd->next)
@@ -808,7 +967,7 @@ char *Cmd_CompleteCommand (char *partial)
 Cmd_ExecuteString
 
 A complete command line has been parsed, so try to execute it
-FIXME: lookupnoadd the token to speed search?
+Commands take precedence over aliases, which take precedence over cvars
 ============
 */
 void Cmd_ExecuteString (char *text)
@@ -823,34 +982,28 @@ void Cmd_ExecuteString (char *text)
 		return;		// no tokens
 
 	// check functions
-	for (cmd = cmd_functions; cmd; cmd = cmd->next)
+	if ((cmd = Cmd_FindCommand (cmd_argv[0], false)) != NULL)
 	{
-		if (!Q_strcasecmp (cmd_argv[0], cmd->name))
+		if (!cmd->function)
 		{
-			if (!cmd->function)
-			{
-				// forward to server command
-				Cmd_ExecuteString (va ("cmd %s", text));
-			}
-			else
-				cmd->function ();
-			return;
+			// forward to server command
+			Cmd_ExecuteString (va ("cmd %s", text));
 		}
+		else
+			cmd->function ();
+		return;
 	}
 
 	// check alias
-	for (a = cmd_alias; a; a = a->next)
+	if ((a = Cmd_FindAlias (cmd_argv[0], false)) != NULL)
 	{
-		if (!Q_strcasecmp (cmd_argv[0], a->name))
+		if (++alias_count == ALIAS_LOOP_COUNT)
 		{
-			if (++alias_count == ALIAS_LOOP_COUNT)
-			{
-				Com_Printf ("ALIAS_LOOP_COUNT\n");
-				return;
-			}
-			Cbuf_InsertText (a->value);
+			Com_Printf ("ALIAS_LOOP_COUNT\n");
 			return;
 		}
+		Cbuf_InsertText (a->value);
+		return;
 	}
 
 	// check cvars
@@ -877,6 +1030,110 @@ void Cmd_List_f (void)
 	Com_Printf ("%i commands\n", i);
 }
 
+/*
+============
+Cmd_Bench_f
+
+Pushes a generated config through the command buffer in the same way as exec and times it.
+Lines mix a registered command (in two spellings) with no-op sets of real cvars by name, which
+have to miss the command and alias tables before they're found.
+============
+*/
+static int cmd_benchcount;
+
+static void Cmd_BenchNop_f (void)
+{
+	cmd_benchcount++;
+}
+
+static void Cmd_Bench_f (void)
+{
+	int		numlines = (Cmd_Argc () > 1) ? atoi (Cmd_Argv (1)) : 10000;
+	cvar_t	*vars[256];
+	int		numvars = 0;
+	cvar_t	*var;
+	char	*script, *saved, *p;
+	int		scriptlen, savedlen, i;
+	double	starttime, endtime;
+
+	if (numlines < 1)
+	{
+		Com_Printf ("usage: cmdbench [lines]\n");
+		return;
+	}
+
+	// pick cvars that can be set to their own value without noise or side effects
+	for (var = cvar_vars; var && numvars < 256; var = var->next)
+	{
+		if (var->flags & CVAR_NOSET) continue;
+		if (strlen (var->name) + strlen (var->string) > 64) continue;
+		if (strpbrk (var->string, "\";$\n")) continue;
+
+		vars[numvars++] = var;
+	}
+
+	// build the script
+	script = Zone_Alloc (numlines * 80 + 1);
+
+	for (i = 0, p = script; i < numlines; i++)
+	{
+		switch (i & 3)
+		{
+		case 0: strcpy (p, "cmdbench_nop\n"); break;
+		case 1: strcpy (p, "CmdBench_Nop arg1 \"arg 2\"\n"); break;
+		default:
+			if (numvars)
+			{
+				var = vars[(i >> 1) % numvars];
+				sprintf (p, "%s \"%s\"\n", var->name, var->string);
+			}
+			else strcpy (p, "cmdbench_nop\n");
+			break;
+		}
+
+		p += strlen (p);
+	}
+
+	scriptlen = p - script;
+
+	// the rest of the line that ran us is still in the buffer; take it out for the duration
+	if ((savedlen = cbuf_end - cbuf_start) != 0)
+	{
+		saved = Zone_Alloc (savedlen);
+		memcpy (saved, cbuf_data + cbuf_start, savedlen);
+	}
+	else saved = NULL;
+
+	cbuf_start = cbuf_end = 0;
+
+	Cmd_AddCommand ("cmdbench_nop", Cmd_BenchNop_f);
+	cmd_benchcount = 0;
+
+	starttime = Sys_FloatTime ();
+
+	Cbuf_Insert (script, scriptlen);
+	Cbuf_Execute ();
+
+	endtime = Sys_FloatTime ();
+
+	Cmd_RemoveCommand ("cmdbench_nop");
+
+	cbuf_start = cbuf_end = 0;
+
+	if (saved)
+	{
+		Cbuf_Append (saved, savedlen);
+		Zone_Free (saved);
+	}
+
+	Zone_Free (script);
+
+	Com_Printf ("cmdbench: %i lines (%i commands, %i cvars) in %.3f ms, %.3f us per line\n",
+		numlines, cmd_benchcount, numlines - cmd_benchcount, (endtime - starttime) * 1000.0,
+		(endtime - starttime) * 1000000.0 / numlines);
+}
+
+
 /*
 ============
 Cmd_Init
@@ -890,5 +1147,6 @@ void Cmd_Init (void)
 	Cmd_AddCommand ("echo", Cmd_Echo_f);
 	Cmd_AddCommand ("alias", Cmd_Alias_f);
 	Cmd_AddCommand ("wait", Cmd_Wait_f);
+	Cmd_AddCommand ("cmdbench", Cmd_Bench_f);
 }
 
@@ -38,8 +38,6 @@ cvar_t	*timescale;
 cvar_t	*fixedtime;
 cvar_t	*logfile_active;	// 1 = buffer log, 2 = flush after each print
 
-FILE	*logfile;
-
 int			server_state;
 
 /*
@@ -77,6 +75,226 @@ void Com_EndRedirect (void)
 	rd_flush = NULL;
 }
 
+/*
+============================================================================
+
+LOG FILE
+
+Com_Printf only runs on the main thread, so the log is a single-producer ring: the main
+thread copies text in and advances log_head, and a writer thread drains everything up to
+it in one write and advances log_tail.  Neither side takes a lock; each index is only ever
+written by one thread and the text is in place before log_head moves past it.  The writer
+is woken when the ring is half full, and otherwise picks up whatever has built up every
+LOG_WRITEMSEC.  logfile 2 is there for crashes, so with it every print waits until the writer
+has flushed it.  When the file passes logfile_maxsize kb it's rotated to qconsole.1.log and a
+new one is started.  Once the writer is running the FILE is its alone.
+
+============================================================================
+*/
+
+#define	LOG_RINGSIZE	0x40000
+#define	LOG_WRITEMSEC	250
+
+cvar_t	*logfile_maxsize;
+
+static char		log_ring[LOG_RINGSIZE];
+static volatile unsigned	log_head;		// written by the main thread only
+static volatile unsigned	log_tail;		// written by the writer thread only
+static volatile unsigned	log_synced;		// log_head as of the writer's last write and flush
+
+static FILE		*logfile;				// only touched by the writer while there is one
+static qboolean	log_open;				// the main thread's view of it
+static char		log_path[MAX_OSPATH];
+static int		log_written;
+static int		log_maxsize;
+static qboolean	log_flush;				// flush after every batch
+
+static void		*log_thread;
+static void		*log_queued;			// wakes the writer
+static void		*log_drained;			// raised by the writer after every batch
+static volatile qboolean	log_shutdown;
+
+
+static void Com_RotateLog (void)
+{
+	char	oldpath[MAX_OSPATH];
+
+	fclose (logfile);
+
+	Com_sprintf (oldpath, sizeof (oldpath), "%s", log_path);
+	strcpy (strrchr (oldpath, '.'), ".1.log");
+
+	remove (oldpath);
+	rename (log_path, oldpath);
+
+	logfile = fopen (log_path, "w");
+	log_written = 0;
+}
+
+
+static void Com_DrainLog (void)
+{
+	unsigned head = log_head;
+
+	while (log_tail != head)
+	{
+		unsigned start = log_tail & (LOG_RINGSIZE - 1);
+		unsigned len = head - log_tail;
+
+		// the wrap point splits a batch into two writes
+		if (start + len > LOG_RINGSIZE)
+			len = LOG_RINGSIZE - start;
+
+		if (logfile)
+		{
+			fwrite (log_ring + start, 1, len, logfile);
+			log_written += len;
+		}
+
+		log_tail += len;
+	}
+
+	if (logfile && log_flush)
+		fflush (logfile);
+
+	log_synced = head;
+
+	if (logfile && log_maxsize > 0 && log_written >= log_maxsize)
+		Com_RotateLog ();
+}
+
+
+static unsigned Com_LogThread (void *param)
+{
+	while (!log_shutdown)
+	{
+		Sys_WaitSignal (log_queued, LOG_WRITEMSEC);
+		Com_DrainLog ();
+		Sys_RaiseSignal (log_drained);
+	}
+
+	// pick up anything printed before the shutdown
+	Com_DrainLog ();
+
+	return 0;
+}
+
+
+/*
+=============
+Com_LogPrint
+
+Queues text for the log file, opening it on first use
+=============
+*/
+static void Com_LogPrint (char *msg)
+{
+	int		len = strlen (msg);
+
+	if (!log_path[0])
+	{
+		Com_sprintf (log_path, sizeof (log_path), "%s/qconsole.log", FS_Gamedir ());
+
+		if ((logfile = fopen (log_path, "w")) == NULL)
+			return;
+
+		log_open = true;
+		log_queued = Sys_CreateSignal ();
+		log_drained = Sys_CreateSignal ();
+		log_thread = Sys_CreateThread (Com_LogThread, NULL);
+	}
+
+	if (!log_open)
+		return;
+
+	// these are read by the writer so they only change between prints
+	log_flush = (logfile_active->value > 1);
+	log_maxsize = logfile_maxsize->value * 1024;
+
+	while (len > 0)
+	{
+		unsigned head = log_head;
+		unsigned space = LOG_RINGSIZE - (head - log_tail);
+		unsigned start = head & (LOG_RINGSIZE - 1);
+		unsigned copy = len;
+
+		if (!space)
+		{
+			if (!log_thread)
+			{
+				// no writer thread so drain it ourselves
+				Com_DrainLog ();
+				continue;
+			}
+
+			// back-pressure; wait for the writer to make room
+			Sys_RaiseSignal (log_queued);
+			Sys_WaitSignal (log_drained, LOG_WRITEMSEC);
+			continue;
+		}
+
+		if (copy > space) copy = space;
+		if (start + copy > LOG_RINGSIZE) copy = LOG_RINGSIZE - start;
+
+		memcpy (log_ring + start, msg, copy);
+
+		// publish the text only after it's in place
+		Sys_WriteBarrier ();
+		log_head = head + copy;
+
+		msg += copy;
+		len -= copy;
+	}
+
+	if (!log_thread)
+	{
+		if (log_flush || log_head - log_tail >= LOG_RINGSIZE / 2)
+			Com_DrainLog ();
+	}
+	else if (log_flush)
+	{
+		// the print mustn't return until it's on disk, or the last lines before a crash are lost
+		while (log_synced != log_head)
+		{
+			Sys_RaiseSignal (log_queued);
+			Sys_WaitSignal (log_drained, LOG_WRITEMSEC);
+		}
+	}
+	else if (log_head - log_tail >= LOG_RINGSIZE / 2)
+		Sys_RaiseSignal (log_queued);
+}
+
+
+/*
+=============
+Com_CloseLog
+
+Writes out everything that's been queued and closes the log
+=============
+*/
+static void Com_CloseLog (void)
+{
+	if (log_thread)
+	{
+		log_shutdown = true;
+		Sys_RaiseSignal (log_queued);
+		Sys_WaitThread (log_thread);
+		log_thread = NULL;
+	}
+	else if (log_open)
+		Com_DrainLog ();
+
+	// the writer is gone so the file is ours again
+	if (logfile)
+	{
+		fclose (logfile);
+		logfile = NULL;
+	}
+
+	log_open = false;
+}
+
+
 /*
 =============
 Com_Printf
@@ -90,6 +308,10 @@ void Com_Printf (char *fmt, ...)
 	va_list		argptr;
 	char		msg[MAXPRINTMSG];
 
+	// the console and redirect buffers belong to the main thread so output from workers is discarded
+	if (!Sys_IsMainThread ())
+		return;
+
 	va_start (argptr, fmt);
 	vsprintf (msg, fmt, argptr);
 	va_end (argptr);
@@ -109,19 +331,7 @@ void Com_Printf (char *fmt, ...)
 
 	// logfile
 	if (logfile_active && logfile_active->value)
-	{
-		char	name[MAX_QPATH];
-
-		if (!logfile)
-		{
-			Com_sprintf (name, sizeof (name), "%s/qconsole.log", FS_Gamedir ());
-			logfile = fopen (name, "w");
-		}
-		if (logfile)
-			fprintf (logfile, "%s", msg);
-		if (logfile_active->value > 1)
-			fflush (logfile);		// force it to save every time
-	}
+		Com_LogPrint (msg);
 }
 
 
@@ -190,11 +400,7 @@ void Com_Error (int code, char *fmt, ...)
 		CL_Shutdown ();
 	}
 
-	if (logfile)
-	{
-		fclose (logfile);
-		logfile = NULL;
-	}
+	Com_CloseLog ();
 
 	Sys_Error ("%s", msg);
 }
@@ -213,11 +419,7 @@ void Com_Quit (void)
 	SV_Shutdown ("Server quit\n", false);
 	CL_Shutdown ();
 
-	if (logfile)
-	{
-		fclose (logfile);
-		logfile = NULL;
-	}
+	Com_CloseLog ();
 
 	Sys_Quit ();
 }
@@ -1302,6 +1504,9 @@ void Qcommon_Init (int argc, char **argv)
 	timescale = Cvar_Get ("timescale", "1", CVAR_CHEAT, NULL);
 	fixedtime = Cvar_Get ("fixedtime", "0", CVAR_CHEAT, NULL);
 	logfile_active = Cvar_Get ("logfile", "0", 0, NULL);
+	logfile_maxsize = Cvar_Get ("logfile_maxsize", "4096", CVAR_ARCHIVE, NULL);
+
+	Mem_Init ();
 
 	s = va ("%4.2f %s %s %s", VERSION, CPUSTRING, __DATE__, BUILDSTRING);
 	Cvar_Get ("version", s, CVAR_SERVERINFO | CVAR_NOSET, NULL);
@@ -1354,6 +1559,8 @@ void Qcommon_Frame (int msec)
 
 	SV_Frame (msec);
 	CL_Frame (msec);
+
+	Mem_Frame ();
 }
 
 /*
@@ -126,6 +126,144 @@ void Con_ToggleChat_f (void)
 	Con_ClearNotify ();
 }
 
+/*
+================
+Con_WrapLine
+
+Finds where a line breaks into rows at the current console width; a word that would fit on a
+row of its own but not in the rest of this one moves down to the next.  Returns the number of
+rows, which is never more than maxrows.
+================
+*/
+#define	CON_CHAR(ofs)	con.text[(ofs) & (CON_TEXTSIZE - 1)]
+#define	CON_LINE(n)		(&con.lines[(n) & (CON_NUMLINES - 1)])
+#define	CON_MAXROWS		128
+
+static int Con_WrapLine (conline_t *line, int *rowstarts, int maxrows)
+{
+	int		i, l, x = 0, rows = 1;
+
+	rowstarts[0] = 0;
+
+	for (i = 0; i < line->length; i++)
+	{
+		qboolean newrow = false;
+
+		if (x >= con.linewidth)
+			newrow = true;
+		else if (x && (CON_CHAR (line->start + i) & 127) > ' ' && (CON_CHAR (line->start + i - 1) & 127) <= ' ')
+		{
+			// count word length
+			for (l = 1; i + l < line->length && l < con.linewidth; l++)
+				if ((CON_CHAR (line->start + i + l) & 127) <= ' ')
+					break;
+
+			if (l != con.linewidth && x + l > con.linewidth)
+				newrow = true;
+		}
+
+		if (newrow)
+		{
+			if (rows == maxrows)
+				break;
+
+			rowstarts[rows++] = i;
+			x = 0;
+		}
+
+		x++;
+	}
+
+	return rows;
+}
+
+
+static int Con_LineRows (int n)
+{
+	int		rowstarts[CON_MAXROWS];
+
+	return Con_WrapLine (CON_LINE (n), rowstarts, CON_MAXROWS);
+}
+
+
+/*
+================
+Con_DrawRow
+================
+*/
+static void Con_DrawRow (conline_t *line, int *rowstarts, int numrows, int row, int y)
+{
+	int		x;
+	int		start = rowstarts[row];
+	int		end = (row + 1 < numrows) ? rowstarts[row + 1] : line->length;
+
+	if (end - start > con.linewidth)
+		end = start + con.linewidth;
+
+	for (x = 0; x < end - start; x++)
+		re.DrawChar ((x + 1) << 3, y, CON_CHAR (line->start + start + x));
+}
+
+
+/*
+================
+Con_Scroll
+
+Moves the bottom of the console display back through the scrollback by the given number of
+wrapped rows, or forward if it's negative
+================
+*/
+void Con_Scroll (int rows)
+{
+	int		numrows = Con_LineRows (con.display);
+
+	// a resize can leave it past the top of its line
+	if (con.displayrow >= numrows)
+		con.displayrow = numrows - 1;
+
+	for (; rows > 0; rows--)
+	{
+		if (con.displayrow + 1 < numrows)
+			con.displayrow++;
+		else if (con.display > con.firstline)
+		{
+			con.display--;
+			con.displayrow = 0;
+			numrows = Con_LineRows (con.display);
+		}
+		else break;
+	}
+
+	for (; rows < 0; rows++)
+	{
+		if (con.displayrow > 0)
+			con.displayrow--;
+		else if (con.display < con.current)
+		{
+			con.display++;
+			con.displayrow = Con_LineRows (con.display) - 1;
+		}
+		else break;
+	}
+}
+
+
+void Con_ScrollHome (void)
+{
+	con.display = con.firstline;
+	con.displayrow = Con_LineRows (con.display) - 1;
+
+	Con_Scroll (-10);
+}
+
+
+void Con_ScrollEnd (void)
+{
+	con.display = con.current;
+	con.displayrow = 0;
+}
+
+
 /*
 ================
 Con_Clear_f
@@ -133,7 +271,20 @@ Con_Clear_f
 */
 void Con_Clear_f (void)
 {
-	memset (con.text, ' ', CON_TEXTSIZE);
+	conline_t	*line;
+
+	// start a fresh line and forget everything before it
+	con.current++;
+	con.firstline = con.current;
+	con.notifyline = con.current;
+	con.linefeed = con.cr = false;
+
+	line = CON_LINE (con.current);
+	line->start = con.textend;
+	line->length = 0;
+	line->time = 0;
+
+	Con_ScrollEnd ();
 }
 
 
@@ -147,9 +298,10 @@ Save the console contents out to a file
 void Con_Dump_f (void)
 {
 	int		l, x;
-	char	*line;
+	conline_t	*line;
+	qboolean	started = false;
 	FILE	*f;
-	char	buffer[1024];
+	char	buffer[CON_MAXLINE + 1];
 	char	name[MAX_OSPATH];
 
 	if (Cmd_Argc () != 2)
@@ -169,32 +321,23 @@ void Con_Dump_f (void)
 		return;
 	}
 
-	// skip empty lines
-	for (l = con.current - con.totallines + 1; l <= con.current; l++)
+	// lines are written unwrapped
+	for (l = con.firstline; l <= con.current; l++)
 	{
-		line = con.text + (l % con.totallines) * con.linewidth;
-		for (x = 0; x < con.linewidth; x++)
-			if (line[x] != ' ')
-				break;
-		if (x != con.linewidth)
-			break;
-	}
+		line = CON_LINE (l);
 
-	// write the remaining lines
-	buffer[con.linewidth] = 0;
-	for (; l <= con.current; l++)
-	{
-		line = con.text + (l % con.totallines) * con.linewidth;
-		strncpy (buffer, line, con.linewidth);
-		for (x = con.linewidth - 1; x >= 0; x--)
-		{
-			if (buffer[x] == ' ')
-				buffer[x] = 0;
-			else
-				break;
-		}
-		for (x = 0; buffer[x]; x++)
-			buffer[x] &= 0x7f;
+		for (x = 0; x < line->length; x++)
+			buffer[x] = CON_CHAR (line->start + x) & 127;
+
+		// strip trailing whitespace
+		for (; x > 0 && buffer[x - 1] == ' '; x--);
+		buffer[x] = 0;
+
+		// skip empty lines at the start
+		if (!x && !started)
+			continue;
+
+		started = true;
 
 		fprintf (f, "%s\n", buffer);
 	}
@@ -210,10 +353,7 @@ Con_ClearNotify
 */
 void Con_ClearNotify (void)
 {
-	int		i;
-
-	for (i = 0; i < NUM_CON_TIMES; i++)
-		con.times[i] = 0;
+	con.notifyline = con.current + 1;
 }
 
 
@@ -243,60 +383,17 @@ void Con_MessageMode2_f (void)
 ================
 Con_CheckResize
 
-If the line width has changed, reformat the buffer.
+The text is wrapped as it's drawn so there's nothing to reformat when the width changes.
 ================
 */
 void Con_CheckResize (void)
 {
-	int		i, j, width, oldwidth, oldtotallines, numlines, numchars;
-	char	tbuf[CON_TEXTSIZE];
-
-	width = (viddef.conwidth >> 3) - 2;
-
-	if (width == con.linewidth)
-		return;
+	int		width = (viddef.conwidth >> 3) - 2;
 
 	if (width < 1)			// video hasn't been initialized yet
-	{
 		width = (640 >> 3) - 2;
-		con.linewidth = width;
-		con.totallines = CON_TEXTSIZE / con.linewidth;
-		memset (con.text, ' ', CON_TEXTSIZE);
-	}
-	else
-	{
-		oldwidth = con.linewidth;
-		con.linewidth = width;
-		oldtotallines = con.totallines;
-		con.totallines = CON_TEXTSIZE / con.linewidth;
-		numlines = oldtotallines;
-
-		if (con.totallines < numlines)
-			numlines = con.totallines;
-
-		numchars = oldwidth;
-
-		if (con.linewidth < numchars)
-			numchars = con.linewidth;
-
-		memcpy (tbuf, con.text, CON_TEXTSIZE);
-		memset (con.text, ' ', CON_TEXTSIZE);
-
-		for (i = 0; i < numlines; i++)
-		{
-			for (j = 0; j < numchars; j++)
-			{
-				con.text[(con.totallines - 1 - i) * con.linewidth + j] =
-					tbuf[((con.current - i + oldtotallines) %
-					oldtotallines) * oldwidth + j];
-			}
-		}
-
-		Con_ClearNotify ();
-	}
 
-	con.current = con.totallines - 1;
-	con.display = con.current;
+	con.linewidth = width;
 }
 
 
@@ -307,8 +404,6 @@ Con_Init
 */
 void Con_Init (void)
 {
-	con.linewidth = -1;
-
 	Con_CheckResize ();
 
 	Com_Printf ("Console initialized.\n");
@@ -332,15 +427,27 @@ void Con_Init (void)
 Con_Linefeed
 ===============
 */
-void Con_Linefeed (void)
+static void Con_Linefeed (void)
 {
-	con.x = 0;
-
-	if (con.display == con.current)
-		con.display++;
+	conline_t	*line;
+	qboolean	follow = (con.display == con.current && !con.displayrow);
 
 	con.current++;
-	memset (&con.text[(con.current % con.totallines) * con.linewidth], ' ', con.linewidth);
+
+	if (con.current - con.firstline >= CON_NUMLINES)
+		con.firstline = con.current - CON_NUMLINES + 1;
+
+	line = CON_LINE (con.current);
+	line->start = con.textend;
+	line->length = 0;
+
+	// mark time for transparent overlay
+	line->time = cls.realtime;
+
+	if (follow)
+		con.display = con.current;
+	else if (con.display < con.firstline)
+		Con_ScrollHome ();
 }
 
 
@@ -348,17 +455,16 @@ void Con_Linefeed (void)
 ================
 Con_Print
 
-Handles cursor positioning, line wrapping, etc
+Handles line breaks and carriage returns; wrapping is left until the text is drawn
 All console printing must go through this in order to be logged to disk
 If no console is visible, the text will appear at the top of the game window
 ================
 */
 void Con_Print (char *txt)
 {
-	int		y;
-	int		c, l;
-	static int	cr;
+	int		c;
 	int		mask;
+	conline_t	*line = CON_LINE (con.current);
 
 	if (!con.initialized)
 		return;
@@ -371,55 +477,50 @@ void Con_Print (char *txt)
 	else
 		mask = 0;
 
-	while ((c = *txt))
+	while ((c = *txt++))
 	{
-		// count word length
-		for (l = 0; l< con.linewidth; l++)
-			if (txt[l] <= ' ')
-				break;
-
-		// word wrap
-		if (l != con.linewidth && (con.x + l > con.linewidth))
-			con.x = 0;
+		if (c == '\n')
+		{
+			// a blank line needs its own entry
+			if (con.linefeed)
+				Con_Linefeed ();
 
-		txt++;
+			con.linefeed = true;
+			con.cr = false;
+			continue;
+		}
 
-		if (cr)
+		if (c == '\r')
 		{
-			con.current--;
-			cr = false;
+			con.cr = true;
+			continue;
 		}
 
-
-		if (!con.x)
+		if (con.linefeed || line->length >= CON_MAXLINE)
 		{
 			Con_Linefeed ();
-			// mark time for transparent overlay
-			if (con.current >= 0)
-				con.times[con.current % NUM_CON_TIMES] = cls.realtime;
+			line = CON_LINE (con.current);
+			con.linefeed = con.cr = false;
 		}
-
-		switch (c)
+		else if (con.cr)
 		{
-		case '\n':
-			con.x = 0;
-			break;
-
-		case '\r':
-			con.x = 0;
-			cr = 1;
-			break;
-
-		default:	// display character and advance
-			y = con.current % con.totallines;
-			con.text[y * con.linewidth + con.x] = c | mask | con.ormask;
-			con.x++;
-			if (con.x >= con.linewidth)
-				con.x = 0;
-			break;
+			// overwrite the current line
+			line->start = con.textend;
+			line->length = 0;
+			con.cr = false;
 		}
 
+		con.text[con.textend & (CON_TEXTSIZE - 1)] = c | mask | con.ormask;
+		con.textend++;
+		line->length++;
+
+		// drop the oldest lines as their text is overwritten
+		while (con.textend - CON_LINE (con.firstline)->start > CON_TEXTSIZE)
+			con.firstline++;
 	}
+
+	if (con.display < con.firstline)
+		Con_ScrollHome ();
 }
 
 
@@ -506,31 +607,48 @@ Draws the last few lines of output transparently over the game top
 void Con_DrawNotify (void)
 {
 	int		x, v;
-	char	*text;
-	int		i;
+	int		i, j, r;
 	int		time;
 	char	*s;
 	int		skip;
+	int		rowstarts[NUM_CON_TIMES][CON_MAXROWS];
+	int		numrows[NUM_CON_TIMES];
+	int		notifylines[NUM_CON_TIMES];
+	int		notifyrows[NUM_CON_TIMES];
+	int		count = 0, total = 0;
 
 	v = 0;
 
-	for (i = con.current - NUM_CON_TIMES + 1; i <= con.current; i++)
+	// gather the most recent lines that are still showing, enough to fill NUM_CON_TIMES rows
+	for (i = con.current; i >= con.firstline && i >= con.notifyline && total < NUM_CON_TIMES; i--)
 	{
-		if (i < 0)
-			continue;
-		time = con.times[i % NUM_CON_TIMES];
-		if (time == 0)
+		conline_t *line = CON_LINE (i);
+
+		if (line->time == 0)
 			continue;
-		time = cls.realtime - time;
+
+		time = cls.realtime - line->time;
+
 		if (time > con_notifytime->value * 1000)
-			continue;
+			break;		// everything before it is older
 
-		text = con.text + (i % con.totallines) * con.linewidth;
+		numrows[count] = Con_WrapLine (line, rowstarts[count], CON_MAXROWS);
+		notifylines[count] = i;
 
-		for (x = 0; x < con.linewidth; x++)
-			re.DrawChar ((x + 1) << 3, v, text[x]);
+		// only the bottom rows of a line if it won't all fit
+		if (numrows[count] > NUM_CON_TIMES - total)
+			notifyrows[count] = NUM_CON_TIMES - total;
+		else notifyrows[count] = numrows[count];
 
-		v += 8;
+		total += notifyrows[count];
+		count++;
+	}
+
+	// and draw them oldest first
+	for (j = count - 1; j >= 0; j--)
+	{
+		for (r = numrows[j] - notifyrows[j]; r < numrows[j]; r++, v += 8)
+			Con_DrawRow (CON_LINE (notifylines[j]), rowstarts[j], numrows[j], r, v);
 	}
 
 	if (cls.key_dest == key_message)
@@ -577,7 +695,9 @@ void Con_DrawConsole (float frac, int alpha)
 	int				i, j, x, y, n;
 	int				rows;
 	char			*text;
-	int				row;
+	int				row, line;
+	int				rowstarts[CON_MAXROWS];
+	int				numrows;
 	char			dlbar[1024];
 
 	int lines = viddef.conheight * frac;
@@ -612,7 +732,7 @@ void Con_DrawConsole (float frac, int alpha)
 #endif
 
 	// draw from the bottom up
-	if (con.display != con.current)
+	if (con.display != con.current || con.displayrow)
 	{
 		// draw arrows to show the buffer is backscrolled
 		for (x = 0; x < con.linewidth; x += 4)
@@ -622,19 +742,25 @@ void Con_DrawConsole (float frac, int alpha)
 		rows--;
 	}
 
-	row = con.display;
+	line = con.display;
+	numrows = Con_WrapLine (CON_LINE (line), rowstarts, CON_MAXROWS);
 
+	if ((row = numrows - 1 - con.displayrow) < 0)
+		row = 0;
+
+	// only the rows on screen are wrapped
 	for (i = 0; i < rows; i++, y -= 8, row--)
 	{
 		if (row < 0)
-			break;
-		if (con.current - row >= con.totallines)
-			break;		// past scrollback wrap point
+		{
+			if (--line < con.firstline)
+				break;
 
-		text = con.text + (row % con.totallines) * con.linewidth;
+			numrows = Con_WrapLine (CON_LINE (line), rowstarts, CON_MAXROWS);
+			row = numrows - 1;
+		}
 
-		for (x = 0; x < con.linewidth; x++)
-			re.DrawChar ((x + 1) << 3, y, text[x]);
+		Con_DrawRow (CON_LINE (line), rowstarts, numrows, row, y);
 	}
 
 	//ZOID
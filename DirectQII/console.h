@@ -24,26 +24,42 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #define	NUM_CON_TIMES 4
 
-#define		CON_TEXTSIZE	32768
+// the scrollback is kept as unwrapped text with a line index and wrapped to the current width
+// when drawn, so printing never re-lays anything out and a resize doesn't lose history
+#define		CON_TEXTSIZE	0x80000		// must be a power of 2
+#define		CON_NUMLINES	0x4000		// must be a power of 2
+#define		CON_MAXLINE		4096		// longer lines are broken up when printed
+
+typedef struct conline_s {
+	int		start;			// offset of the first character in the text ring
+	int		length;
+	int		time;			// cls.realtime time the line was generated for transparent notify lines
+} conline_t;
 
 typedef struct console_s {
 	qboolean	initialized;
 
 	char	text[CON_TEXTSIZE];
+	int		textend;		// ever-increasing; text[textend & (CON_TEXTSIZE - 1)] is where the next character goes
+
+	conline_t	lines[CON_NUMLINES];
+	int		firstline;		// oldest line still held
 	int		current;		// line where next message will be printed
-	int		x;				// offset in current line for next print
-	int		display;		// bottom of console displays this line
+	qboolean	linefeed;	// a \n has been printed but the next line isn't started until there's more text
+	qboolean	cr;			// a \r has been printed so the next text replaces the current line
+
+	int		display;		// bottom of console displays this line...
+	int		displayrow;		// ...and this many wrapped rows up from its last one
+
+	int		notifyline;		// lines before this aren't shown in the notify area
 
 	int		ormask;			// high bit mask for colored characters
 
 	int 	linewidth;		// characters across screen
-	int		totallines;		// total lines in console scrollback
 
 	float	cursorspeed;
 
 	int		vislines;
-
-	float	times[NUM_CON_TIMES];	// cls.realtime time the line was generated for transparent notify lines
 } console_t;
 
 extern	console_t	con;
@@ -57,4 +73,7 @@ void Con_Clear_f (void);
 void Con_DrawNotify (void);
 void Con_ClearNotify (void);
 void Con_ToggleConsole_f (void);
+void Con_Scroll (int rows);
+void Con_ScrollHome (void);
+void Con_ScrollEnd (void);
 
@@ -23,6 +23,22 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 cvar_t	*cvar_vars;
 
+/*
+cvar_vars keeps registration order for cvarlist and Cvar_WriteVariables; every cvar is also
+linked into a hash chain so that name lookups from the console, Cvar_Get and the game dll don't
+walk the whole list.  The hash folds case so that the same key can be used for command dispatch,
+but matching stays exact as it always has been.
+*/
+#define	CVAR_HASH_SIZE	512
+
+static cvar_t	*cvar_hash[CVAR_HASH_SIZE];
+
+// the info strings are rebuilt only after a cvar carrying the matching flag changes
+static char		cvar_userinfo[MAX_INFO_STRING];
+static char		cvar_serverinfo[MAX_INFO_STRING];
+static qboolean	cvar_userinfo_dirty = true;
+static qboolean	cvar_serverinfo_dirty = true;
+
 /*
 ============
 Cvar_InfoValidate
@@ -36,6 +52,29 @@ static qboolean Cvar_InfoValidate (char *s)
 	return true;
 }
 
+/*
+============
+Cvar_HashName
+============
+*/
+static unsigned Cvar_HashName (char *name)
+{
+	unsigned hash = 2166136261u;
+
+	while (*name)
+	{
+		int c = *name++;
+
+		if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+
+		hash ^= (byte) c;
+		hash *= 16777619u;
+	}
+
+	return hash & (CVAR_HASH_SIZE - 1);
+}
+
+
 /*
 ============
 Cvar_FindVar
@@ -45,13 +84,27 @@ static cvar_t *Cvar_FindVar (char *var_name)
 {
 	cvar_t	*var;
 
-	for (var = cvar_vars; var; var = var->next)
+	for (var = cvar_hash[Cvar_HashName (var_name)]; var; var = var->hashnext)
 		if (!strcmp (var_name, var->name))
 			return var;
 
 	return NULL;
 }
 
+
+/*
+============
+Cvar_InfoChanged
+
+Marks the cached info strings stale if a cvar that feeds them (or used to) has changed
+============
+*/
+static void Cvar_InfoChanged (int flags)
+{
+	if (flags & CVAR_USERINFO) cvar_userinfo_dirty = true;
+	if (flags & CVAR_SERVERINFO) cvar_serverinfo_dirty = true;
+}
+
 /*
 ============
 Cvar_VariableValue
@@ -98,9 +151,8 @@ char *Cvar_CompleteVariable (char *partial)
 		return NULL;
 
 	// check exact match
-	for (cvar = cvar_vars; cvar; cvar = cvar->next)
-		if (!strcmp (partial, cvar->name))
-			return cvar->name;
+	if ((cvar = Cvar_FindVar (partial)) != NULL)
+		return cvar->name;
 
 	// check partial match
 	for (cvar = cvar_vars; cvar; cvar = cvar->next)
@@ -139,6 +191,7 @@ void Cvar_RegisterCheatVar (char *var_name, char *var_value);
 cvar_t *Cvar_Get (char *var_name, char *var_value, int flags, cvarcallback_t callback)
 {
 	cvar_t	*var;
+	unsigned	hash;
 
 	if (flags & (CVAR_USERINFO | CVAR_SERVERINFO))
 	{
@@ -157,6 +210,9 @@ cvar_t *Cvar_Get (char *var_name, char *var_value, int flags, cvarcallback_t cal
 		if ((flags & CVAR_CHEAT) && !(var->flags & CVAR_CHEAT))
 			Cvar_RegisterCheatVar (var_name, var_value);
 
+		// adding an info flag puts the var into that info string
+		Cvar_InfoChanged (flags & ~var->flags);
+
 		var->flags |= flags; // don't modify the callback
 		return var;
 	}
@@ -190,7 +246,12 @@ cvar_t *Cvar_Get (char *var_name, char *var_value, int flags, cvarcallback_t cal
 	var->next = cvar_vars;
 	cvar_vars = var;
 
+	hash = Cvar_HashName (var_name);
+	var->hashnext = cvar_hash[hash];
+	cvar_hash[hash] = var;
+
 	var->flags = flags;
+	Cvar_InfoChanged (flags);
 
 	return var;
 }
@@ -257,6 +318,7 @@ cvar_t *Cvar_Set2 (char *var_name, char *value, qboolean force)
 			{
 				var->string = CopyString (value);
 				var->value = atof (var->string);
+				Cvar_InfoChanged (var->flags);
 
 				if (!strcmp (var->name, "game"))
 				{
@@ -289,6 +351,7 @@ cvar_t *Cvar_Set2 (char *var_name, char *value, qboolean force)
 
 	var->string = CopyString (value);
 	var->value = atof (var->string);
+	Cvar_InfoChanged (var->flags);
 
 	// issue the callback with the new value set 
 	if (var->Callback)
@@ -341,6 +404,9 @@ cvar_t *Cvar_FullSet (char *var_name, char *value, int flags)
 
 	var->string = CopyString (value);
 	var->value = atof (var->string);
+
+	// the old flags may have put it in an info string that it's now leaving
+	Cvar_InfoChanged (var->flags | flags);
 	var->flags = flags;
 
 	return var;
@@ -384,6 +450,7 @@ void Cvar_GetLatchedVars (void)
 		var->string = var->latched_string;
 		var->latched_string = NULL;
 		var->value = atof (var->string);
+		Cvar_InfoChanged (var->flags);
 
 		if (!strcmp (var->name, "game"))
 		{
@@ -526,9 +593,8 @@ void Cvar_List_f (void)
 qboolean userinfo_modified;
 
 
-char *Cvar_BitInfo (int bit)
+static void Cvar_BitInfo (char *info, int bit)
 {
-	static char	info[MAX_INFO_STRING];
 	cvar_t	*var;
 
 	info[0] = 0;
@@ -536,20 +602,30 @@ char *Cvar_BitInfo (int bit)
 	for (var = cvar_vars; var; var = var->next)
 		if (var->flags & bit)
 			Info_SetValueForKey (info, var->name, var->string);
-
-	return info;
 }
 
 // returns an info string containing all the CVAR_USERINFO cvars
 char *Cvar_Userinfo (void)
 {
-	return Cvar_BitInfo (CVAR_USERINFO);
+	if (cvar_userinfo_dirty)
+	{
+		Cvar_BitInfo (cvar_userinfo, CVAR_USERINFO);
+		cvar_userinfo_dirty = false;
+	}
+
+	return cvar_userinfo;
 }
 
 // returns an info string containing all the CVAR_SERVERINFO cvars
 char *Cvar_Serverinfo (void)
 {
-	return Cvar_BitInfo (CVAR_SERVERINFO);
+	if (cvar_serverinfo_dirty)
+	{
+		Cvar_BitInfo (cvar_serverinfo, CVAR_SERVERINFO);
+		cvar_serverinfo_dirty = false;
+	}
+
+	return cvar_serverinfo;
 }
 
 
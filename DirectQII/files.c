@@ -19,6 +19,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "qcommon.h"
+#include <stdint.h>
+
+// only the zlib prototypes are needed; the implementation is compiled in r_image.c
+#include "stb_image.h"
 
 // define this to dissalow any data but the demo pak file
 //#define	NO_ADDONS
@@ -44,22 +48,82 @@ QUAKE FILESYSTEM
 // in memory
 //
 
+// zip compression methods we can handle
+#define ZIP_STORED		0
+#define ZIP_DEFLATED	8
+
+// a file in either a .pak or a .pk3
+typedef struct packfile_s {
+	char	name[MAX_QPATH];
+	int		filepos;		// start of the data, after the local header for zips
+	int		filelen;		// uncompressed size
+	int		complen;		// size in the archive, the same as filelen unless deflated
+	int		compression;
+} packfile_t;
+
 typedef struct pack_s {
 	char	filename[MAX_OSPATH];
 
-	// for constraining the binary search range
-	int		namesmin[256];
-	int		namesmax[256];
-
 	FILE	*handle;
 	int		numfiles;
-	dpackfile_t	*files;
+	packfile_t	*files;
+	qboolean	zip;
+
+	// persistent read-only view of the whole pack, NULL if it couldn't be mapped
+	byte	*mapped;
+	int		mappedlen;
 } pack_t;
 
 char	fs_gamedir[MAX_OSPATH];
 cvar_t	*fs_basedir;
 cvar_t	*fs_cddir;
 cvar_t	*fs_gamedirvar;
+cvar_t	*fs_mappacks;
+cvar_t	*fs_iothreads;
+cvar_t	*fs_manifests;
+cvar_t	*fs_cachesize;
+
+// FS_LoadFile counters for fsstats
+typedef struct fsstats_s {
+	int		numloads;
+	int		numzerocopy;
+	int		numinflated;
+	int		numopens;
+	int		numlookups;
+	int		nummisses;
+	int		numasync;
+	double	bytes;
+	double	time;
+	double	blocked;	// main thread time spent in FS_WaitFile
+	int		numcachehits;
+	int		numcachemisses;
+	int		numevicted;
+} fsstats_t;
+
+static fsstats_t fs_stats;
+
+// loads also run on the i/o and preload threads, so the counters are only changed under this
+static void *fs_statslock;
+
+
+static void FS_CountStat (int *counter)
+{
+	Sys_Lock (fs_statslock);
+	(*counter)++;
+	Sys_Unlock (fs_statslock);
+}
+
+
+static void FS_CountLoad (int len, double starttime)
+{
+	double time = Sys_FloatTime () - starttime;
+
+	Sys_Lock (fs_statslock);
+	fs_stats.numloads++;
+	fs_stats.bytes += len;
+	fs_stats.time += time;
+	Sys_Unlock (fs_statslock);
+}
 
 typedef struct filelink_s {
 	struct filelink_s	*next;
@@ -80,51 +144,369 @@ searchpath_t	*fs_searchpaths;
 searchpath_t	*fs_base_searchpaths;	// without gamedirs
 
 
-static dpackfile_t *FS_FindFileInPAK (pack_t *pack, char *filename)
+/*
+=============================================================================
+
+FILE INDEX
+
+Every pack entry and loose file in the search path goes into a single hash table
+with the same precedence as walking fs_searchpaths, so that lookups (including
+lookups for files that don't exist) never need to touch the disk.  Anything that
+changes the directory tree behind our back needs an fs_rescan.
+
+=============================================================================
+*/
+
+#define FS_INDEX_SIZE	16384
+
+typedef struct fsindexentry_s {
+	struct fsindexentry_s *next;
+	unsigned	hash;
+	int			rank;		// position in fs_searchpaths, lower wins
+	searchpath_t *search;
+	packfile_t	*pf;		// NULL for loose files
+	char		name[1];	// variable sized
+} fsindexentry_t;
+
+static fsindexentry_t *fs_index[FS_INDEX_SIZE];
+static int fs_numindexed;
+
+// the index may be read by worker threads (map preloading) while the main thread adds to it
+static void *fs_indexlock;
+
+
+static unsigned FS_HashName (char *name)
+{
+	// names are already lower-case and use forward slashes
+	unsigned hash = 2166136261u;
+
+	while (*name)
+	{
+		hash ^= (byte) *name++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+/*
+================
+FS_CanonicalName
+
+lower-cases and flips slashes so that lookups match the way windows itself treats names; returns false if it doesn't fit
+================
+*/
+static qboolean FS_CanonicalName (char *out, char *in, int outsize)
+{
+	int i;
+
+	for (i = 0; in[i]; i++)
+	{
+		if (i == outsize - 1)
+			return false;
+
+		if (in[i] == '\\')
+			out[i] = '/';
+		else if (in[i] >= 'A' && in[i] <= 'Z')
+			out[i] = in[i] + ('a' - 'A');
+		else out[i] = in[i];
+	}
+
+	out[i] = 0;
+	return true;
+}
+
+
+static void FS_AddIndexEntry (char *name, searchpath_t *search, packfile_t *pf, int rank)
+{
+	char canonical[MAX_OSPATH];
+	fsindexentry_t *e;
+	unsigned hash;
+
+	if (!FS_CanonicalName (canonical, name, sizeof (canonical)))
+		return;
+
+	hash = FS_HashName (canonical);
+
+	for (e = fs_index[hash & (FS_INDEX_SIZE - 1)]; e; e = e->next)
+	{
+		if (e->hash == hash && !strcmp (e->name, canonical))
+		{
+			// an earlier search path wins
+			if (rank < e->rank)
+			{
+				e->rank = rank;
+				e->search = search;
+				e->pf = pf;
+			}
+
+			return;
+		}
+	}
+
+	e = Zone_AllocCategory (sizeof (fsindexentry_t) + strlen (canonical), MEM_FILESYSTEM);
+	strcpy (e->name, canonical);
+	e->hash = hash;
+	e->rank = rank;
+	e->search = search;
+	e->pf = pf;
+
+	e->next = fs_index[hash & (FS_INDEX_SIZE - 1)];
+	fs_index[hash & (FS_INDEX_SIZE - 1)] = e;
+
+	fs_numindexed++;
+}
+
+
+static void FS_FreeIndex (void)
 {
-	int imin, imax;
-	char newname[256];
+	int i;
+
+	for (i = 0; i < FS_INDEX_SIZE; i++)
+	{
+		while (fs_index[i])
+		{
+			fsindexentry_t *next = fs_index[i]->next;
+			Zone_Free (fs_index[i]);
+			fs_index[i] = next;
+		}
+	}
+
+	fs_numindexed = 0;
+}
 
-	// force the name to lower-case so that we can do a valid (and potentially faster) comparison
-	strcpy (newname, filename);
-	_strlwr (newname);
 
-	// if this is the case, the PAK contains no files who's name starts with the first char of the file to load
-	if (pack->namesmin[newname[0]] > pack->namesmax[newname[0]]) return NULL;
+/*
+================
+FS_IndexDirectory
 
-	// this condition is for checking if there is only one file in the pack with this first letter
-	if (pack->namesmin[newname[0]] == pack->namesmax[newname[0]])
+adds every file under a loose game directory; this goes breadth-first because only one Sys_FindFirst can be open at a time
+================
+*/
+static void FS_IndexDirectory (searchpath_t *search, int rank)
+{
+	char	**dirs = NULL;
+	int		numdirs = 1, maxdirs = 0;
+	int		i, baselen = strlen (search->filename) + 1;
+	char	pattern[MAX_OSPATH];
+	char	*s;
+
+	// the first entry is the directory itself
+	maxdirs = 64;
+	dirs = Zone_AllocCategory (maxdirs * sizeof (char *), MEM_FILESYSTEM);
+	dirs[0] = CopyString ("");
+
+	for (i = 0; i < numdirs; i++)
 	{
-		// only one file is a candidate for checking, so check it directly and it's either a match or not
-		dpackfile_t *pf = &pack->files[pack->namesmin[newname[0]]];
+		Com_sprintf (pattern, sizeof (pattern), "%s/%s*", search->filename, dirs[i]);
+
+		// files
+		for (s = Sys_FindFirst (pattern, 0, SFF_SUBDIR | SFF_HIDDEN | SFF_SYSTEM); s; s = Sys_FindNext (0, SFF_SUBDIR | SFF_HIDDEN | SFF_SYSTEM))
+			FS_AddIndexEntry (s + baselen, search, NULL, rank);
+
+		Sys_FindClose ();
+
+		// subdirectories
+		for (s = Sys_FindFirst (pattern, SFF_SUBDIR, SFF_HIDDEN | SFF_SYSTEM); s; s = Sys_FindNext (SFF_SUBDIR, SFF_HIDDEN | SFF_SYSTEM))
+		{
+			if (s[strlen (s) - 1] == '.')
+				continue;	// . and ..
+
+			if (numdirs == maxdirs)
+			{
+				char **newdirs = Zone_AllocCategory ((maxdirs * 2) * sizeof (char *), MEM_FILESYSTEM);
+
+				memcpy (newdirs, dirs, maxdirs * sizeof (char *));
+				Zone_Free (dirs);
+
+				dirs = newdirs;
+				maxdirs *= 2;
+			}
+
+			dirs[numdirs++] = CopyString (va ("%s/", s + baselen));
+		}
+
+		Sys_FindClose ();
+	}
+
+	for (i = 0; i < numdirs; i++)
+		Zone_Free (dirs[i]);
+
+	Zone_Free (dirs);
+}
+
+
+/*
+================
+FS_RebuildIndex
+================
+*/
+static void FS_RebuildIndex (void)
+{
+	searchpath_t *search;
+	int rank, i;
 
-		if (!strcmp (pf->name, newname))
-			return pf;
-		else return NULL;
+	if (!fs_indexlock)
+		fs_indexlock = Sys_CreateLock ();
+
+	Sys_Lock (fs_indexlock);
+
+	FS_FreeIndex ();
+
+	for (search = fs_searchpaths, rank = 0; search; search = search->next, rank++)
+	{
+		if (search->pack)
+		{
+			for (i = 0; i < search->pack->numfiles; i++)
+				FS_AddIndexEntry (search->pack->files[i].name, search, &search->pack->files[i], rank);
+		}
+		else FS_IndexDirectory (search, rank);
 	}
 
-	// short-circuit some of this by defining a range to search in based on the first char of the filename
-	for (imin = pack->namesmin[newname[0]], imax = pack->namesmax[newname[0]]; imax >= imin;)
+	Sys_Unlock (fs_indexlock);
+}
+
+
+/*
+================
+FS_IndexNewFile
+
+Adds a file that the engine has just written to a game directory (downloads, demos) without a full rescan.
+================
+*/
+void FS_IndexNewFile (char *filename)
+{
+	searchpath_t *search;
+	int rank;
+
+	if (!fs_indexlock)
+		return;
+
+	// downloaded player models go to baseq2 rather than the gamedir so find the directory it actually went to
+	for (search = fs_searchpaths, rank = 0; search; search = search->next, rank++)
 	{
-		int imid = (imax + imin) >> 1;
-		int comp = strcmp (pack->files[imid].name, newname);
+		FILE *f;
+
+		if (search->pack)
+			continue;
+
+		if ((f = fopen (va ("%s/%s", search->filename, filename), "rb")) != NULL)
+		{
+			fclose (f);
 
-		if (comp < 0)
-			imin = imid + 1;
-		else if (comp > 0)
-			imax = imid - 1;
-		else return &pack->files[imid];
+			Sys_Lock (fs_indexlock);
+			FS_AddIndexEntry (filename, search, NULL, rank);
+			Sys_Unlock (fs_indexlock);
+
+			break;
+		}
 	}
+}
 
-	// not found
-	return NULL;
+
+/*
+================
+FS_IndexCreatedFile
+
+FS_CreatePath is called with the full path of nearly everything the engine writes (demos,
+screenshots, condumps, copied savegames), so the file goes into the index then.  If it never gets written the entry
+just finds nothing on disk, which FS_FindFile already handles
+================
+*/
+static void FS_IndexCreatedFile (char *path)
+{
+	searchpath_t *search;
+	int rank, len;
+
+	if (!fs_indexlock)
+		return;
+
+	// only a directory
+	if ((len = strlen (path)) < 1 || path[len - 1] == '/')
+		return;
+
+	for (search = fs_searchpaths, rank = 0; search; search = search->next, rank++)
+	{
+		if (search->pack)
+			continue;
+
+		len = strlen (search->filename);
+
+		if (!Q_strncasecmp (path, search->filename, len) && path[len] == '/')
+		{
+			Sys_Lock (fs_indexlock);
+			FS_AddIndexEntry (path + len + 1, search, NULL, rank);
+			Sys_Unlock (fs_indexlock);
+			return;
+		}
+	}
+}
+
+
+/*
+================
+FS_LookupIndex
+
+returns the search path that holds the file, and the pack entry if it's in a pack, or NULL if it's not anywhere
+================
+*/
+static searchpath_t *FS_LookupIndex (char *filename, packfile_t **pf)
+{
+	char canonical[MAX_OSPATH];
+	searchpath_t *search = NULL;
+	fsindexentry_t *e;
+	unsigned hash;
+
+	*pf = NULL;
+
+	// not built yet
+	if (!fs_indexlock)
+		return NULL;
+
+	if (!FS_CanonicalName (canonical, filename, sizeof (canonical)))
+		return NULL;
+
+	hash = FS_HashName (canonical);
+
+	Sys_Lock (fs_indexlock);
+
+	for (e = fs_index[hash & (FS_INDEX_SIZE - 1)]; e; e = e->next)
+	{
+		if (e->hash == hash && !strcmp (e->name, canonical))
+		{
+			search = e->search;
+			*pf = e->pf;
+			break;
+		}
+	}
+
+	// counted under the index lock since worker threads look files up too
+	fs_stats.numlookups++;
+
+	if (!search)
+		fs_stats.nummisses++;
+
+	Sys_Unlock (fs_indexlock);
+
+	return search;
 }
 
 
-static int FS_SortPackFile (dpackfile_t *p1, dpackfile_t *p2)
+/*
+================
+FS_Rescan_f
+
+rebuilds the file index after files have been added or removed outside of the engine
+================
+*/
+void FS_Rescan_f (void)
 {
-	// the PAK files dir was forced to lower-case at load-time so strcmp is sufficient here
-	return strcmp (p1->name, p2->name);
+	double starttime = Sys_FloatTime ();
+
+	FS_RebuildIndex ();
+
+	Com_Printf ("Indexed %i files in %.3f ms\n", fs_numindexed, (Sys_FloatTime () - starttime) * 1000.0);
 }
 
 
@@ -180,6 +562,8 @@ void FS_CreatePath (char *path)
 			*ofs = '/';
 		}
 	}
+
+	FS_IndexCreatedFile (path);
 }
 
 
@@ -220,17 +604,17 @@ int	Developer_searchpath (int who)
 
 /*
 ===========
-FS_FOpenFile
+FS_FindFile
 
-Finds the file in the search path.
-returns filesize and an open FILE *
-Used for streaming data out of either a pak file or
-a seperate file.
+Finds the file in the search path.  If it's in a pack then pack and pf are set and nothing
+is opened, otherwise an open FILE * is returned in file.  Returns the filesize or -1 if not found.
 ===========
 */
 int file_from_pak = 0;
 
-int FS_FOpenFile (char *filename, FILE **file)
+static void FS_RecordLoad (char *path);
+
+static int FS_FindFile (char *filename, FILE **file, pack_t **pack, packfile_t **pf)
 {
 	searchpath_t	*search;
 	char			netpath[MAX_OSPATH];
@@ -238,6 +622,10 @@ int FS_FOpenFile (char *filename, FILE **file)
 
 	file_from_pak = 0;
 
+	*file = NULL;
+	*pack = NULL;
+	*pf = NULL;
+
 	// check for links first
 	for (link = fs_links; link; link = link->next)
 	{
@@ -256,56 +644,81 @@ int FS_FOpenFile (char *filename, FILE **file)
 		}
 	}
 
-	// search through the path, one element at a time
-	for (search = fs_searchpaths; search; search = search->next)
+	// everything else comes from the index
+	if ((search = FS_LookupIndex (filename, pf)) != NULL)
 	{
-		// is the element a pak file?
 		if (search->pack)
 		{
-			// look through all the pak file elements
-			pack_t *pak = search->pack;
-			dpackfile_t *pf = FS_FindFileInPAK (pak, filename);
+			// found it!
+			file_from_pak = 1;
+			Com_DPrintf ("PackFile: %s : %s\n", search->pack->filename, filename);
 
-			if (pf)
-			{
-				// found it!
-				file_from_pak = 1;
-				Com_DPrintf ("PackFile: %s : %s\n", pak->filename, filename);
-
-				// open a new file on the pakfile
-				*file = fopen (pak->filename, "rb");
-
-				if (!*file)
-					Com_Error (ERR_FATAL, "Couldn't reopen %s", pak->filename);
-
-				fseek (*file, pf->filepos, SEEK_SET);
-
-				return pf->filelen;
-			}
+			*pack = search->pack;
+			return (*pf)->filelen;
 		}
 		else
 		{
-			// check a file in the directory tree
+			// loose file in the directory tree
 			Com_sprintf (netpath, sizeof (netpath), "%s/%s", search->filename, filename);
 
-			*file = fopen (netpath, "rb");
-
-			if (!*file)
-				continue;
-
-			Com_DPrintf ("FindFile: %s\n", netpath);
+			if ((*file = fopen (netpath, "rb")) != NULL)
+			{
+				Com_DPrintf ("FindFile: %s\n", netpath);
+				return FS_filelength (*file);
+			}
 
-			return FS_filelength (*file);
+			// it was deleted since the index was built
 		}
 	}
 
 	Com_DPrintf ("FindFile: can't find %s\n", filename);
 
-	*file = NULL;
 	return -1;
 }
 
 
+/*
+===========
+FS_FOpenFile
+
+Finds the file in the search path.
+returns filesize and an open FILE *
+Used for streaming data out of either a pak file or
+a seperate file.
+===========
+*/
+int FS_FOpenFile (char *filename, FILE **file)
+{
+	pack_t		*pak;
+	packfile_t	*pf;
+	int			len = FS_FindFile (filename, file, &pak, &pf);
+
+	if (len != -1)
+		FS_RecordLoad (filename);
+
+	if (pak)
+	{
+		// deflated zip entries can only be loaded whole; anything streamed (cinematics, demos) must be stored
+		if (pf->compression != ZIP_STORED)
+		{
+			Com_Printf ("FS_FOpenFile: %s is compressed in %s and can't be streamed\n", filename, pak->filename);
+			return -1;
+		}
+
+		// open a new file on the pakfile
+		*file = fopen (pak->filename, "rb");
+
+		if (!*file)
+			Com_Error (ERR_FATAL, "Couldn't reopen %s", pak->filename);
+
+		fseek (*file, pf->filepos, SEEK_SET);
+		FS_CountStat (&fs_stats.numopens);
+	}
+
+	return len;
+}
+
+
 /*
 =================
 FS_ReadFile
@@ -358,58 +771,1489 @@ void FS_Read (void *buffer, int len, FILE *f)
 
 
 /*
-============
-FS_LoadFile
-
-Filename are reletive to the quake search path
-a null buffer will just return the file length without loading
-============
+=============================================================================
+
+READ-ONLY LOANS
+
+A read-only load from a mapped pack points into the pack rather than the zone.  Each one
+is noted here by address so that FS_FreeFile can tell it from a zone buffer with a single
+hash lookup.  The same file loaded twice is the same address, so loans are counted.
+
+=============================================================================
+*/
+
+#define FS_LOAN_HASHSIZE	256
+
+#define FS_PointerHash(p, size) ((((uintptr_t) (p)) >> 4) & ((size) - 1))
+
+typedef struct fsloan_s {
+	struct fsloan_s *next;
+	void	*data;
+	int		count;
+} fsloan_t;
+
+static fsloan_t *fs_loans[FS_LOAN_HASHSIZE];
+
+// read-only loads are also made by the preload and i/o threads
+static void *fs_loanlock;
+
+
+static void FS_AddLoan (void *data)
+{
+	fsloan_t **bucket = &fs_loans[FS_PointerHash (data, FS_LOAN_HASHSIZE)];
+	fsloan_t *l;
+
+	Sys_Lock (fs_loanlock);
+
+	for (l = *bucket; l; l = l->next)
+	{
+		if (l->data == data)
+		{
+			l->count++;
+			Sys_Unlock (fs_loanlock);
+			return;
+		}
+	}
+
+	l = Zone_AllocCategory (sizeof (fsloan_t), MEM_FILESYSTEM);
+	l->data = data;
+	l->count = 1;
+	l->next = *bucket;
+	*bucket = l;
+
+	Sys_Unlock (fs_loanlock);
+}
+
+
+/*
+=================
+FS_ReturnLoan
+
+returns false if the buffer wasn't loaned out of a pack
+=================
+*/
+static qboolean FS_ReturnLoan (void *data)
+{
+	fsloan_t **link, *l;
+
+	Sys_Lock (fs_loanlock);
+
+	for (link = &fs_loans[FS_PointerHash (data, FS_LOAN_HASHSIZE)]; (l = *link) != NULL; link = &l->next)
+	{
+		if (l->data == data)
+		{
+			if (!--l->count)
+			{
+				*link = l->next;
+				Zone_Free (l);
+			}
+
+			Sys_Unlock (fs_loanlock);
+			return true;
+		}
+	}
+
+	Sys_Unlock (fs_loanlock);
+
+	return false;
+}
+
+
+/*
+=============================================================================
+
+FILE CACHE
+
+Stored files in mapped packs are already served from memory by the mapping, but deflated
+entries would be inflated again, and unmapped packs read again, every time a map that
+uses them is loaded.  Those go into an LRU cache of up to fs_cachesize mb that survives
+map changes, so shared skins, weapon models and sounds come from ram on a map change.
+
+Entries are keyed by their pack entry so they're flushed on a gamedir change.  Read-only
+loads hand out the cached buffer itself and hold a reference to it until FS_FreeFile;
+other loads get a copy.
+
+=============================================================================
+*/
+
+#define FS_CACHE_HASHSIZE	1024
+
+typedef struct fscacheentry_s {
+	struct fscacheentry_s *prev, *next;		// lru order, head is most recently used
+	struct fscacheentry_s *hashnext;		// by pack entry
+	struct fscacheentry_s *datanext;		// by data, for FS_FreeFile
+
+	packfile_t	*pf;
+	byte		*data;
+	int			len;
+	int			refcount;		// read-only users
+} fscacheentry_t;
+
+typedef struct fscache_s {
+	fscacheentry_t	*hash[FS_CACHE_HASHSIZE];
+	fscacheentry_t	*datahash[FS_CACHE_HASHSIZE];
+	fscacheentry_t	*head, *tail;
+
+	int		numentries;
+	int		bytes;
+
+	void	*lock;
+} fscache_t;
+
+static fscache_t fs_cache;
+
+
+#define FS_CacheHash(p) FS_PointerHash (p, FS_CACHE_HASHSIZE)
+
+static qboolean FS_Cacheable (pack_t *pak, packfile_t *pf)
+{
+	if (!fs_cache.lock || !fs_cachesize->value)
+		return false;
+
+	// stored files in mapped packs are zero-copy already
+	return (pak && (pf->compression != ZIP_STORED || !pak->mapped));
+}
+
+
+static void FS_CacheUnlink (fscacheentry_t *e)
+{
+	fscacheentry_t **link;
+
+	if (e->prev)
+		e->prev->next = e->next;
+	else fs_cache.head = e->next;
+
+	if (e->next)
+		e->next->prev = e->prev;
+	else fs_cache.tail = e->prev;
+
+	for (link = &fs_cache.hash[FS_CacheHash (e->pf)]; *link; link = &(*link)->hashnext)
+	{
+		if (*link == e)
+		{
+			*link = e->hashnext;
+			break;
+		}
+	}
+
+	for (link = &fs_cache.datahash[FS_CacheHash (e->data)]; *link; link = &(*link)->datanext)
+	{
+		if (*link == e)
+		{
+			*link = e->datanext;
+			break;
+		}
+	}
+
+	fs_cache.numentries--;
+	fs_cache.bytes -= e->len;
+}
+
+
+static void FS_CacheLinkHead (fscacheentry_t *e)
+{
+	e->prev = NULL;
+
+	if ((e->next = fs_cache.head) != NULL)
+		fs_cache.head->prev = e;
+	else fs_cache.tail = e;
+
+	fs_cache.head = e;
+}
+
+
+/*
+=================
+FS_CacheEvict
+
+throws out the least recently used entries that nobody is using until there's room for size more bytes
+=================
+*/
+static void FS_CacheEvict (int size)
+{
+	int limit = fs_cachesize->value * 1024 * 1024;
+	fscacheentry_t *e, *prev;
+
+	for (e = fs_cache.tail; e && fs_cache.bytes + size > limit; e = prev)
+	{
+		prev = e->prev;
+
+		if (e->refcount)
+			continue;
+
+		FS_CacheUnlink (e);
+		Zone_Free (e->data);
+		Zone_Free (e);
+
+		fs_stats.numevicted++;
+	}
+}
+
+
+/*
+=================
+FS_CacheLookup
+
+returns the cached data for pf (a copy if it's not a read-only load) or NULL if it's not cached
+=================
+*/
+static byte *FS_CacheLookup (packfile_t *pf, qboolean readonly)
+{
+	fscacheentry_t *e;
+	byte *buf = NULL;
+
+	Sys_Lock (fs_cache.lock);
+
+	for (e = fs_cache.hash[FS_CacheHash (pf)]; e; e = e->hashnext)
+	{
+		if (e->pf == pf)
+		{
+			// move to the front
+			if (e != fs_cache.head)
+			{
+				if (e->prev) e->prev->next = e->next;
+				if (e->next) e->next->prev = e->prev;
+				else fs_cache.tail = e->prev;
+
+				FS_CacheLinkHead (e);
+			}
+
+			if (readonly)
+			{
+				e->refcount++;
+				buf = e->data;
+			}
+			else
+			{
+				buf = Zone_AllocCategory (e->len + 1, MEM_FILESYSTEM);
+				memcpy (buf, e->data, e->len);
+			}
+
+			break;
+		}
+	}
+
+	if (buf)
+		fs_stats.numcachehits++;
+	else fs_stats.numcachemisses++;
+
+	Sys_Unlock (fs_cache.lock);
+
+	return buf;
+}
+
+
+/*
+=================
+FS_CacheInsert
+
+adds a freshly loaded file; a read-only load's buffer becomes the cache entry, otherwise a copy is kept
+=================
+*/
+static void FS_CacheInsert (packfile_t *pf, byte *buf, int len, qboolean readonly)
+{
+	fscacheentry_t *e;
+
+	// don't let one big file flush everything
+	if (len > fs_cachesize->value * 1024 * 1024 / 4)
+		return;
+
+	Sys_Lock (fs_cache.lock);
+
+	// another thread may have loaded it at the same time
+	for (e = fs_cache.hash[FS_CacheHash (pf)]; e; e = e->hashnext)
+	{
+		if (e->pf == pf)
+		{
+			Sys_Unlock (fs_cache.lock);
+			return;
+		}
+	}
+
+	FS_CacheEvict (len);
+
+	e = Zone_AllocCategory (sizeof (fscacheentry_t), MEM_FILESYSTEM);
+	e->pf = pf;
+	e->len = len;
+
+	if (readonly)
+	{
+		e->data = buf;
+		e->refcount = 1;
+	}
+	else
+	{
+		e->data = Zone_AllocCategory (len + 1, MEM_FILESYSTEM);
+		memcpy (e->data, buf, len);
+	}
+
+	FS_CacheLinkHead (e);
+
+	e->hashnext = fs_cache.hash[FS_CacheHash (pf)];
+	fs_cache.hash[FS_CacheHash (pf)] = e;
+
+	e->datanext = fs_cache.datahash[FS_CacheHash (e->data)];
+	fs_cache.datahash[FS_CacheHash (e->data)] = e;
+
+	fs_cache.numentries++;
+	fs_cache.bytes += len;
+
+	Sys_Unlock (fs_cache.lock);
+}
+
+
+/*
+=================
+FS_CacheRelease
+
+drops a read-only reference; returns false if the buffer isn't in the cache
+=================
+*/
+static qboolean FS_CacheRelease (void *buffer)
+{
+	fscacheentry_t *e;
+
+	if (!fs_cache.lock)
+		return false;
+
+	Sys_Lock (fs_cache.lock);
+
+	for (e = fs_cache.datahash[FS_CacheHash (buffer)]; e; e = e->datanext)
+	{
+		if (e->data == buffer)
+		{
+			e->refcount--;
+			Sys_Unlock (fs_cache.lock);
+			return true;
+		}
+	}
+
+	Sys_Unlock (fs_cache.lock);
+
+	return false;
+}
+
+
+/*
+=================
+FS_FlushCache
+
+anything still referenced is left to be freed by FS_FreeFile as if it had never been cached
+=================
+*/
+static void FS_FlushCache (void)
+{
+	if (!fs_cache.lock)
+		return;
+
+	Sys_Lock (fs_cache.lock);
+
+	while (fs_cache.head)
+	{
+		fscacheentry_t *e = fs_cache.head;
+
+		FS_CacheUnlink (e);
+
+		if (!e->refcount)
+			Zone_Free (e->data);
+
+		Zone_Free (e);
+	}
+
+	Sys_Unlock (fs_cache.lock);
+}
+
+
+/*
+============
+FS_InflateFile
+
+decompresses a deflated zip entry straight into the destination; returns false if it's corrupt
+============
+*/
+static qboolean FS_InflateFile (pack_t *pak, packfile_t *pf, byte *buf)
+{
+	byte		*src;
+	FILE		*h;
+	qboolean	ok;
+
+	if (pak->mapped)
+	{
+		// inflate directly out of the mapping so the compressed data is never copied
+		ok = (stbi_zlib_decode_noheader_buffer ((char *) buf, pf->filelen, (char *) pak->mapped + pf->filepos, pf->complen) == pf->filelen);
+	}
+	else
+	{
+		if ((h = fopen (pak->filename, "rb")) == NULL)
+			return false;
+
+		fseek (h, pf->filepos, SEEK_SET);
+		FS_CountStat (&fs_stats.numopens);
+
+		src = Zone_AllocCategory (pf->complen, MEM_FILESYSTEM);
+		ok = (fread (src, 1, pf->complen, h) == pf->complen);
+		fclose (h);
+
+		if (ok)
+			ok = (stbi_zlib_decode_noheader_buffer ((char *) buf, pf->filelen, (char *) src, pf->complen) == pf->filelen);
+
+		Zone_Free (src);
+	}
+
+	FS_CountStat (&fs_stats.numinflated);
+
+	return ok;
+}
+
+
+/*
+============
+FS_LoadFile
+
+Filename are reletive to the quake search path
+a null buffer will just return the file length without loading
+============
+*/
+static int FS_LoadFileInternal (char *path, void **buffer, qboolean readonly)
+{
+	FILE		*h;
+	pack_t		*pak;
+	packfile_t	*pf;
+	byte		*buf;
+	int			len;
+	double		starttime = Sys_FloatTime ();
+
+	// look for it in the filesystem or pack files
+	if ((len = FS_FindFile (path, &h, &pak, &pf)) == -1)
+	{
+		if (buffer)
+			*buffer = NULL;
+		return -1;
+	}
+
+	if (!buffer)
+	{
+		if (h) fclose (h);
+		return len;
+	}
+
+	if (FS_Cacheable (pak, pf))
+	{
+		if ((buf = FS_CacheLookup (pf, readonly)) != NULL)
+		{
+			*buffer = buf;
+
+			FS_RecordLoad (path);
+			FS_CountLoad (len, starttime);
+
+			return len;
+		}
+	}
+
+	if (pak && pf->compression != ZIP_STORED)
+	{
+		// text parsers expect a trailing 0 (which Zone_Alloc provides)
+		buf = Zone_AllocCategory (len + 1, MEM_FILESYSTEM);
+
+		// this may be running on the map preload thread so it mustn't Com_Error; a bad entry is treated as missing
+		if (!FS_InflateFile (pak, pf, buf))
+		{
+			Com_DPrintf ("FS_LoadFile: %s is corrupt in %s\n", path, pak->filename);
+			Zone_Free (buf);
+			*buffer = NULL;
+			return -1;
+		}
+	}
+	else if (pak && pak->mapped)
+	{
+		if (readonly)
+		{
+			// point straight into the pack
+			buf = pak->mapped + pf->filepos;
+			FS_AddLoan (buf);
+			FS_CountStat (&fs_stats.numzerocopy);
+		}
+		else
+		{
+			// the caller wants to modify it so it gets its own copy; still no need to go through the C library though
+			buf = Zone_AllocCategory (len + 1, MEM_FILESYSTEM);
+			memcpy (buf, pak->mapped + pf->filepos, len);
+		}
+	}
+	else
+	{
+		if (pak)
+		{
+			// pack couldn't be mapped so read it the old way; this may be on an i/o thread so it mustn't Com_Error
+			if ((h = fopen (pak->filename, "rb")) == NULL)
+			{
+				*buffer = NULL;
+				return FS_READERROR;
+			}
+
+			fseek (h, pf->filepos, SEEK_SET);
+			FS_CountStat (&fs_stats.numopens);
+		}
+
+		// text parsers expect a trailing 0 (which Zone_Alloc provides)
+		buf = Zone_AllocCategory (len + 1, MEM_FILESYSTEM);
+
+		// not FS_Read, which Com_Errors; the caller decides what a short read means
+		if (fread (buf, 1, len, h) != len)
+		{
+			fclose (h);
+			Zone_Free (buf);
+			*buffer = NULL;
+			return FS_READERROR;
+		}
+
+		fclose (h);
+	}
+
+	*buffer = buf;
+
+	if (FS_Cacheable (pak, pf))
+		FS_CacheInsert (pf, buf, len, readonly);
+
+	FS_RecordLoad (path);
+	FS_CountLoad (len, starttime);
+
+	return len;
+}
+
+
+int FS_LoadFile (char *path, void **buffer)
+{
+	int len = FS_LoadFileInternal (path, buffer, false);
+
+	if (len == FS_READERROR)
+		Com_Error (ERR_FATAL, "FS_LoadFile: couldn't read %s", path);
+
+	return len;
+}
+
+
+int FS_LoadFileReadOnly (char *path, void **buffer)
+{
+	int len = FS_LoadFileInternal (path, buffer, true);
+
+	if (len == FS_READERROR)
+		Com_Error (ERR_FATAL, "FS_LoadFile: couldn't read %s", path);
+
+	return len;
+}
+
+
+/*
+=============
+FS_TryLoadFile
+
+for worker threads, which mustn't Com_Error; a file that's there but can't be read
+comes back as FS_READERROR for the main thread to report
+=============
+*/
+int FS_TryLoadFile (char *path, void **buffer, qboolean readonly)
+{
+	return FS_LoadFileInternal (path, buffer, readonly);
+}
+
+
+/*
+=============
+FS_FreeFile
+=============
+*/
+void FS_FreeFile (void *buffer)
+{
+	// read-only loads from a mapped pack are owned by the pack
+	if (FS_ReturnLoan (buffer))
+		return;
+
+	// read-only loads from the cache are owned by the cache
+	if (FS_CacheRelease (buffer))
+		return;
+
+	Zone_Free (buffer);
+}
+
+/*
+=============================================================================
+
+ASYNCHRONOUS LOADING
+
+A small pool of i/o threads services FS_LoadFileAsync requests highest priority first.
+The returned job is a future: FS_WaitFile gets the result and frees the job.  If the
+job hasn't been started when it's waited on the main thread takes it out of the queue
+and loads it itself rather than waiting behind everything else.
+
+Jobs that point into mapped packs (readonly) must be waited on before a gamedir change.
+
+=============================================================================
+*/
+
+#define FS_MAXIOTHREADS	4
+
+struct fsjob_s {
+	struct fsjob_s *next;
+
+	char		path[MAX_QPATH];
+	qboolean	readonly;
+	fspriority_t priority;
+
+	// protected by the queue lock
+	qboolean	running;
+	qboolean	done;
+
+	void		*buffer;
+	int			len;
+};
+
+typedef struct fsioqueue_s {
+	void	*threads[FS_MAXIOTHREADS];
+	int		numthreads;
+
+	void	*lock;
+	void	*wake;		// raised when a job is queued
+	void	*done;		// raised when a job completes; only the main thread waits on it
+
+	fsjob_t	*head[FS_NUM_PRIORITIES];
+	fsjob_t	*tail[FS_NUM_PRIORITIES];
+	int		numpending;		// queued or running
+} fsioqueue_t;
+
+static fsioqueue_t fs_io;
+
+
+static fsjob_t *FS_TakeJob (void)
+{
+	int i;
+
+	for (i = 0; i < FS_NUM_PRIORITIES; i++)
+	{
+		fsjob_t *job = fs_io.head[i];
+
+		if (job)
+		{
+			if ((fs_io.head[i] = job->next) == NULL)
+				fs_io.tail[i] = NULL;
+
+			job->next = NULL;
+			job->running = true;
+
+			return job;
+		}
+	}
+
+	return NULL;
+}
+
+
+static qboolean FS_UnqueueJob (fsjob_t *job)
+{
+	fsjob_t *prev = NULL, *j;
+
+	for (j = fs_io.head[job->priority]; j; prev = j, j = j->next)
+	{
+		if (j == job)
+		{
+			if (prev)
+				prev->next = job->next;
+			else fs_io.head[job->priority] = job->next;
+
+			if (fs_io.tail[job->priority] == job)
+				fs_io.tail[job->priority] = prev;
+
+			job->next = NULL;
+			job->running = true;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+static unsigned FS_IOThread (void *param)
+{
+	for (;;)
+	{
+		fsjob_t *job;
+
+		Sys_WaitSignal (fs_io.wake, -1);
+
+		// keep going until the queue is empty, so a wake that was raised while we were busy isn't lost
+		for (;;)
+		{
+			Sys_Lock (fs_io.lock);
+			job = FS_TakeJob ();
+			Sys_Unlock (fs_io.lock);
+
+			if (!job)
+				break;
+
+			job->len = FS_LoadFileInternal (job->path, &job->buffer, job->readonly);
+
+			Sys_Lock (fs_io.lock);
+			job->done = true;
+			fs_io.numpending--;
+			Sys_Unlock (fs_io.lock);
+
+			Sys_RaiseSignal (fs_io.done);
+		}
+	}
+
+	return 0;
+}
+
+
+static void FS_InitIOThreads (void)
+{
+	int i, numthreads;
+
+	fs_io.lock = Sys_CreateLock ();
+	fs_io.wake = Sys_CreateSignal ();
+	fs_io.done = Sys_CreateSignal ();
+
+	if ((numthreads = fs_iothreads->value) > FS_MAXIOTHREADS)
+		numthreads = FS_MAXIOTHREADS;
+
+	// with no threads every job is just loaded when it's waited on
+	for (i = 0; i < numthreads; i++)
+	{
+		if ((fs_io.threads[fs_io.numthreads] = Sys_CreateThread (FS_IOThread, NULL)) != NULL)
+			fs_io.numthreads++;
+	}
+}
+
+
+/*
+=================
+FS_LoadFileAsync
+=================
+*/
+fsjob_t *FS_LoadFileAsync (char *path, fspriority_t priority, qboolean readonly)
+{
+	fsjob_t *job = Zone_AllocCategory (sizeof (fsjob_t), MEM_FILESYSTEM);
+
+	strncpy (job->path, path, sizeof (job->path) - 1);
+	job->readonly = readonly;
+	job->priority = priority;
+
+	Sys_Lock (fs_io.lock);
+
+	if (fs_io.tail[priority])
+		fs_io.tail[priority]->next = job;
+	else fs_io.head[priority] = job;
+
+	fs_io.tail[priority] = job;
+	fs_io.numpending++;
+
+	Sys_Unlock (fs_io.lock);
+
+	if (fs_io.numthreads)
+		Sys_RaiseSignal (fs_io.wake);
+
+	FS_CountStat (&fs_stats.numasync);
+
+	return job;
+}
+
+
+/*
+=================
+FS_FileReady
+=================
+*/
+qboolean FS_FileReady (fsjob_t *job)
+{
+	qboolean done;
+
+	Sys_Lock (fs_io.lock);
+	done = job->done;
+	Sys_Unlock (fs_io.lock);
+
+	return done;
+}
+
+
+/*
+=================
+FS_WaitFile
+=================
+*/
+int FS_WaitFile (fsjob_t *job, void **buffer)
+{
+	double starttime = Sys_FloatTime ();
+	qboolean steal;
+	int len;
+
+	Sys_Lock (fs_io.lock);
+
+	if ((steal = FS_UnqueueJob (job)) != false)
+		fs_io.numpending--;
+
+	Sys_Unlock (fs_io.lock);
+
+	if (steal)
+	{
+		job->len = FS_LoadFileInternal (job->path, &job->buffer, job->readonly);
+		job->done = true;
+	}
+	else
+	{
+		// the done signal is shared so it may be for another job; keep checking
+		while (!FS_FileReady (job))
+			Sys_WaitSignal (fs_io.done, -1);
+	}
+
+	*buffer = job->buffer;
+	len = job->len;
+
+	fs_stats.blocked += Sys_FloatTime () - starttime;
+
+	// the i/o thread couldn't report it
+	if (len == FS_READERROR)
+		Com_Error (ERR_FATAL, "FS_LoadFile: couldn't read %s", job->path);
+
+	Zone_Free (job);
+
+	return len;
+}
+
+
+/*
+=================
+FS_FinishAsync
+
+waits for anything still queued or running, so that nothing is reading the packs
+=================
+*/
+static void FS_FinishAsync (void)
+{
+	fsjob_t *job;
+
+	if (!fs_io.lock)
+		return;
+
+	for (;;)
+	{
+		Sys_Lock (fs_io.lock);
+
+		if (!fs_io.numpending)
+		{
+			Sys_Unlock (fs_io.lock);
+			break;
+		}
+
+		// do any that haven't started ourselves
+		if ((job = FS_TakeJob ()) != NULL)
+			fs_io.numpending--;
+
+		Sys_Unlock (fs_io.lock);
+
+		if (job)
+		{
+			job->len = FS_LoadFileInternal (job->path, &job->buffer, job->readonly);
+
+			Sys_Lock (fs_io.lock);
+			job->done = true;
+			Sys_Unlock (fs_io.lock);
+		}
+		else Sys_WaitSignal (fs_io.done, 100);
+	}
+}
+
+
+/*
+=================
+FS_Bench_f
+
+fsbench <prefix> [sync|async]; loads every file whose name starts with prefix and reports how long the main thread was blocked.
+run it from a cold start for each mode to get meaningful numbers.
+=================
+*/
+void FS_Bench_f (void)
+{
+	char		**names;
+	fsjob_t		**jobs;
+	int			i, numnames = 0, len, prefixlen;
+	double		bytes = 0, starttime, blocked;
+	qboolean	async = true;
+	fsindexentry_t *e;
+	void		*buf;
+	char		prefix[MAX_OSPATH];
+
+	if (Cmd_Argc () < 2)
+	{
+		Com_Printf ("usage: fsbench <prefix> [sync|async]\n");
+		return;
+	}
+
+	FS_CanonicalName (prefix, Cmd_Argv (1), sizeof (prefix));
+	prefixlen = strlen (prefix);
+
+	if (Cmd_Argc () > 2 && !Q_strcasecmp (Cmd_Argv (2), "sync"))
+		async = false;
+
+	// take a copy of the names so that the index isn't locked while loading
+	Sys_Lock (fs_indexlock);
+
+	names = Zone_AllocCategory (fs_numindexed * sizeof (char *), MEM_FILESYSTEM);
+
+	for (i = 0; i < FS_INDEX_SIZE; i++)
+	{
+		for (e = fs_index[i]; e; e = e->next)
+		{
+			if (!strncmp (e->name, prefix, prefixlen))
+				names[numnames++] = CopyString (e->name);
+		}
+	}
+
+	Sys_Unlock (fs_indexlock);
+
+	starttime = Sys_FloatTime ();
+
+	if (async)
+	{
+		blocked = fs_stats.blocked;
+		jobs = Zone_AllocCategory (numnames * sizeof (fsjob_t *), MEM_FILESYSTEM);
+
+		for (i = 0; i < numnames; i++)
+			jobs[i] = FS_LoadFileAsync (names[i], FS_PRIORITY_NORMAL, true);
+
+		for (i = 0; i < numnames; i++)
+		{
+			if ((len = FS_WaitFile (jobs[i], &buf)) > 0)
+				bytes += len;
+
+			if (buf)
+				FS_FreeFile (buf);
+		}
+
+		Zone_Free (jobs);
+		blocked = fs_stats.blocked - blocked;
+	}
+	else
+	{
+		for (i = 0; i < numnames; i++)
+		{
+			if ((len = FS_LoadFileReadOnly (names[i], &buf)) > 0)
+				bytes += len;
+
+			if (buf)
+				FS_FreeFile (buf);
+		}
+
+		// every load blocks
+		blocked = Sys_FloatTime () - starttime;
+	}
+
+	Com_Printf ("%s: %i files, %.1f kb in %.3f ms, main thread blocked %.3f ms (%i i/o threads)\n",
+		async ? "async" : "sync", numnames, bytes / 1024.0, (Sys_FloatTime () - starttime) * 1000.0, blocked * 1000.0, async ? fs_io.numthreads : 0);
+
+	for (i = 0; i < numnames; i++)
+		Zone_Free (names[i]);
+
+	Zone_Free (names);
+}
+
+
+/*
+=============================================================================
+
+PREFETCHING
+
+Loads made during precache jump around the packs in whatever order the configstrings
+were set up, which defeats the OS read-ahead.  Before precaching starts the client passes
+the names it's about to load; a worker sorts them by their position in each mapped pack
+and touches their pages front to back so that the loads themselves hit memory.  Names
+passed while the worker is still going are merged into what it has left to do.
+
+=============================================================================
+*/
+
+#define FS_PAGESIZE		4096
+
+typedef struct fsprefetchrange_s {
+	byte	*data;
+	int		len;
+} fsprefetchrange_t;
+
+typedef struct fsprefetch_s {
+	void	*thread;
+	void	*lock;
+	volatile qboolean cancel;
+
+	// protected by the lock; the worker takes them from next on, and new ones are merged in after it
+	fsprefetchrange_t *ranges;
+	int		numranges;
+	int		maxranges;
+	int		next;
+	qboolean	finished;	// the worker ran out and has exited or is about to
+
+	// written by the worker, only valid to read after Sys_WaitThread
+	int		bytes;
+	double	time;
+} fsprefetch_t;
+
+static fsprefetch_t fs_prefetch;
+
+
+static unsigned FS_PrefetchThread (void *param)
+{
+	fsprefetch_t *pf = (fsprefetch_t *) param;
+	double starttime = Sys_FloatTime ();
+	volatile byte touch = 0;
+	fsprefetchrange_t range;
+	int j;
+
+	for (;;)
+	{
+		Sys_Lock (pf->lock);
+
+		if (pf->cancel || pf->next == pf->numranges)
+		{
+			pf->finished = true;
+			Sys_Unlock (pf->lock);
+			break;
+		}
+
+		range = pf->ranges[pf->next++];
+
+		Sys_Unlock (pf->lock);
+
+		// reading one byte of each page is enough to get the whole page in
+		for (j = 0; j < range.len; j += FS_PAGESIZE)
+			touch += range.data[j];
+
+		touch += range.data[range.len - 1];
+		pf->bytes += range.len;
+	}
+
+	pf->time += Sys_FloatTime () - starttime;
+
+	return 0;
+}
+
+
+static int FS_SortPrefetchRanges (const void *a, const void *b)
+{
+	// packs are separate mappings so sorting on the address groups by pack and then orders by position in the pack
+	byte *adata = ((fsprefetchrange_t *) a)->data;
+	byte *bdata = ((fsprefetchrange_t *) b)->data;
+
+	if (adata < bdata)
+		return -1;
+	else if (adata > bdata)
+		return 1;
+	else return 0;
+}
+
+
+static void FS_CancelPrefetch (void)
+{
+	void *lock = fs_prefetch.lock;
+
+	if (fs_prefetch.thread)
+	{
+		fs_prefetch.cancel = true;
+		Sys_WaitThread (fs_prefetch.thread);
+
+		Com_DPrintf ("prefetched %i kb in %.3f ms\n", fs_prefetch.bytes / 1024, fs_prefetch.time * 1000.0);
+	}
+
+	if (fs_prefetch.ranges)
+		Zone_Free (fs_prefetch.ranges);
+
+	memset (&fs_prefetch, 0, sizeof (fs_prefetch));
+	fs_prefetch.lock = lock;
+}
+
+
+/*
+=================
+FS_MergePrefetch
+
+adds ranges to what the worker has left to do, keeping that sorted and dropping any it already has;
+must be called with the lock held
+=================
+*/
+static void FS_MergePrefetch (fsprefetchrange_t *ranges, int numranges)
+{
+	int i, numleft = fs_prefetch.numranges - fs_prefetch.next;
+
+	// what's been taken is finished with
+	if (fs_prefetch.next)
+	{
+		memmove (fs_prefetch.ranges, fs_prefetch.ranges + fs_prefetch.next, numleft * sizeof (fsprefetchrange_t));
+		fs_prefetch.numranges = numleft;
+		fs_prefetch.next = 0;
+	}
+
+	if (numleft + numranges > fs_prefetch.maxranges)
+	{
+		fsprefetchrange_t *newranges = Zone_AllocCategory ((numleft + numranges) * sizeof (fsprefetchrange_t), MEM_FILESYSTEM);
+
+		if (fs_prefetch.ranges)
+		{
+			memcpy (newranges, fs_prefetch.ranges, numleft * sizeof (fsprefetchrange_t));
+			Zone_Free (fs_prefetch.ranges);
+		}
+
+		fs_prefetch.ranges = newranges;
+		fs_prefetch.maxranges = numleft + numranges;
+	}
+
+	memcpy (fs_prefetch.ranges + numleft, ranges, numranges * sizeof (fsprefetchrange_t));
+	qsort (fs_prefetch.ranges, numleft + numranges, sizeof (fsprefetchrange_t), FS_SortPrefetchRanges);
+
+	// a manifest and the configstrings name a lot of the same files; there's always at least one
+	fs_prefetch.numranges = 1;
+
+	for (i = 1; i < numleft + numranges; i++)
+	{
+		if (fs_prefetch.ranges[i].data != fs_prefetch.ranges[fs_prefetch.numranges - 1].data)
+			fs_prefetch.ranges[fs_prefetch.numranges++] = fs_prefetch.ranges[i];
+	}
+}
+
+
+static void FS_StartPrefetch (char **names, int numnames)
+{
+	fsprefetchrange_t *ranges;
+	searchpath_t *search;
+	packfile_t *pf;
+	qboolean finished;
+	int i, numranges = 0;
+
+	if (!numnames)
+		return;
+
+	ranges = Zone_AllocCategory (numnames * sizeof (fsprefetchrange_t), MEM_FILESYSTEM);
+
+	for (i = 0; i < numnames; i++)
+	{
+		// loose files and unmapped packs go through the C library which does its own read-ahead
+		if ((search = FS_LookupIndex (names[i], &pf)) == NULL || !search->pack || !search->pack->mapped)
+			continue;
+
+		if (!pf->complen)
+			continue;
+
+		ranges[numranges].data = search->pack->mapped + pf->filepos;
+		ranges[numranges].len = pf->complen;
+		numranges++;
+	}
+
+	if (numranges)
+	{
+		Sys_Lock (fs_prefetch.lock);
+		FS_MergePrefetch (ranges, numranges);
+		finished = fs_prefetch.finished;
+		Sys_Unlock (fs_prefetch.lock);
+
+		// if the worker ran out before the merge it needs starting again
+		if (!fs_prefetch.thread || finished)
+		{
+			if (fs_prefetch.thread)
+				Sys_WaitThread (fs_prefetch.thread);
+
+			fs_prefetch.finished = false;
+
+			// if the thread can't be created it's just a hint so there's nothing to fall back to
+			if ((fs_prefetch.thread = Sys_CreateThread (FS_PrefetchThread, &fs_prefetch)) == NULL)
+				FS_CancelPrefetch ();
+		}
+	}
+
+	Zone_Free (ranges);
+}
+
+
+/*
+=================
+FS_PrefetchFiles
+=================
+*/
+void FS_PrefetchFiles (char **names, int numnames)
+{
+	// merged with any manifest that's still being replayed
+	FS_StartPrefetch (names, numnames);
+}
+
+
+/*
+=============================================================================
+
+LOAD MANIFESTS
+
+Every file loaded between the start of a map load and the loading plaque going away is
+recorded, in order, to <gamedir>/manifests/<map>.txt.  The next time that map is loaded
+the manifest is handed to the prefetcher before anything else happens, which catches
+the files nothing can predict from the configstrings (skins, sky, the bsp itself).
+
+=============================================================================
+*/
+
+#define FS_RECORD_HASHSIZE	1024
+
+typedef struct fsrecording_s {
+	char		mapname[MAX_QPATH];
+	qboolean	active;
+
+	char		**names;
+	unsigned	*hashes;
+	int			*chain;		// next name + 1 in the same bucket, 0 ends it
+	int			numnames;
+	int			maxnames;
+
+	int			buckets[FS_RECORD_HASHSIZE];	// first name + 1
+} fsrecording_t;
+
+static fsrecording_t fs_recording;
+
+// loads can be recorded from the preload and i/o threads
+static void *fs_recordlock;
+
+
+static void FS_ClearRecording (void)
+{
+	int i;
+
+	for (i = 0; i < fs_recording.numnames; i++)
+		Zone_Free (fs_recording.names[i]);
+
+	if (fs_recording.names) Zone_Free (fs_recording.names);
+	if (fs_recording.hashes) Zone_Free (fs_recording.hashes);
+	if (fs_recording.chain) Zone_Free (fs_recording.chain);
+
+	memset (&fs_recording, 0, sizeof (fs_recording));
+}
+
+
+static void FS_RecordLoad (char *path)
+{
+	char canonical[MAX_OSPATH];
+	unsigned hash;
+	int i;
+
+	if (!fs_recording.active)
+		return;
+
+	if (!FS_CanonicalName (canonical, path, sizeof (canonical)))
+		return;
+
+	hash = FS_HashName (canonical);
+
+	Sys_Lock (fs_recordlock);
+
+	// ended while we were getting the name
+	if (!fs_recording.active)
+	{
+		Sys_Unlock (fs_recordlock);
+		return;
+	}
+
+	// only the first load of each file matters
+	for (i = fs_recording.buckets[hash & (FS_RECORD_HASHSIZE - 1)]; i; i = fs_recording.chain[i - 1])
+	{
+		if (fs_recording.hashes[i - 1] == hash && !strcmp (fs_recording.names[i - 1], canonical))
+		{
+			Sys_Unlock (fs_recordlock);
+			return;
+		}
+	}
+
+	if (fs_recording.numnames == fs_recording.maxnames)
+	{
+		int newmax = fs_recording.maxnames ? fs_recording.maxnames * 2 : 256;
+		char **newnames = Zone_AllocCategory (newmax * sizeof (char *), MEM_FILESYSTEM);
+		unsigned *newhashes = Zone_AllocCategory (newmax * sizeof (unsigned), MEM_FILESYSTEM);
+		int *newchain = Zone_AllocCategory (newmax * sizeof (int), MEM_FILESYSTEM);
+
+		if (fs_recording.numnames)
+		{
+			memcpy (newnames, fs_recording.names, fs_recording.numnames * sizeof (char *));
+			memcpy (newhashes, fs_recording.hashes, fs_recording.numnames * sizeof (unsigned));
+			memcpy (newchain, fs_recording.chain, fs_recording.numnames * sizeof (int));
+			Zone_Free (fs_recording.names);
+			Zone_Free (fs_recording.hashes);
+			Zone_Free (fs_recording.chain);
+		}
+
+		fs_recording.names = newnames;
+		fs_recording.hashes = newhashes;
+		fs_recording.chain = newchain;
+		fs_recording.maxnames = newmax;
+	}
+
+	fs_recording.names[fs_recording.numnames] = CopyString (canonical);
+	fs_recording.hashes[fs_recording.numnames] = hash;
+	fs_recording.chain[fs_recording.numnames] = fs_recording.buckets[hash & (FS_RECORD_HASHSIZE - 1)];
+	fs_recording.numnames++;
+	fs_recording.buckets[hash & (FS_RECORD_HASHSIZE - 1)] = fs_recording.numnames;
+
+	Sys_Unlock (fs_recordlock);
+}
+
+
+/*
+=================
+FS_ReplayManifest
+=================
+*/
+static void FS_ReplayManifest (char *mapname)
+{
+	char	line[MAX_OSPATH];
+	char	**names;
+	int		numnames = 0, maxnames = 256, i;
+	FILE	*f;
+
+	// not through the search path so that it doesn't record itself
+	if ((f = fopen (va ("%s/manifests/%s.txt", fs_gamedir, mapname), "r")) == NULL)
+		return;
+
+	names = Zone_AllocCategory (maxnames * sizeof (char *), MEM_FILESYSTEM);
+
+	while (fgets (line, sizeof (line), f))
+	{
+		char *s = line + strlen (line);
+
+		while (s > line && (s[-1] == '\n' || s[-1] == '\r'))
+			*--s = 0;
+
+		if (!line[0])
+			continue;
+
+		if (numnames == maxnames)
+		{
+			char **newnames = Zone_AllocCategory (maxnames * 2 * sizeof (char *), MEM_FILESYSTEM);
+
+			memcpy (newnames, names, maxnames * sizeof (char *));
+			Zone_Free (names);
+
+			names = newnames;
+			maxnames *= 2;
+		}
+
+		names[numnames++] = CopyString (line);
+	}
+
+	fclose (f);
+
+	FS_StartPrefetch (names, numnames);
+
+	for (i = 0; i < numnames; i++)
+		Zone_Free (names[i]);
+
+	Zone_Free (names);
+
+	Com_DPrintf ("replayed %i file manifest for %s\n", numnames, mapname);
+}
+
+
+/*
+=================
+FS_BeginLoadRecording
+
+called when a map load starts on either side; a listen server and its client share one recording
+=================
+*/
+void FS_BeginLoadRecording (char *mapname)
+{
+	if (!fs_manifests->value)
+		return;
+
+	// the client starts loading the map the server has just spawned
+	if (fs_recording.active && !Q_strcasecmp (fs_recording.mapname, mapname))
+		return;
+
+	// a load that never finished
+	Sys_Lock (fs_recordlock);
+	FS_ClearRecording ();
+	Sys_Unlock (fs_recordlock);
+
+	Com_sprintf (fs_recording.mapname, sizeof (fs_recording.mapname), "%s", mapname);
+	FS_ReplayManifest (fs_recording.mapname);
+	fs_recording.active = true;
+}
+
+
+/*
+=================
+FS_EndLoadRecording
+=================
 */
-int FS_LoadFile (char *path, void **buffer)
+void FS_EndLoadRecording (void)
 {
-	FILE	*h;
-	byte	*buf;
-	int		len;
+	FILE	*f;
+	char	name[MAX_OSPATH];
+	int		i;
 
-	buf = NULL;	// quiet compiler warning
-
-	// look for it in the filesystem or pack files
-	len = FS_FOpenFile (path, &h);
+	if (!fs_recording.active)
+		return;
 
-	if (!h)
-	{
-		if (buffer)
-			*buffer = NULL;
-		return -1;
-	}
+	// stop recording before anything is written
+	Sys_Lock (fs_recordlock);
+	fs_recording.active = false;
+	Sys_Unlock (fs_recordlock);
 
-	if (!buffer)
+	if (fs_recording.numnames)
 	{
-		fclose (h);
-		return len;
-	}
+		Com_sprintf (name, sizeof (name), "%s/manifests/%s.txt", fs_gamedir, fs_recording.mapname);
+		FS_CreatePath (name);
 
-	buf = Zone_Alloc (len);
-	*buffer = buf;
+		if ((f = fopen (name, "w")) != NULL)
+		{
+			for (i = 0; i < fs_recording.numnames; i++)
+				fprintf (f, "%s\n", fs_recording.names[i]);
 
-	FS_Read (buf, len, h);
+			fclose (f);
+		}
+	}
 
-	fclose (h);
+	Com_DPrintf ("recorded %i file manifest for %s\n", fs_recording.numnames, fs_recording.mapname);
 
-	return len;
+	Sys_Lock (fs_recordlock);
+	FS_ClearRecording ();
+	Sys_Unlock (fs_recordlock);
 }
 
 
 /*
-=============
-FS_FreeFile
-=============
+=================
+FS_MapPack
+
+map the whole pack so that loads don't need to reopen it; if this fails (address space) it falls back to fopen
+=================
 */
-void FS_FreeFile (void *buffer)
+static void FS_MapPack (pack_t *pack)
 {
-	Zone_Free (buffer);
+	int i;
+
+	if (!fs_mappacks->value)
+		return;
+
+	if ((pack->mapped = Sys_MapFile (pack->filename, &pack->mappedlen)) == NULL)
+		return;
+
+	// a hacked pack could point outside the file; don't map those
+	for (i = 0; i < pack->numfiles; i++)
+	{
+		packfile_t *pf = &pack->files[i];
+
+		if (pf->filepos < 0 || pf->complen < 0 || pf->filepos > pack->mappedlen || pf->complen > pack->mappedlen - pf->filepos)
+		{
+			Sys_UnmapFile (pack->mapped);
+			pack->mapped = NULL;
+			pack->mappedlen = 0;
+			return;
+		}
+	}
 }
 
+
 /*
 =================
 FS_LoadPackFile
@@ -423,8 +2267,9 @@ of the list so they override previous pack files.
 pack_t *FS_LoadPackFile (char *packfile)
 {
 	dpackheader_t	header;
-	int				i, j;
-	dpackfile_t		*newfiles;
+	int				i;
+	dpackfile_t		*diskfiles;
+	packfile_t		*newfiles;
 	int				numpackfiles;
 	pack_t			*pack;
 	FILE			*packhandle;
@@ -447,51 +2292,207 @@ pack_t *FS_LoadPackFile (char *packfile)
 	if (numpackfiles > MAX_FILES_IN_PACK)
 		Com_Error (ERR_FATAL, "%s has %i files", packfile, numpackfiles);
 
-	newfiles = Zone_Alloc (numpackfiles * sizeof (dpackfile_t));
+	diskfiles = Zone_AllocCategory (numpackfiles * sizeof (dpackfile_t), MEM_FILESYSTEM);
 
 	fseek (packhandle, header.dirofs, SEEK_SET);
-	fread (newfiles, 1, header.dirlen, packhandle);
+	fread (diskfiles, 1, header.dirlen, packhandle);
 
 	// crc the directory to check for modifications
-	checksum = Com_BlockChecksum ((void *) newfiles, header.dirlen);
+	checksum = Com_BlockChecksum ((void *) diskfiles, header.dirlen);
 
 #ifdef NO_ADDONS
 	if (checksum != PAK0_CHECKSUM)
+	{
+		Zone_Free (diskfiles);
+		fclose (packhandle);
 		return NULL;
+	}
 #endif
 	// parse the directory
+	newfiles = Zone_AllocCategory (numpackfiles * sizeof (packfile_t), MEM_FILESYSTEM);
+
 	for (i = 0; i < numpackfiles; i++)
 	{
-		_strlwr (newfiles[i].name); // force it to lower-case for binary search stuff
-		newfiles[i].filepos = LittleLong (newfiles[i].filepos);
-		newfiles[i].filelen = LittleLong (newfiles[i].filelen);
+		memcpy (newfiles[i].name, diskfiles[i].name, sizeof (diskfiles[i].name));
+		newfiles[i].filepos = LittleLong (diskfiles[i].filepos);
+		newfiles[i].filelen = newfiles[i].complen = LittleLong (diskfiles[i].filelen);
+		newfiles[i].compression = ZIP_STORED;
 	}
 
-	// sort the pack by name for faster searching
-	qsort (newfiles, numpackfiles, sizeof (dpackfile_t), (sortfunc_t) FS_SortPackFile);
+	Zone_Free (diskfiles);
 
-	pack = Zone_Alloc (sizeof (pack_t));
+	pack = Zone_AllocCategory (sizeof (pack_t), MEM_FILESYSTEM);
 	strcpy (pack->filename, packfile);
 	pack->handle = packhandle;
 	pack->numfiles = numpackfiles;
 	pack->files = newfiles;
 
-	// set up default ranges such that the search won't run
-	for (i = 0; i < 256; i++)
+	FS_MapPack (pack);
+
+	Com_Printf ("Added packfile %s (%i files)\n", packfile, numpackfiles);
+	return pack;
+}
+
+
+/*
+=================
+FS_LoadZipFile
+
+Takes an explicit path to a .pk3 (a plain zip).  Only stored and deflated entries are
+supported, and zip64, spanned and encrypted archives are rejected.  The data offset of
+each entry is resolved from its local header here so loads can go straight to it.
+=================
+*/
+#define ZIP_LOCALHEADER_SIZE	30
+#define ZIP_CENTRALHEADER_SIZE	46
+#define ZIP_ENDHEADER_SIZE		22
+#define ZIP_MAXCOMMENT			0xffff
+
+#define ZIP_LOCALHEADER_ID		0x04034b50
+#define ZIP_CENTRALHEADER_ID	0x02014b50
+#define ZIP_ENDHEADER_ID		0x06054b50
+
+// zip headers aren't aligned so they're read a byte at a time
+#define ZIP_SHORT(p)	((p)[0] | ((p)[1] << 8))
+#define ZIP_LONG(p)		((p)[0] | ((p)[1] << 8) | ((p)[2] << 16) | ((unsigned) (p)[3] << 24))
+
+pack_t *FS_LoadZipFile (char *zipfile)
+{
+	FILE		*ziphandle;
+	byte		*tail = NULL, *dir = NULL, *end = NULL, *cd;
+	byte		local[ZIP_LOCALHEADER_SIZE];
+	int			filelen, taillen, dirofs, dirlen, numentries;
+	int			i, numzipfiles = 0;
+	packfile_t	*newfiles = NULL;
+	pack_t		*pack;
+
+	if ((ziphandle = fopen (zipfile, "rb")) == NULL)
+		return NULL;
+
+	filelen = FS_filelength (ziphandle);
+
+	// the end of central directory record is at the end, followed by a comment of up to 64k
+	if ((taillen = filelen) > ZIP_ENDHEADER_SIZE + ZIP_MAXCOMMENT)
+		taillen = ZIP_ENDHEADER_SIZE + ZIP_MAXCOMMENT;
+
+	if (taillen < ZIP_ENDHEADER_SIZE)
+		goto badzip;
+
+	tail = Zone_AllocCategory (taillen, MEM_FILESYSTEM);
+	fseek (ziphandle, filelen - taillen, SEEK_SET);
+
+	if (fread (tail, 1, taillen, ziphandle) != taillen)
+		goto badzip;
+
+	for (i = taillen - ZIP_ENDHEADER_SIZE; i >= 0; i--)
 	{
-		pack->namesmin[i] = pack->numfiles - 1;
-		pack->namesmax[i] = 0;
+		if (ZIP_LONG (&tail[i]) == ZIP_ENDHEADER_ID)
+		{
+			end = &tail[i];
+			break;
+		}
 	}
 
-	// set up constrained ranges
-	for (i = 0, j = pack->numfiles - 1; i < pack->numfiles; i++, j--)
+	// no end record, or a multi-disk archive
+	if (!end || ZIP_SHORT (&end[4]) != 0 || ZIP_SHORT (&end[6]) != 0)
+		goto badzip;
+
+	numentries = ZIP_SHORT (&end[10]);
+	dirlen = ZIP_LONG (&end[12]);
+	dirofs = ZIP_LONG (&end[16]);
+
+	// this also catches zip64, which has 0xffffffff here; subtract rather than add so a hacked offset can't overflow past the check
+	if (dirofs < 0 || dirlen < 0 || dirofs > filelen || dirlen > filelen - dirofs)
+		goto badzip;
+
+	// read the central directory
+	dir = Zone_AllocCategory (dirlen, MEM_FILESYSTEM);
+	fseek (ziphandle, dirofs, SEEK_SET);
+
+	if (fread (dir, 1, dirlen, ziphandle) != dirlen)
+		goto badzip;
+
+	newfiles = Zone_AllocCategory (numentries * sizeof (packfile_t), MEM_FILESYSTEM);
+
+	for (i = 0, cd = dir; i < numentries; i++)
 	{
-		pack->namesmin[pack->files[j].name[0]] = j;
-		pack->namesmax[pack->files[i].name[0]] = i;
+		int namelen, localofs, compression;
+		packfile_t *pf = &newfiles[numzipfiles];
+
+		if (cd + ZIP_CENTRALHEADER_SIZE > dir + dirlen || ZIP_LONG (cd) != ZIP_CENTRALHEADER_ID)
+			goto badzip;
+
+		namelen = ZIP_SHORT (&cd[28]);
+		compression = ZIP_SHORT (&cd[10]);
+		localofs = ZIP_LONG (&cd[42]);
+
+		if (cd + ZIP_CENTRALHEADER_SIZE + namelen > dir + dirlen)
+			goto badzip;
+
+		// skip directories, encrypted entries, compression we can't handle and names that are too long for the game
+		if ((compression == ZIP_STORED || compression == ZIP_DEFLATED) && !(ZIP_SHORT (&cd[8]) & 1) &&
+			namelen > 0 && namelen < MAX_QPATH && cd[ZIP_CENTRALHEADER_SIZE + namelen - 1] != '/')
+		{
+			memcpy (pf->name, &cd[ZIP_CENTRALHEADER_SIZE], namelen);
+			pf->name[namelen] = 0;
+			pf->compression = compression;
+			pf->complen = ZIP_LONG (&cd[20]);
+			pf->filelen = ZIP_LONG (&cd[24]);
+
+			// the local header's name and extra field lengths can differ from the central directory's
+			fseek (ziphandle, localofs, SEEK_SET);
+
+			if (localofs < 0 || localofs > filelen || fread (local, 1, ZIP_LOCALHEADER_SIZE, ziphandle) != ZIP_LOCALHEADER_SIZE || ZIP_LONG (local) != ZIP_LOCALHEADER_ID)
+				goto badzip;
+
+			pf->filepos = localofs + ZIP_LOCALHEADER_SIZE + ZIP_SHORT (&local[26]) + ZIP_SHORT (&local[28]);
+
+			// localofs is bounded above, so filepos can't have overflowed
+			if (pf->filelen < 0 || pf->complen < 0 || pf->filepos > filelen || pf->complen > filelen - pf->filepos)
+				goto badzip;
+
+			if (compression == ZIP_STORED && pf->complen != pf->filelen)
+				goto badzip;
+
+			numzipfiles++;
+		}
+
+		cd += ZIP_CENTRALHEADER_SIZE + namelen + ZIP_SHORT (&cd[30]) + ZIP_SHORT (&cd[32]);
 	}
 
-	Com_Printf ("Added packfile %s (%i files)\n", packfile, numpackfiles);
+	Zone_Free (tail);
+	Zone_Free (dir);
+
+	pack = Zone_AllocCategory (sizeof (pack_t), MEM_FILESYSTEM);
+	strcpy (pack->filename, zipfile);
+	pack->handle = ziphandle;
+	pack->numfiles = numzipfiles;
+	pack->files = newfiles;
+	pack->zip = true;
+
+	FS_MapPack (pack);
+
+	Com_Printf ("Added packfile %s (%i files)\n", zipfile, numzipfiles);
 	return pack;
+
+badzip:;
+	// a broken download shouldn't take the whole game down, so just leave it out
+	Com_Printf ("%s is not a valid zip file\n", zipfile);
+
+	if (tail) Zone_Free (tail);
+	if (dir) Zone_Free (dir);
+	if (newfiles) Zone_Free (newfiles);
+
+	fclose (ziphandle);
+	return NULL;
+}
+
+
+char **FS_ListFiles (char *findname, int *numfiles, unsigned musthave, unsigned canthave);
+
+static int FS_SortNames (const void *a, const void *b)
+{
+	return strcmp (*(char **) a, *(char **) b);
 }
 
 
@@ -501,6 +2502,7 @@ FS_AddGameDirectory
 
 Sets fs_gamedir, adds the directory to the head of the path,
 then loads and adds pak1.pak pak2.pak ...
+followed by any .pk3 files in alphabetical order, so that pk3s override paks and later names override earlier ones
 ================
 */
 void FS_AddGameDirectory (char *dir)
@@ -509,11 +2511,13 @@ void FS_AddGameDirectory (char *dir)
 	searchpath_t	*search;
 	pack_t			*pak;
 	char			pakfile[MAX_OSPATH];
+	char			**zipfiles;
+	int				numzipfiles;
 
 	strcpy (fs_gamedir, dir);
 
 	// add the directory to the search path
-	search = Zone_Alloc (sizeof (searchpath_t));
+	search = Zone_AllocCategory (sizeof (searchpath_t), MEM_FILESYSTEM);
 	strcpy (search->filename, dir);
 	search->next = fs_searchpaths;
 	fs_searchpaths = search;
@@ -525,11 +2529,34 @@ void FS_AddGameDirectory (char *dir)
 		pak = FS_LoadPackFile (pakfile);
 		if (!pak)
 			continue;
-		search = Zone_Alloc (sizeof (searchpath_t));
+		search = Zone_AllocCategory (sizeof (searchpath_t), MEM_FILESYSTEM);
 		search->pack = pak;
 		search->next = fs_searchpaths;
 		fs_searchpaths = search;
 	}
+
+	// add any pk3 files
+	if ((zipfiles = FS_ListFiles (va ("%s/*.pk3", dir), &numzipfiles, 0, SFF_SUBDIR | SFF_HIDDEN | SFF_SYSTEM)) != NULL)
+	{
+		numzipfiles--;	// the list has a NULL guard on the end
+
+		qsort (zipfiles, numzipfiles, sizeof (char *), FS_SortNames);
+
+		for (i = 0; i < numzipfiles; i++)
+		{
+			if ((pak = FS_LoadZipFile (zipfiles[i])) != NULL)
+			{
+				search = Zone_AllocCategory (sizeof (searchpath_t), MEM_FILESYSTEM);
+				search->pack = pak;
+				search->next = fs_searchpaths;
+				fs_searchpaths = search;
+			}
+
+			Zone_Free (zipfiles[i]);
+		}
+
+		Zone_Free (zipfiles);
+	}
 }
 
 
@@ -583,11 +2610,23 @@ void FS_SetGamedir (char *dir)
 		return;
 	}
 
+	// the index, any prefetch and any outstanding loads point into the packs that are about to go
+	FS_CancelPrefetch ();
+	FS_FinishAsync ();
+	FS_FlushCache ();
+
+	Sys_Lock (fs_indexlock);
+	FS_FreeIndex ();
+	Sys_Unlock (fs_indexlock);
+
 	// free up any current game dir info
 	while (fs_searchpaths != fs_base_searchpaths)
 	{
 		if (fs_searchpaths->pack)
 		{
+			if (fs_searchpaths->pack->mapped)
+				Sys_UnmapFile (fs_searchpaths->pack->mapped);
+
 			fclose (fs_searchpaths->pack->handle);
 			Zone_Free (fs_searchpaths->pack->files);
 			Zone_Free (fs_searchpaths->pack);
@@ -615,6 +2654,8 @@ void FS_SetGamedir (char *dir)
 			FS_AddGameDirectory (va ("%s/%s", fs_cddir->string, dir));
 		FS_AddGameDirectory (va ("%s/%s", fs_basedir->string, dir));
 	}
+
+	FS_RebuildIndex ();
 }
 
 
@@ -659,7 +2700,7 @@ void FS_Link_f (void)
 	}
 
 	// create a new link
-	l = Zone_Alloc (sizeof (*l));
+	l = Zone_AllocCategory (sizeof (*l), MEM_FILESYSTEM);
 	l->next = fs_links;
 	fs_links = l;
 	l->from = CopyString (Cmd_Argv (1));
@@ -693,7 +2734,7 @@ char **FS_ListFiles (char *findname, int *numfiles, unsigned musthave, unsigned
 	nfiles++; // add space for a guard
 	*numfiles = nfiles;
 
-	list = Zone_Alloc (sizeof (char *) * nfiles);
+	list = Zone_AllocCategory (sizeof (char *) * nfiles, MEM_FILESYSTEM);
 	memset (list, 0, sizeof (char *) * nfiles);
 
 	s = Sys_FindFirst (findname, musthave, canthave);
@@ -702,7 +2743,7 @@ char **FS_ListFiles (char *findname, int *numfiles, unsigned musthave, unsigned
 	{
 		if (s[strlen (s) - 1] != '.')
 		{
-			list[nfiles] = strdup (s);
+			list[nfiles] = CopyString (s);
 #ifdef _WIN32
 			strlwr (list[nfiles]);
 #endif
@@ -787,7 +2828,7 @@ void FS_Path_f (void)
 		if (s == fs_base_searchpaths)
 			Com_Printf ("----------\n");
 		if (s->pack)
-			Com_Printf ("%s (%i files)\n", s->pack->filename, s->pack->numfiles);
+			Com_Printf ("%s (%i files%s%s)\n", s->pack->filename, s->pack->numfiles, s->pack->zip ? ", zip" : "", s->pack->mapped ? ", mapped" : "");
 		else
 			Com_Printf ("%s\n", s->filename);
 	}
@@ -826,6 +2867,250 @@ void FS_CopyFile (char *src, char *dst)
 }
 
 
+/*
+=============================================================================
+
+BUFFERED WRITERS
+
+Data is gathered into large blocks which are handed to a writer thread, so that the
+main thread never waits on the disk unless every block is still queued, in which case
+it waits for the writer to free one (so memory use is bounded by FSW_NUMBLOCKS).
+
+=============================================================================
+*/
+
+#define FSW_BLOCKSIZE	0x40000
+#define FSW_NUMBLOCKS	4
+
+struct fswriter_s {
+	FILE		*f;
+
+	// blocks [writeblock, writeblock + numqueued) belong to the writer thread, the next one is being filled
+	byte		*blocks[FSW_NUMBLOCKS];
+	int			blocklen[FSW_NUMBLOCKS];
+	int			writeblock;
+	int			numqueued;
+
+	void		*thread;			// NULL for synchronous writes
+	void		*lock;
+	void		*blockqueued;		// raised by the main thread when a block is queued or on shutdown
+	void		*blockwritten;		// raised by the writer thread when a block is freed
+	qboolean	shutdown;
+	qboolean	error;
+
+	int			numstalls;			// number of times the main thread had to wait for the writer
+};
+
+
+static unsigned FS_WriterThread (void *param)
+{
+	fswriter_t *w = (fswriter_t *) param;
+
+	for (;;)
+	{
+		int block;
+
+		Sys_Lock (w->lock);
+
+		while (!w->numqueued && !w->shutdown)
+		{
+			Sys_Unlock (w->lock);
+			Sys_WaitSignal (w->blockqueued, -1);
+			Sys_Lock (w->lock);
+		}
+
+		// on shutdown everything queued gets written before the thread exits
+		if (!w->numqueued)
+		{
+			Sys_Unlock (w->lock);
+			break;
+		}
+
+		block = w->writeblock;
+		Sys_Unlock (w->lock);
+
+		if (fwrite (w->blocks[block], 1, w->blocklen[block], w->f) != w->blocklen[block])
+			w->error = true;
+
+		Sys_Lock (w->lock);
+		w->blocklen[block] = 0;
+		w->writeblock = (w->writeblock + 1) % FSW_NUMBLOCKS;
+		w->numqueued--;
+		Sys_Unlock (w->lock);
+
+		Sys_RaiseSignal (w->blockwritten);
+	}
+
+	return 0;
+}
+
+
+/*
+==============
+FS_OpenWriter
+
+Creates the file and returns a writer for it, or NULL if it couldn't be opened.
+==============
+*/
+fswriter_t *FS_OpenWriter (char *filename, qboolean async)
+{
+	fswriter_t *w;
+	FILE *f;
+	int i;
+
+	if ((f = fopen (filename, "wb")) == NULL)
+		return NULL;
+
+	// we do our own buffering
+	setvbuf (f, NULL, _IONBF, 0);
+
+	w = Zone_AllocCategory (sizeof (fswriter_t), MEM_FILESYSTEM);
+	w->f = f;
+
+	// a synchronous writer only ever needs one block
+	for (i = 0; i < (async ? FSW_NUMBLOCKS : 1); i++)
+		w->blocks[i] = Zone_AllocCategory (FSW_BLOCKSIZE, MEM_FILESYSTEM);
+
+	if (async)
+	{
+		w->lock = Sys_CreateLock ();
+		w->blockqueued = Sys_CreateSignal ();
+		w->blockwritten = Sys_CreateSignal ();
+
+		if ((w->thread = Sys_CreateThread (FS_WriterThread, w)) == NULL)
+			Com_DPrintf ("FS_OpenWriter : couldn't create a writer thread for %s\n", filename);
+	}
+
+	return w;
+}
+
+
+static void FS_QueueWriterBlock (fswriter_t *w)
+{
+	if (!w->thread)
+	{
+		// synchronous
+		if (fwrite (w->blocks[0], 1, w->blocklen[0], w->f) != w->blocklen[0])
+			w->error = true;
+
+		w->blocklen[0] = 0;
+		return;
+	}
+
+	Sys_Lock (w->lock);
+
+	w->numqueued++;
+	Sys_RaiseSignal (w->blockqueued);
+
+	// back-pressure; wait until the writer has freed up the next block
+	if (w->numqueued == FSW_NUMBLOCKS)
+	{
+		w->numstalls++;
+
+		while (w->numqueued == FSW_NUMBLOCKS)
+		{
+			Sys_Unlock (w->lock);
+			Sys_WaitSignal (w->blockwritten, -1);
+			Sys_Lock (w->lock);
+		}
+	}
+
+	Sys_Unlock (w->lock);
+}
+
+
+static int FS_WriterFillBlock (fswriter_t *w)
+{
+	int block;
+
+	if (!w->thread)
+		return 0;
+
+	// only the main thread modifies numqueued upwards so reading it under the lock is stable enough here
+	Sys_Lock (w->lock);
+	block = (w->writeblock + w->numqueued) % FSW_NUMBLOCKS;
+	Sys_Unlock (w->lock);
+
+	return block;
+}
+
+
+/*
+==============
+FS_WriterWrite
+==============
+*/
+void FS_WriterWrite (fswriter_t *w, void *data, int len)
+{
+	byte *src = (byte *) data;
+
+	while (len > 0)
+	{
+		int block = FS_WriterFillBlock (w);
+		int copy = FSW_BLOCKSIZE - w->blocklen[block];
+
+		if (copy > len)
+			copy = len;
+
+		memcpy (w->blocks[block] + w->blocklen[block], src, copy);
+		w->blocklen[block] += copy;
+
+		src += copy;
+		len -= copy;
+
+		if (w->blocklen[block] == FSW_BLOCKSIZE)
+			FS_QueueWriterBlock (w);
+	}
+}
+
+
+/*
+==============
+FS_CloseWriter
+
+Flushes everything that's pending to disk and closes the file; returns false if any writes failed.
+==============
+*/
+qboolean FS_CloseWriter (fswriter_t *w, int *numstalls)
+{
+	qboolean ok;
+	int block = FS_WriterFillBlock (w);
+	int i;
+
+	// queue the partial block
+	if (w->blocklen[block])
+		FS_QueueWriterBlock (w);
+
+	if (w->thread)
+	{
+		Sys_Lock (w->lock);
+		w->shutdown = true;
+		Sys_Unlock (w->lock);
+
+		Sys_RaiseSignal (w->blockqueued);
+		Sys_WaitThread (w->thread);
+	}
+
+	Sys_DestroySignal (w->blockwritten);
+	Sys_DestroySignal (w->blockqueued);
+	Sys_DestroyLock (w->lock);
+
+	fclose (w->f);
+	ok = !w->error;
+
+	if (numstalls)
+		*numstalls = w->numstalls;
+
+	for (i = 0; i < FSW_NUMBLOCKS; i++)
+		if (w->blocks[i])
+			Zone_Free (w->blocks[i]);
+
+	Zone_Free (w);
+
+	return ok;
+}
+
+
 void FS_RemoveFile (char *filename)
 {
 	FILE *f;
@@ -867,6 +3152,31 @@ char *FS_NextPath (char *prevpath)
 }
 
 
+/*
+================
+FS_Stats_f
+
+fsstats [reset]; for timing precache, e.g. fsstats reset; map base1; fsstats
+================
+*/
+void FS_Stats_f (void)
+{
+	if (Cmd_Argc () > 1 && !Q_strcasecmp (Cmd_Argv (1), "reset"))
+	{
+		Sys_Lock (fs_statslock);
+		memset (&fs_stats, 0, sizeof (fs_stats));
+		Sys_Unlock (fs_statslock);
+		return;
+	}
+
+	Com_Printf ("%i loads (%i zero-copy, %i inflated), %i pack opens\n", fs_stats.numloads, fs_stats.numzerocopy, fs_stats.numinflated, fs_stats.numopens);
+	Com_Printf ("%i lookups (%i not found), %i files indexed\n", fs_stats.numlookups, fs_stats.nummisses, fs_numindexed);
+	Com_Printf ("%.1f kb in %.3f ms\n", fs_stats.bytes / 1024.0, fs_stats.time * 1000.0);
+	Com_Printf ("%i async loads, main thread blocked %.3f ms\n", fs_stats.numasync, fs_stats.blocked * 1000.0);
+	Com_Printf ("cache: %i hits, %i misses, %i evicted; %i files in %.1f kb\n", fs_stats.numcachehits, fs_stats.numcachemisses, fs_stats.numevicted, fs_cache.numentries, fs_cache.bytes / 1024.0);
+}
+
+
 /*
 ================
 FS_InitFilesystem
@@ -877,6 +3187,28 @@ void FS_InitFilesystem (void)
 	Cmd_AddCommand ("path", FS_Path_f);
 	Cmd_AddCommand ("link", FS_Link_f);
 	Cmd_AddCommand ("dir", FS_Dir_f);
+	Cmd_AddCommand ("fsstats", FS_Stats_f);
+	Cmd_AddCommand ("fs_rescan", FS_Rescan_f);
+	Cmd_AddCommand ("fsbench", FS_Bench_f);
+
+	fs_statslock = Sys_CreateLock ();
+
+	// fs_mappacks 0 disables memory-mapping of pack files, which may be needed if address space is tight
+	fs_mappacks = Cvar_Get ("fs_mappacks", "1", CVAR_NOSET, NULL);
+
+	// number of threads servicing FS_LoadFileAsync; 0 loads everything on the main thread when it's waited on
+	fs_iothreads = Cvar_Get ("fs_iothreads", "2", CVAR_NOSET, NULL);
+	FS_InitIOThreads ();
+
+	// record the files each map load uses to <gamedir>/manifests and prefetch them the next time it's loaded
+	fs_manifests = Cvar_Get ("fs_manifests", "0", CVAR_ARCHIVE, NULL);
+	fs_recordlock = Sys_CreateLock ();
+	fs_prefetch.lock = Sys_CreateLock ();
+
+	// mb of decompressed or unmapped pack data kept in memory across map changes; 0 disables
+	fs_cachesize = Cvar_Get ("fs_cachesize", "32", CVAR_ARCHIVE, NULL);
+	fs_cache.lock = Sys_CreateLock ();
+	fs_loanlock = Sys_CreateLock ();
 
 	// basedir <path>
 	// allows the game to run from outside the data tree
@@ -896,6 +3228,8 @@ void FS_InitFilesystem (void)
 	// any set gamedirs will be freed up to here
 	fs_base_searchpaths = fs_searchpaths;
 
+	FS_RebuildIndex ();
+
 	// check for game override
 	fs_gamedirvar = Cvar_Get ("game", "", CVAR_LATCH | CVAR_SERVERINFO, NULL);
 	if (fs_gamedirvar->string[0])
@@ -349,27 +349,25 @@ void Key_Console (int key)
 
 	if (key == K_PGUP || key == K_KP_PGUP)
 	{
-		con.display -= 2;
+		Con_Scroll (2);
 		return;
 	}
 
 	if (key == K_PGDN || key == K_KP_PGDN)
 	{
-		con.display += 2;
-		if (con.display > con.current)
-			con.display = con.current;
+		Con_Scroll (-2);
 		return;
 	}
 
 	if (key == K_HOME || key == K_KP_HOME)
 	{
-		con.display = con.current - con.totallines + 10;
+		Con_ScrollHome ();
 		return;
 	}
 
 	if (key == K_END || key == K_KP_END)
 	{
-		con.display = con.current;
+		Con_ScrollEnd ();
 		return;
 	}
 
@@ -220,7 +220,7 @@ static qboolean PlayerConfig_ScanDirectories (void)
 					if (strrchr (scratch, '.'))
 						*strrchr (scratch, '.') = 0;
 
-					skinnames[s] = strdup (scratch);
+					skinnames[s] = CopyString (scratch);
 					s++;
 				}
 			}
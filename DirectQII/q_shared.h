@@ -222,6 +222,7 @@ SYSTEM SPECIFIC
 extern	int	sys_currmsec;
 
 int Sys_Milliseconds (void);
+double Sys_FloatTime (void); // high-resolution seconds, for profiling only
 void Sys_Mkdir (char *path);
 
 
@@ -274,6 +275,7 @@ typedef struct cvar_s {
 	float		value;
 	cvarcallback_t Callback;
 	struct cvar_s *next;
+	struct cvar_s *hashnext;	// engine only; the game dll never allocates these
 } cvar_t;
 
 #endif		// CVAR
@@ -60,11 +60,101 @@ int Sys_Milliseconds (void)
 }
 
 
+/*
+================
+Sys_FloatTime
+
+doesn't update sys_currmsec so it's safe to use for timing things within a frame
+================
+*/
+double Sys_FloatTime (void)
+{
+	static __int64 qpcstart = 0;
+	static double qpcscale = 0;
+	__int64 qpcnow = 0;
+
+	if (!qpcstart)
+	{
+		__int64 qpcfreq = 0;
+
+		QueryPerformanceCounter ((LARGE_INTEGER *) &qpcstart);
+		QueryPerformanceFrequency ((LARGE_INTEGER *) &qpcfreq);
+
+		qpcscale = 1.0 / (double) qpcfreq;
+	}
+
+	QueryPerformanceCounter ((LARGE_INTEGER *) &qpcnow);
+
+	return (double) (qpcnow - qpcstart) * qpcscale;
+}
+
+
 void Sys_Mkdir (char *path)
 {
 	_mkdir (path);
 }
 
+
+/*
+================
+Sys_MapFile
+
+maps an entire file read-only and returns the base of the view, or NULL on failure; the
+view holds its own reference to the file so the handles can be closed immediately
+================
+*/
+void *Sys_MapFile (char *filename, int *length)
+{
+	HANDLE hFile, hMapping;
+	void *view = NULL;
+	DWORD size;
+
+	if ((hFile = CreateFile (filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	if ((size = GetFileSize (hFile, NULL)) != 0 && size != 0xffffffff && size < 0x7fffffff)
+	{
+		if ((hMapping = CreateFileMapping (hFile, NULL, PAGE_READONLY, 0, 0, NULL)) != NULL)
+		{
+			view = MapViewOfFile (hMapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle (hMapping);
+		}
+	}
+
+	CloseHandle (hFile);
+
+	if (view)
+		*length = (int) size;
+
+	return view;
+}
+
+
+void Sys_UnmapFile (void *base)
+{
+	if (base)
+		UnmapViewOfFile (base);
+}
+
+
+/*
+================
+Sys_ReserveMemory
+
+reserves address space without backing it with memory; pages must be committed before use and come back zeroed
+================
+*/
+void *Sys_ReserveMemory (int size)
+{
+	return VirtualAlloc (NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+
+qboolean Sys_CommitMemory (void *base, int size)
+{
+	return (VirtualAlloc (base, size, MEM_COMMIT, PAGE_READWRITE) != NULL);
+}
+
 //============================================
 
 char	findbase[MAX_OSPATH];
@@ -627,6 +627,9 @@ CMODEL
 
 
 cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum);
+void CM_PreloadMap (char *name);
+// starts reading and parsing the named map in the background so that a later CM_LoadMap only has to copy it in
+void CM_CancelPreload (void);
 cmodel_t *CM_InlineModel (char *name); // *1, *2, etc
 
 int CM_NumClusters (void);
@@ -703,6 +706,27 @@ int FS_LoadFile (char *path, void **buffer);
 // a null buffer will just return the file length without loading
 // a -1 length is not present
 
+int FS_LoadFileReadOnly (char *path, void **buffer);
+// as FS_LoadFile but the data may point directly into a mapped pack so it must not be written to,
+// isn't 0 terminated (text must go through FS_LoadFile), and mustn't be held past the current
+// frame since a gamedir change unmaps the packs; it must still be released with FS_FreeFile
+
+#define FS_READERROR	-2
+
+int FS_TryLoadFile (char *path, void **buffer, qboolean readonly);
+// as FS_LoadFile or FS_LoadFileReadOnly, but safe off the main thread: a file that's there but
+// can't be read returns FS_READERROR instead of a Com_Error, and the caller reports it
+
+typedef struct fsjob_s fsjob_t;
+
+typedef enum {FS_PRIORITY_HIGH, FS_PRIORITY_NORMAL, FS_PRIORITY_LOW, FS_NUM_PRIORITIES} fspriority_t;
+
+fsjob_t *FS_LoadFileAsync (char *path, fspriority_t priority, qboolean readonly);
+qboolean FS_FileReady (fsjob_t *job);
+int FS_WaitFile (fsjob_t *job, void **buffer);
+// queues a load on the i/o threads; the job must always be finished with FS_WaitFile (from the main
+// thread), which returns the same as FS_LoadFile or FS_LoadFileReadOnly would have and frees the job
+
 void FS_Read (void *buffer, int len, FILE *f);
 // properly handles partial reads
 
@@ -710,6 +734,28 @@ void FS_FreeFile (void *buffer);
 
 void FS_CreatePath (char *path);
 
+void FS_PrefetchFiles (char **names, int numnames);
+// hint that these files are about to be loaded; they're read in on a worker thread in
+// the order they sit in the packs so that the loads don't have to wait on the disk
+
+void FS_BeginLoadRecording (char *mapname);
+void FS_EndLoadRecording (void);
+// with fs_manifests set, the files loaded between these are saved as a per-map manifest which is
+// prefetched the next time the same map is loaded
+
+void FS_IndexNewFile (char *filename);
+// the file index is only rebuilt on a gamedir change or fs_rescan, so anything the engine
+// writes to the game directory that may be loaded back must be added with this; a file whose
+// path went through FS_CreatePath already has been
+
+typedef struct fswriter_s fswriter_t;
+
+fswriter_t *FS_OpenWriter (char *filename, qboolean async);
+void FS_WriterWrite (fswriter_t *w, void *data, int len);
+qboolean FS_CloseWriter (fswriter_t *w, int *numstalls);
+// buffered sequential output; an async writer does the disk writes on its own thread
+// and only blocks the caller if it falls too far behind
+
 void FS_CopyFile (char *src, char *dst);
 void FS_RemoveFile (char *filename);
 
@@ -758,9 +804,33 @@ void *Z_TagAlloc (int size, int tag);
 void Z_FreeTags (int tag);
 void Z_Init (void);
 
+void Hunk_BeginLoad (char *name);
+// resets the hunk high-water mark reported by meminfo for a new map load
+
+// memory accounting categories; keep mem_categorynames in sync
+typedef enum {
+	MEM_ZONE,			// anything not charged elsewhere
+	MEM_GAME,			// Z_TagAlloc
+	MEM_HUNK,
+	MEM_FILESYSTEM,		// pack directories, the file index and cache, file buffers
+	MEM_SOUND,
+	MEM_CINEMATIC,
+	MEM_IMAGES,			// textures, estimated from their size
+	MEM_MODELS,
+	MEM_COLLISION,
+	MEM_NUMCATEGORIES
+} memcategory_t;
+
 void *Zone_Alloc (int size);
+void *Zone_AllocCategory (int size, memcategory_t category);
 void Zone_Free (void *ptr);
 
+void Mem_Charge (memcategory_t category, int bytes);
+// for memory that isn't from Zone_Alloc; negative bytes releases it
+
+void Mem_Init (void);
+void Mem_Frame (void);
+
 void Qcommon_Init (int argc, char **argv);
 void Qcommon_Frame (int msec);
 void Qcommon_Shutdown (void);
@@ -788,11 +858,49 @@ void Sys_UnloadGame (void);
 void *Sys_GetGameAPI (void *parms);
 // loads the game dll and calls the api init function
 
+void *Sys_MapFile (char *filename, int *length);
+void Sys_UnmapFile (void *base);
+// read-only memory mapping of a whole file; returns NULL if it can't be mapped
+
+void *Sys_ReserveMemory (int size);
+qboolean Sys_CommitMemory (void *base, int size);
+// address space that's committed in pieces as it's used; newly committed memory is zeroed
+
 void Sys_SendKeyEvents (void);
 void Sys_Error (char *error, ...);
 void Sys_Quit (void);
 char *Sys_GetClipboardData (void);
 
+// background work; worker threads must not call Com_Error or touch main-thread state
+typedef unsigned (*systhreadfunc_t) (void *);
+
+void *Sys_CreateThread (systhreadfunc_t func, void *param);
+void Sys_WaitThread (void *thread);
+// waits for the thread to complete and releases it
+
+qboolean Sys_IsMainThread (void);
+
+void *Sys_CreateLock (void);
+void Sys_DestroyLock (void *lock);
+void Sys_Lock (void *lock);
+void Sys_Unlock (void *lock);
+
+// for the lock-free rings; keeps the stores to anything a volatile index publishes ahead of the store to the index
+#ifdef _MSC_VER
+#include <intrin.h>
+#define	Sys_WriteBarrier()	_WriteBarrier ()
+#else
+#define	Sys_WriteBarrier()	__atomic_thread_fence (__ATOMIC_RELEASE)
+#endif
+
+void *Sys_CreateSignal (void);
+void Sys_DestroySignal (void *signal);
+void Sys_RaiseSignal (void *signal);
+qboolean Sys_WaitSignal (void *signal, int msec);
+// returns false on a timeout; msec < 0 waits forever
+
+void Sys_Sleep (int msec);
+
 /*
 ==============================================================
 
@@ -156,8 +156,8 @@ Image_LoadPCX
 */
 void Image_LoadPCX (char *filename, byte **pic, byte **palette, int *width, int *height)
 {
-	byte	*raw;
-	pcx_t	*pcx;
+	byte	*raw, *file;
+	pcx_t	header, *pcx = &header;
 	int		x, y;
 	int		len;
 	int		dataByte, runLength;
@@ -167,16 +167,23 @@ void Image_LoadPCX (char *filename, byte **pic, byte **palette, int *width, int
 	*palette = NULL;
 
 	// load the file
-	len = ri.FS_LoadFile (filename, (void **) &raw);
+	len = ri.FS_LoadFileReadOnly (filename, (void **) &file);
 
-	if (!raw)
+	if (!file)
 	{
 		ri.Con_Printf (PRINT_DEVELOPER, "Bad pcx file %s\n", filename);
 		return;
 	}
 
-	// parse the PCX file
-	pcx = (pcx_t *) raw;
+	if (len < sizeof (pcx_t) + 768)
+	{
+		ri.Con_Printf (PRINT_ALL, "Bad pcx file %s\n", filename);
+		ri.FS_FreeFile (file);
+		return;
+	}
+
+	// parse the PCX file; the header is copied off because the file data may be read-only
+	memcpy (&header, file, sizeof (pcx_t));
 
 	pcx->xmin = LittleShort (pcx->xmin);
 	pcx->ymin = LittleShort (pcx->ymin);
@@ -187,11 +194,12 @@ void Image_LoadPCX (char *filename, byte **pic, byte **palette, int *width, int
 	pcx->bytes_per_line = LittleShort (pcx->bytes_per_line);
 	pcx->palette_type = LittleShort (pcx->palette_type);
 
-	raw = &pcx->data;
+	raw = &((pcx_t *) file)->data;
 
 	if (pcx->manufacturer != 0x0a || pcx->version != 5 || pcx->encoding != 1 || pcx->bits_per_pixel != 8)
 	{
 		ri.Con_Printf (PRINT_ALL, "Bad pcx file %s\n", filename);
+		ri.FS_FreeFile (file);
 		return;
 	}
 
@@ -203,7 +211,7 @@ void Image_LoadPCX (char *filename, byte **pic, byte **palette, int *width, int
 	if (palette)
 	{
 		*palette = ri.Hunk_Alloc (768);
-		memcpy (*palette, (byte *) pcx + len - 768, 768);
+		memcpy (*palette, file + len - 768, 768);
 	}
 
 	if (width) *width = pcx->xmax + 1;
@@ -228,13 +236,13 @@ void Image_LoadPCX (char *filename, byte **pic, byte **palette, int *width, int
 		}
 	}
 
-	if (raw - (byte *) pcx > len)
+	if (raw - file > len)
 	{
 		ri.Con_Printf (PRINT_DEVELOPER, "PCX file %s was malformed", filename);
 		*pic = NULL;
 	}
 
-	ri.FS_FreeFile (pcx);
+	ri.FS_FreeFile (file);
 }
 
 
@@ -274,12 +282,12 @@ byte *Image_LoadTGA (char *name, int *width, int *height)
 	byte	*buf_p;
 	byte	*buffer;
 	int		length;
-	TargaHeader		*targa_header;
+	TargaHeader		header, *targa_header = &header;
 	byte			*targa_rgba;
 	byte *pic = NULL;
 
 	// load the file
-	length = ri.FS_LoadFile (name, (void **) &buffer);
+	length = ri.FS_LoadFileReadOnly (name, (void **) &buffer);
 
 	if (!buffer)
 	{
@@ -289,7 +297,8 @@ byte *Image_LoadTGA (char *name, int *width, int *height)
 
 	buf_p = buffer;
 
-	targa_header = (TargaHeader *) buf_p;
+	// the header is copied off because the file data may be read-only
+	memcpy (&header, buf_p, sizeof (TargaHeader));
 	buf_p += sizeof (TargaHeader);
 
 	targa_header->colormap_index = LittleShort (targa_header->colormap_index);
@@ -889,7 +898,7 @@ byte *Image_LoadPNG (char *name, int *width, int *height)
 	byte *buf = NULL;
 	int len = 0;
 
-	if ((len = ri.FS_LoadFile (name, (void **) &buf)) != -1)
+	if ((len = ri.FS_LoadFileReadOnly (name, (void **) &buf)) != -1)
 	{
 		// attempt to load as 4-component RGBA
 		int channels = 0;
@@ -178,6 +178,32 @@ void Mod_Init (void)
 
 
 
+/*
+==================
+Mod_HeapBytes
+
+totals up what a model's loader put on its heap
+==================
+*/
+static int Mod_HeapBytes (HANDLE hHeap)
+{
+	PROCESS_HEAP_ENTRY entry;
+	int bytes = 0;
+
+	if (!hHeap) return 0;
+
+	entry.lpData = NULL;
+
+	while (HeapWalk (hHeap, &entry))
+	{
+		if (entry.wFlags & PROCESS_HEAP_ENTRY_BUSY)
+			bytes += entry.cbData;
+	}
+
+	return bytes;
+}
+
+
 /*
 ==================
 Mod_ForName
@@ -279,6 +305,9 @@ model_t *Mod_ForName (char *name, qboolean crash)
 
 	ri.FS_FreeFile (buf);
 
+	mod->membytes = Mod_HeapBytes (mod->hHeap);
+	ri.Mem_Charge (MEM_MODELS, mod->membytes);
+
 	return mod;
 }
 
@@ -452,6 +481,8 @@ Mod_Free
 */
 void Mod_Free (model_t *mod)
 {
+	ri.Mem_Charge (MEM_MODELS, -mod->membytes);
+
 	if (mod->hHeap)
 	{
 		HeapDestroy (mod->hHeap);
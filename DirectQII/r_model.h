@@ -233,6 +233,7 @@ typedef struct model_s {
 
 	// Heap memory handle for this model
 	HANDLE		hHeap;
+	int			membytes;	// what's on hHeap after loading, for meminfo
 
 	// headers for MD2 and SPR (to do - move BSP here too)
 	// these were a union but we want it to be more explicit and make it an error if the wrong header type is accessed for a model
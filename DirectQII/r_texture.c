@@ -77,6 +77,34 @@ void R_DescribeTexture (D3D11_TEXTURE2D_DESC *Desc, int width, int height, int a
 }
 
 
+/*
+================
+R_ChargeTexture
+
+charges (or with a negative sign releases) a texture's memory to the images category; everything we create is 32 bits per texel
+================
+*/
+static void R_ChargeTexture (ID3D11Texture2D *Texture, int sign)
+{
+	D3D11_TEXTURE2D_DESC Desc;
+	int width, height, level, bytes = 0;
+
+	if (!Texture) return;
+
+	Texture->lpVtbl->GetDesc (Texture, &Desc);
+
+	for (level = 0, width = Desc.Width, height = Desc.Height; level < Desc.MipLevels; level++)
+	{
+		bytes += width * height * 4;
+
+		if ((width >>= 1) < 1) width = 1;
+		if ((height >>= 1) < 1) height = 1;
+	}
+
+	ri.Mem_Charge (MEM_IMAGES, sign * bytes * Desc.ArraySize);
+}
+
+
 void R_CreateTexture32 (image_t *image, unsigned *data)
 {
 	D3D11_TEXTURE2D_DESC Desc;
@@ -150,6 +178,8 @@ void R_CreateTexture32 (image_t *image, unsigned *data)
 	// no RTV on this one
 	image->RTV = NULL;
 
+	R_ChargeTexture (image->Texture, 1);
+
 	// free loading memory
 	ri.Hunk_FreeToLowMark (mark);
 }
@@ -341,7 +371,7 @@ image_t *GL_LoadWal (char *name, int flags)
 		return image;
 
 	// load the pic from disk
-	ri.FS_LoadFile (name, (void **) &mt);
+	ri.FS_LoadFileReadOnly (name, (void **) &mt);
 
 	if (!mt)
 	{
@@ -511,6 +541,8 @@ void R_FreeUnusedImages (void)
 		// disposable type
 		if (image->flags & TEX_DISPOSABLE)
 		{
+			R_ChargeTexture (image->Texture, -1);
+
 			SAFE_RELEASE (image->Texture);
 			SAFE_RELEASE (image->SRV);
 			SAFE_RELEASE (image->RTV);
@@ -545,6 +577,8 @@ void R_ShutdownImages (void)
 
 	for (i = 0, image = gltextures; i < MAX_GLTEXTURES; i++, image++)
 	{
+		R_ChargeTexture (image->Texture, -1);
+
 		SAFE_RELEASE (image->Texture);
 		SAFE_RELEASE (image->SRV);
 		SAFE_RELEASE (image->RTV);
@@ -595,6 +629,8 @@ image_t *R_LoadTexArray (char *base)
 	if (FAILED (d3d_Device->lpVtbl->CreateTexture2D (d3d_Device, &Desc, srd, &image->Texture))) ri.Sys_Error (ERR_FATAL, "CreateTexture2D failed");
 	if (FAILED (d3d_Device->lpVtbl->CreateShaderResourceView (d3d_Device, (ID3D11Resource *) image->Texture, NULL, &image->SRV))) ri.Sys_Error (ERR_FATAL, "CreateShaderResourceView failed");
 
+	R_ChargeTexture (image->Texture, 1);
+
 	// no RTV on this one
 	image->RTV = NULL;
 
@@ -627,6 +663,8 @@ void R_CreateRenderTarget (texture_t *rt)
 	if (FAILED (d3d_Device->lpVtbl->CreateTexture2D (d3d_Device, &rt->Desc, NULL, &rt->Texture))) ri.Sys_Error (ERR_FATAL, "CreateTexture2D failed");
 	if (FAILED (d3d_Device->lpVtbl->CreateShaderResourceView (d3d_Device, (ID3D11Resource *) rt->Texture, NULL, &rt->SRV))) ri.Sys_Error (ERR_FATAL, "CreateShaderResourceView failed");
 	if (FAILED (d3d_Device->lpVtbl->CreateRenderTargetView (d3d_Device, (ID3D11Resource *) rt->Texture, NULL, &rt->RTV))) ri.Sys_Error (ERR_FATAL, "CreateRenderTargetView failed");
+
+	R_ChargeTexture (rt->Texture, 1);
 }
 
 
@@ -645,11 +683,15 @@ void R_CreateTexture (texture_t *t, D3D11_SUBRESOURCE_DATA *srd, int width, int
 
 	// no RTV on this one
 	t->RTV = NULL;
+
+	R_ChargeTexture (t->Texture, 1);
 }
 
 
 void R_ReleaseTexture (texture_t *t)
 {
+	R_ChargeTexture (t->Texture, -1);
+
 	SAFE_RELEASE (t->Texture);
 	SAFE_RELEASE (t->SRV);
 	SAFE_RELEASE (t->RTV);
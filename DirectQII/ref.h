@@ -230,6 +230,7 @@ typedef struct refimport_s {
 	// loading temp allocations
 	void *(*Hunk_Alloc) (int size);
 	int (*Hunk_LowMark) (void);
+	void (*Mem_Charge) (memcategory_t category, int bytes);
 	void (*Hunk_FreeToLowMark) (int);
 
 	void (*Cmd_AddCommand) (char *name, void (*cmd) (void));
@@ -246,6 +247,7 @@ typedef struct refimport_s {
 	// a -1 return means the file does not exist
 	// NULL can be passed for buf to just determine existance
 	int (*FS_LoadFile) (char *name, void **buf);
+	int (*FS_LoadFileReadOnly) (char *name, void **buf);
 	void (*FS_FreeFile) (void *buf);
 
 	// gamedir will be the current directory that generated
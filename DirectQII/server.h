@@ -169,9 +169,14 @@ typedef struct server_static_s {
 	challenge_t	challenges[MAX_CHALLENGES];	// to prevent invalid IPs from connecting
 
 	// serverrecord values
-	FILE		*demofile;
+	fswriter_t	*demofile;
 	sizebuf_t	demo_multicast;
 	byte		demo_multicast_buf[MAX_MSGLEN];
+
+	// main-thread cost of recording, reported by serverstop
+	int			demo_frames;
+	double		demo_totaltime;
+	double		demo_maxtime;
 } server_static_t;
 
 //=============================================================================
@@ -188,6 +193,8 @@ extern	cvar_t		*sv_paused;
 extern	cvar_t		*maxclients;
 extern	cvar_t		*sv_noreload;			// don't reload level state when reentering
 extern	cvar_t		*sv_airaccelerate;		// don't reload level state when reentering
+extern	cvar_t		*sv_preloadmaps;		// read the nextserver map in the background
+extern	cvar_t		*sv_asyncdemos;			// write serverrecord demos on a separate thread
 // development tool
 extern	cvar_t		*sv_enforcetime;
 
@@ -219,6 +226,7 @@ void Master_Heartbeat (void);
 //
 void SV_InitGame (void);
 void SV_Map (qboolean attractloop, char *levelstring, qboolean loadgame);
+void SV_PreloadLevel (char *levelstring);
 
 
 //
@@ -22,12 +22,79 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "client.h"
 #include "snd_loc.h"
 
+#ifdef S_MIX_X86
+#include <emmintrin.h>
+#endif
+
 void S_Play (void);
 void S_SoundList (void);
 void S_Update_ ();
 void S_StopAllSounds (void);
 
 
+// =======================================================================
+// Mixer thread commands
+// =======================================================================
+
+// everything the mixer owns (channels, playsounds, paintedtime and the DMA
+// buffer) is only changed through these, so the game never waits on the mixer
+typedef enum sndcmdtype_s
+{
+	SND_CMD_START,			// queue a playsound
+	SND_CMD_STOPALL,		// clear the channels, playsounds and DMA buffer
+	SND_CMD_LISTENER,		// new frame; respatialize and drop the autosounds
+	SND_CMD_ENTITY,			// origin of an entity with a dynamic sound
+	SND_CMD_LOOPSOUND,		// merged autosound for this frame
+	SND_CMD_RELEASE,		// stop anything using an sfx that's about to be freed
+	SND_CMD_PAUSE,			// stop touching the DMA buffer
+	SND_CMD_SILENCE,		// keep the DMA buffer cleared and don't mix
+	SND_CMD_FENCE			// raise s_mixfence
+} sndcmdtype_t;
+
+typedef struct sndcmd_s
+{
+	sndcmdtype_t	type;
+
+	union
+	{
+		playsound_t	play;
+		listener_t	listener;
+		struct { int entnum; vec3_t origin; } entity;
+		struct { sfx_t *sfx; int left, right; } loop;
+		sfx_t		*sfx;
+		qboolean	state;
+	} u;
+} sndcmd_t;
+
+// single producer (the main thread), single consumer (the mixer)
+#define	MAX_SOUND_COMMANDS	4096
+#define	MIXER_MSEC			5
+
+static sndcmd_t		s_cmds[MAX_SOUND_COMMANDS];
+static volatile unsigned	s_cmdhead;		// published by the main thread
+static volatile unsigned	s_cmdtail;		// consumed by the mixer
+static unsigned		s_cmdwrite;				// main thread's unpublished position
+
+static void			*s_mixthreadhandle;
+static void			*s_mixwake;
+static void			*s_mixfence;
+static volatile qboolean	s_mixquit;
+static qboolean		s_silenced;				// main thread's record of the last SND_CMD_SILENCE
+
+// mixer state
+static qboolean		s_mixpaused;
+static qboolean		s_mixsilenced;
+
+static void S_PostCommand (sndcmd_t *cmd);
+static void S_KickMixer (void);
+static void S_SyncMixer (void);
+static void S_StartMixer (qboolean threaded);
+static void S_StopMixer (void);
+static void S_ClearBuffer (void);
+static void S_MixBench_f (void);
+static void S_LoopBench_f (void);
+
+
 // =======================================================================
 // Internal sound data & structures
 // =======================================================================
@@ -46,16 +113,23 @@ int			sound_started = 0;
 
 dma_t		dma;
 
-vec3_t		listener_origin;
-vec3_t		listener_forward;
-vec3_t		listener_right;
-vec3_t		listener_up;
+listener_t	s_listener;				// main thread's view, for the loop sounds
+static listener_t	s_mixlistener;	// mixer thread's view, for the channels
 
 qboolean	s_registering;
 
 int			soundtime;		// sample PAIRS
 int   		paintedtime; 	// sample PAIRS
 
+// the mixer owns paintedtime; this is its last value for the main thread
+static volatile int	s_paintedtime;
+static int	s_lastpainted;
+
+// the mixer can't read cl_entities, so the main thread sends it the origins of
+// entities that may still have a dynamic sound playing
+static int		s_entsounding[MAX_EDICTS];		// main: paintedtime the entity's last sound ends at
+static vec3_t	s_entorigins[MAX_EDICTS];		// mixer: last origin sent
+
 // during registration it is possible to have more sounds
 // than could actually be referenced during gameplay,
 // because we don't want to free anything until we are
@@ -75,9 +149,15 @@ cvar_t		*s_volume;
 cvar_t		*s_testsound;
 cvar_t		*s_show;
 cvar_t		*s_mixahead;
+cvar_t		*s_mixthread;
+cvar_t		*s_voices;
 
+qboolean	s_voicesdirty;
 
-int		s_rawend;
+// set by the mixer if the device stops letting us lock it; the main thread shuts down
+volatile qboolean	s_dmafailed;
+
+volatile int	s_rawend;
 portable_samplepair_t	s_rawsamples[MAX_RAW_SAMPLES];
 
 
@@ -101,6 +181,8 @@ void S_SoundInfo_f (void)
 	Com_Printf ("%5d submission_chunk\n", dma.submission_chunk);
 	Com_Printf ("%5d speed\n", dma.speed);
 	Com_Printf ("0x%x dma buffer\n", dma.buffer);
+
+	S_LoadStats ();
 }
 
 
@@ -124,25 +206,28 @@ void S_Init (void)
 		s_mixahead = Cvar_Get ("s_mixahead", "0.2", CVAR_ARCHIVE, NULL);
 		s_show = Cvar_Get ("s_show", "0", 0, NULL);
 		s_testsound = Cvar_Get ("s_testsound", "0", 0, NULL);
+		s_mixthread = Cvar_Get ("s_mixthread", "1", CVAR_ARCHIVE, NULL);
+		s_voices = Cvar_Get ("s_voices", "32", CVAR_ARCHIVE, NULL);
 
 		Cmd_AddCommand ("play", S_Play);
 		Cmd_AddCommand ("stopsound", S_StopAllSounds);
 		Cmd_AddCommand ("soundlist", S_SoundList);
 		Cmd_AddCommand ("soundinfo", S_SoundInfo_f);
+		Cmd_AddCommand ("s_mixbench", S_MixBench_f);
+		Cmd_AddCommand ("s_loopbench", S_LoopBench_f);
 
 		if (!SNDDMA_Init ())
 			return;
 
-		S_InitScaletable ();
+		S_InitMixer ();
+		S_InitLoaders ();
 
 		sound_started = 1;
 		num_sfx = 0;
 
-		soundtime = 0;
-		paintedtime = 0;
-
 		Com_Printf ("sound sampling rate: %i\n", dma.speed);
 
+		S_StartMixer (s_mixthread->value);
 		S_StopAllSounds ();
 	}
 
@@ -162,14 +247,22 @@ void S_Shutdown (void)
 	if (!sound_started)
 		return;
 
+	S_StopMusic ();
+	S_StopMixer ();
 	SNDDMA_Shutdown ();
 
 	sound_started = 0;
+	s_dmafailed = false;
 
 	Cmd_RemoveCommand ("play");
 	Cmd_RemoveCommand ("stopsound");
 	Cmd_RemoveCommand ("soundlist");
 	Cmd_RemoveCommand ("soundinfo");
+	Cmd_RemoveCommand ("s_mixbench");
+	Cmd_RemoveCommand ("s_loopbench");
+
+	S_ShutdownMixer ();
+	S_ShutdownLoaders ();
 
 	// free all sounds
 	for (i = 0, sfx = known_sfx; i < num_sfx; i++, sfx++)
@@ -322,6 +415,28 @@ void S_EndRegistration (void)
 {
 	int		i;
 	sfx_t	*sfx;
+	sndcmd_t	cmd;
+	qboolean	release = false;
+
+	// the last registration's loads have normally finished long ago
+	S_FinishLoads ();
+
+	// the mixer may still be playing sounds we're about to free
+	for (i = 0, sfx = known_sfx; i < num_sfx; i++, sfx++)
+	{
+		if (!sfx->name[0] || !sfx->cache)
+			continue;
+		if (sfx->registration_sequence != s_registration_sequence)
+		{
+			cmd.type = SND_CMD_RELEASE;
+			cmd.u.sfx = sfx;
+			S_PostCommand (&cmd);
+			release = true;
+		}
+	}
+
+	if (release)
+		S_SyncMixer ();
 
 	// free any sounds not from this registration sequence
 	for (i = 0, sfx = known_sfx; i < num_sfx; i++, sfx++)
@@ -337,13 +452,8 @@ void S_EndRegistration (void)
 		}
 	}
 
-	// load everything in
-	for (i = 0, sfx = known_sfx; i < num_sfx; i++, sfx++)
-	{
-		if (!sfx->name[0])
-			continue;
-		S_LoadSound (sfx);
-	}
+	// load everything in on the loader threads
+	S_QueueSounds (known_sfx, num_sfx);
 
 	s_registering = false;
 }
@@ -351,42 +461,88 @@ void S_EndRegistration (void)
 
 //=============================================================================
 
+/*
+=================
+S_VoiceScore
+
+How much a channel deserves to be mixed: its louder side weighted by what kind of
+sound it is.  Silent channels score 0 and are never mixed
+=================
+*/
+static float S_VoiceScore (channel_t *ch)
+{
+	// CHAN_AUTO, CHAN_WEAPON, CHAN_VOICE, CHAN_ITEM, CHAN_BODY, then unnamed
+	static const float chanpriority[8] = {0.8f, 1.0f, 0.9f, 0.7f, 0.6f, 0.5f, 0.5f, 0.5f};
+	float	score = (ch->leftvol > ch->rightvol) ? ch->leftvol : ch->rightvol;
+
+	if (ch->autosound)
+		score *= 0.5f;
+	else score *= chanpriority[ch->entchannel & 7];
+
+	// the player always hears their own sounds
+	if (ch->entnum == s_mixlistener.playernum + 1)
+		score *= 4.0f;
+
+	return score;
+}
+
+
 /*
 =================
 S_PickChannel
+
+incoming is S_VoiceScore of the sound that wants the channel; when every channel is busy
+it only takes one from a sound that scores lower, otherwise it gets NULL and is dropped
 =================
 */
-channel_t *S_PickChannel (int entnum, int entchannel)
+channel_t *S_PickChannel (int entnum, int entchannel, float incoming)
 {
 	int			ch_idx;
 	int			first_to_die;
 	int			life_left;
+	float		score, lowest;
 	channel_t	*ch;
 
+	// S_StartSound has already rejected these; the mixer can't Com_Error
 	if (entchannel < 0)
-		Com_Error (ERR_DROP, "S_PickChannel: entchannel<0");
+		return NULL;
 
-	// Check for replacement sound, or find the best one to replace
+	// Check for replacement sound, or find the best one to replace; an empty
+	// channel if there is one, otherwise the one least worth hearing
 	first_to_die = -1;
 	life_left = 0x7fffffff;
+	lowest = 1e30f;
 
-	for (ch_idx = 0; ch_idx < MAX_CHANNELS; ch_idx++)
+	for (ch_idx = 0, ch = channels; ch_idx < MAX_CHANNELS; ch_idx++, ch++)
 	{
 		// channel 0 never overrides
-		if (entchannel != 0 && channels[ch_idx].entnum == entnum && channels[ch_idx].entchannel == entchannel)
+		if (entchannel != 0 && ch->entnum == entnum && ch->entchannel == entchannel)
 		{
 			// always override sound from same entity
 			first_to_die = ch_idx;
 			break;
 		}
 
+		if (!ch->sfx)
+		{
+			if (lowest >= 0)
+			{
+				first_to_die = ch_idx;
+				lowest = -1;
+			}
+			continue;
+		}
+
 		// don't let monster sounds override player sounds
-		if (channels[ch_idx].entnum == cl.playernum + 1 && entnum != cl.playernum + 1 && channels[ch_idx].sfx)
+		if (ch->entnum == s_mixlistener.playernum + 1 && entnum != s_mixlistener.playernum + 1)
 			continue;
 
-		if (channels[ch_idx].end - paintedtime < life_left)
+		score = S_VoiceScore (ch);
+
+		if (score < lowest || (score == lowest && ch->end - paintedtime < life_left))
 		{
-			life_left = channels[ch_idx].end - paintedtime;
+			lowest = score;
+			life_left = ch->end - paintedtime;
 			first_to_die = ch_idx;
 		}
 	}
@@ -394,34 +550,104 @@ channel_t *S_PickChannel (int entnum, int entchannel)
 	if (first_to_die == -1)
 		return NULL;
 
+	// a quieter sound never cuts off a louder one; lowest is -1 for an empty channel and the same-entity override breaks out with it untouched
+	if (lowest >= 0 && ch_idx == MAX_CHANNELS && incoming < lowest)
+		return NULL;
+
 	ch = &channels[first_to_die];
 	memset (ch, 0, sizeof (*ch));
 
+	s_voicesdirty = true;
+
 	return ch;
 }
 
+
+typedef struct voicescore_s
+{
+	float		score;
+	channel_t	*ch;
+} voicescore_t;
+
+static int S_CompareVoices (const void *a, const void *b)
+{
+	float	sa = ((voicescore_t *) a)->score;
+	float	sb = ((voicescore_t *) b)->score;
+
+	return (sa < sb) ? 1 : ((sa > sb) ? -1 : 0);
+}
+
+
+/*
+=================
+S_SelectVoices
+
+Mixes the s_voices loudest channels and makes the rest virtual.  Called by the
+mixer when a channel starts or the listener moves
+=================
+*/
+void S_SelectVoices (void)
+{
+	voicescore_t	voices[MAX_CHANNELS];
+	int				numvoices = 0;
+	int				maxvoices = s_voices->value;
+	int				i;
+	channel_t		*ch;
+
+	if (maxvoices < 1)
+		maxvoices = 1;
+
+	for (i = 0, ch = channels; i < MAX_CHANNELS; i++, ch++)
+	{
+		if (!ch->sfx)
+			continue;
+
+		if ((voices[numvoices].score = S_VoiceScore (ch)) <= 0)
+		{
+			ch->isvirtual = true;
+			continue;
+		}
+
+		// favour what's already playing so that voices near the cutoff don't flicker in and out
+		if (!ch->isvirtual)
+			voices[numvoices].score *= 1.1f;
+
+		voices[numvoices++].ch = ch;
+	}
+
+	if (numvoices > maxvoices)
+		qsort (voices, numvoices, sizeof (voices[0]), S_CompareVoices);
+
+	for (i = 0; i < numvoices; i++)
+		voices[i].ch->isvirtual = (i >= maxvoices);
+
+	s_voicesdirty = false;
+}
+
+
 /*
 =================
 S_SpatializeOrigin
 
-Used for spatializing channels and autosounds
+Used for spatializing channels and autosounds; the main thread and the mixer
+each pass their own listener
 =================
 */
-void S_SpatializeOrigin (vec3_t origin, float master_vol, float dist_mult, int *left_vol, int *right_vol)
+void S_SpatializeOrigin (listener_t *listener, vec3_t origin, float master_vol, float dist_mult, int *left_vol, int *right_vol)
 {
 	vec_t		dot;
 	vec_t		dist;
 	vec_t		lscale, rscale, scale;
 	vec3_t		source_vec;
 
-	if (cls.state != ca_active)
+	if (!listener->active)
 	{
 		*left_vol = *right_vol = 255;
 		return;
 	}
 
 	// calculate stereo seperation and distance attenuation
-	VectorSubtract (origin, listener_origin, source_vec);
+	VectorSubtract (origin, listener->origin, source_vec);
 
 	dist = VectorNormalize (source_vec);
 	dist -= SOUND_FULLVOLUME;
@@ -429,7 +655,7 @@ void S_SpatializeOrigin (vec3_t origin, float master_vol, float dist_mult, int *
 		dist = 0;			// close enough to be at full volume
 	dist *= dist_mult;		// different attenuation levels
 
-	dot = DotProduct (listener_right, source_vec);
+	dot = DotProduct (listener->right, source_vec);
 
 	if (dma.channels == 1 || !dist_mult)
 	{ // no attenuation = no spatialization
@@ -464,7 +690,7 @@ void S_Spatialize (channel_t *ch)
 	vec3_t		origin;
 
 	// anything coming from the view entity will always be full volume
-	if (ch->entnum == cl.playernum + 1)
+	if (ch->entnum == s_mixlistener.playernum + 1)
 	{
 		ch->leftvol = ch->master_vol;
 		ch->rightvol = ch->master_vol;
@@ -476,9 +702,9 @@ void S_Spatialize (channel_t *ch)
 		VectorCopy (ch->origin, origin);
 	}
 	else
-		CL_GetEntitySoundOrigin (ch->entnum, origin);
+		VectorCopy (s_entorigins[ch->entnum], origin);
 
-	S_SpatializeOrigin (origin, ch->master_vol, ch->dist_mult, &ch->leftvol, &ch->rightvol);
+	S_SpatializeOrigin (&s_mixlistener, origin, ch->master_vol, ch->dist_mult, &ch->leftvol, &ch->rightvol);
 }
 
 
@@ -535,35 +761,38 @@ by the update loop.
 void S_IssuePlaysound (playsound_t *ps)
 {
 	channel_t	*ch;
+	channel_t	incoming;
 	sfxcache_t	*sc;
 
-	if (s_show->value)
-		Com_Printf ("Issue %i\n", ps->begin);
-	// pick a channel to play on
-	ch = S_PickChannel (ps->entnum, ps->entchannel);
-	if (!ch)
+	// the main thread loaded it before queueing the playsound
+	if ((sc = ps->sfx->cache) == NULL)
 	{
 		S_FreePlaysound (ps);
 		return;
 	}
 
-	// spatialize
+	// spatialize first, so that it can be scored against what's already playing
+	memset (&incoming, 0, sizeof (incoming));
+
 	if (ps->attenuation == ATTN_STATIC)
-		ch->dist_mult = ps->attenuation * 0.001;
+		incoming.dist_mult = ps->attenuation * 0.001;
 	else
-		ch->dist_mult = ps->attenuation * 0.0005;
-	ch->master_vol = ps->volume;
-	ch->entnum = ps->entnum;
-	ch->entchannel = ps->entchannel;
-	ch->sfx = ps->sfx;
-	VectorCopy (ps->origin, ch->origin);
-	ch->fixed_origin = ps->fixed_origin;
+		incoming.dist_mult = ps->attenuation * 0.0005;
+	incoming.master_vol = ps->volume;
+	incoming.entnum = ps->entnum;
+	incoming.entchannel = ps->entchannel;
+	incoming.sfx = ps->sfx;
+	VectorCopy (ps->origin, incoming.origin);
+	incoming.fixed_origin = ps->fixed_origin;
 
-	S_Spatialize (ch);
+	S_Spatialize (&incoming);
 
-	ch->pos = 0;
-	sc = S_LoadSound (ch->sfx);
-	ch->end = paintedtime + sc->length;
+	incoming.pos = 0;
+	incoming.end = paintedtime + sc->length;
+
+	// pick a channel to play on
+	if ((ch = S_PickChannel (ps->entnum, ps->entchannel, S_VoiceScore (&incoming))) != NULL)
+		*ch = incoming;
 
 	// free the playsound
 	S_FreePlaysound (ps);
@@ -640,9 +869,10 @@ Entchannel 0 will never override a playing sound
 void S_StartSound (vec3_t origin, int entnum, int entchannel, struct sfx_s *sfx, float fvol, float attenuation, float timeofs)
 {
 	sfxcache_t	*sc;
-	int			vol;
-	playsound_t	*ps, *sort;
+	sndcmd_t	cmd;
+	playsound_t	*ps = &cmd.u.play;
 	int			start;
+	int			painted = s_paintedtime;
 
 	if (!sound_started)
 		return;
@@ -650,20 +880,20 @@ void S_StartSound (vec3_t origin, int entnum, int entchannel, struct sfx_s *sfx,
 	if (!sfx)
 		return;
 
+	if (entchannel < 0)
+		Com_Error (ERR_DROP, "S_StartSound: entchannel<0");
+
 	if (sfx->name[0] == '*')
 		sfx = S_RegisterSexedSound (&cl_entities[entnum].current, sfx->name);
 
-	// make sure the sound is loaded
-	sc = S_LoadSound (sfx);
-	if (!sc)
+	// if it's still loading, or was never precached and is only now being queued, the
+	// mixer drops it unless it's in by the time it should start
+	sc = S_RequestSound (sfx);
+	if (!sc && !sfx->loading)
 		return;		// couldn't load the sound's data
 
-	vol = fvol * 255;
-
-	// make the playsound_t
-	ps = S_AllocPlaysound ();
-	if (!ps)
-		return;
+	// make the playsound_t; the mixer links it into the pending list
+	cmd.type = SND_CMD_START;
 
 	if (origin)
 	{
@@ -671,24 +901,28 @@ void S_StartSound (vec3_t origin, int entnum, int entchannel, struct sfx_s *sfx,
 		ps->fixed_origin = true;
 	}
 	else
+	{
+		// the mixer keeps this until S_Update sends it a newer one
+		CL_GetEntitySoundOrigin (entnum, ps->origin);
 		ps->fixed_origin = false;
+	}
 
 	ps->entnum = entnum;
 	ps->entchannel = entchannel;
 	ps->attenuation = attenuation;
-	ps->volume = vol;
+	ps->volume = (int) (fvol * 255);
 	ps->sfx = sfx;
 
 	// drift s_beginofs
 	start = cl.frame.servertime * 0.001 * dma.speed + s_beginofs;
-	if (start < paintedtime)
+	if (start < painted)
 	{
-		start = paintedtime;
+		start = painted;
 		s_beginofs = start - (cl.frame.servertime * 0.001 * dma.speed);
 	}
-	else if (start > paintedtime + 0.3 * dma.speed)
+	else if (start > painted + 0.3 * dma.speed)
 	{
-		start = paintedtime + 0.1 * dma.speed;
+		start = painted + 0.1 * dma.speed;
 		s_beginofs = start - (cl.frame.servertime * 0.001 * dma.speed);
 	}
 	else
@@ -697,10 +931,50 @@ void S_StartSound (vec3_t origin, int entnum, int entchannel, struct sfx_s *sfx,
 	}
 
 	if (!timeofs)
-		ps->begin = paintedtime;
+		ps->begin = painted;
 	else
 		ps->begin = start + timeofs * dma.speed;
 
+	// keep sending the entity's origin while the sound can be heard
+	if (!origin && sc)
+	{
+		if (sc->loopstart >= 0)
+			s_entsounding[entnum] = 0x7fffffff;
+		else if ((int) ps->begin + sc->length > s_entsounding[entnum])
+			s_entsounding[entnum] = ps->begin + sc->length;
+	}
+
+	S_PostCommand (&cmd);
+}
+
+
+/*
+=================
+S_QueuePlaysound
+
+Mixer side of S_StartSound
+=================
+*/
+static void S_QueuePlaysound (playsound_t *play)
+{
+	playsound_t	*ps, *sort;
+
+	if (!play->fixed_origin)
+		VectorCopy (play->origin, s_entorigins[play->entnum]);
+
+	ps = S_AllocPlaysound ();
+	if (!ps)
+		return;
+
+	ps->sfx = play->sfx;
+	ps->volume = play->volume;
+	ps->attenuation = play->attenuation;
+	ps->entnum = play->entnum;
+	ps->entchannel = play->entchannel;
+	ps->fixed_origin = play->fixed_origin;
+	VectorCopy (play->origin, ps->origin);
+	ps->begin = play->begin;
+
 	// sort into the pending sound list
 	for (sort = s_pendingplays.next;
 		sort != &s_pendingplays && sort->begin < ps->begin;
@@ -740,17 +1014,17 @@ void S_StartLocalSound (char *sound)
 /*
 ==================
 S_ClearBuffer
+
+Mixer thread
 ==================
 */
-void S_ClearBuffer (void)
+static void S_ClearBuffer (void)
 {
 	int		clear;
 
-	if (!sound_started)
+	if (!sound_started || s_mixpaused)
 		return;
 
-	s_rawend = 0;
-
 	if (dma.samplebits == 8)
 		clear = 0x80;
 	else
@@ -762,23 +1036,18 @@ void S_ClearBuffer (void)
 	SNDDMA_Submit ();
 }
 
+
 /*
 ==================
-S_StopAllSounds
+S_ClearChannels
+
+Mixer thread
 ==================
 */
-void CDAudio_Stop (void);
-
-void S_StopAllSounds (void)
+static void S_ClearChannels (void)
 {
 	int		i;
 
-	// this should also stop music
-	CDAudio_Stop ();
-
-	if (!sound_started)
-		return;
-
 	// clear all the playsounds
 	memset (s_playsounds, 0, sizeof (s_playsounds));
 	s_freeplays.next = s_freeplays.prev = &s_freeplays;
@@ -798,149 +1067,428 @@ void S_StopAllSounds (void)
 	S_ClearBuffer ();
 }
 
+
 /*
 ==================
-S_AddLoopSounds
-
-Entities with a ->sound field will generated looped sounds
-that are automatically started, stopped, and merged together
-as the entities are sent to the client
+S_StopAllSounds
 ==================
 */
-void S_AddLoopSounds (void)
+void CDAudio_Stop (void);
+
+void S_StopAllSounds (void)
 {
-	int			i, j;
-	int			sounds[MAX_EDICTS];
-	int			left, right, left_total, right_total;
-	channel_t	*ch;
-	sfx_t		*sfx;
-	sfxcache_t	*sc;
-	int			num;
-	entity_state_t	*ent;
+	sndcmd_t	cmd;
 
-	if (cl_paused->value)
-		return;
+	// this should also stop music
+	CDAudio_Stop ();
 
-	if (cls.state != ca_active)
+	if (!sound_started)
 		return;
 
-	if (!cl.sound_prepped)
-		return;
+	s_rawend = 0;
+	memset (s_entsounding, 0, sizeof (s_entsounding));
+
+	cmd.type = SND_CMD_STOPALL;
+	S_PostCommand (&cmd);
+	S_KickMixer ();
+}
+
+
+/*
+==================
+S_ReleaseSound
+
+Mixer thread; stops anything still using an sfx that S_EndRegistration is freeing
+==================
+*/
+static void S_ReleaseSound (sfx_t *sfx)
+{
+	int			i;
+	playsound_t	*ps, *next;
 
-	for (i = 0; i < cl.frame.num_entities; i++)
+	for (i = 0; i < MAX_CHANNELS; i++)
 	{
-		num = (cl.frame.parse_entities + i)&(MAX_PARSE_ENTITIES - 1);
-		ent = &cl_parse_entities[num];
-		sounds[i] = ent->sound;
+		if (channels[i].sfx == sfx)
+			memset (&channels[i], 0, sizeof (channels[i]));
 	}
 
-	for (i = 0; i < cl.frame.num_entities; i++)
+	for (ps = s_pendingplays.next; ps != &s_pendingplays; ps = next)
 	{
-		if (!sounds[i])
-			continue;
+		next = ps->next;
 
-		sfx = cl.sound_precache[sounds[i]];
-		if (!sfx)
-			continue;		// bad sound effect
-		sc = sfx->cache;
-		if (!sc)
-			continue;
+		if (ps->sfx == sfx)
+			S_FreePlaysound (ps);
+	}
+}
 
-		num = (cl.frame.parse_entities + i)&(MAX_PARSE_ENTITIES - 1);
-		ent = &cl_parse_entities[num];
 
-		// find the total contribution of all sounds of this type
-		S_SpatializeOrigin (ent->origin, 255.0, SOUND_LOOPATTENUATE,
-			&left_total, &right_total);
-		for (j = i + 1; j < cl.frame.num_entities; j++)
-		{
-			if (sounds[j] != sounds[i])
-				continue;
-			sounds[j] = 0;	// don't check this again later
+// every emitter of a looping sound this frame, laid out for S_SpatializeLoops
+typedef struct loopemitters_s
+{
+	int		count;
+	int		sounds[MAX_EDICTS];
+	float	x[MAX_EDICTS];
+	float	y[MAX_EDICTS];
+	float	z[MAX_EDICTS];
+	int		left[MAX_EDICTS];
+	int		right[MAX_EDICTS];
+} loopemitters_t;
+
+// the emitters merged by sound, in the order each sound first appeared
+typedef struct loopgroups_s
+{
+	int		count;
+	int		sounds[MAX_SOUNDS];
+	int		left[MAX_SOUNDS];
+	int		right[MAX_SOUNDS];
+} loopgroups_t;
 
-			num = (cl.frame.parse_entities + j)&(MAX_PARSE_ENTITIES - 1);
-			ent = &cl_parse_entities[num];
+static loopemitters_t	s_loopemitters;
+static loopgroups_t		s_loopgroups;
 
-			S_SpatializeOrigin (ent->origin, 255.0, SOUND_LOOPATTENUATE,
-				&left, &right);
-			left_total += left;
-			right_total += right;
-		}
 
-		if (left_total == 0 && right_total == 0)
-			continue;		// not audible
+#ifdef S_MIX_X86
+/*
+==================
+S_LoopScale
 
-		// allocate a channel
-		ch = S_PickChannel (0, 0);
-		if (!ch)
-			return;
+S_SpatializeOrigin works out the side scale and the distance scale in double and rounds
+each to a float, so this does the same two lanes at a time
+==================
+*/
+static S_TARGET_SSE2 __m128 S_LoopScale (__m128 dist, __m128 dot, __m128d half)
+{
+	__m128d	one = _mm_set1_pd (1.0);
+	__m128d	lo, hi;
+	__m128	side;
 
-		if (left_total > 255)
-			left_total = 255;
-		if (right_total > 255)
-			right_total = 255;
-		ch->leftvol = left_total;
-		ch->rightvol = right_total;
-		ch->autosound = true;	// remove next frame
-		ch->sfx = sfx;
-		ch->pos = paintedtime % sc->length;
-		ch->end = paintedtime + sc->length - ch->pos;
-	}
+	lo = _mm_mul_pd (half, _mm_add_pd (one, _mm_cvtps_pd (dot)));
+	hi = _mm_mul_pd (half, _mm_add_pd (one, _mm_cvtps_pd (_mm_movehl_ps (dot, dot))));
+	side = _mm_movelh_ps (_mm_cvtpd_ps (lo), _mm_cvtpd_ps (hi));
+
+	lo = _mm_mul_pd (_mm_sub_pd (one, _mm_cvtps_pd (dist)), _mm_cvtps_pd (side));
+	hi = _mm_mul_pd (_mm_sub_pd (one, _mm_cvtps_pd (_mm_movehl_ps (dist, dist))), _mm_cvtps_pd (_mm_movehl_ps (side, side)));
+
+	return _mm_movelh_ps (_mm_cvtpd_ps (lo), _mm_cvtpd_ps (hi));
 }
 
-//=============================================================================
 
 /*
-============
-S_RawSamples
+==================
+S_SpatializeLoops
 
-Cinematic streaming and voice over network
-============
+S_SpatializeOrigin at full volume and loop attenuation for four emitters at a time; the
+steps are the same as the scalar version's so the volumes come out the same.  SSE2 is
+the baseline on every x86 the engine runs on, so it isn't checked for; other targets
+get the scalar loop below
+==================
 */
-void S_RawSamples (int samples, int rate, int width, int channels, byte *data)
+static S_TARGET_SSE2 void S_SpatializeLoops (listener_t *listener, loopemitters_t *e)
 {
-	// we could do scale tables for this stuff
 	int		i;
-	int		src, dst;
-	float	scale;
+	__m128	ox, oy, oz, rx, ry, rz;
+	__m128	zero = _mm_setzero_ps ();
+	__m128	one = _mm_set1_ps (1.0f);
+	__m128	fullvolume = _mm_set1_ps (SOUND_FULLVOLUME);
+	__m128	attenuate = _mm_set1_ps (SOUND_LOOPATTENUATE);
+	__m128	master = _mm_set1_ps (255.0f);
+	__m128	signbit = _mm_set1_ps (-0.0f);
+	__m128	separation;
+	__m128d	half;
+	__m128i	izero = _mm_setzero_si128 ();
+
+	if (!listener->active)
+	{
+		for (i = 0; i < e->count; i++)
+			e->left[i] = e->right[i] = 255;
 
-	if (!sound_started)
 		return;
+	}
 
-	if (s_rawend < paintedtime)
-		s_rawend = paintedtime;
+	// mono has no separation, so both sides get the full scale
+	if (dma.channels == 1)
+	{
+		half = _mm_set1_pd (1.0);
+		separation = zero;
+	}
+	else
+	{
+		half = _mm_set1_pd (0.5);
+		separation = one;
+	}
 
-	scale = (float) rate / dma.speed;
+	ox = _mm_set1_ps (listener->origin[0]);
+	oy = _mm_set1_ps (listener->origin[1]);
+	oz = _mm_set1_ps (listener->origin[2]);
+	rx = _mm_set1_ps (listener->right[0]);
+	ry = _mm_set1_ps (listener->right[1]);
+	rz = _mm_set1_ps (listener->right[2]);
 
-	//Com_Printf ("%i < %i < %i\n", soundtime, paintedtime, s_rawend);
-	if (channels == 2 && width == 2)
+	// the arrays are MAX_EDICTS long and S_GroupLoopSounds pads the last four out with copies
+	for (i = 0; i < e->count; i += 4)
 	{
-		if (scale == 1.0)
-		{
-			// optimized case
-			for (i = 0; i < samples; i++)
-			{
-				dst = s_rawend & (MAX_RAW_SAMPLES - 1);
-				s_rawend++;
-				s_rawsamples[dst].left = (LittleShort (((short *) data)[i * 2]) << 8) * s_volume->value;
-				s_rawsamples[dst].right = (LittleShort (((short *) data)[i * 2 + 1]) << 8) * s_volume->value;
-			}
-		}
-		else
-		{
-			for (i = 0;; i++)
-			{
-				src = i * scale;
+		__m128 dx = _mm_sub_ps (_mm_loadu_ps (&e->x[i]), ox);
+		__m128 dy = _mm_sub_ps (_mm_loadu_ps (&e->y[i]), oy);
+		__m128 dz = _mm_sub_ps (_mm_loadu_ps (&e->z[i]), oz);
+		__m128 dist = _mm_sqrt_ps (_mm_add_ps (_mm_add_ps (_mm_mul_ps (dx, dx), _mm_mul_ps (dy, dy)), _mm_mul_ps (dz, dz)));
 
-				if (src >= samples)
-					break;
+		// VectorNormalize leaves a zero vector alone, so the dot comes out 0
+		__m128 ilength = _mm_and_ps (_mm_div_ps (one, dist), _mm_cmpneq_ps (dist, zero));
+		__m128 dot = _mm_add_ps (_mm_add_ps (
+			_mm_mul_ps (rx, _mm_mul_ps (dx, ilength)),
+			_mm_mul_ps (ry, _mm_mul_ps (dy, ilength))),
+			_mm_mul_ps (rz, _mm_mul_ps (dz, ilength)));
 
-				dst = s_rawend & (MAX_RAW_SAMPLES - 1);
-				s_rawend++;
-				s_rawsamples[dst].left = (LittleShort (((short *) data)[src * 2]) << 8) * s_volume->value;
-				s_rawsamples[dst].right = (LittleShort (((short *) data)[src * 2 + 1]) << 8) * s_volume->value;
-			}
-		}
+		__m128i left, right;
+
+		dist = _mm_mul_ps (_mm_max_ps (_mm_sub_ps (dist, fullvolume), zero), attenuate);
+		dot = _mm_mul_ps (dot, separation);
+
+		// truncated like the (int) casts, then negatives clamped to 0
+		right = _mm_cvttps_epi32 (_mm_mul_ps (master, S_LoopScale (dist, dot, half)));
+		left = _mm_cvttps_epi32 (_mm_mul_ps (master, S_LoopScale (dist, _mm_xor_ps (dot, signbit), half)));
+
+		_mm_storeu_si128 ((__m128i *) &e->right[i], _mm_and_si128 (right, _mm_cmpgt_epi32 (right, izero)));
+		_mm_storeu_si128 ((__m128i *) &e->left[i], _mm_and_si128 (left, _mm_cmpgt_epi32 (left, izero)));
+	}
+}
+#else
+/*
+==================
+S_SpatializeLoops
+
+Each emitter through S_SpatializeOrigin, as S_GroupLoopSoundsReference does
+==================
+*/
+static void S_SpatializeLoops (listener_t *listener, loopemitters_t *e)
+{
+	int		i;
+	vec3_t	origin;
+
+	for (i = 0; i < e->count; i++)
+	{
+		origin[0] = e->x[i];
+		origin[1] = e->y[i];
+		origin[2] = e->z[i];
+
+		S_SpatializeOrigin (listener, origin, 255.0, SOUND_LOOPATTENUATE, &e->left[i], &e->right[i]);
+	}
+}
+#endif
+
+
+/*
+==================
+S_GroupLoopSounds
+
+The sound index is already a perfect hash, so each emitter finds its group through a
+MAX_SOUNDS table instead of being compared against every other emitter
+==================
+*/
+static void S_GroupLoopSounds (listener_t *listener, loopemitters_t *e, loopgroups_t *g)
+{
+	int		i;
+	int		slot[MAX_SOUNDS];
+
+	g->count = 0;
+
+	if (!e->count)
+		return;
+
+	// pad out to a multiple of four with copies of the last emitter; they're never summed
+	for (i = e->count; i & 3; i++)
+	{
+		e->x[i] = e->x[e->count - 1];
+		e->y[i] = e->y[e->count - 1];
+		e->z[i] = e->z[e->count - 1];
+	}
+
+	S_SpatializeLoops (listener, e);
+
+	memset (slot, -1, sizeof (slot));
+
+	for (i = 0; i < e->count; i++)
+	{
+		int	group = slot[e->sounds[i]];
+
+		if (group < 0)
+		{
+			group = slot[e->sounds[i]] = g->count++;
+			g->sounds[group] = e->sounds[i];
+			g->left[group] = 0;
+			g->right[group] = 0;
+		}
+
+		g->left[group] += e->left[i];
+		g->right[group] += e->right[i];
+	}
+}
+
+
+/*
+==================
+S_AddLoopSounds
+
+Entities with a ->sound field will generated looped sounds
+that are automatically started, stopped, and merged together
+as the entities are sent to the client.  These are merged on
+the main thread and sent to the mixer as one command each
+==================
+*/
+void S_AddLoopSounds (void)
+{
+	int			i;
+	int			left_total, right_total;
+	sfx_t		*sfx;
+	int			num;
+	entity_state_t	*ent;
+	sndcmd_t	cmd;
+	loopemitters_t	*e = &s_loopemitters;
+	loopgroups_t	*g = &s_loopgroups;
+
+	if (cl_paused->value)
+		return;
+
+	if (cls.state != ca_active)
+		return;
+
+	if (!cl.sound_prepped)
+		return;
+
+	e->count = 0;
+
+	for (i = 0; i < cl.frame.num_entities && e->count < MAX_EDICTS; i++)
+	{
+		num = (cl.frame.parse_entities + i)&(MAX_PARSE_ENTITIES - 1);
+		ent = &cl_parse_entities[num];
+
+		if (ent->sound <= 0 || ent->sound >= MAX_SOUNDS)
+			continue;
+
+		sfx = cl.sound_precache[ent->sound];
+		if (!sfx)
+			continue;		// bad sound effect
+		if (!sfx->cache)
+			continue;
+
+		e->sounds[e->count] = ent->sound;
+		e->x[e->count] = ent->origin[0];
+		e->y[e->count] = ent->origin[1];
+		e->z[e->count] = ent->origin[2];
+		e->count++;
+	}
+
+	// find the total contribution of all sounds of each type
+	S_GroupLoopSounds (&s_listener, e, g);
+
+	for (i = 0; i < g->count; i++)
+	{
+		left_total = g->left[i];
+		right_total = g->right[i];
+
+		if (left_total == 0 && right_total == 0)
+			continue;		// not audible
+
+		if (left_total > 255)
+			left_total = 255;
+		if (right_total > 255)
+			right_total = 255;
+
+		cmd.type = SND_CMD_LOOPSOUND;
+		cmd.u.loop.sfx = cl.sound_precache[g->sounds[i]];
+		cmd.u.loop.left = left_total;
+		cmd.u.loop.right = right_total;
+		S_PostCommand (&cmd);
+	}
+}
+
+
+/*
+==================
+S_AddLoopSound
+
+Mixer side of S_AddLoopSounds
+==================
+*/
+static void S_AddLoopSound (sfx_t *sfx, int left, int right)
+{
+	channel_t	*ch;
+	sfxcache_t	*sc = sfx->cache;
+
+	channel_t	incoming;
+
+	if (!sc)
+		return;
+
+	memset (&incoming, 0, sizeof (incoming));
+
+	incoming.leftvol = left;
+	incoming.rightvol = right;
+	incoming.autosound = true;	// remove next frame
+	incoming.sfx = sfx;
+	incoming.pos = paintedtime % sc->length;
+	incoming.end = paintedtime + sc->length - incoming.pos;
+
+	// allocate a channel
+	if ((ch = S_PickChannel (0, 0, S_VoiceScore (&incoming))) != NULL)
+		*ch = incoming;
+}
+
+//=============================================================================
+
+/*
+============
+S_RawSamples
+
+Cinematic streaming and voice over network
+============
+*/
+void S_RawSamples (int samples, int rate, int width, int channels, byte *data)
+{
+	// we could do scale tables for this stuff
+	int		i;
+	int		src, dst;
+	float	scale;
+	int		rawend, painted;
+
+	if (!sound_started)
+		return;
+
+	// the mixer reads s_rawend, so the samples are filled in past it and only then published
+	rawend = s_rawend;
+
+	if (rawend < (painted = s_paintedtime))
+		rawend = painted;
+
+	scale = (float) rate / dma.speed;
+
+	//Com_Printf ("%i < %i < %i\n", soundtime, paintedtime, s_rawend);
+	if (channels == 2 && width == 2)
+	{
+		if (scale == 1.0)
+		{
+			// optimized case
+			for (i = 0; i < samples; i++)
+			{
+				dst = rawend++ & (MAX_RAW_SAMPLES - 1);
+				s_rawsamples[dst].left = (LittleShort (((short *) data)[i * 2]) << 8) * s_volume->value;
+				s_rawsamples[dst].right = (LittleShort (((short *) data)[i * 2 + 1]) << 8) * s_volume->value;
+			}
+		}
+		else
+		{
+			for (i = 0;; i++)
+			{
+				src = i * scale;
+
+				if (src >= samples)
+					break;
+
+				dst = rawend++ & (MAX_RAW_SAMPLES - 1);
+				s_rawsamples[dst].left = (LittleShort (((short *) data)[src * 2]) << 8) * s_volume->value;
+				s_rawsamples[dst].right = (LittleShort (((short *) data)[src * 2 + 1]) << 8) * s_volume->value;
+			}
+		}
 	}
 	else if (channels == 1 && width == 2)
 	{
@@ -951,8 +1499,7 @@ void S_RawSamples (int samples, int rate, int width, int channels, byte *data)
 			if (src >= samples)
 				break;
 
-			dst = s_rawend & (MAX_RAW_SAMPLES - 1);
-			s_rawend++;
+			dst = rawend++ & (MAX_RAW_SAMPLES - 1);
 			s_rawsamples[dst].left = (LittleShort (((short *) data)[src]) << 8) * s_volume->value;
 			s_rawsamples[dst].right = (LittleShort (((short *) data)[src]) << 8) * s_volume->value;
 		}
@@ -966,8 +1513,7 @@ void S_RawSamples (int samples, int rate, int width, int channels, byte *data)
 			if (src >= samples)
 				break;
 
-			dst = s_rawend & (MAX_RAW_SAMPLES - 1);
-			s_rawend++;
+			dst = rawend++ & (MAX_RAW_SAMPLES - 1);
 			s_rawsamples[dst].left = (((char *) data)[src * 2] << 16) * s_volume->value;
 			s_rawsamples[dst].right = (((char *) data)[src * 2 + 1] << 16) * s_volume->value;
 		}
@@ -981,12 +1527,27 @@ void S_RawSamples (int samples, int rate, int width, int channels, byte *data)
 			if (src >= samples)
 				break;
 
-			dst = s_rawend & (MAX_RAW_SAMPLES - 1);
-			s_rawend++;
+			dst = rawend++ & (MAX_RAW_SAMPLES - 1);
 			s_rawsamples[dst].left = ((((byte *) data)[src] - 128) << 16) * s_volume->value;
 			s_rawsamples[dst].right = ((((byte *) data)[src] - 128) << 16) * s_volume->value;
 		}
 	}
+
+	Sys_WriteBarrier ();
+	s_rawend = rawend;
+}
+
+
+/*
+============
+S_RawSamplesAhead
+============
+*/
+int S_RawSamplesAhead (void)
+{
+	int		ahead = s_rawend - s_paintedtime;
+
+	return (ahead > 0) ? ahead : 0;
 }
 
 
@@ -1003,56 +1564,85 @@ void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 {
 	int			i;
 	int			total;
+	int			painted;
 	channel_t	*ch;
-	channel_t	*combine;
+	sndcmd_t	cmd;
 
 	if (!sound_started)
 		return;
 
+	S_CheckLoads ();
+
+	if (s_dmafailed)
+	{
+		Com_Printf ("S_Update: lost the sound buffer\n");
+		S_Shutdown ();
+		return;
+	}
+
+	// the mixer chopped paintedtime back down; anything timed against the old value is stale
+	if ((painted = s_paintedtime) < s_lastpainted)
+	{
+		s_rawend = 0;
+		memset (s_entsounding, 0, sizeof (s_entsounding));
+	}
+
+	s_lastpainted = painted;
+
 	// if the laoding plaque is up, clear everything
 	// out to make sure we aren't looping a dirty
 	// dma buffer while loading
 	if (cls.disable_screen)
 	{
-		S_ClearBuffer ();
+		s_rawend = 0;
+
+		if (!s_silenced)
+		{
+			cmd.type = SND_CMD_SILENCE;
+			cmd.u.state = s_silenced = true;
+			S_PostCommand (&cmd);
+		}
+
+		S_KickMixer ();
 		return;
 	}
 
-	// rebuild scale tables if volume is modified
-	if (s_volume->modified)
-		S_InitScaletable ();
+	if (s_silenced)
+	{
+		cmd.type = SND_CMD_SILENCE;
+		cmd.u.state = s_silenced = false;
+		S_PostCommand (&cmd);
+	}
 
-	VectorCopy (origin, listener_origin);
-	VectorCopy (forward, listener_forward);
-	VectorCopy (right, listener_right);
-	VectorCopy (up, listener_up);
+	S_UpdateMusic ();
 
-	combine = NULL;
+	VectorCopy (origin, s_listener.origin);
+	VectorCopy (forward, s_listener.forward);
+	VectorCopy (right, s_listener.right);
+	VectorCopy (up, s_listener.up);
+	s_listener.playernum = cl.playernum;
+	s_listener.active = (cls.state == ca_active);
 
-	// update spatialization for dynamic sounds	
-	ch = channels;
-	for (i = 0; i < MAX_CHANNELS; i++, ch++)
+	// the mixer respatializes its dynamic sounds with these
+	cmd.type = SND_CMD_LISTENER;
+	cmd.u.listener = s_listener;
+	S_PostCommand (&cmd);
+
+	for (i = 0; i < MAX_EDICTS; i++)
 	{
-		if (!ch->sfx)
-			continue;
-		if (ch->autosound)
-		{
-			// autosounds are regenerated fresh each frame
-			memset (ch, 0, sizeof (*ch));
+		if (s_entsounding[i] <= painted)
 			continue;
-		}
-		S_Spatialize (ch);         // respatialize channel
-		if (!ch->leftvol && !ch->rightvol)
-		{
-			memset (ch, 0, sizeof (*ch));
-			continue;
-		}
+
+		cmd.type = SND_CMD_ENTITY;
+		cmd.u.entity.entnum = i;
+		CL_GetEntitySoundOrigin (i, cmd.u.entity.origin);
+		S_PostCommand (&cmd);
 	}
 
 	// add loopsounds
 	S_AddLoopSounds ();
 
-	// debugging output
+	// debugging output; this reads the mixer's channels without syncing, which is fine for a rough list
 	if (s_show->value)
 	{
 		total = 0;
@@ -1060,22 +1650,57 @@ void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 		for (i = 0; i < MAX_CHANNELS; i++, ch++)
 			if (ch->sfx && (ch->leftvol || ch->rightvol))
 			{
-				Com_Printf ("%3i %3i %s\n", ch->leftvol, ch->rightvol, ch->sfx->name);
+				Com_Printf ("%3i %3i %s%s\n", ch->leftvol, ch->rightvol, ch->sfx->name, ch->isvirtual ? " (virtual)" : "");
 				total++;
 			}
 
-		Com_Printf ("----(%i)---- painted: %i\n", total, paintedtime);
+		Com_Printf ("----(%i)---- painted: %i\n", total, painted);
 	}
 
 	// mix some sound
-	S_Update_ ();
+	S_KickMixer ();
+}
+
+
+/*
+============
+S_UpdateListener
+
+Mixer side of S_Update; autosounds are regenerated fresh each frame
+============
+*/
+static void S_UpdateListener (listener_t *listener)
+{
+	int			i;
+	channel_t	*ch;
+
+	s_mixlistener = *listener;
+
+	// update spatialization for dynamic sounds
+	ch = channels;
+	for (i = 0; i < MAX_CHANNELS; i++, ch++)
+	{
+		if (!ch->sfx)
+			continue;
+		if (ch->autosound)
+		{
+			// autosounds are regenerated fresh each frame
+			memset (ch, 0, sizeof (*ch));
+			continue;
+		}
+		S_Spatialize (ch);         // respatialize channel; silent ones go virtual rather than stopping
+	}
+
+	s_voicesdirty = true;
 }
 
+
+static int	s_dmabuffers;
+static int	s_olddmapos;
+
 void GetSoundtime (void)
 {
 	int		samplepos;
-	static	int		buffers;
-	static	int		oldsamplepos;
 	int		fullsamples;
 
 	fullsamples = dma.samples / dma.channels;
@@ -1084,21 +1709,22 @@ void GetSoundtime (void)
 	// calls to S_Update.  Oh well.
 	samplepos = SNDDMA_GetDMAPos ();
 
-	if (samplepos < oldsamplepos)
+	if (samplepos < s_olddmapos)
 	{
-		buffers++;					// buffer wrapped
+		s_dmabuffers++;					// buffer wrapped
 
 		if (paintedtime > 0x40000000)
 		{
-			// time to chop things off to avoid 32 bit limits
-			buffers = 0;
+			// time to chop things off to avoid 32 bit limits; S_Update
+			// sees paintedtime go backwards and resets its side
+			s_dmabuffers = 0;
 			paintedtime = fullsamples;
-			S_StopAllSounds ();
+			S_ClearChannels ();
 		}
 	}
-	oldsamplepos = samplepos;
+	s_olddmapos = samplepos;
 
-	soundtime = buffers * fullsamples + samplepos / dma.channels;
+	soundtime = s_dmabuffers * fullsamples + samplepos / dma.channels;
 }
 
 
@@ -1139,8 +1765,606 @@ void S_Update_ (void)
 	S_PaintChannels (endtime);
 
 	SNDDMA_Submit ();
+
+	s_paintedtime = paintedtime;
+}
+
+
+/*
+===============================================================================
+
+MIXER THREAD
+
+The mixer owns the channels, playsounds, paintedtime and the DMA buffer.  The
+main thread batches its commands for a frame and publishes them together, so
+the mixer never paints a frame with the autosounds cleared but not yet re-added.
+With s_mixthread 0, or if the thread can't be created, the same commands are
+run inline from S_Update
+
+===============================================================================
+*/
+
+/*
+============
+S_PostCommand
+
+Main thread; the command isn't visible to the mixer until S_KickMixer
+============
+*/
+static void S_PostCommand (sndcmd_t *cmd)
+{
+	while (s_cmdwrite - s_cmdtail >= MAX_SOUND_COMMANDS)
+	{
+		// full; publish what we have and wait for the mixer to make room
+		S_KickMixer ();
+
+		if (s_mixthreadhandle)
+			Sys_Sleep (1);
+	}
+
+	s_cmds[s_cmdwrite & (MAX_SOUND_COMMANDS - 1)] = *cmd;
+	s_cmdwrite++;
 }
 
+
+/*
+============
+S_RunCommands
+
+Mixer thread
+============
+*/
+static void S_RunCommands (void)
+{
+	unsigned	tail = s_cmdtail;
+	unsigned	head = s_cmdhead;
+	sndcmd_t	*cmd;
+
+	for (; tail != head; tail++)
+	{
+		cmd = &s_cmds[tail & (MAX_SOUND_COMMANDS - 1)];
+
+		switch (cmd->type)
+		{
+		case SND_CMD_START:
+			S_QueuePlaysound (&cmd->u.play);
+			break;
+
+		case SND_CMD_STOPALL:
+			S_ClearChannels ();
+			break;
+
+		case SND_CMD_LISTENER:
+			S_UpdateListener (&cmd->u.listener);
+			break;
+
+		case SND_CMD_ENTITY:
+			VectorCopy (cmd->u.entity.origin, s_entorigins[cmd->u.entity.entnum]);
+			break;
+
+		case SND_CMD_LOOPSOUND:
+			S_AddLoopSound (cmd->u.loop.sfx, cmd->u.loop.left, cmd->u.loop.right);
+			break;
+
+		case SND_CMD_RELEASE:
+			S_ReleaseSound (cmd->u.sfx);
+			break;
+
+		case SND_CMD_PAUSE:
+			s_mixpaused = cmd->u.state;
+			break;
+
+		case SND_CMD_SILENCE:
+			s_mixsilenced = cmd->u.state;
+			break;
+
+		case SND_CMD_FENCE:
+			if (s_mixfence)
+				Sys_RaiseSignal (s_mixfence);
+			break;
+		}
+	}
+
+	// hand the slots back only after we're done reading them
+	s_cmdtail = tail;
+}
+
+
+/*
+============
+S_MixerFrame
+============
+*/
+static void S_MixerFrame (void)
+{
+	S_RunCommands ();
+
+	if (s_mixpaused)
+		return;
+
+	if (s_mixsilenced)
+		S_ClearBuffer ();
+	else
+		S_Update_ ();
+}
+
+
+static unsigned S_MixerThread (void *param)
+{
+	while (!s_mixquit)
+	{
+		S_MixerFrame ();
+		Sys_WaitSignal (s_mixwake, MIXER_MSEC);
+	}
+
+	return 0;
+}
+
+
+/*
+============
+S_KickMixer
+
+Main thread; publishes the commands posted so far and gets them run
+============
+*/
+static void S_KickMixer (void)
+{
+	// the slots must be written before the mixer can see them
+	Sys_WriteBarrier ();
+	s_cmdhead = s_cmdwrite;
+
+	if (s_mixthreadhandle)
+		Sys_RaiseSignal (s_mixwake);
+	else
+		S_MixerFrame ();
+}
+
+
+/*
+============
+S_SyncMixer
+
+Main thread; returns once the mixer has run everything posted so far
+============
+*/
+static void S_SyncMixer (void)
+{
+	sndcmd_t	cmd;
+
+	if (!sound_started)
+		return;
+
+	if (!s_mixthreadhandle)
+	{
+		Sys_WriteBarrier ();
+		s_cmdhead = s_cmdwrite;
+		S_RunCommands ();
+		return;
+	}
+
+	cmd.type = SND_CMD_FENCE;
+	S_PostCommand (&cmd);
+	S_KickMixer ();
+
+	Sys_WaitSignal (s_mixfence, -1);
+}
+
+
+/*
+============
+S_PauseMixer
+
+Keeps the mixer off the DMA buffer while the platform layer destroys and
+recreates it
+============
+*/
+void S_PauseMixer (qboolean pause)
+{
+	sndcmd_t	cmd;
+
+	if (!sound_started)
+		return;
+
+	cmd.type = SND_CMD_PAUSE;
+	cmd.u.state = pause;
+	S_PostCommand (&cmd);
+
+	if (pause)
+		S_SyncMixer ();
+	else
+		S_KickMixer ();
+}
+
+
+static void S_StartMixer (qboolean threaded)
+{
+	soundtime = paintedtime = 0;
+	s_paintedtime = s_lastpainted = 0;
+	s_dmabuffers = s_olddmapos = 0;
+	s_rawend = 0;
+
+	s_cmdhead = s_cmdtail = s_cmdwrite = 0;
+	s_mixpaused = s_mixsilenced = s_silenced = false;
+	s_mixquit = false;
+
+	memset (s_entsounding, 0, sizeof (s_entsounding));
+	memset (&s_mixlistener, 0, sizeof (s_mixlistener));
+
+	// the mixer's lists have to be valid before it can run a command
+	S_ClearChannels ();
+
+	if (!threaded)
+	{
+		Com_Printf ("...mixing on the main thread\n");
+		return;
+	}
+
+	s_mixwake = Sys_CreateSignal ();
+	s_mixfence = Sys_CreateSignal ();
+
+	if ((s_mixthreadhandle = Sys_CreateThread (S_MixerThread, NULL)) == NULL)
+	{
+		Sys_DestroySignal (s_mixwake);
+		Sys_DestroySignal (s_mixfence);
+		s_mixwake = s_mixfence = NULL;
+
+		Com_Printf ("...couldn't create the mixer thread; mixing on the main thread\n");
+		return;
+	}
+
+	Com_Printf ("...mixing on a separate thread\n");
+}
+
+
+static void S_StopMixer (void)
+{
+	if (!s_mixthreadhandle)
+		return;
+
+	s_mixquit = true;
+	Sys_RaiseSignal (s_mixwake);
+	Sys_WaitThread (s_mixthreadhandle);
+	s_mixthreadhandle = NULL;
+
+	Sys_DestroySignal (s_mixwake);
+	Sys_DestroySignal (s_mixfence);
+	s_mixwake = s_mixfence = NULL;
+}
+
+
+/*
+===============================================================================
+
+MIXER BENCHMARK
+
+Replays a fixed script of one-shot, looping, auto and streamed sounds through
+the mixer on the headless device with a manual clock, so that runs compare
+between builds.  The optional WAV output can be diffed against an earlier
+build's to check that a mixer change didn't alter the sound
+
+===============================================================================
+*/
+
+#define	BENCH_FPS			100
+#define	BENCH_RAWRATE		22050
+#define	BENCH_NUMSFX		8
+#define	BENCH_FIRSTLOOP		3		// the rest are autosounds
+
+static sfx_t	s_benchsfx[BENCH_NUMSFX];
+static unsigned	s_benchseed;
+
+static int S_BenchRand (void)
+{
+	// our own generator so every run replays the same script
+	s_benchseed = s_benchseed * 1103515245 + 12345;
+	return (s_benchseed >> 16) & 0x7fff;
+}
+
+
+static void S_BenchSound (sfx_t *sfx, int width, float seconds, qboolean loop, float pitch)
+{
+	int			i;
+	int			length = seconds * dma.speed;
+	sfxcache_t	*sc = Zone_AllocCategory (length * width + sizeof (sfxcache_t), MEM_SOUND);
+
+	Com_sprintf (sfx->name, sizeof (sfx->name), "mixbench/%i.wav", (int) (sfx - s_benchsfx));
+	sfx->cache = sc;
+
+	sc->length = length;
+	sc->loopstart = loop ? 0 : -1;
+	sc->speed = dma.speed;
+	sc->width = width;
+	sc->stereo = 0;
+
+	// a tone with some noise on it; one-shots fade out
+	for (i = 0; i < length; i++)
+	{
+		float v = sin (i * pitch) * 0.6f + (S_BenchRand () / 32768.0f - 0.5f) * 0.4f;
+
+		if (!loop)
+			v *= 1.0f - (float) i / length;
+
+		if (width == 1)
+			((signed char *) sc->data)[i] = v * 127;
+		else ((short *) sc->data)[i] = v * 32767;
+	}
+}
+
+
+static void S_BenchStart (int sfxnum, float volume, float attenuation)
+{
+	vec3_t	origin;
+
+	origin[0] = (S_BenchRand () & 2047) - 1024;
+	origin[1] = (S_BenchRand () & 2047) - 1024;
+	origin[2] = (S_BenchRand () & 255) - 128;
+
+	S_StartSound (origin, 1 + S_BenchRand () % 200, S_BenchRand () & 7, &s_benchsfx[sfxnum], volume, attenuation, 0);
+}
+
+
+/*
+============
+S_MixBench_f
+
+s_mixbench [seconds] [wavfile]
+============
+*/
+static void S_MixBench_f (void)
+{
+	int			seconds = (Cmd_Argc () > 1) ? atoi (Cmd_Argv (1)) : 10;
+	char		*wavfile = (Cmd_Argc () > 2) ? Cmd_Argv (2) : NULL;
+	int			speed = dma.speed;
+	int			i, frame;
+	static short	raw[BENCH_RAWRATE / BENCH_FPS * 2];
+	double		starttime, mixtime = 0;
+	sndcmd_t	cmd;
+
+	if (!sound_started)
+	{
+		Com_Printf ("sound system not started\n");
+		return;
+	}
+
+	if (seconds < 1)
+		seconds = 1;
+
+	// the loader threads resample to dma.speed, so none can still be running while dma is torn down
+	S_FinishLoads ();
+
+	// take the mixer off the device and run it inline against the manual clock
+	S_StopMixer ();
+	SNDDMA_Shutdown ();
+
+	if (!SNDNULL_Init (true, wavfile, speed))
+		SNDNULL_Init (true, NULL, speed);
+
+	S_StartMixer (false);
+
+	s_benchseed = 1;
+
+	S_BenchSound (&s_benchsfx[0], 1, 0.4f, false, 0.30f);	// gunfire
+	S_BenchSound (&s_benchsfx[1], 2, 1.5f, false, 0.05f);	// voice
+	S_BenchSound (&s_benchsfx[2], 2, 1.0f, true, 0.08f);	// cue-looped machinery
+
+	for (i = BENCH_FIRSTLOOP; i < BENCH_NUMSFX; i++)
+		S_BenchSound (&s_benchsfx[i], (i & 1) + 1, 0.5f + i * 0.1f, true, 0.02f * i);
+
+	for (i = 0; i < BENCH_RAWRATE / BENCH_FPS; i++)
+		raw[i * 2 + 0] = raw[i * 2 + 1] = sin (i * 0.1) * 8000;
+
+	for (frame = 0; frame < seconds * BENCH_FPS; frame++)
+	{
+		float	angle = frame * 0.01f;
+
+		// what S_Update sends each frame
+		memset (&cmd, 0, sizeof (cmd));
+		cmd.type = SND_CMD_LISTENER;
+		cmd.u.listener.forward[0] = cos (angle);
+		cmd.u.listener.forward[1] = sin (angle);
+		cmd.u.listener.right[0] = sin (angle);
+		cmd.u.listener.right[1] = -cos (angle);
+		cmd.u.listener.up[2] = 1;
+		cmd.u.listener.active = true;
+		S_PostCommand (&cmd);
+
+		for (i = BENCH_FIRSTLOOP; i < BENCH_NUMSFX; i++)
+		{
+			cmd.type = SND_CMD_LOOPSOUND;
+			cmd.u.loop.sfx = &s_benchsfx[i];
+			cmd.u.loop.left = S_BenchRand () & 255;
+			cmd.u.loop.right = S_BenchRand () & 255;
+			S_PostCommand (&cmd);
+		}
+
+		if (!(frame % 3))
+			S_BenchStart (0, 1, ATTN_NORM);
+
+		if (!(frame % 20))
+			S_BenchStart (1, 1, ATTN_IDLE);
+
+		if (!(frame % 100))
+			S_BenchStart (2, 0.5f, ATTN_STATIC);
+
+		// a cinematic's worth of streamed sound
+		S_RawSamples (BENCH_RAWRATE / BENCH_FPS, BENCH_RAWRATE, 2, 2, (byte *) raw);
+
+		SNDNULL_Advance (speed / BENCH_FPS);
+
+		starttime = Sys_FloatTime ();
+		S_KickMixer ();
+		mixtime += Sys_FloatTime () - starttime;
+	}
+
+	Com_Printf ("%i seconds of sound mixed in %.3f ms, %.3f ms per second\n", seconds, mixtime * 1000.0, mixtime * 1000.0 / seconds);
+
+	// put the real device back
+	S_ClearChannels ();
+
+	for (i = 0; i < BENCH_NUMSFX; i++)
+	{
+		Zone_Free (s_benchsfx[i].cache);
+		memset (&s_benchsfx[i], 0, sizeof (s_benchsfx[i]));
+	}
+
+	SNDDMA_Shutdown ();
+
+	if (!SNDDMA_Init ())
+	{
+		Com_Printf ("S_MixBench_f: couldn't restart the sound device\n");
+		S_Shutdown ();
+		return;
+	}
+
+	S_StartMixer (s_mixthread->value);
+}
+
+
+/*
+===============================================================================
+
+LOOP SOUND BENCHMARK
+
+Merges a fixed scatter of looping emitters the way S_AddLoopSounds used to, with
+every emitter checked against every later one and spatialized on its own, and the
+way it does now, then checks that both came up with the same volumes
+
+===============================================================================
+*/
+
+/*
+==================
+S_GroupLoopSoundsReference
+
+The old quadratic merge, kept for s_loopbench to check against
+==================
+*/
+static void S_GroupLoopSoundsReference (listener_t *listener, loopemitters_t *e, loopgroups_t *g)
+{
+	int		i, j;
+	int		sounds[MAX_EDICTS];
+	int		left, right;
+	vec3_t	origin;
+
+	memcpy (sounds, e->sounds, e->count * sizeof (int));
+	g->count = 0;
+
+	for (i = 0; i < e->count; i++)
+	{
+		if (!sounds[i])
+			continue;
+
+		origin[0] = e->x[i];
+		origin[1] = e->y[i];
+		origin[2] = e->z[i];
+
+		S_SpatializeOrigin (listener, origin, 255.0, SOUND_LOOPATTENUATE, &g->left[g->count], &g->right[g->count]);
+
+		for (j = i + 1; j < e->count; j++)
+		{
+			if (sounds[j] != sounds[i])
+				continue;
+			sounds[j] = 0;	// don't check this again later
+
+			origin[0] = e->x[j];
+			origin[1] = e->y[j];
+			origin[2] = e->z[j];
+
+			S_SpatializeOrigin (listener, origin, 255.0, SOUND_LOOPATTENUATE, &left, &right);
+
+			g->left[g->count] += left;
+			g->right[g->count] += right;
+		}
+
+		g->sounds[g->count++] = sounds[i];
+	}
+}
+
+
+/*
+==================
+S_LoopBench_f
+
+s_loopbench [emitters] [sounds] [passes]
+==================
+*/
+static void S_LoopBench_f (void)
+{
+	int			i;
+	int			numemitters = (Cmd_Argc () > 1) ? atoi (Cmd_Argv (1)) : 1000;
+	int			numsounds = (Cmd_Argc () > 2) ? atoi (Cmd_Argv (2)) : 24;
+	int			passes = (Cmd_Argc () > 3) ? atoi (Cmd_Argv (3)) : 100;
+	int			differ = 0;
+	double		starttime, reftime, hashtime;
+	listener_t	listener;
+	loopemitters_t		*e = &s_loopemitters;
+	static loopgroups_t	reference;
+
+	if (numemitters < 1) numemitters = 1;
+	if (numemitters > MAX_EDICTS) numemitters = MAX_EDICTS;
+	if (numsounds < 1) numsounds = 1;
+	if (numsounds > MAX_SOUNDS - 1) numsounds = MAX_SOUNDS - 1;
+	if (passes < 1) passes = 1;
+
+	memset (&listener, 0, sizeof (listener));
+	VectorSet (listener.origin, 100, -50, 24);
+	VectorSet (listener.forward, 0.8f, -0.6f, 0);
+	VectorSet (listener.right, 0.6f, 0.8f, 0);
+	VectorSet (listener.up, 0, 0, 1);
+	listener.active = true;
+
+	// spread over +/- 1024 units, so some are at full volume, most are attenuated and some are out of range
+	s_benchseed = 1;
+	e->count = numemitters;
+
+	for (i = 0; i < numemitters; i++)
+	{
+		e->sounds[i] = 1 + S_BenchRand () % numsounds;
+		e->x[i] = listener.origin[0] + (S_BenchRand () - 16384) / 16.0f;
+		e->y[i] = listener.origin[1] + (S_BenchRand () - 16384) / 16.0f;
+		e->z[i] = listener.origin[2] + (S_BenchRand () - 16384) / 128.0f;
+	}
+
+	// one right on top of the listener
+	e->x[0] = listener.origin[0];
+	e->y[0] = listener.origin[1];
+	e->z[0] = listener.origin[2];
+
+	starttime = Sys_FloatTime ();
+
+	for (i = 0; i < passes; i++)
+		S_GroupLoopSoundsReference (&listener, e, &reference);
+
+	reftime = Sys_FloatTime () - starttime;
+	starttime = Sys_FloatTime ();
+
+	for (i = 0; i < passes; i++)
+		S_GroupLoopSounds (&listener, e, &s_loopgroups);
+
+	hashtime = Sys_FloatTime () - starttime;
+
+	if (reference.count != s_loopgroups.count)
+		differ = reference.count;
+	else
+	{
+		for (i = 0; i < reference.count; i++)
+		{
+			if (reference.sounds[i] != s_loopgroups.sounds[i] || reference.left[i] != s_loopgroups.left[i] || reference.right[i] != s_loopgroups.right[i])
+				differ++;
+		}
+	}
+
+	Com_Printf ("%i emitters of %i sounds, %i passes\n", numemitters, numsounds, passes);
+	Com_Printf ("quadratic: %.4f ms per pass\n", reftime * 1000.0 / passes);
+	Com_Printf ("hashed:    %.4f ms per pass\n", hashtime * 1000.0 / passes);
+
+	if (differ)
+		Com_Printf ("%i of %i groups differ\n", differ, reference.count);
+	else Com_Printf ("all %i groups match\n", reference.count);
+}
+
+
 /*
 ===============================================================================
 
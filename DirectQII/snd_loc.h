@@ -19,7 +19,25 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 // snd_loc.h -- private sound functions
 
-// !!! if this is changed, the asm code must change !!!
+/*
+the vector code in snd_mix.c and snd_dma.c is only built for x86.  MSVC compiles any intrinsic
+anywhere; GCC and Clang need the instruction set enabled per function so that the rest of the
+code (and the scalar fallbacks) still build for a plain target
+*/
+#if defined (_M_IX86) || defined (_M_X64) || defined (__i386__) || defined (__x86_64__)
+#define S_MIX_X86
+#endif
+
+#if defined (_MSC_VER)
+#define S_ALIGN(n)		__declspec(align(n))
+#define S_TARGET_SSE2
+#define S_TARGET_AVX2
+#else
+#define S_ALIGN(n)		__attribute__ ((aligned (n)))
+#define S_TARGET_SSE2	__attribute__ ((target ("sse2")))
+#define S_TARGET_AVX2	__attribute__ ((target ("avx2")))
+#endif
+
 typedef struct portable_samplepair_s
 {
 	int			left;
@@ -42,6 +60,7 @@ typedef struct sfx_s
 	int			registration_sequence;
 	sfxcache_t	*cache;
 	char 		*truename;
+	volatile qboolean	loading;	// queued for or on a loader thread; cache is set when it's done
 } sfx_t;
 
 // a playsound_t will be generated by each call to S_StartSound,
@@ -60,6 +79,17 @@ typedef struct playsound_s
 	unsigned	begin;			// begin on this sample
 } playsound_t;
 
+// the main thread and the mixer each keep one of these
+typedef struct listener_s
+{
+	vec3_t		origin;
+	vec3_t		forward;
+	vec3_t		right;
+	vec3_t		up;
+	int			playernum;
+	qboolean	active;			// cls.state == ca_active when it was taken
+} listener_t;
+
 typedef struct dma_s
 {
 	int			channels;
@@ -71,7 +101,6 @@ typedef struct dma_s
 	byte		*buffer;
 } dma_t;
 
-// !!! if this is changed, the asm code must change !!!
 typedef struct channel_s
 {
 	sfx_t		*sfx;			// sfx number
@@ -87,6 +116,7 @@ typedef struct channel_s
 	int			master_vol;		// 0-255 master volume
 	qboolean	fixed_origin;	// use origin instead of fetching entnum's origin
 	qboolean	autosound;		// from an entity->sound, cleared each frame
+	qboolean	isvirtual;		// not loud enough to mix; pos still advances so it resumes in place
 } channel_t;
 
 typedef struct wavinfo_s
@@ -97,6 +127,7 @@ typedef struct wavinfo_s
 	int			loopstart;
 	int			samples;
 	int			dataofs;		// chunk starts this many bytes from file start
+	char		*error;			// why channels is 0; GetWavinfo doesn't print it because it may be on a loader thread
 } wavinfo_t;
 
 
@@ -121,21 +152,33 @@ void SNDDMA_BeginPainting (void);
 
 void SNDDMA_Submit (void);
 
+// headless output (snd_null.c); the platform's SNDDMA_ functions hand off to these while it's active
+qboolean SNDNULL_Init (qboolean manual, char *wavfile, int speed);
+qboolean SNDNULL_Active (void);
+void SNDNULL_Advance (int samples);
+int SNDNULL_GetDMAPos (void);
+void SNDNULL_BeginPainting (void);
+void SNDNULL_Submit (void);
+void SNDNULL_Shutdown (void);
+
 //====================================================================
 
-#define	MAX_CHANNELS			32
+// logical channels; only the s_voices loudest of them are mixed
+#define	MAX_CHANNELS			256
 extern	channel_t   channels[MAX_CHANNELS];
+extern	qboolean	s_voicesdirty;
 
+extern	int		sound_started;
 extern	int		paintedtime;
-extern	int		s_rawend;
-extern	vec3_t	listener_origin;
-extern	vec3_t	listener_forward;
-extern	vec3_t	listener_right;
-extern	vec3_t	listener_up;
+extern	volatile int	s_rawend;		// written by the main thread, read by the mixer
+
+extern	volatile qboolean	s_dmafailed;
+extern	listener_t	s_listener;
 extern	dma_t	dma;
 extern	playsound_t	s_pendingplays;
 
-#define	MAX_RAW_SAMPLES	8192
+// big enough for streamed music to stay a few frames ahead at 44 kHz
+#define	MAX_RAW_SAMPLES	32768
 extern	portable_samplepair_t	s_rawsamples[MAX_RAW_SAMPLES];
 
 extern cvar_t	*s_volume;
@@ -143,19 +186,44 @@ extern cvar_t	*s_nosound;
 extern cvar_t	*s_show;
 extern cvar_t	*s_mixahead;
 extern cvar_t	*s_testsound;
+extern cvar_t	*s_mixthread;
+extern cvar_t	*s_voices;
 
 wavinfo_t GetWavinfo (char *name, byte *wav, int wavlength);
 
-void S_InitScaletable (void);
+void S_InitMixer (void);
+void S_ShutdownMixer (void);
+
+// the mixer stays off the DMA buffer while paused
+void S_PauseMixer (qboolean pause);
 
 sfxcache_t *S_LoadSound (sfx_t *s);
+void S_LoadSounds (sfx_t *sfx, int numsfx);
+
+// background loading; nothing may free an sfx until S_FinishLoads
+void S_InitLoaders (void);
+void S_ShutdownLoaders (void);
+void S_QueueSounds (sfx_t *sfx, int numsfx);
+sfxcache_t *S_RequestSound (sfx_t *sfx);
+void S_FinishLoads (void);
+void S_CheckLoads (void);
+void S_LoadStats (void);
+
+// raw samples queued past what the mixer has painted
+int S_RawSamplesAhead (void);
+
+// keeps streamed music fed; called from S_Update
+void S_UpdateMusic (void);
 
 void S_IssuePlaysound (playsound_t *ps);
 
 void S_PaintChannels (int endtime);
 
 // picks a channel based on priorities, empty slots, number of channels
-channel_t *S_PickChannel (int entnum, int entchannel);
+channel_t *S_PickChannel (int entnum, int entchannel, float incoming);
 
 // spatializes a channel
 void S_Spatialize (channel_t *ch);
+
+// picks which channels are mixed and which are virtual
+void S_SelectVoices (void);
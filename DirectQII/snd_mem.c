@@ -29,20 +29,17 @@ byte *S_Alloc (int size);
 /*
 ================
 ResampleSfx
+
+sc isn't attached to its sfx yet, so this can run on a loader thread
 ================
 */
-void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
+static void ResampleSfx (sfxcache_t *sc, int inrate, int inwidth, byte *data)
 {
 	int		outcount;
 	int		srcsample;
 	float	stepscale;
 	int		i;
 	int		sample, samplefrac, fracstep;
-	sfxcache_t	*sc;
-
-	sc = sfx->cache;
-	if (!sc)
-		return;
 
 	stepscale = (float) inrate / dma.speed;	// this is usually 0.5, 1, or 2
 
@@ -91,54 +88,78 @@ void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 
 /*
 ==============
-S_LoadSound
+S_SoundFileName
+
+returns false if the sound doesn't need to be loaded from a file
 ==============
 */
-sfxcache_t *S_LoadSound (sfx_t *s)
+static qboolean S_SoundFileName (sfx_t *s, char *namebuffer, int size)
 {
-	char	namebuffer[MAX_QPATH];
-	byte	*data;
-	wavinfo_t	info;
-	int		len;
-	float	stepscale;
-	sfxcache_t	*sc;
-	int		size;
 	char	*name;
 
 	if (s->name[0] == '*')
-		return NULL;
+		return false;
 
 	// see if still in memory
-	sc = s->cache;
-	if (sc)
-		return sc;
+	if (s->cache)
+		return false;
 
-	//Com_Printf ("S_LoadSound: %x\n", (int)stackbuf);
-	// load it in
 	if (s->truename)
 		name = s->truename;
 	else
 		name = s->name;
 
 	if (name[0] == '#')
-		strcpy (namebuffer, &name[1]);
+		Com_sprintf (namebuffer, size, "%s", &name[1]);
 	else
-		Com_sprintf (namebuffer, sizeof (namebuffer), "sound/%s", name);
+		Com_sprintf (namebuffer, size, "sound/%s", name);
+
+	return true;
+}
 
-	//	Com_Printf ("loading %s\n",namebuffer);
 
-	size = FS_LoadFile (namebuffer, (void **) &data);
+/*
+==============
+S_CacheSound
+
+resamples loaded wav data into the sfx cache and releases the data; the cache is only
+attached to the sfx once it's complete, because the mixer may be looking at it.  This
+runs on the loader threads too, so it doesn't print; on failure it sets reason and the
+caller reports it with S_LoadFailed
+==============
+*/
+static char snd_notfound[] = "not found";
+
+static sfxcache_t *S_CacheSound (sfx_t *s, byte *data, int size, char **reason)
+{
+	wavinfo_t	info;
+	int		len;
+	float	stepscale;
+	sfxcache_t	*sc;
+
+	if (size == FS_READERROR)
+	{
+		*reason = "read error";
+		return NULL;
+	}
 
 	if (!data)
 	{
-		Com_DPrintf ("Couldn't load %s\n", namebuffer);
+		*reason = snd_notfound;
 		return NULL;
 	}
 
 	info = GetWavinfo (s->name, data, size);
+	if (!info.channels)
+	{
+		*reason = info.error;
+		FS_FreeFile (data);
+		return NULL;
+	}
+
 	if (info.channels != 1)
 	{
-		Com_Printf ("%s is a stereo sample\n", s->name);
+		*reason = "stereo sample";
 		FS_FreeFile (data);
 		return NULL;
 	}
@@ -148,10 +169,11 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	len = info.samples / stepscale;
 	len = len * info.width * info.channels;
 
-	sc = s->cache = Zone_Alloc (len + sizeof (sfxcache_t));
+	sc = Zone_AllocCategory (len + sizeof (sfxcache_t), MEM_SOUND);
 
 	if (!sc)
 	{
+		*reason = "out of memory";
 		FS_FreeFile (data);
 		return NULL;
 	}
@@ -162,14 +184,483 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	sc->width = info.width;
 	sc->stereo = info.channels;
 
-	ResampleSfx (s, sc->speed, sc->width, data + info.dataofs);
+	ResampleSfx (sc, sc->speed, sc->width, data + info.dataofs);
 
 	FS_FreeFile (data);
 
+	// the mixer thread reads through s->cache without a lock
+	Sys_WriteBarrier ();
+	s->cache = sc;
+
 	return sc;
 }
 
 
+/*
+==============
+S_LoadFailed
+
+main thread only; a missing sound is routine so it's only mentioned with developer set
+==============
+*/
+static void S_LoadFailed (char *name, char *reason)
+{
+	if (reason == snd_notfound)
+		Com_DPrintf ("Couldn't load %s: %s\n", name, reason);
+	else Com_Printf ("Couldn't load %s: %s\n", name, reason);
+}
+
+
+/*
+==============
+S_LoadSound
+==============
+*/
+sfxcache_t *S_LoadSound (sfx_t *s)
+{
+	char	namebuffer[MAX_QPATH];
+	char	*reason = NULL;
+	byte	*data;
+	int		size;
+	sfxcache_t	*sc;
+
+	// a loader thread has it
+	if (s->loading)
+		return NULL;
+
+	if (!S_SoundFileName (s, namebuffer, sizeof (namebuffer)))
+		return s->cache;
+
+	size = FS_LoadFileReadOnly (namebuffer, (void **) &data);
+
+	if ((sc = S_CacheSound (s, data, size, &reason)) == NULL)
+		S_LoadFailed (namebuffer, reason);
+
+	return sc;
+}
+
+
+/*
+==============
+S_LoadSounds
+
+loads a batch of sounds (at registration) with all the reads queued up front, so that
+the disk is busy with the next one while the current one is being resampled
+==============
+*/
+void S_LoadSounds (sfx_t *sfx, int numsfx)
+{
+	char	namebuffer[MAX_QPATH];
+	fsjob_t	**jobs = Zone_Alloc (numsfx * sizeof (fsjob_t *));
+	char	*reason = NULL;
+	byte	*data;
+	int		i, size;
+
+	for (i = 0; i < numsfx; i++)
+	{
+		if (sfx[i].name[0] && S_SoundFileName (&sfx[i], namebuffer, sizeof (namebuffer)))
+			jobs[i] = FS_LoadFileAsync (namebuffer, FS_PRIORITY_NORMAL, true);
+	}
+
+	for (i = 0; i < numsfx; i++)
+	{
+		if (!jobs[i])
+			continue;
+
+		S_SoundFileName (&sfx[i], namebuffer, sizeof (namebuffer));
+		size = FS_WaitFile (jobs[i], (void **) &data);
+
+		if (!S_CacheSound (&sfx[i], data, size, &reason))
+			S_LoadFailed (namebuffer, reason);
+	}
+
+	Zone_Free (jobs);
+}
+
+
+
+/*
+===============================================================================
+
+BACKGROUND LOADING
+
+S_EndRegistration hands every sound that isn't resident to a couple of loader
+threads, which read, parse and resample it and then attach the finished cache to
+the sfx.  Until then sfx->loading is set and sfx->cache is NULL; the game doesn't
+wait for it and the mixer just skips it.  Nothing that frees an sfx may run while
+loads are in flight, so S_EndRegistration and S_Shutdown call S_FinishLoads first
+
+===============================================================================
+*/
+
+#define	MAX_SOUND_LOADERS	2
+#define	LOAD_QUEUE_SIZE		1024		// > MAX_SFX, and each sfx is queued at most once
+#define	MAX_LOAD_FAILURES	32			// named in the report; any more are only counted
+
+// the loader threads can't print, so a failure is kept for the main thread to report
+typedef struct sndloadfailure_s
+{
+	char	name[MAX_QPATH];
+	char	*reason;
+} sndloadfailure_t;
+
+typedef struct sndloadstats_s
+{
+	char	mapname[MAX_QPATH];
+	int		numsounds;
+	int		numfailed;
+	int		numreported;		// failures already printed; main thread only
+	sndloadfailure_t	failures[MAX_LOAD_FAILURES];
+	int		bytes;				// resident after resampling
+	double	starttime;
+	double	walltime;			// from S_EndRegistration to the last sound finishing
+	double	worktime;			// summed over the loader threads
+	qboolean	finished;
+} sndloadstats_t;
+
+static struct
+{
+	void	*threads[MAX_SOUND_LOADERS];
+	int		numthreads;
+	volatile qboolean	quit;
+
+	void	*lock;
+	void	*wake;			// raised when a sound is queued
+	void	*done;			// raised when a sound finishes; only the main thread waits on it
+
+	// protected by the lock
+	sfx_t	*queue[LOAD_QUEUE_SIZE];
+	int		head, tail;
+	int		numpending;		// queued or being loaded
+
+	sndloadstats_t	stats;
+} snd_load;
+
+
+static unsigned S_LoaderThread (void *param)
+{
+	char	namebuffer[MAX_QPATH];
+	char	*reason;
+	byte	*data;
+	int		size;
+	sfx_t	*sfx;
+	sfxcache_t	*sc;
+	double	starttime;
+
+	while (!snd_load.quit)
+	{
+		Sys_WaitSignal (snd_load.wake, -1);
+
+		// keep going until the queue is empty, so a wake that was raised while we were busy isn't lost
+		for (;;)
+		{
+			Sys_Lock (snd_load.lock);
+
+			if (snd_load.head == snd_load.tail)
+				sfx = NULL;
+			else sfx = snd_load.queue[snd_load.tail++ & (LOAD_QUEUE_SIZE - 1)];
+
+			Sys_Unlock (snd_load.lock);
+
+			if (!sfx)
+				break;
+
+			starttime = Sys_FloatTime ();
+			reason = NULL;
+			sc = NULL;
+
+			if (S_SoundFileName (sfx, namebuffer, sizeof (namebuffer)))
+			{
+				// FS_LoadFileReadOnly would Com_Error on a read error, which can't happen on this thread
+				size = FS_TryLoadFile (namebuffer, (void **) &data, true);
+				sc = S_CacheSound (sfx, data, size, &reason);
+			}
+
+			Sys_Lock (snd_load.lock);
+
+			snd_load.stats.worktime += Sys_FloatTime () - starttime;
+
+			if (sc)
+				snd_load.stats.bytes += sc->length * sc->width;
+			else if (reason)
+			{
+				if (snd_load.stats.numfailed < MAX_LOAD_FAILURES)
+				{
+					sndloadfailure_t *f = &snd_load.stats.failures[snd_load.stats.numfailed];
+
+					Com_sprintf (f->name, sizeof (f->name), "%s", namebuffer);
+					f->reason = reason;
+				}
+
+				snd_load.stats.numfailed++;
+			}
+
+			sfx->loading = false;
+			snd_load.numpending--;
+
+			Sys_Unlock (snd_load.lock);
+
+			Sys_RaiseSignal (snd_load.done);
+		}
+	}
+
+	// pass the shutdown on to the next thread; the signal only wakes one of us
+	Sys_RaiseSignal (snd_load.wake);
+
+	return 0;
+}
+
+
+/*
+==============
+S_ReportLoads
+
+Prints the failures the loader threads have recorded since the last call
+==============
+*/
+static void S_ReportLoads (void)
+{
+	sndloadstats_t	*st = &snd_load.stats;
+	int		numfailed;
+
+	Sys_Lock (snd_load.lock);
+	numfailed = st->numfailed;
+	Sys_Unlock (snd_load.lock);
+
+	// an entry is complete before numfailed counts it and isn't touched again, so it can be read unlocked
+	for (; st->numreported < numfailed && st->numreported < MAX_LOAD_FAILURES; st->numreported++)
+		S_LoadFailed (st->failures[st->numreported].name, st->failures[st->numreported].reason);
+
+	if (numfailed > st->numreported)
+	{
+		Com_Printf ("...and %i more sounds failed to load\n", numfailed - st->numreported);
+		st->numreported = numfailed;
+	}
+}
+
+
+/*
+==============
+S_QueueSound
+
+Returns false if there are no loader threads, in which case the sound must be loaded synchronously
+==============
+*/
+static qboolean S_QueueSound (sfx_t *sfx)
+{
+	char	namebuffer[MAX_QPATH];
+
+	if (!snd_load.numthreads)
+		return false;
+
+	if (sfx->loading || !sfx->name[0] || !S_SoundFileName (sfx, namebuffer, sizeof (namebuffer)))
+		return true;
+
+	sfx->loading = true;
+
+	Sys_Lock (snd_load.lock);
+
+	snd_load.queue[snd_load.head++ & (LOAD_QUEUE_SIZE - 1)] = sfx;
+	snd_load.numpending++;
+	snd_load.stats.numsounds++;
+
+	Sys_Unlock (snd_load.lock);
+
+	Sys_RaiseSignal (snd_load.wake);
+
+	return true;
+}
+
+
+/*
+==============
+S_QueueSounds
+
+S_EndRegistration's replacement for S_LoadSounds
+==============
+*/
+void S_QueueSounds (sfx_t *sfx, int numsfx)
+{
+	int		i;
+
+	if (!snd_load.numthreads)
+	{
+		S_LoadSounds (sfx, numsfx);
+		return;
+	}
+
+	// anything from the last registration that hasn't been printed would be lost in the reset
+	S_ReportLoads ();
+
+	Sys_Lock (snd_load.lock);
+
+	memset (&snd_load.stats, 0, sizeof (snd_load.stats));
+	Com_sprintf (snd_load.stats.mapname, sizeof (snd_load.stats.mapname), "%s", cl.configstrings[CS_MODELS + 1]);
+	snd_load.stats.starttime = Sys_FloatTime ();
+
+	Sys_Unlock (snd_load.lock);
+
+	for (i = 0; i < numsfx; i++)
+		S_QueueSound (&sfx[i]);
+}
+
+
+/*
+==============
+S_RequestSound
+
+For playing a sound that may not be resident; returns its cache if it is, otherwise queues it
+and returns NULL rather than stall the frame
+==============
+*/
+sfxcache_t *S_RequestSound (sfx_t *sfx)
+{
+	if (sfx->cache || sfx->loading)
+		return sfx->cache;
+
+	if (!S_QueueSound (sfx))
+		return S_LoadSound (sfx);
+
+	return NULL;
+}
+
+
+/*
+==============
+S_FinishLoads
+
+Waits for everything in flight
+==============
+*/
+void S_FinishLoads (void)
+{
+	double	starttime = Sys_FloatTime ();
+	int		pending;
+
+	if (!snd_load.numthreads)
+		return;
+
+	for (;;)
+	{
+		Sys_Lock (snd_load.lock);
+		pending = snd_load.numpending;
+		Sys_Unlock (snd_load.lock);
+
+		if (!pending)
+			break;
+
+		// the done signal is raised for every sound so keep checking
+		Sys_WaitSignal (snd_load.done, -1);
+	}
+
+	S_ReportLoads ();
+
+	if (Sys_FloatTime () - starttime > 0.001)
+		Com_DPrintf ("S_FinishLoads: waited %.3f ms for sound loads\n", (Sys_FloatTime () - starttime) * 1000.0);
+}
+
+
+/*
+==============
+S_CheckLoads
+
+Called each frame; reports a registration's load once the last of it is in
+==============
+*/
+void S_CheckLoads (void)
+{
+	sndloadstats_t	*st = &snd_load.stats;
+	qboolean	report = false;
+
+	if (!snd_load.numthreads)
+		return;
+
+	// sounds requested during play can fail after the registration is done
+	S_ReportLoads ();
+
+	if (st->finished || !st->starttime)
+		return;
+
+	Sys_Lock (snd_load.lock);
+
+	if (!snd_load.numpending)
+	{
+		st->walltime = Sys_FloatTime () - st->starttime;
+		st->finished = report = true;
+	}
+
+	Sys_Unlock (snd_load.lock);
+
+	if (report)
+		Com_DPrintf ("%s: %i sounds loaded in %.1f ms\n", st->mapname, st->numsounds, st->walltime * 1000.0);
+}
+
+
+/*
+==============
+S_LoadStats
+
+For soundinfo
+==============
+*/
+void S_LoadStats (void)
+{
+	sndloadstats_t	*st = &snd_load.stats;
+
+	if (!snd_load.numthreads)
+	{
+		Com_Printf ("sounds are loaded on the main thread\n");
+		return;
+	}
+
+	if (!st->starttime)
+		return;
+
+	Com_Printf ("last registration (%s): %i sounds, %i failed, %i KB\n", st->mapname, st->numsounds, st->numfailed, st->bytes / 1024);
+
+	if (st->finished)
+		Com_Printf ("...%.1f ms wall time, %.1f ms of work on %i threads\n", st->walltime * 1000.0, st->worktime * 1000.0, snd_load.numthreads);
+	else Com_Printf ("...still loading\n");
+}
+
+
+void S_InitLoaders (void)
+{
+	int		i;
+
+	memset (&snd_load, 0, sizeof (snd_load));
+
+	snd_load.lock = Sys_CreateLock ();
+	snd_load.wake = Sys_CreateSignal ();
+	snd_load.done = Sys_CreateSignal ();
+
+	for (i = 0; i < MAX_SOUND_LOADERS; i++)
+	{
+		if ((snd_load.threads[snd_load.numthreads] = Sys_CreateThread (S_LoaderThread, NULL)) != NULL)
+			snd_load.numthreads++;
+	}
+}
+
+
+void S_ShutdownLoaders (void)
+{
+	int		i;
+
+	S_FinishLoads ();
+
+	snd_load.quit = true;
+	Sys_RaiseSignal (snd_load.wake);
+
+	for (i = 0; i < snd_load.numthreads; i++)
+		Sys_WaitThread (snd_load.threads[i]);
+
+	Sys_DestroyLock (snd_load.lock);
+	Sys_DestroySignal (snd_load.wake);
+	Sys_DestroySignal (snd_load.done);
+
+	memset (&snd_load, 0, sizeof (snd_load));
+}
+
 
 /*
 ===============================================================================
@@ -180,83 +671,87 @@ WAV loading
 */
 
 
-byte	*data_p;
-byte 	*iff_end;
-byte 	*last_chunk;
-byte 	*iff_data;
-int 	iff_chunk_len;
+// parse state, so that sounds can be read on several threads at once
+typedef struct wavparse_s
+{
+	byte	*data_p;
+	byte 	*iff_end;
+	byte 	*last_chunk;
+	byte 	*iff_data;
+	int 	iff_chunk_len;
+} wavparse_t;
 
 
-short GetLittleShort (void)
+static short GetLittleShort (wavparse_t *w)
 {
 	short val = 0;
-	val = *data_p;
-	val = val + (*(data_p + 1) << 8);
-	data_p += 2;
+	val = *w->data_p;
+	val = val + (*(w->data_p + 1) << 8);
+	w->data_p += 2;
 	return val;
 }
 
-int GetLittleLong (void)
+static int GetLittleLong (wavparse_t *w)
 {
 	int val = 0;
-	val = *data_p;
-	val = val + (*(data_p + 1) << 8);
-	val = val + (*(data_p + 2) << 16);
-	val = val + (*(data_p + 3) << 24);
-	data_p += 4;
+	val = *w->data_p;
+	val = val + (*(w->data_p + 1) << 8);
+	val = val + (*(w->data_p + 2) << 16);
+	val = val + (*(w->data_p + 3) << 24);
+	w->data_p += 4;
 	return val;
 }
 
-void FindNextChunk (char *name)
+static void FindNextChunk (wavparse_t *w, char *name)
 {
 	while (1)
 	{
-		data_p = last_chunk;
+		w->data_p = w->last_chunk;
 
-		if (data_p >= iff_end)
+		if (w->data_p >= w->iff_end)
 		{
 			// didn't find the chunk
-			data_p = NULL;
+			w->data_p = NULL;
 			return;
 		}
 
-		data_p += 4;
-		iff_chunk_len = GetLittleLong ();
-		if (iff_chunk_len < 0)
+		w->data_p += 4;
+		w->iff_chunk_len = GetLittleLong (w);
+		if (w->iff_chunk_len < 0)
 		{
-			data_p = NULL;
+			w->data_p = NULL;
 			return;
 		}
-		//		if (iff_chunk_len > 1024 * 1024)
-		//			Sys_Error ("FindNextChunk: %i length is past the 1 meg sanity limit", iff_chunk_len);
-		data_p -= 8;
-		last_chunk = data_p + 8 + ((iff_chunk_len + 1) & ~1);
-		if (!strncmp (data_p, name, 4))
+		//		if (w->iff_chunk_len > 1024 * 1024)
+		//			Sys_Error ("FindNextChunk: %i length is past the 1 meg sanity limit", w->iff_chunk_len);
+		w->data_p -= 8;
+		w->last_chunk = w->data_p + 8 + ((w->iff_chunk_len + 1) & ~1);
+		if (!strncmp (w->data_p, name, 4))
 			return;
 	}
 }
 
-void FindChunk (char *name)
+static void FindChunk (wavparse_t *w, char *name)
 {
-	last_chunk = iff_data;
-	FindNextChunk (name);
+	w->last_chunk = w->iff_data;
+	FindNextChunk (w, name);
 }
 
 
-void DumpChunks (void)
+static void DumpChunks (wavparse_t *w)
 {
 	char	str[5];
 
 	str[4] = 0;
-	data_p = iff_data;
+	w->data_p = w->iff_data;
 	do
 	{
-		memcpy (str, data_p, 4);
-		data_p += 4;
-		iff_chunk_len = GetLittleLong ();
-		Com_Printf ("0x%x : %s (%d)\n", (int) (data_p - 4), str, iff_chunk_len);
-		data_p += (iff_chunk_len + 1) & ~1;
-	} while (data_p < iff_end);
+		memcpy (str, w->data_p, 4);
+		w->data_p += 4;
+		w->iff_chunk_len = GetLittleLong (w);
+		Com_Printf ("0x%x : %s (%d)\n", (int) (w->data_p - 4), str, w->iff_chunk_len);
+		w->data_p += (w->iff_chunk_len + 1) & ~1;
+	} while (w->data_p < w->iff_end);
 }
 
 /*
@@ -266,6 +761,7 @@ GetWavinfo
 */
 wavinfo_t GetWavinfo (char *name, byte *wav, int wavlength)
 {
+	wavparse_t	parse, *w = &parse;
 	wavinfo_t	info;
 	int     i;
 	int     format;
@@ -274,59 +770,62 @@ wavinfo_t GetWavinfo (char *name, byte *wav, int wavlength)
 	memset (&info, 0, sizeof (info));
 
 	if (!wav)
+	{
+		info.error = "no data";
 		return info;
+	}
 
-	iff_data = wav;
-	iff_end = wav + wavlength;
+	w->iff_data = wav;
+	w->iff_end = wav + wavlength;
 
 	// find "RIFF" chunk
-	FindChunk ("RIFF");
-	if (!(data_p && !strncmp (data_p + 8, "WAVE", 4)))
+	FindChunk (w, "RIFF");
+	if (!(w->data_p && !strncmp (w->data_p + 8, "WAVE", 4)))
 	{
-		Com_Printf ("Missing RIFF/WAVE chunks\n");
+		info.error = "missing RIFF/WAVE chunks";
 		return info;
 	}
 
 	// get "fmt " chunk
-	iff_data = data_p + 12;
-	// DumpChunks ();
+	w->iff_data = w->data_p + 12;
+	// DumpChunks (w);
 
-	FindChunk ("fmt ");
-	if (!data_p)
+	FindChunk (w, "fmt ");
+	if (!w->data_p)
 	{
-		Com_Printf ("Missing fmt chunk\n");
+		info.error = "missing fmt chunk";
 		return info;
 	}
-	data_p += 8;
-	format = GetLittleShort ();
+	w->data_p += 8;
+	format = GetLittleShort (w);
 	if (format != 1)
 	{
-		Com_Printf ("Microsoft PCM format only\n");
+		info.error = "Microsoft PCM format only";
 		return info;
 	}
 
-	info.channels = GetLittleShort ();
-	info.rate = GetLittleLong ();
-	data_p += 4 + 2;
-	info.width = GetLittleShort () / 8;
+	info.channels = GetLittleShort (w);
+	info.rate = GetLittleLong (w);
+	w->data_p += 4 + 2;
+	info.width = GetLittleShort (w) / 8;
 
 	// get cue chunk
-	FindChunk ("cue ");
-	if (data_p)
+	FindChunk (w, "cue ");
+	if (w->data_p)
 	{
-		data_p += 32;
-		info.loopstart = GetLittleLong ();
+		w->data_p += 32;
+		info.loopstart = GetLittleLong (w);
 		//		Com_Printf("loopstart=%d\n", sfx->loopstart);
 
 		// if the next chunk is a LIST chunk, look for a cue length marker
-		FindNextChunk ("LIST");
-		if (data_p)
+		FindNextChunk (w, "LIST");
+		if (w->data_p)
 		{
-			if (!strncmp (data_p + 28, "mark", 4))
+			if (!strncmp (w->data_p + 28, "mark", 4))
 			{
 				// this is not a proper parse, but it works with cooledit...
-				data_p += 24;
-				i = GetLittleLong ();	// samples in loop
+				w->data_p += 24;
+				i = GetLittleLong (w);	// samples in loop
 				info.samples = info.loopstart + i;
 				//				Com_Printf("looped length: %i\n", i);
 			}
@@ -336,25 +835,30 @@ wavinfo_t GetWavinfo (char *name, byte *wav, int wavlength)
 		info.loopstart = -1;
 
 	// find data chunk
-	FindChunk ("data");
-	if (!data_p)
+	FindChunk (w, "data");
+	if (!w->data_p)
 	{
-		Com_Printf ("Missing data chunk\n");
+		info.error = "missing data chunk";
 		return info;
 	}
 
-	data_p += 4;
-	samples = GetLittleLong () / info.width;
+	w->data_p += 4;
+	samples = GetLittleLong (w) / info.width;
 
 	if (info.samples)
 	{
 		if (samples < info.samples)
-			Com_Error (ERR_DROP, "Sound %s has a bad loop length", name);
+		{
+			// this may be on a loader thread so it can't Com_Error; the sound is just rejected
+			memset (&info, 0, sizeof (info));
+			info.error = "bad loop length";
+			return info;
+		}
 	}
 	else
 		info.samples = samples;
 
-	info.dataofs = data_p - wav;
+	info.dataofs = w->data_p - wav;
 
 	return info;
 }
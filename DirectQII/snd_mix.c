@@ -22,115 +22,502 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "client.h"
 #include "snd_loc.h"
 
+// S_MIX_X86 and the target macros are in snd_loc.h
+#ifdef S_MIX_X86
+#if defined (_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#endif
+
+/*
+the paint buffer is interleaved left/right floats in 16-bit sample units, so the channels
+are mixed with a multiply-add per sample and clamped and converted to the dma format once at
+the end.  there's a plain C version of each kernel which the vector ones are checked against
+by s_mixtest; they do the same float operations in the same order so the results should be
+identical.
+*/
 #define	PAINTBUFFER_SIZE	2048
-portable_samplepair_t paintbuffer[PAINTBUFFER_SIZE];
-int		snd_scaletable[32][256];
-int 	*snd_p, snd_linear_count, snd_vol;
-short	*snd_out;
 
-void S_WriteLinearBlastStereo16 (void);
+static S_ALIGN(32) float paintbuffer[PAINTBUFFER_SIZE * 2];
+
+typedef struct mixkernels_s {
+	char	*name;
+
+	// add count mono samples scaled by lgain/rgain into count stereo pairs at out
+	void (*Paint8) (float *out, signed char *sfx, int count, float lgain, float rgain);
+	void (*Paint16) (float *out, short *sfx, int count, float lgain, float rgain);
+
+	// clamp and round count floats into 16-bit samples
+	void (*Transfer16) (short *out, float *in, int count);
+} mixkernels_t;
+
+static mixkernels_t	*snd_mixer;
+static float		snd_volume;
+
+cvar_t	*s_mixer;
+
+
+/*
+===============================================================================
+
+REFERENCE KERNELS
+
+===============================================================================
+*/
+
+static void S_Paint8_C (float *out, signed char *sfx, int count, float lgain, float rgain)
+{
+	int		i;
+
+	// 8 bit samples are scaled up to 16 bit through the gains
+	lgain *= 256.0f;
+	rgain *= 256.0f;
+
+	for (i = 0; i < count; i++, out += 2)
+	{
+		float data = sfx[i];
+
+		out[0] += data * lgain;
+		out[1] += data * rgain;
+	}
+}
 
-#if !(defined __linux__ && defined __i386__)
-#if	!id386
 
-void S_WriteLinearBlastStereo16 (void)
+static void S_Paint16_C (float *out, short *sfx, int count, float lgain, float rgain)
 {
 	int		i;
-	int		val;
 
-	for (i = 0; i < snd_linear_count; i += 2)
+	for (i = 0; i < count; i++, out += 2)
 	{
-		val = snd_p[i] >> 8;
-		if (val > 0x7fff)
-			snd_out[i] = 0x7fff;
-		else if (val < (short) 0x8000)
-			snd_out[i] = (short) 0x8000;
-		else
-			snd_out[i] = val;
+		float data = sfx[i];
 
-		val = snd_p[i + 1] >> 8;
-		if (val > 0x7fff)
-			snd_out[i + 1] = 0x7fff;
-		else if (val < (short) 0x8000)
-			snd_out[i + 1] = (short) 0x8000;
-		else
-			snd_out[i + 1] = val;
+		out[0] += data * lgain;
+		out[1] += data * rgain;
 	}
 }
-#else
-__declspec(naked) void S_WriteLinearBlastStereo16 (void)
+
+
+static void S_Transfer16_C (short *out, float *in, int count)
+{
+	int		i;
+
+	for (i = 0; i < count; i++)
+	{
+		float val = in[i];
+
+		if (val > 32767.0f)
+			val = 32767.0f;
+		else if (val < -32768.0f)
+			val = -32768.0f;
+
+		// round to nearest even like cvtps2dq
+		out[i] = (short) lrintf (val);
+	}
+}
+
+
+static mixkernels_t snd_mixer_c = {"C", S_Paint8_C, S_Paint16_C, S_Transfer16_C};
+
+
+#ifdef S_MIX_X86
+/*
+===============================================================================
+
+SSE2 KERNELS
+
+===============================================================================
+*/
+
+static S_TARGET_SSE2 void S_Paint8_SSE2 (float *out, signed char *sfx, int count, float lgain, float rgain)
+{
+	__m128 gains = _mm_setr_ps (lgain * 256.0f, rgain * 256.0f, lgain * 256.0f, rgain * 256.0f);
+	int		i;
+
+	for (i = 0; i + 4 <= count; i += 4, out += 8)
+	{
+		// sign-extend 4 bytes to 4 ints by shifting them to the top of each lane and back
+		__m128i b = _mm_cvtsi32_si128 (*(int *) &sfx[i]);
+		__m128i d = _mm_srai_epi32 (_mm_unpacklo_epi16 (_mm_unpacklo_epi8 (b, b), _mm_unpacklo_epi8 (b, b)), 24);
+		__m128 f = _mm_cvtepi32_ps (d);
+
+		_mm_storeu_ps (out + 0, _mm_add_ps (_mm_loadu_ps (out + 0), _mm_mul_ps (_mm_unpacklo_ps (f, f), gains)));
+		_mm_storeu_ps (out + 4, _mm_add_ps (_mm_loadu_ps (out + 4), _mm_mul_ps (_mm_unpackhi_ps (f, f), gains)));
+	}
+
+	if (i < count)
+		S_Paint8_C (out, &sfx[i], count - i, lgain, rgain);
+}
+
+
+static S_TARGET_SSE2 void S_Paint16_SSE2 (float *out, short *sfx, int count, float lgain, float rgain)
+{
+	__m128 gains = _mm_setr_ps (lgain, rgain, lgain, rgain);
+	int		i;
+
+	for (i = 0; i + 4 <= count; i += 4, out += 8)
+	{
+		__m128i s = _mm_loadl_epi64 ((__m128i *) &sfx[i]);
+		__m128i d = _mm_srai_epi32 (_mm_unpacklo_epi16 (s, s), 16);
+		__m128 f = _mm_cvtepi32_ps (d);
+
+		_mm_storeu_ps (out + 0, _mm_add_ps (_mm_loadu_ps (out + 0), _mm_mul_ps (_mm_unpacklo_ps (f, f), gains)));
+		_mm_storeu_ps (out + 4, _mm_add_ps (_mm_loadu_ps (out + 4), _mm_mul_ps (_mm_unpackhi_ps (f, f), gains)));
+	}
+
+	if (i < count)
+		S_Paint16_C (out, &sfx[i], count - i, lgain, rgain);
+}
+
+
+static S_TARGET_SSE2 void S_Transfer16_SSE2 (short *out, float *in, int count)
+{
+	__m128 maxval = _mm_set1_ps (32767.0f);
+	__m128 minval = _mm_set1_ps (-32768.0f);
+	int		i;
+
+	for (i = 0; i + 8 <= count; i += 8)
+	{
+		__m128i a = _mm_cvtps_epi32 (_mm_max_ps (_mm_min_ps (_mm_loadu_ps (in + i + 0), maxval), minval));
+		__m128i b = _mm_cvtps_epi32 (_mm_max_ps (_mm_min_ps (_mm_loadu_ps (in + i + 4), maxval), minval));
+
+		_mm_storeu_si128 ((__m128i *) &out[i], _mm_packs_epi32 (a, b));
+	}
+
+	if (i < count)
+		S_Transfer16_C (&out[i], &in[i], count - i);
+}
+
+
+static mixkernels_t snd_mixer_sse2 = {"SSE2", S_Paint8_SSE2, S_Paint16_SSE2, S_Transfer16_SSE2};
+
+
+/*
+===============================================================================
+
+AVX2 KERNELS
+
+===============================================================================
+*/
+
+static S_TARGET_AVX2 void S_Paint8_AVX2 (float *out, signed char *sfx, int count, float lgain, float rgain)
 {
-	__asm {
-
-		push edi
-			push ebx
-			mov ecx, ds:dword ptr[snd_linear_count]
-			mov ebx, ds : dword ptr[snd_p]
-			mov edi, ds : dword ptr[snd_out]
-LWLBLoopTop :
-			mov eax, ds : dword ptr[-8 + ebx + ecx * 4]
-			sar eax, 8
-			cmp eax, 07FFFh
-			jg LClampHigh
-			cmp eax, 0FFFF8000h
-			jnl LClampDone
-			mov eax, 0FFFF8000h
-			jmp LClampDone
-LClampHigh :
-		mov eax, 07FFFh
-LClampDone :
-		   mov edx, ds : dword ptr[-4 + ebx + ecx * 4]
-		   sar edx, 8
-		   cmp edx, 07FFFh
-		   jg LClampHigh2
-		   cmp edx, 0FFFF8000h
-		   jnl LClampDone2
-		   mov edx, 0FFFF8000h
-		   jmp LClampDone2
-LClampHigh2 :
-		mov edx, 07FFFh
-LClampDone2 :
-			shl edx, 16
-			and eax, 0FFFFh
-			or edx, eax
-			mov ds : dword ptr[-4 + edi + ecx * 2], edx
-			sub ecx, 2
-			jnz LWLBLoopTop
-			pop ebx
-			pop edi
-			ret
+	__m256 gains = _mm256_setr_ps (lgain, rgain, lgain, rgain, lgain, rgain, lgain, rgain);
+	int		i;
+
+	gains = _mm256_mul_ps (gains, _mm256_set1_ps (256.0f));
+
+	for (i = 0; i + 8 <= count; i += 8, out += 16)
+	{
+		__m256 f = _mm256_cvtepi32_ps (_mm256_cvtepi8_epi32 (_mm_loadl_epi64 ((__m128i *) &sfx[i])));
+
+		// unpack works within 128-bit lanes so the halves need swapping back into order
+		__m256 lo = _mm256_unpacklo_ps (f, f);
+		__m256 hi = _mm256_unpackhi_ps (f, f);
+
+		_mm256_storeu_ps (out + 0, _mm256_add_ps (_mm256_loadu_ps (out + 0), _mm256_mul_ps (_mm256_permute2f128_ps (lo, hi, 0x20), gains)));
+		_mm256_storeu_ps (out + 8, _mm256_add_ps (_mm256_loadu_ps (out + 8), _mm256_mul_ps (_mm256_permute2f128_ps (lo, hi, 0x31), gains)));
 	}
+
+	_mm256_zeroupper ();
+
+	if (i < count)
+		S_Paint8_C (out, &sfx[i], count - i, lgain, rgain);
 }
 
+
+static S_TARGET_AVX2 void S_Paint16_AVX2 (float *out, short *sfx, int count, float lgain, float rgain)
+{
+	__m256 gains = _mm256_setr_ps (lgain, rgain, lgain, rgain, lgain, rgain, lgain, rgain);
+	int		i;
+
+	for (i = 0; i + 8 <= count; i += 8, out += 16)
+	{
+		__m256 f = _mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (_mm_loadu_si128 ((__m128i *) &sfx[i])));
+		__m256 lo = _mm256_unpacklo_ps (f, f);
+		__m256 hi = _mm256_unpackhi_ps (f, f);
+
+		_mm256_storeu_ps (out + 0, _mm256_add_ps (_mm256_loadu_ps (out + 0), _mm256_mul_ps (_mm256_permute2f128_ps (lo, hi, 0x20), gains)));
+		_mm256_storeu_ps (out + 8, _mm256_add_ps (_mm256_loadu_ps (out + 8), _mm256_mul_ps (_mm256_permute2f128_ps (lo, hi, 0x31), gains)));
+	}
+
+	_mm256_zeroupper ();
+
+	if (i < count)
+		S_Paint16_C (out, &sfx[i], count - i, lgain, rgain);
+}
+
+
+static S_TARGET_AVX2 void S_Transfer16_AVX2 (short *out, float *in, int count)
+{
+	__m256 maxval = _mm256_set1_ps (32767.0f);
+	__m256 minval = _mm256_set1_ps (-32768.0f);
+	int		i;
+
+	for (i = 0; i + 16 <= count; i += 16)
+	{
+		__m256i a = _mm256_cvtps_epi32 (_mm256_max_ps (_mm256_min_ps (_mm256_loadu_ps (in + i + 0), maxval), minval));
+		__m256i b = _mm256_cvtps_epi32 (_mm256_max_ps (_mm256_min_ps (_mm256_loadu_ps (in + i + 8), maxval), minval));
+
+		// packs interleaves the 128-bit lanes of a and b so put them back in order
+		_mm256_storeu_si256 ((__m256i *) &out[i], _mm256_permute4x64_epi64 (_mm256_packs_epi32 (a, b), 0xd8));
+	}
+
+	_mm256_zeroupper ();
+
+	if (i < count)
+		S_Transfer16_C (&out[i], &in[i], count - i);
+}
+
+
+static mixkernels_t snd_mixer_avx2 = {"AVX2", S_Paint8_AVX2, S_Paint16_AVX2, S_Transfer16_AVX2};
+
+
+/*
+===============================================================================
+
+KERNEL SELECTION
+
+===============================================================================
+*/
+
+static void S_CPUID (int info[4], int leaf, int subleaf)
+{
+#ifdef _MSC_VER
+	__cpuidex (info, leaf, subleaf);
+#else
+	__cpuid_count (leaf, subleaf, info[0], info[1], info[2], info[3]);
 #endif
+}
+
+
+// the low word of XCR0, which says which register state the OS saves
+static unsigned S_XCR0 (void)
+{
+#ifdef _MSC_VER
+	return (unsigned) _xgetbv (0);
+#else
+	unsigned eax, edx;
+
+	__asm__ volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+
+	return eax;
 #endif
+}
 
-void S_TransferStereo16 (unsigned long *pbuf, int endtime)
+
+static qboolean S_CPUHasSSE2 (void)
 {
-	int		lpos;
-	int		lpaintedtime;
+	int		info[4];
+
+	S_CPUID (info, 1, 0);
+
+	return (info[3] & (1 << 26)) ? true : false;
+}
+
+
+static qboolean S_CPUHasAVX2 (void)
+{
+	int		info[4];
+
+	S_CPUID (info, 0, 0);
+
+	if (info[0] < 7)
+		return false;
+
+	// the OS must also be saving the ymm registers
+	S_CPUID (info, 1, 0);
+
+	if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)))
+		return false;
+
+	if ((S_XCR0 () & 6) != 6)
+		return false;
+
+	S_CPUID (info, 7, 0);
+
+	return (info[1] & (1 << 5)) ? true : false;
+}
+#endif
+
 
-	snd_p = (int *) paintbuffer;
-	lpaintedtime = paintedtime;
+/*
+================
+S_BestMixer
+
+s_mixer 0 forces the C kernels, 1 allows up to SSE2 and 2 (the default) up to AVX2
+================
+*/
+static mixkernels_t *S_BestMixer (int allowed)
+{
+#ifdef S_MIX_X86
+	if (allowed >= 2 && S_CPUHasAVX2 ()) return &snd_mixer_avx2;
+	if (allowed >= 1 && S_CPUHasSSE2 ()) return &snd_mixer_sse2;
+#endif
+
+	return &snd_mixer_c;
+}
+
+
+static void S_SelectMixer (void)
+{
+	snd_mixer = S_BestMixer (s_mixer->value);
+	s_mixer->modified = false;
+
+	Com_DPrintf ("sound mixer: %s\n", snd_mixer->name);
+}
+
+
+/*
+================
+S_MixTest_f
+
+Runs each kernel set that this CPU has over random data, checks it against the C kernels and
+times it
+================
+*/
+static void S_MixTest_f (void)
+{
+	static S_ALIGN(32) float ref[PAINTBUFFER_SIZE * 2];
+	static S_ALIGN(32) float test[PAINTBUFFER_SIZE * 2];
+	static short s16[PAINTBUFFER_SIZE + 8];
+	static signed char s8[PAINTBUFFER_SIZE + 8];
+	static short out16[2][PAINTBUFFER_SIZE * 2];
+	mixkernels_t *kernels[3];
+	int		numkernels = 0;
+	int		i, j, k, pass;
+
+	kernels[numkernels++] = &snd_mixer_c;
+
+#ifdef S_MIX_X86
+	if (S_CPUHasSSE2 ()) kernels[numkernels++] = &snd_mixer_sse2;
+	if (S_CPUHasAVX2 ()) kernels[numkernels++] = &snd_mixer_avx2;
+#endif
+
+	for (i = 0; i < PAINTBUFFER_SIZE + 8; i++)
+	{
+		s16[i] = (rand () & 0xffff) - 0x8000;
+		s8[i] = (rand () & 0xff) - 0x80;
+	}
+
+	for (k = 0; k < numkernels; k++)
+	{
+		mixkernels_t *mix = kernels[k];
+		int		mismatches = 0;
+		float	maxdiff = 0;
+		double	starttime, paintms, transferms;
+
+		// correctness; odd offsets and lengths to exercise the unaligned and remainder paths
+		for (pass = 0; pass < 64; pass++)
+		{
+			int		offset = rand () & 7;
+			int		count = PAINTBUFFER_SIZE - 8 - (rand () & 31);
+			float	lgain = (rand () & 255) / 256.0f;
+			float	rgain = (rand () & 255) / 256.0f;
+
+			for (i = 0; i < PAINTBUFFER_SIZE * 2; i++)
+				ref[i] = test[i] = (rand () & 0xffff) - 0x8000;
+
+			snd_mixer_c.Paint16 (ref + offset * 2, s16 + offset, count, lgain, rgain);
+			snd_mixer_c.Paint8 (ref + offset * 2, s8 + offset, count, lgain, rgain);
+			snd_mixer_c.Transfer16 (out16[0], ref + offset, count);
+
+			mix->Paint16 (test + offset * 2, s16 + offset, count, lgain, rgain);
+			mix->Paint8 (test + offset * 2, s8 + offset, count, lgain, rgain);
+			mix->Transfer16 (out16[1], test + offset, count);
+
+			for (i = 0; i < PAINTBUFFER_SIZE * 2; i++)
+			{
+				float diff = fabs (ref[i] - test[i]);
+
+				if (diff > maxdiff) maxdiff = diff;
+				if (diff > 0) mismatches++;
+			}
+
+			for (i = 0; i < count; i++)
+				if (out16[0][i] != out16[1][i])
+					mismatches++;
+		}
+
+		// speed; 64 channels into a full buffer and out again
+		starttime = Sys_FloatTime ();
+
+		for (pass = 0; pass < 100; pass++)
+		{
+			for (j = 0; j < 64; j++)
+			{
+				if (j & 1)
+					mix->Paint8 (test, s8 + (j & 7), PAINTBUFFER_SIZE, 0.25f, 0.5f);
+				else mix->Paint16 (test, s16 + (j & 7), PAINTBUFFER_SIZE, 0.5f, 0.25f);
+			}
+		}
+
+		paintms = (Sys_FloatTime () - starttime) * 1000.0;
+		starttime = Sys_FloatTime ();
+
+		for (pass = 0; pass < 100; pass++)
+			mix->Transfer16 (out16[1], test, PAINTBUFFER_SIZE * 2);
+
+		transferms = (Sys_FloatTime () - starttime) * 1000.0;
+
+		Com_Printf ("%-4s : %i mismatches, max diff %g, paint %.3f ms, transfer %.3f ms\n",
+			mix->name, mismatches, maxdiff, paintms, transferms);
+	}
+}
+
+
+/*
+================
+S_InitMixer
+================
+*/
+void S_InitMixer (void)
+{
+	s_mixer = Cvar_Get ("s_mixer", "2", CVAR_ARCHIVE, NULL);
+	S_SelectMixer ();
+
+	Cmd_AddCommand ("s_mixtest", S_MixTest_f);
+}
+
+
+void S_ShutdownMixer (void)
+{
+	Cmd_RemoveCommand ("s_mixtest");
+}
+
+
+/*
+===============================================================================
+
+TRANSFER
+
+===============================================================================
+*/
+
+static void S_TransferStereo16 (short *pbuf, int endtime)
+{
+	int		lpos;
+	int		lpaintedtime = paintedtime;
+	float	*p = paintbuffer;
 
 	while (lpaintedtime < endtime)
 	{
 		// handle recirculating buffer issues
-		lpos = lpaintedtime & ((dma.samples >> 1) - 1);
-
-		snd_out = (short *) pbuf + (lpos << 1);
+		int count;
 
-		snd_linear_count = (dma.samples >> 1) - lpos;
-		if (lpaintedtime + snd_linear_count > endtime)
-			snd_linear_count = endtime - lpaintedtime;
+		lpos = lpaintedtime & ((dma.samples >> 1) - 1);
+		count = (dma.samples >> 1) - lpos;
 
-		snd_linear_count <<= 1;
+		if (lpaintedtime + count > endtime)
+			count = endtime - lpaintedtime;
 
 		// write a linear blast of samples
-		S_WriteLinearBlastStereo16 ();
+		snd_mixer->Transfer16 (pbuf + (lpos << 1), p, count << 1);
 
-		snd_p += snd_linear_count;
-		lpaintedtime += (snd_linear_count >> 1);
+		p += count << 1;
+		lpaintedtime += count;
 	}
 }
 
@@ -140,17 +527,14 @@ S_TransferPaintBuffer
 
 ===================
 */
-void S_TransferPaintBuffer (int endtime)
+static void S_TransferPaintBuffer (int endtime)
 {
 	int 	out_idx;
 	int 	count;
 	int 	out_mask;
-	int 	*p;
+	float 	*p;
 	int 	step;
 	int		val;
-	unsigned long *pbuf;
-
-	pbuf = (unsigned long *) dma.buffer;
 
 	if (s_testsound->value)
 	{
@@ -160,18 +544,18 @@ void S_TransferPaintBuffer (int endtime)
 		// write a fixed sine wave
 		count = (endtime - paintedtime);
 		for (i = 0; i < count; i++)
-			paintbuffer[i].left = paintbuffer[i].right = sin ((paintedtime + i) * 0.1) * 20000 * 256;
+			paintbuffer[i * 2 + 0] = paintbuffer[i * 2 + 1] = sin ((paintedtime + i) * 0.1) * 20000;
 	}
 
 	if (dma.samplebits == 16 && dma.channels == 2)
 	{
 		// optimized case
-		S_TransferStereo16 (pbuf, endtime);
+		S_TransferStereo16 ((short *) dma.buffer, endtime);
 	}
 	else
 	{
 		// general case
-		p = (int *) paintbuffer;
+		p = paintbuffer;
 		count = (endtime - paintedtime) * dma.channels;
 		out_mask = dma.samples - 1;
 		out_idx = paintedtime * dma.channels & out_mask;
@@ -179,10 +563,10 @@ void S_TransferPaintBuffer (int endtime)
 
 		if (dma.samplebits == 16)
 		{
-			short *out = (short *) pbuf;
+			short *out = (short *) dma.buffer;
 			while (count--)
 			{
-				val = *p >> 8;
+				val = (int) *p;
 				p += step;
 				if (val > 0x7fff)
 					val = 0x7fff;
@@ -194,10 +578,10 @@ void S_TransferPaintBuffer (int endtime)
 		}
 		else if (dma.samplebits == 8)
 		{
-			unsigned char *out = (unsigned char *) pbuf;
+			unsigned char *out = (unsigned char *) dma.buffer;
 			while (count--)
 			{
-				val = *p >> 8;
+				val = (int) *p;
 				p += step;
 				if (val > 0x7fff)
 					val = 0x7fff;
@@ -219,19 +603,34 @@ CHANNEL MIXING
 ===============================================================================
 */
 
-void S_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int endtime, int offset);
-void S_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int endtime, int offset);
+static void S_PaintChannel (channel_t *ch, sfxcache_t *sc, int count, int offset)
+{
+	// 0-255 channel volumes scaled by s_volume
+	float	lgain = ch->leftvol * snd_volume;
+	float	rgain = ch->rightvol * snd_volume;
+
+	if (sc->width == 1)
+		snd_mixer->Paint8 (&paintbuffer[offset * 2], (signed char *) sc->data + ch->pos, count, lgain, rgain);
+	else snd_mixer->Paint16 (&paintbuffer[offset * 2], (short *) sc->data + ch->pos, count, lgain, rgain);
+
+	ch->pos += count;
+}
+
 
 void S_PaintChannels (int endtime)
 {
 	int 	i;
 	int 	end;
+	int		rawend;
 	channel_t *ch;
 	sfxcache_t	*sc;
 	int		ltime, count;
 	playsound_t	*ps;
 
-	snd_vol = s_volume->value * 256;
+	snd_volume = s_volume->value / 256.0f;
+
+	if (s_mixer->modified)
+		S_SelectMixer ();
 
 	//Com_Printf ("%i to %i\n", paintedtime, endtime);
 	while (paintedtime < endtime)
@@ -258,11 +657,17 @@ void S_PaintChannels (int endtime)
 			break;
 		}
 
-		// clear the paint buffer
-		if (s_rawend < paintedtime)
+		// new sounds or a new listener may change which voices are loud enough to mix
+		if (s_voicesdirty)
+			S_SelectVoices ();
+
+		// clear the paint buffer; s_rawend is only read once since the main thread moves it
+		rawend = s_rawend;
+
+		if (rawend < paintedtime)
 		{
 			//			Com_Printf ("clear\n");
-			memset (paintbuffer, 0, (end - paintedtime) * sizeof (portable_samplepair_t));
+			memset (paintbuffer, 0, (end - paintedtime) * 2 * sizeof (float));
 		}
 		else
 		{
@@ -270,12 +675,14 @@ void S_PaintChannels (int endtime)
 			int		s;
 			int		stop;
 
-			stop = (end < s_rawend) ? end : s_rawend;
+			stop = (end < rawend) ? end : rawend;
 
+			// raw samples are still in the old << 8 integer scale
 			for (i = paintedtime; i < stop; i++)
 			{
 				s = i&(MAX_RAW_SAMPLES - 1);
-				paintbuffer[i - paintedtime] = s_rawsamples[s];
+				paintbuffer[(i - paintedtime) * 2 + 0] = s_rawsamples[s].left * (1.0f / 256.0f);
+				paintbuffer[(i - paintedtime) * 2 + 1] = s_rawsamples[s].right * (1.0f / 256.0f);
 			}
 			//		if (i != end)
 			//			Com_Printf ("partial stream\n");
@@ -283,8 +690,8 @@ void S_PaintChannels (int endtime)
 			//			Com_Printf ("full stream\n");
 			for (; i < end; i++)
 			{
-				paintbuffer[i - paintedtime].left =
-					paintbuffer[i - paintedtime].right = 0;
+				paintbuffer[(i - paintedtime) * 2 + 0] =
+					paintbuffer[(i - paintedtime) * 2 + 1] = 0;
 			}
 		}
 
@@ -297,7 +704,7 @@ void S_PaintChannels (int endtime)
 
 			while (ltime < end)
 			{
-				if (!ch->sfx || (!ch->leftvol && !ch->rightvol))
+				if (!ch->sfx)
 					break;
 
 				// max painting is to the end of the buffer
@@ -307,16 +714,17 @@ void S_PaintChannels (int endtime)
 				if (ch->end - ltime < count)
 					count = ch->end - ltime;
 
-				sc = S_LoadSound (ch->sfx);
+				// the main thread loads sounds; the mixer only plays what's resident
+				sc = ch->sfx->cache;
 				if (!sc)
 					break;
 
 				if (count > 0 && ch->sfx)
 				{
-					if (sc->width == 1)// FIXME; 8 bit asm is wrong now
-						S_PaintChannelFrom8 (ch, sc, count, ltime - paintedtime);
-					else
-						S_PaintChannelFrom16 (ch, sc, count, ltime - paintedtime);
+					// virtual voices keep their place without being mixed
+					if (ch->isvirtual)
+						ch->pos += count;
+					else S_PaintChannel (ch, sc, count, ltime - paintedtime);
 
 					ltime += count;
 				}
@@ -349,153 +757,3 @@ void S_PaintChannels (int endtime)
 		paintedtime = end;
 	}
 }
-
-void S_InitScaletable (void)
-{
-	int		i, j;
-	int		scale;
-
-	s_volume->modified = false;
-	for (i = 0; i < 32; i++)
-	{
-		scale = i * 8 * 256 * s_volume->value;
-		for (j = 0; j < 256; j++)
-			snd_scaletable[i][j] = ((signed char) j) * scale;
-	}
-}
-
-
-#if !(defined __linux__ && defined __i386__)
-#if	!id386
-
-void S_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int count, int offset)
-{
-	int 	data;
-	int		*lscale, *rscale;
-	unsigned char *sfx;
-	int		i;
-	portable_samplepair_t	*samp;
-
-	if (ch->leftvol > 255)
-		ch->leftvol = 255;
-	if (ch->rightvol > 255)
-		ch->rightvol = 255;
-
-	lscale = snd_scaletable[ch->leftvol >> 11];
-	rscale = snd_scaletable[ch->rightvol >> 11];
-	sfx = (signed char *) sc->data + ch->pos;
-
-	samp = &paintbuffer[offset];
-
-	for (i = 0; i < count; i++, samp++)
-	{
-		data = sfx[i];
-		samp->left += lscale[data];
-		samp->right += rscale[data];
-	}
-
-	ch->pos += count;
-}
-
-#else
-
-__declspec(naked) void S_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int count, int offset)
-{
-	__asm {
-		push esi
-			push edi
-			push ebx
-			push ebp
-			mov ebx, ds:dword ptr[4 + 16 + esp]
-			mov esi, ds : dword ptr[8 + 16 + esp]
-			mov eax, ds : dword ptr[4 + ebx]
-			mov edx, ds : dword ptr[8 + ebx]
-			cmp eax, 255
-			jna LLeftSet
-			mov eax, 255
-LLeftSet :
-		 cmp edx, 255
-		 jna LRightSet
-		 mov edx, 255
-LRightSet :
-		  and eax, 0F8h
-		  add esi, 20
-		  and edx, 0F8h
-		  mov edi, ds : dword ptr[16 + ebx]
-		  mov ecx, ds : dword ptr[12 + 16 + esp]
-		  add esi, edi
-		  shl eax, 7
-		  add edi, ecx
-		  shl edx, 7
-		  mov ds : dword ptr[16 + ebx], edi
-		  add eax, offset snd_scaletable
-		  add edx, offset snd_scaletable
-		  sub ebx, ebx
-		  mov bl, ds : byte ptr[-1 + esi + ecx * 1]
-		  test ecx, 1
-		  jz LMix8Loop
-		  mov edi, ds : dword ptr[eax + ebx * 4]
-		  mov ebp, ds : dword ptr[edx + ebx * 4]
-		  add edi, ds : dword ptr[paintbuffer + 0 - 8 + ecx * 8]
-		  add ebp, ds : dword ptr[paintbuffer + 4 - 8 + ecx * 8]
-		  mov ds : dword ptr[paintbuffer + 0 - 8 + ecx * 8], edi
-		  mov ds : dword ptr[paintbuffer + 4 - 8 + ecx * 8], ebp
-		  mov bl, ds : byte ptr[-2 + esi + ecx * 1]
-		  dec ecx
-		  jz LDone
-LMix8Loop :
-		mov edi, ds : dword ptr[eax + ebx * 4]
-			mov ebp, ds : dword ptr[edx + ebx * 4]
-			add edi, ds : dword ptr[paintbuffer + 0 - 8 + ecx * 8]
-			add ebp, ds : dword ptr[paintbuffer + 4 - 8 + ecx * 8]
-			mov bl, ds : byte ptr[-2 + esi + ecx * 1]
-			mov ds : dword ptr[paintbuffer + 0 - 8 + ecx * 8], edi
-			mov ds : dword ptr[paintbuffer + 4 - 8 + ecx * 8], ebp
-			mov edi, ds : dword ptr[eax + ebx * 4]
-			mov ebp, ds : dword ptr[edx + ebx * 4]
-			mov bl, ds : byte ptr[-3 + esi + ecx * 1]
-			add edi, ds : dword ptr[paintbuffer + 0 - 8 * 2 + ecx * 8]
-			add ebp, ds : dword ptr[paintbuffer + 4 - 8 * 2 + ecx * 8]
-			mov ds : dword ptr[paintbuffer + 0 - 8 * 2 + ecx * 8], edi
-			mov ds : dword ptr[paintbuffer + 4 - 8 * 2 + ecx * 8], ebp
-			sub ecx, 2
-			jnz LMix8Loop
-LDone :
-		pop ebp
-			pop ebx
-			pop edi
-			pop esi
-			ret
-	}
-}
-
-#endif
-#endif
-
-void S_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int count, int offset)
-{
-	int data;
-	int left, right;
-	int leftvol, rightvol;
-	signed short *sfx;
-	int	i;
-	portable_samplepair_t	*samp;
-
-	leftvol = ch->leftvol * snd_vol;
-	rightvol = ch->rightvol * snd_vol;
-	sfx = (signed short *) sc->data + ch->pos;
-
-	samp = &paintbuffer[offset];
-
-	for (i = 0; i < count; i++, samp++)
-	{
-		data = sfx[i];
-		left = (data * leftvol) >> 8;
-		right = (data * rightvol) >> 8;
-		samp->left += left;
-		samp->right += right;
-	}
-
-	ch->pos += count;
-}
-
@@ -0,0 +1,225 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// snd_null.c -- headless sound output; the mix is thrown away or written to a WAV file,
+// and the DMA position comes from a virtual clock instead of a device
+
+#include "client.h"
+#include "snd_loc.h"
+
+// same size as the DirectSound secondary buffer; > 1 second at 16-bit, 22050 Hz
+#define NULL_BUFFER_SIZE	0x10000
+
+#define WAV_HEADER_SIZE		44
+
+static struct
+{
+	qboolean	active;
+	qboolean	manual;			// the clock only moves in SNDNULL_Advance
+	int			starttime;		// Sys_Milliseconds at init, for the real time clock
+	int			samplepos;		// mono samples played, for the manual clock
+	int			written;		// mono samples written to the WAV file
+	FILE		*wav;
+	int			wavbytes;
+	byte		*buffer;
+} snd_null;
+
+
+static void SNDNULL_PutLong (byte *p, int l)
+{
+	p[0] = l & 255;
+	p[1] = (l >> 8) & 255;
+	p[2] = (l >> 16) & 255;
+	p[3] = (l >> 24) & 255;
+}
+
+
+static void SNDNULL_PutShort (byte *p, int s)
+{
+	p[0] = s & 255;
+	p[1] = (s >> 8) & 255;
+}
+
+
+/*
+==================
+SNDNULL_WriteHeader
+
+Written once with zero sizes when the file is opened and again with the real ones when it's closed
+==================
+*/
+static void SNDNULL_WriteHeader (void)
+{
+	byte	header[WAV_HEADER_SIZE];
+
+	memcpy (header + 0, "RIFF", 4);
+	SNDNULL_PutLong (header + 4, WAV_HEADER_SIZE - 8 + snd_null.wavbytes);
+	memcpy (header + 8, "WAVEfmt ", 8);
+	SNDNULL_PutLong (header + 16, 16);
+	SNDNULL_PutShort (header + 20, 1);	// PCM
+	SNDNULL_PutShort (header + 22, dma.channels);
+	SNDNULL_PutLong (header + 24, dma.speed);
+	SNDNULL_PutLong (header + 28, dma.speed * dma.channels * (dma.samplebits / 8));
+	SNDNULL_PutShort (header + 32, dma.channels * (dma.samplebits / 8));
+	SNDNULL_PutShort (header + 34, dma.samplebits);
+	memcpy (header + 36, "data", 4);
+	SNDNULL_PutLong (header + 40, snd_null.wavbytes);
+
+	fseek (snd_null.wav, 0, SEEK_SET);
+	fwrite (header, WAV_HEADER_SIZE, 1, snd_null.wav);
+	fseek (snd_null.wav, 0, SEEK_END);
+}
+
+
+/*
+==================
+SNDNULL_Init
+
+wavfile is relative to the game directory, or NULL to throw the mix away.  With a manual
+clock nothing plays until SNDNULL_Advance is called
+==================
+*/
+qboolean SNDNULL_Init (qboolean manual, char *wavfile, int speed)
+{
+	char	name[MAX_OSPATH];
+
+	memset (&snd_null, 0, sizeof (snd_null));
+	memset ((void *) &dma, 0, sizeof (dma));
+
+	dma.channels = 2;
+	dma.samplebits = 16;
+	dma.speed = speed;
+	dma.samples = NULL_BUFFER_SIZE / (dma.samplebits / 8);
+	dma.submission_chunk = 1;
+
+	if (wavfile && wavfile[0])
+	{
+		Com_sprintf (name, sizeof (name), "%s/%s", FS_Gamedir (), wavfile);
+		FS_CreatePath (name);
+
+		if ((snd_null.wav = fopen (name, "wb")) == NULL)
+		{
+			Com_Printf ("SNDNULL_Init: couldn't open %s\n", name);
+			return false;
+		}
+
+		SNDNULL_WriteHeader ();
+		Com_Printf ("...writing sound to %s\n", name);
+	}
+
+	snd_null.buffer = Zone_AllocCategory (NULL_BUFFER_SIZE, MEM_SOUND);
+	snd_null.manual = manual;
+	snd_null.starttime = Sys_Milliseconds ();
+	snd_null.active = true;
+
+	dma.buffer = snd_null.buffer;
+
+	return true;
+}
+
+
+qboolean SNDNULL_Active (void)
+{
+	return snd_null.active;
+}
+
+
+/*
+==================
+SNDNULL_Advance
+
+Moves the manual clock on by a number of sample pairs
+==================
+*/
+void SNDNULL_Advance (int samples)
+{
+	snd_null.samplepos += samples * dma.channels;
+}
+
+
+/*
+==================
+SNDNULL_GetDMAPos
+
+Anything the clock has moved past has been "played", so that's what goes out to the WAV file;
+the mixer only paints ahead of the position so it's still intact
+==================
+*/
+int SNDNULL_GetDMAPos (void)
+{
+	int		pos;
+
+	if (snd_null.manual)
+		pos = snd_null.samplepos;
+	else pos = (int) ((double) (Sys_Milliseconds () - snd_null.starttime) * dma.speed / 1000.0) * dma.channels;
+
+	if (snd_null.wav)
+	{
+		// if we fell a whole buffer behind, the oldest of it is already gone
+		if (pos - snd_null.written > dma.samples)
+			snd_null.written = pos - dma.samples;
+
+		while (snd_null.written < pos)
+		{
+			int start = snd_null.written & (dma.samples - 1);
+			int count = pos - snd_null.written;
+
+			if (start + count > dma.samples)
+				count = dma.samples - start;
+
+			fwrite (snd_null.buffer + start * (dma.samplebits / 8), count * (dma.samplebits / 8), 1, snd_null.wav);
+
+			snd_null.wavbytes += count * (dma.samplebits / 8);
+			snd_null.written += count;
+		}
+	}
+
+	return pos & (dma.samples - 1);
+}
+
+
+void SNDNULL_BeginPainting (void)
+{
+	dma.buffer = snd_null.buffer;
+}
+
+
+void SNDNULL_Submit (void)
+{
+}
+
+
+void SNDNULL_Shutdown (void)
+{
+	if (!snd_null.active)
+		return;
+
+	if (snd_null.wav)
+	{
+		SNDNULL_WriteHeader ();
+		fclose (snd_null.wav);
+	}
+
+	if (snd_null.buffer)
+		Zone_Free (snd_null.buffer);
+
+	memset (&snd_null, 0, sizeof (snd_null));
+	dma.buffer = NULL;
+}
+
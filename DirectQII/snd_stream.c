@@ -0,0 +1,270 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// snd_stream.c -- music read off disk a chunk at a time and fed through the raw sample ring,
+// so a track is never loaded or resampled whole
+
+#include "client.h"
+#include "snd_loc.h"
+
+// how far the raw samples are kept ahead of the mixer; this is what rides out a long frame
+#define MUSIC_LEAD		(MAX_RAW_SAMPLES / 2)
+
+// largest single read; the header is parsed out of the first one
+#define MUSIC_CHUNK		0x4000
+
+extern cvar_t *bgmvolume;
+
+static struct
+{
+	FILE		*file;
+	char		name[MAX_QPATH];
+	wavinfo_t	info;
+	int			framesize;		// bytes per sample frame (all channels)
+	int			datastart;		// file offset of the first frame
+	int			frames;			// in the whole track
+	int			pos;			// next frame to be read
+	qboolean	paused;
+	byte		chunk[MUSIC_CHUNK];
+} s_music;
+
+
+/*
+==================
+S_StartMusic
+
+Opens a PCM wav for streaming; it starts playing on the next S_Update.  Returns false if
+it isn't there or can't be streamed, so the caller can try something else
+==================
+*/
+qboolean S_StartMusic (char *name)
+{
+	int		len;
+	int		start;
+	int		headerlen;
+
+	S_StopMusic ();
+
+	if (!sound_started)
+		return false;
+
+	// compressed pak entries fail here and the file is left NULL
+	if ((len = FS_FOpenFile (name, &s_music.file)) == -1 || !s_music.file)
+	{
+		s_music.file = NULL;
+		return false;
+	}
+
+	// FS_FOpenFile leaves a pak entry's file positioned at its start
+	start = ftell (s_music.file);
+
+	if ((headerlen = len) > MUSIC_CHUNK)
+		headerlen = MUSIC_CHUNK;
+
+	if (fread (s_music.chunk, headerlen, 1, s_music.file) != 1)
+	{
+		Com_Printf ("S_StartMusic: couldn't read %s\n", name);
+		S_StopMusic ();
+		return false;
+	}
+
+	s_music.info = GetWavinfo (name, s_music.chunk, headerlen);
+
+	if (!s_music.info.channels)
+	{
+		Com_Printf ("S_StartMusic: %s: %s\n", name, s_music.info.error);
+		S_StopMusic ();
+		return false;
+	}
+
+	if (s_music.info.channels > 2 || s_music.info.width < 1 || s_music.info.width > 2)
+	{
+		Com_Printf ("S_StartMusic: %s is not 8 or 16 bit mono or stereo\n", name);
+		S_StopMusic ();
+		return false;
+	}
+
+	s_music.framesize = s_music.info.width * s_music.info.channels;
+	s_music.datastart = start + s_music.info.dataofs;
+	s_music.frames = s_music.info.samples * s_music.info.width / s_music.framesize;
+
+	// a truncated file just ends early
+	if (s_music.frames > (len - s_music.info.dataofs) / s_music.framesize)
+		s_music.frames = (len - s_music.info.dataofs) / s_music.framesize;
+
+	if (s_music.frames <= 0)
+	{
+		Com_Printf ("S_StartMusic: %s has no samples\n", name);
+		S_StopMusic ();
+		return false;
+	}
+
+	fseek (s_music.file, s_music.datastart, SEEK_SET);
+	Com_sprintf (s_music.name, sizeof (s_music.name), "%s", name);
+
+	return true;
+}
+
+
+/*
+==================
+S_StopMusic
+
+Whatever of the track is still queued in the raw samples is dropped, unless the track
+already ran out; then the tail is left to play into whatever starts next
+==================
+*/
+void S_StopMusic (void)
+{
+	if (!s_music.file)
+		return;
+
+	fclose (s_music.file);
+	memset (&s_music, 0, sizeof (s_music));
+
+	s_rawend = 0;
+}
+
+
+/*
+==================
+S_PauseMusic
+
+The queued samples are thrown away on a pause and the file backed up over them, so a
+resume picks up from what was last heard
+==================
+*/
+void S_PauseMusic (qboolean pause)
+{
+	if (!s_music.file || s_music.paused == pause)
+		return;
+
+	if (pause && dma.speed)
+	{
+		s_music.pos -= (int) ((double) S_RawSamplesAhead () * s_music.info.rate / dma.speed);
+
+		if (s_music.pos < 0)
+			s_music.pos = 0;
+
+		s_rawend = 0;
+		fseek (s_music.file, s_music.datastart + s_music.pos * s_music.framesize, SEEK_SET);
+	}
+
+	s_music.paused = pause;
+}
+
+
+/*
+==================
+S_MusicPlaying
+
+Stays true while paused; goes false once the last of the track has been read
+==================
+*/
+qboolean S_MusicPlaying (void)
+{
+	return (s_music.file != NULL);
+}
+
+
+/*
+==================
+S_ScaleMusic
+
+bgmvolume on top of s_volume, which S_RawSamples applies
+==================
+*/
+static void S_ScaleMusic (int frames)
+{
+	int		i;
+	int		count = frames * s_music.info.channels;
+	int		scale = (int) (bgmvolume->value * 256);
+
+	if (scale >= 256)
+		return;
+
+	if (scale < 0)
+		scale = 0;
+
+	if (s_music.info.width == 2)
+	{
+		short *data = (short *) s_music.chunk;
+
+		for (i = 0; i < count; i++)
+			data[i] = LittleShort ((LittleShort (data[i]) * scale) >> 8);
+	}
+	else
+	{
+		byte *data = s_music.chunk;
+
+		for (i = 0; i < count; i++)
+			data[i] = (((data[i] - 128) * scale) >> 8) + 128;
+	}
+}
+
+
+/*
+==================
+S_UpdateMusic
+
+Called by S_Update; tops the raw samples back up to MUSIC_LEAD ahead of the mixer.  The
+track is closed as soon as its last chunk is queued
+==================
+*/
+void S_UpdateMusic (void)
+{
+	int		ahead;
+	int		frames;
+
+	if (!s_music.file || s_music.paused)
+		return;
+
+	while ((ahead = S_RawSamplesAhead ()) < MUSIC_LEAD)
+	{
+		// in the track's own rate; the extra frame covers rounding in S_RawSamples
+		frames = (int) ((double) (MUSIC_LEAD - ahead) * s_music.info.rate / dma.speed) + 1;
+
+		if (frames > MUSIC_CHUNK / s_music.framesize)
+			frames = MUSIC_CHUNK / s_music.framesize;
+
+		if (frames > s_music.frames - s_music.pos)
+			frames = s_music.frames - s_music.pos;
+
+		if (frames <= 0)
+		{
+			// leave the tail that's queued to play out
+			fclose (s_music.file);
+			s_music.file = NULL;
+			return;
+		}
+
+		if (fread (s_music.chunk, frames * s_music.framesize, 1, s_music.file) != 1)
+		{
+			Com_Printf ("S_UpdateMusic: read error on %s\n", s_music.name);
+			fclose (s_music.file);
+			s_music.file = NULL;
+			return;
+		}
+
+		s_music.pos += frames;
+
+		S_ScaleMusic (frames);
+		S_RawSamples (frames, s_music.info.rate, s_music.info.width, s_music.info.channels, s_music.chunk);
+	}
+}
@@ -298,9 +298,18 @@ Returns false if nothing is found.
 int SNDDMA_Init (void)
 {
 	sndinitstat	stat;
+	cvar_t		*s_device = Cvar_Get ("s_device", "dsound", CVAR_ARCHIVE, NULL);
+	cvar_t		*s_wavfile = Cvar_Get ("s_wavfile", "sound.wav", 0, NULL);
 
 	memset ((void *) &dma, 0, sizeof (dma));
 
+	// headless output for machines without a sound device
+	if (!Q_strcasecmp (s_device->string, "null") || !Q_strcasecmp (s_device->string, "wav"))
+	{
+		Com_Printf ("Initializing %s sound output\n", s_device->string);
+		return SNDNULL_Init (false, Q_strcasecmp (s_device->string, "wav") ? NULL : s_wavfile->string, 22050);
+	}
+
 	// assume DirectSound won't initialize
 	dsound_init = 0;
 	stat = SIS_FAILURE;
@@ -353,6 +362,9 @@ int SNDDMA_GetDMAPos (void)
 	int		s;
 	DWORD	dwWrite;
 
+	if (SNDNULL_Active ())
+		return SNDNULL_GetDMAPos ();
+
 	if (dsound_init)
 	{
 		mmtime.wType = TIME_SAMPLES;
@@ -382,6 +394,12 @@ void SNDDMA_BeginPainting (void)
 	HRESULT	hresult;
 	DWORD	dwStatus;
 
+	if (SNDNULL_Active ())
+	{
+		SNDNULL_BeginPainting ();
+		return;
+	}
+
 	if (!ds_Buffer)
 		return;
 
@@ -404,8 +422,9 @@ void SNDDMA_BeginPainting (void)
 	{
 		if (hresult != DSERR_BUFFERLOST)
 		{
-			Com_Printf ("S_TransferStereo16: Lock failed with error '%s'\n", DSoundError (hresult));
-			S_Shutdown ();
+			// this runs on the mixer thread, so leave the shutdown to S_Update
+			Com_DPrintf ("S_TransferStereo16: Lock failed with error '%s'\n", DSoundError (hresult));
+			s_dmafailed = true;
 			return;
 		}
 		else
@@ -429,6 +448,12 @@ Also unlocks the dsound buffer
 */
 void SNDDMA_Submit (void)
 {
+	if (SNDNULL_Active ())
+	{
+		SNDNULL_Submit ();
+		return;
+	}
+
 	if (!dma.buffer)
 		return;
 
@@ -447,7 +472,9 @@ Reset the sound device for exiting
 */
 void SNDDMA_Shutdown (void)
 {
-	FreeSound ();
+	if (SNDNULL_Active ())
+		SNDNULL_Shutdown ();
+	else FreeSound ();
 }
 
 
@@ -467,12 +494,15 @@ void S_Activate (qboolean active)
 		if (ds_Object && cl_hwnd && snd_isdirect)
 		{
 			DS_CreateBuffers ();
+			S_PauseMixer (false);
 		}
 	}
 	else
 	{
 		if (ds_Object && cl_hwnd && snd_isdirect)
 		{
+			// the mixer may be halfway through painting the buffer
+			S_PauseMixer (true);
 			DS_DestroyBuffers ();
 		}
 	}
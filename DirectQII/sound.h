@@ -30,6 +30,12 @@ void S_StartLocalSound (char *s);
 void S_RawSamples (int samples, int rate, int width, int channels, byte *data);
 
 void S_StopAllSounds (void);
+
+// music streamed off disk through the raw samples; S_StartMusic fails on anything but a PCM wav
+qboolean S_StartMusic (char *name);
+void S_StopMusic (void);
+void S_PauseMusic (qboolean pause);
+qboolean S_MusicPlaying (void);
 void S_Update (vec3_t origin, vec3_t v_forward, vec3_t v_right, vec3_t v_up);
 
 void S_Activate (qboolean active);
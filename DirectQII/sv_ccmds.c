@@ -858,16 +858,23 @@ void SV_ServerRecord_f (void)
 
 	Com_Printf ("recording to %s.\n", name);
 	FS_CreatePath (name);
-	svs.demofile = fopen (name, "wb");
+	svs.demofile = FS_OpenWriter (name, sv_asyncdemos->value ? true : false);
 	if (!svs.demofile)
 	{
 		Com_Printf ("ERROR: couldn't open.\n");
 		return;
 	}
 
+	// so that it can be played back without a rescan
+	FS_IndexNewFile (va ("demos/%s.dm2", Cmd_Argv (1)));
+
 	// setup a buffer to catch all multicasts
 	SZ_Init (&svs.demo_multicast, svs.demo_multicast_buf, sizeof (svs.demo_multicast_buf));
 
+	svs.demo_frames = 0;
+	svs.demo_totaltime = 0;
+	svs.demo_maxtime = 0;
+
 	// write a single giant fake message with all the startup info
 	SZ_Init (&buf, buf_data, sizeof (buf_data));
 
@@ -895,8 +902,8 @@ void SV_ServerRecord_f (void)
 	// write it to the demo file
 	Com_DPrintf ("signon message length: %i\n", buf.cursize);
 	len = LittleLong (buf.cursize);
-	fwrite (&len, 4, 1, svs.demofile);
-	fwrite (buf.data, buf.cursize, 1, svs.demofile);
+	FS_WriterWrite (svs.demofile, &len, 4);
+	FS_WriterWrite (svs.demofile, buf.data, buf.cursize);
 
 	// the rest of the demo file will be individual frames
 }
@@ -911,14 +918,28 @@ Ends server demo recording
 */
 void SV_ServerStop_f (void)
 {
+	int numstalls;
+
 	if (!svs.demofile)
 	{
 		Com_Printf ("Not doing a serverrecord.\n");
 		return;
 	}
-	fclose (svs.demofile);
+
+	if (!FS_CloseWriter (svs.demofile, &numstalls))
+		Com_Printf ("ERROR: failed writing demo file.\n");
+
 	svs.demofile = NULL;
 	Com_Printf ("Recording completed.\n");
+
+	if (svs.demo_frames)
+	{
+		Com_Printf ("%i frames, %.3f ms/frame average, %.3f ms worst, %i stalls\n",
+			svs.demo_frames,
+			(svs.demo_totaltime * 1000.0) / svs.demo_frames,
+			svs.demo_maxtime * 1000.0,
+			numstalls);
+	}
 }
 
 
@@ -938,6 +959,31 @@ void SV_KillServer_f (void)
 	NET_Config (false);	// close network sockets
 }
 
+/*
+===============
+SV_PreloadMap_f
+
+Reads the given map in the background for a faster changelevel; for use by
+map rotation scripts and mods that know the next map before the engine does
+===============
+*/
+void SV_PreloadMap_f (void)
+{
+	if (Cmd_Argc () != 2)
+	{
+		Com_Printf ("USAGE: preloadmap <mapname>\n");
+		return;
+	}
+
+	if (!svs.initialized)
+	{
+		Com_Printf ("No server running.\n");
+		return;
+	}
+
+	SV_PreloadLevel (Cmd_Argv (1));
+}
+
 /*
 ===============
 SV_ServerCommand_f
@@ -984,6 +1030,7 @@ void SV_InitOperatorCommands (void)
 	Cmd_AddCommand ("load", SV_Loadgame_f);
 
 	Cmd_AddCommand ("killserver", SV_KillServer_f);
+	Cmd_AddCommand ("preloadmap", SV_PreloadMap_f);
 
 	Cmd_AddCommand ("sv", SV_ServerCommand_f);
 }
@@ -119,37 +119,83 @@ int		c_traces, c_brush_traces;
 
 MAP LOADING
 
+The lumps are parsed into a cmapdata_t.  CM_LoadMap points one at the globals and
+parses straight into them; the preload thread parses into a set of arrays of its
+own, which CM_TakePreload copies over the globals.  Either way the pointers that
+are stored in the arrays (node and brushside planes, brushside surfaces) are into
+the globals, because that's where the data ends up.  The loaders may run on the
+preload thread so they return an error instead of calling Com_Error
+
 ===============================================================================
 */
 
-byte	*cmod_base;
+typedef struct cmapdata_s {
+	int				numtexinfo;
+	mapsurface_t	*surfaces;
+
+	int				numleafs;
+	int				numclusters;
+	int				emptyleaf, solidleaf;
+	cleaf_t			*leafs;
+
+	int				numleafbrushes;
+	unsigned short	*leafbrushes;
+
+	int				numplanes;
+	cplane_t		*planes;
+
+	int				numbrushes;
+	cbrush_t		*brushes;
+
+	int				numbrushsides;
+	cbrushside_t	*brushsides;
+
+	int				numcmodels;
+	cmodel_t		*cmodels;
+
+	int				numnodes;
+	cnode_t			*nodes;
+
+	int				numareas;
+	carea_t			*areas;
+
+	int				numareaportals;
+	dareaportal_t	*areaportals;
+
+	int				numvisibility;
+	byte			*visibility;
+
+	int				numentitychars;
+	char			*entitystring;
+} cmapdata_t;
+
 
 /*
 =================
 CMod_LoadSubmodels
 =================
 */
-void CMod_LoadSubmodels (lump_t *l)
+static char *CMod_LoadSubmodels (cmapdata_t *map, byte *base, lump_t *l)
 {
 	dmodel_t	*in;
 	cmodel_t	*out;
 	int			i, j, count;
 
-	in = (void *) (cmod_base + l->fileofs);
+	in = (void *) (base + l->fileofs);
 	if (l->filelen % sizeof (*in))
-		Com_Error (ERR_DROP, "CMod_LoadSubmodels: funny lump size");
+		return "CMod_LoadSubmodels: funny lump size";
 	count = l->filelen / sizeof (*in);
 
 	if (count < 1)
-		Com_Error (ERR_DROP, "Map with no models");
+		return "Map with no models";
 	if (count > MAX_MAP_MODELS)
-		Com_Error (ERR_DROP, "Map has too many models");
+		return "Map has too many models";
 
-	numcmodels = count;
+	map->numcmodels = count;
 
 	for (i = 0; i < count; i++, in++, out++)
 	{
-		out = &map_cmodels[i];
+		out = &map->cmodels[i];
 
 		for (j = 0; j < 3; j++)
 		{
@@ -160,6 +206,8 @@ void CMod_LoadSubmodels (lump_t *l)
 		}
 		out->headnode = LittleLong (in->headnode);
 	}
+
+	return NULL;
 }
 
 
@@ -168,23 +216,23 @@ void CMod_LoadSubmodels (lump_t *l)
 CMod_LoadSurfaces
 =================
 */
-void CMod_LoadSurfaces (lump_t *l)
+static char *CMod_LoadSurfaces (cmapdata_t *map, byte *base, lump_t *l)
 {
 	texinfo_t	*in;
 	mapsurface_t	*out;
 	int			i, count;
 
-	in = (void *) (cmod_base + l->fileofs);
+	in = (void *) (base + l->fileofs);
 	if (l->filelen % sizeof (*in))
-		Com_Error (ERR_DROP, "CMod_LoadSurfaces: funny lump size");
+		return "CMod_LoadSurfaces: funny lump size";
 	count = l->filelen / sizeof (*in);
 	if (count < 1)
-		Com_Error (ERR_DROP, "Map with no surfaces");
+		return "Map with no surfaces";
 	if (count > MAX_MAP_TEXINFO)
-		Com_Error (ERR_DROP, "Map has too many surfaces");
+		return "Map has too many surfaces";
 
-	numtexinfo = count;
-	out = map_surfaces;
+	map->numtexinfo = count;
+	out = map->surfaces;
 
 	for (i = 0; i < count; i++, in++, out++)
 	{
@@ -193,6 +241,8 @@ void CMod_LoadSurfaces (lump_t *l)
 		out->c.flags = LittleLong (in->flags);
 		out->c.value = LittleLong (in->value);
 	}
+
+	return NULL;
 }
 
 
@@ -202,25 +252,25 @@ CMod_LoadNodes
 
 =================
 */
-void CMod_LoadNodes (lump_t *l)
+static char *CMod_LoadNodes (cmapdata_t *map, byte *base, lump_t *l)
 {
 	dnode_t		*in;
 	int			child;
 	cnode_t		*out;
 	int			i, j, count;
 
-	in = (void *) (cmod_base + l->fileofs);
+	in = (void *) (base + l->fileofs);
 	if (l->filelen % sizeof (*in))
-		Com_Error (ERR_DROP, "CMod_LoadNodes: funny lump size");
+		return "CMod_LoadNodes: funny lump size";
 	count = l->filelen / sizeof (*in);
 
 	if (count < 1)
-		Com_Error (ERR_DROP, "Map has no nodes");
+		return "Map has no nodes";
 	if (count > MAX_MAP_NODES)
-		Com_Error (ERR_DROP, "Map has too many nodes");
+		return "Map has too many nodes";
 
-	out = map_nodes;
-	numnodes = count;
+	out = map->nodes;
+	map->numnodes = count;
 
 	for (i = 0; i < count; i++, out++, in++)
 	{
@@ -231,6 +281,8 @@ void CMod_LoadNodes (lump_t *l)
 			out->children[j] = child;
 		}
 	}
+
+	return NULL;
 }
 
 
@@ -240,23 +292,23 @@ CMod_LoadBrushes
 
 =================
 */
-void CMod_LoadBrushes (lump_t *l)
+static char *CMod_LoadBrushes (cmapdata_t *map, byte *base, lump_t *l)
 {
 	dbrush_t	*in;
 	cbrush_t	*out;
 	int			i, count;
 
-	in = (void *) (cmod_base + l->fileofs);
+	in = (void *) (base + l->fileofs);
 	if (l->filelen % sizeof (*in))
-		Com_Error (ERR_DROP, "CMod_LoadBrushes: funny lump size");
+		return "CMod_LoadBrushes: funny lump size";
 	count = l->filelen / sizeof (*in);
 
 	if (count > MAX_MAP_BRUSHES)
-		Com_Error (ERR_DROP, "Map has too many brushes");
+		return "Map has too many brushes";
 
-	out = map_brushes;
+	out = map->brushes;
 
-	numbrushes = count;
+	map->numbrushes = count;
 
 	for (i = 0; i < count; i++, out++, in++)
 	{
@@ -265,6 +317,7 @@ void CMod_LoadBrushes (lump_t *l)
 		out->contents = LittleLong (in->contents);
 	}
 
+	return NULL;
 }
 
 /*
@@ -272,27 +325,27 @@ void CMod_LoadBrushes (lump_t *l)
 CMod_LoadLeafs
 =================
 */
-void CMod_LoadLeafs (lump_t *l)
+static char *CMod_LoadLeafs (cmapdata_t *map, byte *base, lump_t *l)
 {
 	int			i;
 	cleaf_t		*out;
 	dleaf_t 	*in;
 	int			count;
 
-	in = (void *) (cmod_base + l->fileofs);
+	in = (void *) (base + l->fileofs);
 	if (l->filelen % sizeof (*in))
-		Com_Error (ERR_DROP, "CMod_LoadLeafs: funny lump size");
+		return "CMod_LoadLeafs: funny lump size";
 	count = l->filelen / sizeof (*in);
 
 	if (count < 1)
-		Com_Error (ERR_DROP, "Map with no leafs");
+		return "Map with no leafs";
 	// need to save space for box planes
 	if (count > MAX_MAP_PLANES)
-		Com_Error (ERR_DROP, "Map has too many planes");
+		return "Map has too many planes";
 
-	out = map_leafs;
-	numleafs = count;
-	numclusters = 0;
+	out = map->leafs;
+	map->numleafs = count;
+	map->numclusters = 0;
 
 	for (i = 0; i < count; i++, in++, out++)
 	{
@@ -302,24 +355,26 @@ void CMod_LoadLeafs (lump_t *l)
 		out->firstleafbrush = LittleShort (in->firstleafbrush);
 		out->numleafbrushes = LittleShort (in->numleafbrushes);
 
-		if (out->cluster >= numclusters)
-			numclusters = out->cluster + 1;
+		if (out->cluster >= map->numclusters)
+			map->numclusters = out->cluster + 1;
 	}
 
-	if (map_leafs[0].contents != CONTENTS_SOLID)
-		Com_Error (ERR_DROP, "Map leaf 0 is not CONTENTS_SOLID");
-	solidleaf = 0;
-	emptyleaf = -1;
-	for (i = 1; i < numleafs; i++)
+	if (map->leafs[0].contents != CONTENTS_SOLID)
+		return "Map leaf 0 is not CONTENTS_SOLID";
+	map->solidleaf = 0;
+	map->emptyleaf = -1;
+	for (i = 1; i < map->numleafs; i++)
 	{
-		if (!map_leafs[i].contents)
+		if (!map->leafs[i].contents)
 		{
-			emptyleaf = i;
+			map->emptyleaf = i;
 			break;
 		}
 	}
-	if (emptyleaf == -1)
-		Com_Error (ERR_DROP, "Map does not have an empty leaf");
+	if (map->emptyleaf == -1)
+		return "Map does not have an empty leaf";
+
+	return NULL;
 }
 
 /*
@@ -327,7 +382,7 @@ void CMod_LoadLeafs (lump_t *l)
 CMod_LoadPlanes
 =================
 */
-void CMod_LoadPlanes (lump_t *l)
+static char *CMod_LoadPlanes (cmapdata_t *map, byte *base, lump_t *l)
 {
 	int			i, j;
 	cplane_t	*out;
@@ -335,19 +390,19 @@ void CMod_LoadPlanes (lump_t *l)
 	int			count;
 	int			bits;
 
-	in = (void *) (cmod_base + l->fileofs);
+	in = (void *) (base + l->fileofs);
 	if (l->filelen % sizeof (*in))
-		Com_Error (ERR_DROP, "CMod_LoadPlanes: funny lump size");
+		return "CMod_LoadPlanes: funny lump size";
 	count = l->filelen / sizeof (*in);
 
 	if (count < 1)
-		Com_Error (ERR_DROP, "Map with no planes");
+		return "Map with no planes";
 	// need to save space for box planes
 	if (count > MAX_MAP_PLANES)
-		Com_Error (ERR_DROP, "Map has too many planes");
+		return "Map has too many planes";
 
-	out = map_planes;
-	numplanes = count;
+	out = map->planes;
+	map->numplanes = count;
 
 	for (i = 0; i < count; i++, in++, out++)
 	{
@@ -363,6 +418,8 @@ void CMod_LoadPlanes (lump_t *l)
 		out->type = LittleLong (in->type);
 		out->signbits = bits;
 	}
+
+	return NULL;
 }
 
 /*
@@ -370,29 +427,31 @@ void CMod_LoadPlanes (lump_t *l)
 CMod_LoadLeafBrushes
 =================
 */
-void CMod_LoadLeafBrushes (lump_t *l)
+static char *CMod_LoadLeafBrushes (cmapdata_t *map, byte *base, lump_t *l)
 {
 	int			i;
 	unsigned short	*out;
 	unsigned short 	*in;
 	int			count;
 
-	in = (void *) (cmod_base + l->fileofs);
+	in = (void *) (base + l->fileofs);
 	if (l->filelen % sizeof (*in))
-		Com_Error (ERR_DROP, "CMod_LoadLeafBrushes: funny lump size");
+		return "CMod_LoadLeafBrushes: funny lump size";
 	count = l->filelen / sizeof (*in);
 
 	if (count < 1)
-		Com_Error (ERR_DROP, "Map with no planes");
+		return "Map with no planes";
 	// need to save space for box planes
 	if (count > MAX_MAP_LEAFBRUSHES)
-		Com_Error (ERR_DROP, "Map has too many leafbrushes");
+		return "Map has too many leafbrushes";
 
-	out = map_leafbrushes;
-	numleafbrushes = count;
+	out = map->leafbrushes;
+	map->numleafbrushes = count;
 
 	for (i = 0; i < count; i++, in++, out++)
 		*out = LittleShort (*in);
+
+	return NULL;
 }
 
 /*
@@ -400,7 +459,7 @@ void CMod_LoadLeafBrushes (lump_t *l)
 CMod_LoadBrushSides
 =================
 */
-void CMod_LoadBrushSides (lump_t *l)
+static char *CMod_LoadBrushSides (cmapdata_t *map, byte *base, lump_t *l)
 {
 	int			i, j;
 	cbrushside_t	*out;
@@ -408,27 +467,29 @@ void CMod_LoadBrushSides (lump_t *l)
 	int			count;
 	int			num;
 
-	in = (void *) (cmod_base + l->fileofs);
+	in = (void *) (base + l->fileofs);
 	if (l->filelen % sizeof (*in))
-		Com_Error (ERR_DROP, "CMod_LoadBrushSides: funny lump size");
+		return "CMod_LoadBrushSides: funny lump size";
 	count = l->filelen / sizeof (*in);
 
 	// need to save space for box planes
 	if (count > MAX_MAP_BRUSHSIDES)
-		Com_Error (ERR_DROP, "Map has too many planes");
+		return "Map has too many planes";
 
-	out = map_brushsides;
-	numbrushsides = count;
+	out = map->brushsides;
+	map->numbrushsides = count;
 
 	for (i = 0; i < count; i++, in++, out++)
 	{
 		num = LittleShort (in->planenum);
 		out->plane = &map_planes[num];
 		j = LittleShort (in->texinfo);
-		if (j >= numtexinfo)
-			Com_Error (ERR_DROP, "Bad brushside texinfo");
+		if (j >= map->numtexinfo)
+			return "Bad brushside texinfo";
 		out->surface = &map_surfaces[j];
 	}
+
+	return NULL;
 }
 
 /*
@@ -436,23 +497,23 @@ void CMod_LoadBrushSides (lump_t *l)
 CMod_LoadAreas
 =================
 */
-void CMod_LoadAreas (lump_t *l)
+static char *CMod_LoadAreas (cmapdata_t *map, byte *base, lump_t *l)
 {
 	int			i;
 	carea_t		*out;
 	darea_t 	*in;
 	int			count;
 
-	in = (void *) (cmod_base + l->fileofs);
+	in = (void *) (base + l->fileofs);
 	if (l->filelen % sizeof (*in))
-		Com_Error (ERR_DROP, "CMod_LoadAreas: funny lump size");
+		return "CMod_LoadAreas: funny lump size";
 	count = l->filelen / sizeof (*in);
 
 	if (count > MAX_MAP_AREAS)
-		Com_Error (ERR_DROP, "Map has too many areas");
+		return "Map has too many areas";
 
-	out = map_areas;
-	numareas = count;
+	out = map->areas;
+	map->numareas = count;
 
 	for (i = 0; i < count; i++, in++, out++)
 	{
@@ -461,6 +522,8 @@ void CMod_LoadAreas (lump_t *l)
 		out->floodvalid = 0;
 		out->floodnum = 0;
 	}
+
+	return NULL;
 }
 
 /*
@@ -468,29 +531,31 @@ void CMod_LoadAreas (lump_t *l)
 CMod_LoadAreaPortals
 =================
 */
-void CMod_LoadAreaPortals (lump_t *l)
+static char *CMod_LoadAreaPortals (cmapdata_t *map, byte *base, lump_t *l)
 {
 	int			i;
 	dareaportal_t		*out;
 	dareaportal_t 	*in;
 	int			count;
 
-	in = (void *) (cmod_base + l->fileofs);
+	in = (void *) (base + l->fileofs);
 	if (l->filelen % sizeof (*in))
-		Com_Error (ERR_DROP, "CMod_LoadAreaPortals: funny lump size");
+		return "CMod_LoadAreaPortals: funny lump size";
 	count = l->filelen / sizeof (*in);
 
 	if (count > MAX_MAP_AREAS)
-		Com_Error (ERR_DROP, "Map has too many areas");
+		return "Map has too many areas";
 
-	out = map_areaportals;
-	numareaportals = count;
+	out = map->areaportals;
+	map->numareaportals = count;
 
 	for (i = 0; i < count; i++, in++, out++)
 	{
 		out->portalnum = LittleLong (in->portalnum);
 		out->otherarea = LittleLong (in->otherarea);
 	}
+
+	return NULL;
 }
 
 /*
@@ -498,22 +563,32 @@ void CMod_LoadAreaPortals (lump_t *l)
 CMod_LoadVisibility
 =================
 */
-void CMod_LoadVisibility (lump_t *l)
+static char *CMod_LoadVisibility (cmapdata_t *map, byte *base, lump_t *l)
 {
 	int		i;
+	dvis_t	*vis = (dvis_t *) map->visibility;
 
-	numvisibility = l->filelen;
+	map->numvisibility = l->filelen;
 	if (l->filelen > MAX_MAP_VISIBILITY)
-		Com_Error (ERR_DROP, "Map has too large visibility lump");
+		return "Map has too large visibility lump";
+
+	memcpy (map->visibility, base + l->fileofs, l->filelen);
 
-	memcpy (map_visibility, cmod_base + l->fileofs, l->filelen);
+	// no vis; the preload thread's copy is only as big as the lump so don't read a count from it
+	if (l->filelen < sizeof (int))
+		return NULL;
 
-	map_vis->numclusters = LittleLong (map_vis->numclusters);
-	for (i = 0; i < map_vis->numclusters; i++)
+	vis->numclusters = LittleLong (vis->numclusters);
+	if (vis->numclusters < 0 || vis->numclusters > (l->filelen - sizeof (int)) / sizeof (vis->bitofs[0]))
+		return "Map has a bad visibility lump";
+
+	for (i = 0; i < vis->numclusters; i++)
 	{
-		map_vis->bitofs[i][0] = LittleLong (map_vis->bitofs[i][0]);
-		map_vis->bitofs[i][1] = LittleLong (map_vis->bitofs[i][1]);
+		vis->bitofs[i][0] = LittleLong (vis->bitofs[i][0]);
+		vis->bitofs[i][1] = LittleLong (vis->bitofs[i][1]);
 	}
+
+	return NULL;
 }
 
 
@@ -522,15 +597,433 @@ void CMod_LoadVisibility (lump_t *l)
 CMod_LoadEntityString
 =================
 */
-void CMod_LoadEntityString (lump_t *l)
+static char *CMod_LoadEntityString (cmapdata_t *map, byte *base, lump_t *l)
+{
+	if ((map->numentitychars = l->filelen) > MAX_MAP_ENTSTRING)
+		return "Map has too large entity lump";
+
+	memcpy (map->entitystring, base + l->fileofs, l->filelen);
+
+	return NULL;
+}
+
+
+typedef char *(*cmodlumpfunc_t) (cmapdata_t *map, byte *base, lump_t *l);
+
+typedef struct cmodlump_s {
+	int lump;
+	char *name;
+	cmodlumpfunc_t loader;
+} cmodlump_t;
+
+// this order matters as later lumps reference data from earlier
+static cmodlump_t cmod_lumps[] = {
+	{LUMP_TEXINFO, "texinfo", CMod_LoadSurfaces},
+	{LUMP_LEAFS, "leafs", CMod_LoadLeafs},
+	{LUMP_LEAFBRUSHES, "leafbrushes", CMod_LoadLeafBrushes},
+	{LUMP_PLANES, "planes", CMod_LoadPlanes},
+	{LUMP_BRUSHES, "brushes", CMod_LoadBrushes},
+	{LUMP_BRUSHSIDES, "brushsides", CMod_LoadBrushSides},
+	{LUMP_MODELS, "models", CMod_LoadSubmodels},
+	{LUMP_NODES, "nodes", CMod_LoadNodes},
+	{LUMP_AREAS, "areas", CMod_LoadAreas},
+	{LUMP_AREAPORTALS, "areaportals", CMod_LoadAreaPortals},
+	{LUMP_VISIBILITY, "visibility", CMod_LoadVisibility},
+	{LUMP_ENTITIES, "entities", CMod_LoadEntityString}
+};
+
+#define NUM_CMOD_LUMPS	(sizeof (cmod_lumps) / sizeof (cmod_lumps[0]))
+
+
+/*
+==================
+CMod_ParseMap
+
+runs all of the lump loaders; returns NULL, or why the map can't be used
+==================
+*/
+static char *CMod_ParseMap (cmapdata_t *map, byte *base, dheader_t *header, double *lumptimes)
+{
+	int		i;
+	char	*error;
+
+	for (i = 0; i < NUM_CMOD_LUMPS; i++)
+	{
+		double starttime = Sys_FloatTime ();
+
+		if ((error = cmod_lumps[i].loader (map, base, &header->lumps[cmod_lumps[i].lump])) != NULL)
+			return error;
+
+		lumptimes[i] = Sys_FloatTime () - starttime;
+	}
+
+	return NULL;
+}
+
+
+/*
+==================
+CMod_GlobalMapData
+
+a cmapdata_t that parses straight into the globals
+==================
+*/
+static void CMod_GlobalMapData (cmapdata_t *map)
+{
+	memset (map, 0, sizeof (*map));
+
+	map->surfaces = map_surfaces;
+	map->leafs = map_leafs;
+	map->leafbrushes = map_leafbrushes;
+	map->planes = map_planes;
+	map->brushes = map_brushes;
+	map->brushsides = map_brushsides;
+	map->cmodels = map_cmodels;
+	map->nodes = map_nodes;
+	map->areas = map_areas;
+	map->areaportals = map_areaportals;
+	map->visibility = map_visibility;
+	map->entitystring = map_entitystring;
+}
+
+
+/*
+==================
+CMod_AllocMapData
+
+arrays of its own for the preload thread, sized from the lumps so that each loader's count
+fits; returns false if they can't be allocated
+==================
+*/
+static void *CMod_AllocLump (dheader_t *header, int lump, int disksize, int memsize)
+{
+	return Zone_AllocCategory ((header->lumps[lump].filelen / disksize) * memsize + 1, MEM_COLLISION);
+}
+
+static void CMod_FreeMapData (cmapdata_t *map)
+{
+	Zone_Free (map->surfaces);
+	Zone_Free (map->leafs);
+	Zone_Free (map->leafbrushes);
+	Zone_Free (map->planes);
+	Zone_Free (map->brushes);
+	Zone_Free (map->brushsides);
+	Zone_Free (map->cmodels);
+	Zone_Free (map->nodes);
+	Zone_Free (map->areas);
+	Zone_Free (map->areaportals);
+	Zone_Free (map->visibility);
+	Zone_Free (map->entitystring);
+
+	memset (map, 0, sizeof (*map));
+}
+
+static qboolean CMod_AllocMapData (cmapdata_t *map, dheader_t *header)
+{
+	memset (map, 0, sizeof (*map));
+
+	map->surfaces = CMod_AllocLump (header, LUMP_TEXINFO, sizeof (texinfo_t), sizeof (mapsurface_t));
+	map->leafs = CMod_AllocLump (header, LUMP_LEAFS, sizeof (dleaf_t), sizeof (cleaf_t));
+	map->leafbrushes = CMod_AllocLump (header, LUMP_LEAFBRUSHES, sizeof (unsigned short), sizeof (unsigned short));
+	map->planes = CMod_AllocLump (header, LUMP_PLANES, sizeof (dplane_t), sizeof (cplane_t));
+	map->brushes = CMod_AllocLump (header, LUMP_BRUSHES, sizeof (dbrush_t), sizeof (cbrush_t));
+	map->brushsides = CMod_AllocLump (header, LUMP_BRUSHSIDES, sizeof (dbrushside_t), sizeof (cbrushside_t));
+	map->cmodels = CMod_AllocLump (header, LUMP_MODELS, sizeof (dmodel_t), sizeof (cmodel_t));
+	map->nodes = CMod_AllocLump (header, LUMP_NODES, sizeof (dnode_t), sizeof (cnode_t));
+	map->areas = CMod_AllocLump (header, LUMP_AREAS, sizeof (darea_t), sizeof (carea_t));
+	map->areaportals = CMod_AllocLump (header, LUMP_AREAPORTALS, sizeof (dareaportal_t), sizeof (dareaportal_t));
+	map->visibility = CMod_AllocLump (header, LUMP_VISIBILITY, 1, 1);
+	map->entitystring = CMod_AllocLump (header, LUMP_ENTITIES, 1, 1);
+
+	if (map->surfaces && map->leafs && map->leafbrushes && map->planes && map->brushes && map->brushsides &&
+		map->cmodels && map->nodes && map->areas && map->areaportals && map->visibility && map->entitystring)
+		return true;
+
+	CMod_FreeMapData (map);
+
+	return false;
+}
+
+
+/*
+==================
+CMod_InstallMap
+
+makes a parsed map the current one; the arrays are only copied if it wasn't parsed into the globals
+==================
+*/
+static void CMod_CopyLump (void *dst, void *src, int size)
 {
-	if ((numentitychars = l->filelen) > MAX_MAP_ENTSTRING)
-		Com_Error (ERR_DROP, "Map has too large entity lump");
-	else memcpy (map_entitystring, cmod_base + l->fileofs, l->filelen);
+	if (src != dst)
+		memcpy (dst, src, size);
+}
+
+static void CMod_InstallMap (cmapdata_t *map)
+{
+	numtexinfo = map->numtexinfo;
+	CMod_CopyLump (map_surfaces, map->surfaces, numtexinfo * sizeof (*map_surfaces));
+
+	numleafs = map->numleafs;
+	numclusters = map->numclusters;
+	emptyleaf = map->emptyleaf;
+	solidleaf = map->solidleaf;
+	CMod_CopyLump (map_leafs, map->leafs, numleafs * sizeof (*map_leafs));
+
+	numleafbrushes = map->numleafbrushes;
+	CMod_CopyLump (map_leafbrushes, map->leafbrushes, numleafbrushes * sizeof (*map_leafbrushes));
+
+	numplanes = map->numplanes;
+	CMod_CopyLump (map_planes, map->planes, numplanes * sizeof (*map_planes));
+
+	numbrushes = map->numbrushes;
+	CMod_CopyLump (map_brushes, map->brushes, numbrushes * sizeof (*map_brushes));
+
+	numbrushsides = map->numbrushsides;
+	CMod_CopyLump (map_brushsides, map->brushsides, numbrushsides * sizeof (*map_brushsides));
+
+	numcmodels = map->numcmodels;
+	CMod_CopyLump (map_cmodels, map->cmodels, numcmodels * sizeof (*map_cmodels));
+
+	numnodes = map->numnodes;
+	CMod_CopyLump (map_nodes, map->nodes, numnodes * sizeof (*map_nodes));
+
+	numareas = map->numareas;
+	CMod_CopyLump (map_areas, map->areas, numareas * sizeof (*map_areas));
+
+	numareaportals = map->numareaportals;
+	CMod_CopyLump (map_areaportals, map->areaportals, numareaportals * sizeof (*map_areaportals));
+
+	numvisibility = map->numvisibility;
+	CMod_CopyLump (map_visibility, map->visibility, numvisibility * sizeof (*map_visibility));
+
+	numentitychars = map->numentitychars;
+	CMod_CopyLump (map_entitystring, map->entitystring, numentitychars * sizeof (*map_entitystring));
 }
 
 
 
+/*
+===============================================================================
+
+MAP PRELOADING
+
+When the next map is known in advance (nextserver or preloadmap) its BSP is read,
+checksummed, validated and parsed on a worker thread during the current level, into
+a cmapdata_t of its own.  The current level is still using the globals, so they're
+only replaced when CM_LoadMap takes the preload at changelevel, which is a copy of
+the parsed arrays rather than a parse.
+
+===============================================================================
+*/
+
+typedef struct cmpreload_s {
+	char		name[MAX_QPATH];
+	void		*thread;
+
+	// written by the worker, only valid to read after Sys_WaitThread
+	qboolean	parsed;
+	cmapdata_t	map;
+	dheader_t	header;
+	int			length;
+	unsigned	checksum;
+	double		readtime;
+	double		lumptimes[NUM_CMOD_LUMPS];
+	char		*error;
+} cmpreload_t;
+
+static cmpreload_t cm_preload;
+
+cvar_t *map_loadtimes;
+
+
+/*
+==================
+CMod_ValidateHeader
+
+checks that the BSP can be parsed without running off the end of the buffer; this is also
+called from the preload thread so it must not Com_Error
+==================
+*/
+static qboolean CMod_ValidateHeader (unsigned *buf, int length, dheader_t *header)
+{
+	int i;
+
+	if (length < sizeof (dheader_t))
+		return false;
+
+	*header = *(dheader_t *) buf;
+
+	for (i = 0; i < sizeof (dheader_t) / 4; i++)
+		((int *) header)[i] = LittleLong (((int *) header)[i]);
+
+	if (header->version != BSPVERSION)
+		return false;
+
+	for (i = 0; i < HEADER_LUMPS; i++)
+	{
+		if (header->lumps[i].fileofs < 0 || header->lumps[i].filelen < 0)
+			return false;
+
+		if (header->lumps[i].fileofs > length || header->lumps[i].filelen > length - header->lumps[i].fileofs)
+			return false;
+	}
+
+	return true;
+}
+
+
+static unsigned CM_PreloadThread (void *param)
+{
+	cmpreload_t *pl = (cmpreload_t *) param;
+	double starttime = Sys_FloatTime ();
+	dheader_t *header = &pl->header;
+	unsigned *buf;
+
+	// FS_LoadFile would Com_Error on a read error, which can't be done from here
+	pl->length = FS_TryLoadFile (pl->name, (void **) &buf, true);
+
+	// anything that goes wrong is left for the synchronous path to load again and throw the proper error
+	if (buf)
+	{
+		if (CMod_ValidateHeader (buf, pl->length, header) && CMod_AllocMapData (&pl->map, header))
+		{
+			pl->checksum = LittleLong (Com_BlockChecksum (buf, pl->length));
+
+			if ((pl->error = CMod_ParseMap (&pl->map, (byte *) buf, header, pl->lumptimes)) == NULL)
+				pl->parsed = true;
+			else CMod_FreeMapData (&pl->map);
+		}
+
+		// everything that's needed has been copied out of it
+		FS_FreeFile (buf);
+	}
+
+	pl->readtime = Sys_FloatTime () - starttime;
+
+	return 0;
+}
+
+
+/*
+==================
+CM_CancelPreload
+
+waits for any preload in flight and throws away the result
+==================
+*/
+void CM_CancelPreload (void)
+{
+	if (cm_preload.thread)
+	{
+		Sys_WaitThread (cm_preload.thread);
+		cm_preload.thread = NULL;
+	}
+
+	if (cm_preload.parsed)
+	{
+		CMod_FreeMapData (&cm_preload.map);
+		cm_preload.parsed = false;
+	}
+
+	cm_preload.name[0] = 0;
+}
+
+
+/*
+==================
+CM_PreloadMap
+
+begins reading a map in the background
+==================
+*/
+void CM_PreloadMap (char *name)
+{
+	// already loaded or loading
+	if (!strcmp (name, map_name) || !strcmp (name, cm_preload.name))
+		return;
+
+	CM_CancelPreload ();
+
+	memset (&cm_preload, 0, sizeof (cm_preload));
+	strncpy (cm_preload.name, name, sizeof (cm_preload.name) - 1);
+
+	if ((cm_preload.thread = Sys_CreateThread (CM_PreloadThread, &cm_preload)) == NULL)
+		cm_preload.name[0] = 0;
+	else Com_DPrintf ("Preloading %s\n", name);
+}
+
+
+/*
+==================
+CM_TakePreload
+
+if the map was preloaded, makes it the current one, otherwise returns false and the map must be loaded normally
+==================
+*/
+static qboolean CM_TakePreload (char *name, dheader_t *header, int *length, unsigned *checksum, double *taketime, double *lumptimes)
+{
+	qboolean taken = false;
+
+	if (!cm_preload.thread)
+		return false;
+
+	if (!strcmp (name, cm_preload.name))
+	{
+		double starttime = Sys_FloatTime ();
+
+		// normally done already; if it isn't we pay the remainder here
+		Sys_WaitThread (cm_preload.thread);
+		cm_preload.thread = NULL;
+
+		if (cm_preload.parsed)
+		{
+			CMod_InstallMap (&cm_preload.map);
+
+			*header = cm_preload.header;
+			*length = cm_preload.length;
+			*checksum = cm_preload.checksum;
+			memcpy (lumptimes, cm_preload.lumptimes, sizeof (cm_preload.lumptimes));
+			*taketime = Sys_FloatTime () - starttime;
+
+			taken = true;
+
+			Com_DPrintf ("%s was preloaded (%.3f ms on worker)\n", name, cm_preload.readtime * 1000.0);
+		}
+		else if (cm_preload.length == FS_READERROR)
+		{
+			// the synchronous load will hit the same error and report it properly
+			Com_Printf ("Couldn't preload %s\n", name);
+		}
+		else if (cm_preload.error)
+			Com_DPrintf ("Couldn't preload %s: %s\n", name, cm_preload.error);
+	}
+
+	CM_CancelPreload ();
+
+	return taken;
+}
+
+
+/*
+==================
+CM_ChargeMemory
+
+the collision arrays are static so this is the part of them the current map actually uses
+==================
+*/
+static int cm_membytes;
+
+static void CM_ChargeMemory (void)
+{
+	cm_membytes = numplanes * sizeof (cplane_t) + numnodes * sizeof (cnode_t) + numleafs * sizeof (cleaf_t) +
+		numleafbrushes * sizeof (unsigned short) + numcmodels * sizeof (cmodel_t) + numbrushes * sizeof (cbrush_t) +
+		numbrushsides * sizeof (cbrushside_t) + numtexinfo * sizeof (mapsurface_t) + numvisibility + numentitychars +
+		numareas * sizeof (carea_t) + numareaportals * sizeof (dareaportal_t);
+
+	Mem_Charge (MEM_COLLISION, cm_membytes);
+}
+
+
 /*
 ==================
 CM_LoadMap
@@ -545,8 +1038,13 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum)
 	dheader_t		header;
 	int				length;
 	static unsigned	last_checksum;
+	double			readtime, lumptimes[NUM_CMOD_LUMPS];
+	qboolean		preloaded;
+	cmapdata_t		map;
+	char			*error;
 
 	map_noareas = Cvar_Get ("map_noareas", "0", 0, NULL);
+	map_loadtimes = Cvar_Get ("map_loadtimes", "0", 0, NULL);
 
 	if (!strcmp (map_name, name) && (clientload || !Cvar_VariableValue ("flushmap")))
 	{
@@ -569,8 +1067,12 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum)
 	map_entitystring[0] = 0;
 	map_name[0] = 0;
 
+	Mem_Charge (MEM_COLLISION, -cm_membytes);
+	cm_membytes = 0;
+
 	if (!name || !name[0])
 	{
+		CM_CancelPreload ();
 		numleafs = 1;
 		numclusters = 1;
 		numareas = 1;
@@ -578,38 +1080,40 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum)
 		return &map_cmodels[0];			// cinematic servers won't have anything at all
 	}
 
-	// load the file
-	length = FS_LoadFile (name, (void **) &buf);
-	if (!buf)
-		Com_Error (ERR_DROP, "Couldn't load %s", name);
+	// a preload has been parsed already and only needs copying in
+	if ((preloaded = CM_TakePreload (name, &header, &length, &last_checksum, &readtime, lumptimes)) == false)
+	{
+		double starttime = Sys_FloatTime ();
 
-	last_checksum = LittleLong (Com_BlockChecksum (buf, length));
-	*checksum = last_checksum;
+		length = FS_LoadFileReadOnly (name, (void **) &buf);
+		if (!buf)
+			Com_Error (ERR_DROP, "Couldn't load %s", name);
 
-	header = *(dheader_t *) buf;
-	for (i = 0; i < sizeof (dheader_t) / 4; i++)
-		((int *) &header)[i] = LittleLong (((int *) &header)[i]);
+		last_checksum = LittleLong (Com_BlockChecksum (buf, length));
+		readtime = Sys_FloatTime () - starttime;
 
-	if (header.version != BSPVERSION)
-		Com_Error (ERR_DROP, "CMod_LoadBrushModel: %s has wrong version number (%i should be %i)", name, header.version, BSPVERSION);
+		if (!CMod_ValidateHeader (buf, length, &header))
+		{
+			FS_FreeFile (buf);
 
-	cmod_base = (byte *) buf;
+			if (length >= sizeof (dheader_t) && header.version != BSPVERSION)
+				Com_Error (ERR_DROP, "CMod_LoadBrushModel: %s has wrong version number (%i should be %i)", name, header.version, BSPVERSION);
+			else Com_Error (ERR_DROP, "CMod_LoadBrushModel: %s is truncated or has bad lumps", name);
+		}
+
+		// load into heap
+		CMod_GlobalMapData (&map);
+		error = CMod_ParseMap (&map, (byte *) buf, &header, lumptimes);
 
-	// load into heap
-	CMod_LoadSurfaces (&header.lumps[LUMP_TEXINFO]);
-	CMod_LoadLeafs (&header.lumps[LUMP_LEAFS]);
-	CMod_LoadLeafBrushes (&header.lumps[LUMP_LEAFBRUSHES]);
-	CMod_LoadPlanes (&header.lumps[LUMP_PLANES]);
-	CMod_LoadBrushes (&header.lumps[LUMP_BRUSHES]);
-	CMod_LoadBrushSides (&header.lumps[LUMP_BRUSHSIDES]);
-	CMod_LoadSubmodels (&header.lumps[LUMP_MODELS]);
-	CMod_LoadNodes (&header.lumps[LUMP_NODES]);
-	CMod_LoadAreas (&header.lumps[LUMP_AREAS]);
-	CMod_LoadAreaPortals (&header.lumps[LUMP_AREAPORTALS]);
-	CMod_LoadVisibility (&header.lumps[LUMP_VISIBILITY]);
-	CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES]);
+		FS_FreeFile (buf);
 
-	FS_FreeFile (buf);
+		if (error)
+			Com_Error (ERR_DROP, "%s", error);
+
+		CMod_InstallMap (&map);
+	}
+
+	*checksum = last_checksum;
 
 	CM_InitBoxHull ();
 
@@ -617,6 +1121,35 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum)
 	FloodAreaConnections ();
 
 	strcpy (map_name, name);
+	CM_ChargeMemory ();
+
+	if (map_loadtimes->value)
+	{
+		double totaltime = readtime;
+
+		Com_Printf ("%s : %i bytes\n", name, length);
+
+		if (preloaded)
+		{
+			// the parse was on the worker; all this thread did was wait for it and copy it in
+			Com_Printf ("%-12s %8s %9.3f ms\n", "take", "", readtime * 1000.0);
+
+			for (i = 0; i < NUM_CMOD_LUMPS; i++)
+				Com_Printf ("%-12s %8i %9.3f ms (preloaded)\n", cmod_lumps[i].name, header.lumps[cmod_lumps[i].lump].filelen, lumptimes[i] * 1000.0);
+		}
+		else
+		{
+			Com_Printf ("%-12s %8s %9.3f ms\n", "read", "", readtime * 1000.0);
+
+			for (i = 0; i < NUM_CMOD_LUMPS; i++)
+			{
+				Com_Printf ("%-12s %8i %9.3f ms\n", cmod_lumps[i].name, header.lumps[cmod_lumps[i].lump].filelen, lumptimes[i] * 1000.0);
+				totaltime += lumptimes[i];
+			}
+		}
+
+		Com_Printf ("%-12s %8s %9.3f ms\n", "total", "", totaltime * 1000.0);
+	}
 
 	return &map_cmodels[0];
 }
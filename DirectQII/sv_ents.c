@@ -583,10 +583,13 @@ void SV_RecordDemoMessage (void)
 	sizebuf_t	buf;
 	byte		buf_data[32768];
 	int			len;
+	double		starttime, frametime;
 
 	if (!svs.demofile)
 		return;
 
+	starttime = Sys_FloatTime ();
+
 	memset (&nostate, 0, sizeof (nostate));
 	SZ_Init (&buf, buf_data, sizeof (buf_data));
 
@@ -619,7 +622,16 @@ void SV_RecordDemoMessage (void)
 
 	// now write the entire message to the file, prefixed by the length
 	len = LittleLong (buf.cursize);
-	fwrite (&len, 4, 1, svs.demofile);
-	fwrite (buf.data, buf.cursize, 1, svs.demofile);
+	FS_WriterWrite (svs.demofile, &len, 4);
+	FS_WriterWrite (svs.demofile, buf.data, buf.cursize);
+
+	// track what this costs the main thread
+	frametime = Sys_FloatTime () - starttime;
+
+	svs.demo_frames++;
+	svs.demo_totaltime += frametime;
+
+	if (frametime > svs.demo_maxtime)
+		svs.demo_maxtime = frametime;
 }
 
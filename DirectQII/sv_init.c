@@ -228,6 +228,9 @@ void SV_SpawnServer (char *server, char *spawnpoint, server_state_t serverstate,
 	}
 	else
 	{
+		// record (or replay) the files this map load uses
+		FS_BeginLoadRecording (server);
+
 		Com_sprintf (sv.configstrings[CS_MODELS + 1], sizeof (sv.configstrings[CS_MODELS + 1]),
 			"maps/%s.bsp", server);
 		sv.models[1] = CM_LoadMap (sv.configstrings[CS_MODELS + 1], false, &checksum);
@@ -299,6 +302,9 @@ void SV_InitGame (void)
 		SCR_BeginLoadingPlaque ();
 	}
 
+	// this may change the gamedir so nothing can be reading from the old one
+	CM_CancelPreload ();
+
 	// get any latched variable changes (maxclients, etc)
 	Cvar_GetLatchedVars ();
 
@@ -353,6 +359,141 @@ void SV_InitGame (void)
 }
 
 
+/*
+======================
+SV_PreloadLevel
+
+accepts the same syntax as SV_Map and starts loading the map in the background
+if it's a bsp; cinematics, pics and demos are small enough to not bother
+======================
+*/
+void SV_PreloadLevel (char *levelstring)
+{
+	char	level[MAX_QPATH];
+	char	*ch;
+	int		l;
+
+	if (!sv_preloadmaps->value)
+		return;
+
+	strncpy (level, levelstring, sizeof (level) - 1);
+	level[sizeof (level) - 1] = 0;
+
+	// strip nextserver and spawnpoint
+	if ((ch = strstr (level, "+")) != NULL) *ch = 0;
+	if ((ch = strstr (level, "$")) != NULL) *ch = 0;
+
+	// skip the end-of-unit flag if necessary
+	if (level[0] == '*')
+		memmove (level, level + 1, strlen (level));
+
+	if ((l = strlen (level)) < 1)
+		return;
+
+	if (l > 4 && (!strcmp (level + l - 4, ".cin") || !strcmp (level + l - 4, ".dm2") || !strcmp (level + l - 4, ".pcx")))
+		return;
+
+	CM_PreloadMap (va ("maps/%s.bsp", level));
+}
+
+
+/*
+======================
+SV_PreloadRotation
+
+deathmatch levels end in the game dll, which changes map itself and never sets nextserver,
+so work out the next map the way the stock game does: dmflags same level, then the next
+entry in sv_maplist, then the worldspawn nextmap key, then the first target_changelevel.
+a mod with a rotation of its own just gets a preload that's thrown away at changelevel
+======================
+*/
+static void SV_PreloadRotation (void)
+{
+	char	maplist[MAX_STRING_CHARS];
+	char	key[MAX_TOKEN_CHARS];
+	char	classname[MAX_TOKEN_CHARS], map[MAX_TOKEN_CHARS];
+	char	nextmap[MAX_TOKEN_CHARS], changelevel[MAX_TOKEN_CHARS];
+	char	*s, *t;
+	qboolean	found = false;
+
+	if ((int) Cvar_VariableValue ("dmflags") & DF_SAME_LEVEL)
+		return;
+
+	// the list is separated by spaces or commas and wraps around
+	strncpy (maplist, Cvar_VariableString ("sv_maplist"), sizeof (maplist) - 1);
+	maplist[sizeof (maplist) - 1] = 0;
+
+	for (s = maplist; *s; s++)
+		if (*s == ',') *s = ' ';
+
+	for (s = maplist; ; )
+	{
+		t = COM_Parse (&s);
+
+		if (!t[0])
+			break;
+
+		if (found)
+		{
+			SV_PreloadLevel (t);
+			return;
+		}
+
+		if (!Q_stricmp (t, sv.name))
+			found = true;
+	}
+
+	if (found)
+	{
+		s = maplist;
+		SV_PreloadLevel (COM_Parse (&s));
+		return;
+	}
+
+	// otherwise the entities say where the level goes
+	nextmap[0] = changelevel[0] = 0;
+
+	for (s = CM_EntityString (); ; )
+	{
+		t = COM_Parse (&s);
+
+		if (!s || t[0] != '{')
+			break;
+
+		classname[0] = map[0] = 0;
+
+		for (;;)
+		{
+			t = COM_Parse (&s);
+
+			if (!s || t[0] == '}')
+				break;
+
+			strcpy (key, t);
+			t = COM_Parse (&s);
+
+			if (!s)
+				break;
+
+			if (!strcmp (key, "classname"))
+				strcpy (classname, t);
+			else if (!strcmp (key, "nextmap"))
+				strcpy (nextmap, t);
+			else if (!strcmp (key, "map"))
+				strcpy (map, t);
+		}
+
+		if (!changelevel[0] && !strcmp (classname, "target_changelevel"))
+			strcpy (changelevel, map);
+	}
+
+	if (nextmap[0])
+		SV_PreloadLevel (nextmap);
+	else if (changelevel[0])
+		SV_PreloadLevel (changelevel);
+}
+
+
 /*
 ======================
 SV_Map
@@ -441,4 +582,14 @@ void SV_Map (qboolean attractloop, char *levelstring, qboolean loadgame)
 	}
 
 	SV_BroadcastCommand ("reconnect\n");
+
+	// if we already know where we're going next, start reading it now
+	if (*(ch = Cvar_VariableString ("nextserver")))
+	{
+		// nextserver is in the form gamemap "<map>"
+		if (!strcmp (COM_Parse (&ch), "gamemap") && ch)
+			SV_PreloadLevel (COM_Parse (&ch));
+	}
+	else if (sv.state == ss_game && Cvar_VariableValue ("deathmatch"))
+		SV_PreloadRotation ();
 }
@@ -43,6 +43,8 @@ cvar_t *allow_download_maps;
 cvar_t *sv_airaccelerate;
 
 cvar_t	*sv_noreload;			// don't reload level state when reentering
+cvar_t	*sv_preloadmaps;		// read and parse the nextserver map in the background
+cvar_t	*sv_asyncdemos;			// write serverrecord demos on a separate thread
 
 cvar_t	*maxclients;			// FIXME: rename sv_maxclients
 cvar_t	*sv_showclamp;
@@ -915,6 +917,9 @@ void SV_Init (void)
 
 	sv_airaccelerate = Cvar_Get ("sv_airaccelerate", "0", CVAR_LATCH, NULL);
 
+	sv_preloadmaps = Cvar_Get ("sv_preloadmaps", "1", CVAR_ARCHIVE, NULL);
+	sv_asyncdemos = Cvar_Get ("sv_asyncdemos", "1", 0, NULL);
+
 	public_server = Cvar_Get ("public", "0", 0, NULL);
 
 	sv_reconnect_limit = Cvar_Get ("sv_reconnect_limit", "3", CVAR_ARCHIVE, NULL);
@@ -976,6 +981,9 @@ void SV_Shutdown (char *finalmsg, qboolean reconnect)
 	Master_Shutdown ();
 	SV_ShutdownGameProgs ();
 
+	// the preload thread uses the filesystem so it can't be left running over a gamedir change
+	CM_CancelPreload ();
+
 	// free current level
 	if (sv.demofile)
 		fclose (sv.demofile);
@@ -988,7 +996,7 @@ void SV_Shutdown (char *finalmsg, qboolean reconnect)
 	if (svs.client_entities)
 		Zone_Free (svs.client_entities);
 	if (svs.demofile)
-		fclose (svs.demofile);
+		FS_CloseWriter (svs.demofile, NULL);
 	memset (&svs, 0, sizeof (svs));
 }
 
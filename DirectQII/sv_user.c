@@ -338,6 +338,7 @@ void SV_BeginDownload_f (void)
 	if (sv_client->download)
 		FS_FreeFile (sv_client->download);
 
+	// this is held across frames, so it's a copy rather than a pointer into a pack a gamedir change could unmap
 	sv_client->downloadsize = FS_LoadFile (name, (void **) &sv_client->download);
 	sv_client->downloadcount = offset;
 
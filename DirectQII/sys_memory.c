@@ -17,42 +17,120 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
-// sys_win.h
+// sys_memory.c
 
 #include "ref.h"
-#include <windows.h>
-#include "resource.h"
-#include <errno.h>
-#include <float.h>
-#include <fcntl.h>
 #include <stdio.h>
-#include <direct.h>
-#include <io.h>
-#include <conio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/*
+==============================================================================
+
+MEMORY ACCOUNTING
+
+Everything that owns a significant amount of memory charges it to a category, so that
+meminfo can show where it's going and mem_csvlog can track it over a long map rotation.
+Zone blocks remember their category so they're released automatically by Zone_Free;
+anything else (the renderer's textures and model heaps, collision data) charges and
+releases explicitly.
+
+==============================================================================
+*/
+
+static char *mem_categorynames[MEM_NUMCATEGORIES] = {
+	"zone",
+	"game",
+	"hunk",
+	"filesystem",
+	"sound",
+	"cinematic",
+	"images",
+	"models",
+	"collision"
+};
+
+typedef struct memcounter_s {
+	int		live;
+	int		peak;
+} memcounter_t;
+
+static memcounter_t mem_counters[MEM_NUMCATEGORIES];
+
+static cvar_t *mem_csvlog;
+static FILE *mem_csvfile;
+static int mem_csvtime;
+
+// created in Z_Init; nothing can allocate from another thread before then
+static void *zone_lock;
+
+
+static void Mem_ChargeUnlocked (memcategory_t category, int bytes)
+{
+	memcounter_t *c = &mem_counters[category];
+
+	if ((c->live += bytes) > c->peak)
+		c->peak = c->live;
+}
+
+
+void Mem_Charge (memcategory_t category, int bytes)
+{
+	if (category < 0 || category >= MEM_NUMCATEGORIES)
+		return;
+
+	if (zone_lock) Sys_Lock (zone_lock);
+	Mem_ChargeUnlocked (category, bytes);
+	if (zone_lock) Sys_Unlock (zone_lock);
+}
 
 /*
 ==============================================================================
 
 ZONE MEMORY ALLOCATION
 
-using heap allocations to prevent a crash from a bad Z_Free when calling gi.FreeTags
-via ge->SpawnEntities during loading of eou7.cin (Z_FreeTags now just throws away
-the full heap rather than using individual Z_Free calls which makes it safe)
+Each Z_TagAlloc tag is an arena of chunks that allocations are bumped out of; Z_FreeTags
+throws away every chunk in the arena at once, which keeps it safe from a bad Z_Free when
+calling gi.FreeTags via ge->SpawnEntities during loading of eou7.cin.  Z_Free is never used
+directly by game code so it remains a nop.
+
+Freed chunks are kept for reuse and only the part that was used last time is cleared, and
+only when it's handed out again, so a level change doesn't pay to zero memory twice.  The
+game only uses a handful of tags but any value is allowed.
+
+This only uses the C library so it isn't tied to Win32 heaps.
 
 ==============================================================================
 */
 
-// it's possible for games to exceed this (neither baseq2 nor ctf do) which would cause an error meaning we need to increase it
-#define MAX_ZONETAGS	1024
+#define ZONE_CHUNKSIZE		0x10000		// 64k; anything bigger gets a chunk to itself
+#define ZONE_MAXFREECHUNKS	256			// up to 16mb of chunks kept around for reuse
+#define ZONE_NUMARENAHASH	64
+
+typedef struct zchunk_s {
+	struct zchunk_s *next;
+	int		size;
+	int		used;
+	int		dirty;		// bytes that need clearing before they can be handed out again
+} zchunk_t;
 
-typedef struct zone_s {
-	HANDLE hZone;
-	int tag;
-	int count;
-	int bytes;
-} zone_t;
+// keep the data 16-aligned
+#define ZONE_CHUNKHEADER	((sizeof (zchunk_t) + 15) & ~15)
+
+typedef struct zarena_s {
+	struct zarena_s *next;
+	int		tag;
+	zchunk_t *chunks;	// the head is the one being allocated from
+	int		count;
+	int		bytes;
+} zarena_t;
+
+static zarena_t *z_arenas[ZONE_NUMARENAHASH];
+
+static zchunk_t *z_freechunks;
+static int z_numfreechunks;
 
-zone_t z_zones[MAX_ZONETAGS];
 
 /*
 ========================
@@ -65,6 +143,76 @@ void Z_Free (void *ptr)
 }
 
 
+static zarena_t *Z_FindArena (int tag, qboolean create)
+{
+	zarena_t *arena;
+	int hash = tag & (ZONE_NUMARENAHASH - 1);
+
+	for (arena = z_arenas[hash]; arena; arena = arena->next)
+		if (arena->tag == tag)
+			return arena;
+
+	if (!create)
+		return NULL;
+
+	if ((arena = (zarena_t *) calloc (1, sizeof (zarena_t))) == NULL)
+		Com_Error (ERR_FATAL, "Z_TagAlloc: failed to create tag %i", tag);
+
+	arena->tag = tag;
+	arena->next = z_arenas[hash];
+	z_arenas[hash] = arena;
+
+	return arena;
+}
+
+
+static zchunk_t *Z_NewChunk (zarena_t *arena, int size)
+{
+	zchunk_t *chunk;
+
+	if (size <= ZONE_CHUNKSIZE && z_freechunks)
+	{
+		// reuse a freed chunk; it's cleared lazily as it's allocated from
+		chunk = z_freechunks;
+		z_freechunks = chunk->next;
+		z_numfreechunks--;
+	}
+	else
+	{
+		if (size < ZONE_CHUNKSIZE)
+			size = ZONE_CHUNKSIZE;
+
+		// fresh memory from calloc is already clear (and large blocks get it from the OS as zero pages)
+		if ((chunk = (zchunk_t *) calloc (1, ZONE_CHUNKHEADER + size)) == NULL)
+			Com_Error (ERR_FATAL, "Z_TagAlloc: failed to allocate %i bytes", size);
+
+		chunk->size = size;
+	}
+
+	if (!arena->chunks || size > ZONE_CHUNKSIZE)
+	{
+		// oversized chunks go behind the current one so that what's left of it can still be used
+		if (arena->chunks)
+		{
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		}
+		else
+		{
+			chunk->next = NULL;
+			arena->chunks = chunk;
+		}
+	}
+	else
+	{
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+	}
+
+	return chunk;
+}
+
+
 /*
 ========================
 Z_FreeTags
@@ -72,18 +220,44 @@ Z_FreeTags
 */
 void Z_FreeTags (int tag)
 {
-	// this should never happen; if it does then we need to know
-	if (tag < 0 || tag >= MAX_ZONETAGS)
-	{
-		Com_Error (ERR_FATAL, "Z_FreeTags: bad tag");
+	zarena_t *arena, **link;
+	zchunk_t *chunk, *next;
+
+	if ((arena = Z_FindArena (tag, false)) == NULL)
 		return;
+
+	// Com_Printf ("Z_FreeTags : Freeing %i kb in %i allocations from tag %i\n", (arena->bytes + 512) / 1024, arena->count, tag);
+
+	for (chunk = arena->chunks; chunk; chunk = next)
+	{
+		next = chunk->next;
+
+		if (chunk->size == ZONE_CHUNKSIZE && z_numfreechunks < ZONE_MAXFREECHUNKS)
+		{
+			if (chunk->used > chunk->dirty)
+				chunk->dirty = chunk->used;
+
+			chunk->used = 0;
+			chunk->next = z_freechunks;
+			z_freechunks = chunk;
+			z_numfreechunks++;
+		}
+		else free (chunk);
 	}
 
-	// Com_Printf ("Z_FreeTags : Freeing %i kb in %i allocations from tag %i\n", (z_zones[tag].bytes + 512) / 1024, z_zones[tag].count, tag);
+	Mem_Charge (MEM_GAME, -arena->bytes);
 
-	// destroy and fully clear the zone
-	HeapDestroy (z_zones[tag].hZone);
-	memset (&z_zones[tag], 0, sizeof (z_zones[tag]));
+	// and take the arena out
+	for (link = &z_arenas[tag & (ZONE_NUMARENAHASH - 1)]; *link; link = &(*link)->next)
+	{
+		if (*link == arena)
+		{
+			*link = arena->next;
+			break;
+		}
+	}
+
+	free (arena);
 }
 
 
@@ -94,54 +268,296 @@ Z_TagAlloc
 */
 void *Z_TagAlloc (int size, int tag)
 {
-	if (tag < 0 || tag >= MAX_ZONETAGS)
+	zarena_t *arena;
+	zchunk_t *chunk;
+	byte *buf;
+	int alloc;
+
+	if (size < 0)
 	{
-		Com_Error (ERR_FATAL, "Z_TagAlloc: bad tag");
+		Com_Error (ERR_FATAL, "Z_TagAlloc: bad size");
 		return NULL;
 	}
+
+	// get the correct arena, creating it if necessary
+	arena = Z_FindArena (tag, true);
+
+	// 16-align all allocations
+	alloc = (size + 15) & ~15;
+
+	if ((chunk = arena->chunks) == NULL || chunk->used + alloc > chunk->size)
+		chunk = Z_NewChunk (arena, alloc);
+
+	buf = (byte *) chunk + ZONE_CHUNKHEADER + chunk->used;
+
+	// reused memory is only cleared as it's handed out
+	if (chunk->used < chunk->dirty)
+		memset (buf, 0, (chunk->dirty - chunk->used < alloc) ? chunk->dirty - chunk->used : alloc);
+
+	chunk->used += alloc;
+
+	// counts
+	arena->bytes += size;
+	arena->count++;
+
+	Mem_Charge (MEM_GAME, size);
+
+	return buf;
+}
+
+
+/*
+==============================================================================
+
+for use in the engine - small blocks come from pools of fixed size classes so that
+the constant churn of strings and small structs doesn't fragment anything, larger
+ones go to the C library.  These are used from worker threads so they're locked.
+
+==============================================================================
+*/
+
+#define ZONE_NUMCLASSES		8		// 16 to 2048 bytes
+#define ZONE_MINCLASS		16
+#define ZONE_SLABSIZE		0x10000
+
+// goes in front of every block; 16 bytes to keep the data 16-aligned
+typedef struct zhdr_s {
+	int		sizeclass;		// -1 for blocks from the C library
+	int		size;
+	int		category;
+	int		pad;
+} zhdr_t;
+
+typedef struct zfreeblock_s {
+	struct zfreeblock_s *next;
+} zfreeblock_t;
+
+static zfreeblock_t *zone_freeblocks[ZONE_NUMCLASSES];
+
+// pool blocks are carved from here; slabs are never given back
+static byte *zone_slab;
+static int zone_slabremaining;
+static int zone_numslabs;
+
+
+static int Zone_SizeClass (int size)
+{
+	int sizeclass;
+
+	for (sizeclass = 0; sizeclass < ZONE_NUMCLASSES; sizeclass++)
+		if (size <= (ZONE_MINCLASS << sizeclass))
+			return sizeclass;
+
+	return -1;
+}
+
+
+void *Zone_AllocCategory (int size, memcategory_t category)
+{
+	int sizeclass = Zone_SizeClass (size);
+	zhdr_t *hdr;
+
+	if (sizeclass < 0)
+	{
+		if ((hdr = (zhdr_t *) calloc (1, sizeof (zhdr_t) + size)) == NULL)
+			return NULL;
+	}
+	else
+	{
+		int blocksize = sizeof (zhdr_t) + (ZONE_MINCLASS << sizeclass);
+
+		if (zone_lock) Sys_Lock (zone_lock);
+
+		if (zone_freeblocks[sizeclass])
+		{
+			hdr = (zhdr_t *) zone_freeblocks[sizeclass];
+			zone_freeblocks[sizeclass] = zone_freeblocks[sizeclass]->next;
+		}
+		else
+		{
+			if (zone_slabremaining < blocksize)
+			{
+				// whatever was left of the previous slab is too small for this class and is lost
+				if ((zone_slab = (byte *) malloc (ZONE_SLABSIZE)) == NULL)
+				{
+					if (zone_lock) Sys_Unlock (zone_lock);
+					return NULL;
+				}
+
+				zone_slabremaining = ZONE_SLABSIZE;
+				zone_numslabs++;
+			}
+
+			hdr = (zhdr_t *) zone_slab;
+			zone_slab += blocksize;
+			zone_slabremaining -= blocksize;
+		}
+
+		if (zone_lock) Sys_Unlock (zone_lock);
+
+		// pool blocks are always dirty
+		memset (hdr + 1, 0, size);
+	}
+
+	hdr->sizeclass = sizeclass;
+	hdr->size = size;
+	hdr->category = category;
+
+	Mem_Charge (category, size);
+
+	return hdr + 1;
+}
+
+
+void *Zone_Alloc (int size)
+{
+	return Zone_AllocCategory (size, MEM_ZONE);
+}
+
+
+void Zone_Free (void *ptr)
+{
+	zhdr_t *hdr;
+
+	if (!ptr) return;
+
+	hdr = (zhdr_t *) ptr - 1;
+
+	Mem_Charge (hdr->category, -hdr->size);
+
+	if (hdr->sizeclass < 0)
+		free (hdr);
 	else
 	{
-		// get the correct zone
-		zone_t *z = &z_zones[tag];
+		zfreeblock_t *block = (zfreeblock_t *) hdr;
+		int sizeclass = hdr->sizeclass;
 
-		// create the heap if necessary
-		if (!z->hZone) z->hZone = HeapCreate (0, 0, 0);
-		if (!z->hZone) Com_Error (ERR_FATAL, "Z_TagAlloc: failed on HeapCreate");
+		if (zone_lock) Sys_Lock (zone_lock);
 
-		// counts
-		z->bytes += size;
-		z->count++;
+		block->next = zone_freeblocks[sizeclass];
+		zone_freeblocks[sizeclass] = block;
 
-		// return what we got
-		return HeapAlloc (z->hZone, HEAP_ZERO_MEMORY, size);
+		if (zone_lock) Sys_Unlock (zone_lock);
 	}
 }
 
 
 void Z_Init (void)
 {
-	memset (z_zones, 0, sizeof (z_zones));
+	memset (z_arenas, 0, sizeof (z_arenas));
+
+	if (!zone_lock)
+		zone_lock = Sys_CreateLock ();
 }
 
 
 /*
-==============================================================================
-
-for use in the engine - these just wrap standard HeapAlloc/HeapFree for the
-convenience of modules that don't include windows.h
+========================
+Z_Bench_f
 
-==============================================================================
+zonebench [levels]; replays the pattern of allocations the game makes on a level change (gi.FreeTags (TAG_LEVEL),
+then a string per entity key during SpawnEntities plus some TAG_GAME clients/items) along with the engine's
+Zone churn, against this allocator and against plain calloc/free
+========================
 */
-void *Zone_Alloc (int size)
+#define ZBENCH_TAG_GAME		0x10000765	// so as not to hit the real game's tags
+#define ZBENCH_TAG_LEVEL	0x10000766
+#define ZBENCH_NUMENTS		1024
+#define ZBENCH_KEYSPERENT	6
+#define ZBENCH_NUMZONE		4096
+
+static unsigned zbench_seed;
+
+static int Z_BenchRand (int lo, int hi)
 {
-	return HeapAlloc (GetProcessHeap (), HEAP_ZERO_MEMORY, size);
+	zbench_seed = zbench_seed * 1103515245 + 12345;
+	return lo + (int) ((zbench_seed >> 16) % (unsigned) (hi - lo + 1));
 }
 
 
-void Zone_Free (void *ptr)
+static void Z_Bench_f (void)
 {
-	HeapFree (GetProcessHeap (), 0, ptr);
-	HeapCompact (GetProcessHeap (), 0);
+	int		levels = (Cmd_Argc () > 1) ? atoi (Cmd_Argv (1)) : 100;
+	void	**ptrs = (void **) calloc (ZBENCH_NUMENTS * ZBENCH_KEYSPERENT + ZBENCH_NUMZONE, sizeof (void *));
+	int		pass, level, i, numptrs;
+	double	times[2];
+
+	if (!ptrs || levels < 1)
+	{
+		if (ptrs) free (ptrs);
+		return;
+	}
+
+	for (pass = 0; pass < 2; pass++)
+	{
+		double starttime = Sys_FloatTime ();
+
+		zbench_seed = 0;
+
+		// InitGame allocates the clients and items once
+		if (pass == 0)
+			Z_TagAlloc (256 * 1024, ZBENCH_TAG_GAME);
+
+		for (level = 0, numptrs = 0; level < levels; level++)
+		{
+			// SpawnEntities starts by freeing the previous level
+			if (pass == 0)
+				Z_FreeTags (ZBENCH_TAG_LEVEL);
+			else
+			{
+				for (i = 0; i < numptrs; i++)
+					free (ptrs[i]);
+			}
+
+			numptrs = 0;
+
+			// ED_NewString for every key in the entity string
+			for (i = 0; i < ZBENCH_NUMENTS * ZBENCH_KEYSPERENT; i++)
+			{
+				int size = Z_BenchRand (4, 64);
+
+				if (pass == 0)
+					Z_TagAlloc (size, ZBENCH_TAG_LEVEL);
+				else ptrs[numptrs++] = calloc (1, size);
+			}
+
+			// the engine side of a level change: configstrings, cvars, file names and the like
+			for (i = 0; i < ZBENCH_NUMZONE; i++)
+			{
+				void *p;
+				int size = Z_BenchRand (8, 512);
+
+				if (pass == 0)
+				{
+					p = Zone_Alloc (size);
+					Zone_Free (p);
+				}
+				else
+				{
+					p = calloc (1, size);
+					free (p);
+				}
+			}
+		}
+
+		// clean up
+		if (pass == 0)
+		{
+			Z_FreeTags (ZBENCH_TAG_LEVEL);
+			Z_FreeTags (ZBENCH_TAG_GAME);
+		}
+		else
+		{
+			for (i = 0; i < numptrs; i++)
+				free (ptrs[i]);
+		}
+
+		times[pass] = Sys_FloatTime () - starttime;
+	}
+
+	free (ptrs);
+
+	Com_Printf ("%i levels: zone %.3f ms, calloc/free %.3f ms\n", levels, times[0] * 1000.0, times[1] * 1000.0);
 }
 
 
@@ -150,40 +566,99 @@ void Zone_Free (void *ptr)
 
 LOAD MEMORY ALLOCATION
 
-Temporary memory used for loading is a 64mb buffer; call Load_AllocMemory to draw down memory from the buffer, Load_FreeMemory when completed to reset the buffer
+Temporary memory used for loading; call Hunk_Alloc to draw down memory from the buffer, Hunk_FreeToLowMark when completed to reset it.
+
+The buffer is reserved address space that's committed as the mark first reaches it, so
+it only costs what the biggest load actually used and can go well past the old fixed
+64mb for big maps and models.  Newly committed pages are already zero, so nothing is
+cleared on release; memory below the highest mark reached so far is cleared as it's
+handed out again.
 
 ==============================================================================
 */
 
-#define LOAD_BUFFER_SIZE 0x4000000
+#define HUNK_MAXRESERVE		0x20000000	// 512mb
+#define HUNK_MINRESERVE		0x4000000	// 64mb, which is what it always used to be
+#define HUNK_COMMITSIZE		0x100000	// commit in 1mb steps
+
+typedef struct hunk_s {
+	byte	*base;
+	int		reserved;
+	int		committed;
+	int		mark;
+	int		dirty;		// everything below this has been used and may not be zero
+
+	// high-water marks
+	int		peak;
+	int		loadpeak;
+	char	loadname[MAX_QPATH];
+} hunk_t;
 
-byte load_buffer[LOAD_BUFFER_SIZE];
-int load_buffer_mark = 0;
+static hunk_t hunk;
+
+
+static void Hunk_Init (void)
+{
+	// a 32-bit process may not have a contiguous 512mb free, so step down until we get something
+	for (hunk.reserved = HUNK_MAXRESERVE; hunk.reserved >= HUNK_MINRESERVE; hunk.reserved >>= 1)
+		if ((hunk.base = (byte *) Sys_ReserveMemory (hunk.reserved)) != NULL)
+			return;
+
+	Sys_Error ("Hunk_Init: failed to reserve memory");
+}
 
 
 void *Hunk_Alloc (int size)
 {
+	byte *buf;
+
+	if (!hunk.base)
+		Hunk_Init ();
+
 	// 16-align all allocations
 	size = (size + 15) & ~15;
 
-	if (load_buffer_mark + size >= LOAD_BUFFER_SIZE)
+	if (size < 0 || hunk.mark + size > hunk.reserved)
 	{
-		Sys_Error ("Load_AllocMemory overflow");
+		Sys_Error ("Hunk_Alloc overflow");
 		return NULL;
 	}
-	else
+
+	if (hunk.mark + size > hunk.committed)
 	{
-		byte *buf = &load_buffer[load_buffer_mark];
-		load_buffer_mark += size;
-		memset (buf, 0, size);
-		return buf;
+		int commit = (hunk.mark + size + HUNK_COMMITSIZE - 1) & ~(HUNK_COMMITSIZE - 1);
+
+		if (commit > hunk.reserved)
+			commit = hunk.reserved;
+
+		if (!Sys_CommitMemory (hunk.base + hunk.committed, commit - hunk.committed))
+		{
+			Sys_Error ("Hunk_Alloc: failed to commit %i bytes", commit - hunk.committed);
+			return NULL;
+		}
+
+		hunk.committed = commit;
 	}
+
+	buf = hunk.base + hunk.mark;
+
+	// only memory that's been used before needs to be cleared
+	if (hunk.mark < hunk.dirty)
+		memset (buf, 0, (hunk.dirty - hunk.mark < size) ? hunk.dirty - hunk.mark : size);
+
+	hunk.mark += size;
+	Mem_Charge (MEM_HUNK, size);
+
+	if (hunk.mark > hunk.peak) hunk.peak = hunk.mark;
+	if (hunk.mark > hunk.loadpeak) hunk.loadpeak = hunk.mark;
+
+	return buf;
 }
 
 
 int	Hunk_LowMark (void)
 {
-	return load_buffer_mark;
+	return hunk.mark;
 }
 
 
@@ -191,10 +666,124 @@ void Hunk_FreeToLowMark (int mark)
 {
 	// this can happen if something between a Hunk_LowMark and Hunk_FreeToLowMark pair frees to 0
 	if (mark < 0) return;
-	if (mark >= load_buffer_mark) return;
+	if (mark >= hunk.mark) return;
+
+	// the released range is cleared when it's next allocated rather than here
+	if (hunk.mark > hunk.dirty)
+		hunk.dirty = hunk.mark;
+
+	Mem_Charge (MEM_HUNK, mark - hunk.mark);
+	hunk.mark = mark;
+}
+
 
-	memset (&load_buffer[mark], 0, load_buffer_mark - mark);
-	load_buffer_mark = mark;
+void Hunk_BeginLoad (char *name)
+{
+	Com_sprintf (hunk.loadname, sizeof (hunk.loadname), "%s", name);
+	hunk.loadpeak = hunk.mark;
+}
+
+
+/*
+========================
+Mem_Info_f
+
+meminfo [reset]; reset sets the peaks back to what's live now
+========================
+*/
+static void Mem_Info_f (void)
+{
+	int i, total = 0;
+
+	if (Cmd_Argc () > 1 && !Q_strcasecmp (Cmd_Argv (1), "reset"))
+	{
+		for (i = 0; i < MEM_NUMCATEGORIES; i++)
+			mem_counters[i].peak = mem_counters[i].live;
+
+		return;
+	}
+
+	Com_Printf ("category        live kb    peak kb\n");
+
+	for (i = 0; i < MEM_NUMCATEGORIES; i++)
+	{
+		Com_Printf ("%-12s %10i %10i\n", mem_categorynames[i], mem_counters[i].live / 1024, mem_counters[i].peak / 1024);
+		total += mem_counters[i].live;
+	}
+
+	Com_Printf ("total        %10i\n\n", total / 1024);
+
+	Com_Printf ("zone: %i kb of pool slabs, %i kb of free tag chunks\n", (zone_numslabs * ZONE_SLABSIZE) / 1024, (z_numfreechunks * ZONE_CHUNKSIZE) / 1024);
+	Com_Printf ("hunk: %i kb in use, %i kb committed of %i mb reserved\n", hunk.mark / 1024, hunk.committed / 1024, hunk.reserved / (1024 * 1024));
+	Com_Printf ("hunk peak: %i kb (%s), %i kb overall\n", hunk.loadpeak / 1024, hunk.loadname[0] ? hunk.loadname : "no map", hunk.peak / 1024);
+}
+
+
+/*
+========================
+Mem_Frame
+
+writes a line of live counters to meminfo.csv in the gamedir every mem_csvlog seconds
+========================
+*/
+void Mem_Frame (void)
+{
+	int i, now;
+
+	if (!mem_csvlog->value)
+	{
+		if (mem_csvfile)
+		{
+			fclose (mem_csvfile);
+			mem_csvfile = NULL;
+		}
+
+		return;
+	}
+
+	now = Sys_Milliseconds ();
+
+	if (mem_csvfile && now - mem_csvtime < mem_csvlog->value * 1000)
+		return;
+
+	if (!mem_csvfile)
+	{
+		if ((mem_csvfile = fopen (va ("%s/meminfo.csv", FS_Gamedir ()), "a")) == NULL)
+		{
+			Com_Printf ("couldn't open meminfo.csv; disabling mem_csvlog\n");
+			Cvar_Set ("mem_csvlog", "0");
+			return;
+		}
+
+		fprintf (mem_csvfile, "time,map");
+
+		for (i = 0; i < MEM_NUMCATEGORIES; i++)
+			fprintf (mem_csvfile, ",%s", mem_categorynames[i]);
+
+		fprintf (mem_csvfile, "\n");
+	}
+
+	mem_csvtime = now;
+
+	fprintf (mem_csvfile, "%i,%s", now / 1000, Cvar_VariableString ("mapname"));
+
+	for (i = 0; i < MEM_NUMCATEGORIES; i++)
+		fprintf (mem_csvfile, ",%i", mem_counters[i].live);
+
+	fprintf (mem_csvfile, "\n");
+
+	// so it's still useful if we crash
+	fflush (mem_csvfile);
+}
+
+
+void Mem_Init (void)
+{
+	Cmd_AddCommand ("zonebench", Z_Bench_f);
+	Cmd_AddCommand ("meminfo", Mem_Info_f);
+
+	// seconds between lines in meminfo.csv, 0 is off
+	mem_csvlog = Cvar_Get ("mem_csvlog", "0", 0, NULL);
 }
 
 
@@ -204,6 +793,5 @@ void Sys_SetupMemoryRefImports (refimport_t	*ri)
 	ri->Hunk_Alloc = Hunk_Alloc;
 	ri->Hunk_FreeToLowMark = Hunk_FreeToLowMark;
 	ri->Hunk_LowMark = Hunk_LowMark;
+	ri->Mem_Charge = Mem_Charge;
 }
-
-
@@ -136,6 +136,129 @@ void Sys_Init (void)
 }
 
 
+/*
+==============================================================================
+
+THREADS
+
+Thin wrappers so that subsystems which do background work don't need to include
+windows.h; worker threads must never touch engine state that the main thread owns
+
+==============================================================================
+*/
+
+static DWORD sys_mainthreadid = 0;
+
+typedef struct systhread_s {
+	HANDLE hThread;
+	systhreadfunc_t func;
+	void *param;
+} systhread_t;
+
+
+static DWORD WINAPI Sys_ThreadProc (LPVOID lpParameter)
+{
+	systhread_t *t = (systhread_t *) lpParameter;
+	return t->func (t->param);
+}
+
+
+void *Sys_CreateThread (systhreadfunc_t func, void *param)
+{
+	systhread_t *t = (systhread_t *) Zone_Alloc (sizeof (systhread_t));
+
+	t->func = func;
+	t->param = param;
+
+	if ((t->hThread = CreateThread (NULL, 0, Sys_ThreadProc, t, 0, NULL)) == NULL)
+	{
+		Zone_Free (t);
+		return NULL;
+	}
+
+	return t;
+}
+
+
+void Sys_WaitThread (void *thread)
+{
+	systhread_t *t = (systhread_t *) thread;
+
+	if (!t) return;
+
+	WaitForSingleObject (t->hThread, INFINITE);
+	CloseHandle (t->hThread);
+	Zone_Free (t);
+}
+
+
+qboolean Sys_IsMainThread (void)
+{
+	// no worker threads can exist before WinMain sets this
+	return (!sys_mainthreadid || GetCurrentThreadId () == sys_mainthreadid);
+}
+
+
+void *Sys_CreateLock (void)
+{
+	CRITICAL_SECTION *cs = (CRITICAL_SECTION *) Zone_Alloc (sizeof (CRITICAL_SECTION));
+	InitializeCriticalSection (cs);
+	return cs;
+}
+
+
+void Sys_DestroyLock (void *lock)
+{
+	if (!lock) return;
+
+	DeleteCriticalSection ((CRITICAL_SECTION *) lock);
+	Zone_Free (lock);
+}
+
+
+void Sys_Lock (void *lock)
+{
+	EnterCriticalSection ((CRITICAL_SECTION *) lock);
+}
+
+
+void Sys_Unlock (void *lock)
+{
+	LeaveCriticalSection ((CRITICAL_SECTION *) lock);
+}
+
+
+void *Sys_CreateSignal (void)
+{
+	// auto-reset so that each raise wakes exactly one wait
+	return CreateEvent (NULL, FALSE, FALSE, NULL);
+}
+
+
+void Sys_DestroySignal (void *signal)
+{
+	if (signal) CloseHandle ((HANDLE) signal);
+}
+
+
+void Sys_RaiseSignal (void *signal)
+{
+	SetEvent ((HANDLE) signal);
+}
+
+
+qboolean Sys_WaitSignal (void *signal, int msec)
+{
+	return (WaitForSingleObject ((HANDLE) signal, (msec < 0) ? INFINITE : msec) == WAIT_OBJECT_0);
+}
+
+
+void Sys_Sleep (int msec)
+{
+	Sleep (msec);
+}
+
+
 /*
 ================
 Sys_SendKeyEvents
@@ -468,6 +591,9 @@ int WINAPI WinMain (HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLin
 	Sys_SetWorkingDirectory ();
 #endif
 
+	// worker threads use this to stay away from main-thread-only state
+	sys_mainthreadid = GetCurrentThreadId ();
+
 	ParseCommandLine (lpCmdLine);
 
 	Qcommon_Init (argc, argv);
@@ -319,6 +319,7 @@ qboolean VID_LoadRefresh (void)
 	ri.Mkdir = Sys_Mkdir;
 	ri.SendKeyEvents = Sys_SendKeyEvents;
 	ri.FS_LoadFile = FS_LoadFile;
+	ri.FS_LoadFileReadOnly = FS_LoadFileReadOnly;
 	ri.FS_FreeFile = FS_FreeFile;
 	ri.FS_Gamedir = FS_Gamedir;
 	ri.Cvar_Get = Cvar_Get;